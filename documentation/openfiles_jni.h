@@ -36,6 +36,9 @@
  * - \ref com.connectedway.io.RandomAccessFile
  * - \ref com.connectedway.io.File
  *
+ * The streams and RandomAccessFile return a
+ * \ref com.connectedway.nio.FileChannel from getChannel().
+ *
  * Please view the following application for an example Java application
  * written for Open Files
  * 
@@ -0,0 +1,76 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_JNICHECKSUM_H__)
+#define __OFC_JNICHECKSUM_H__
+
+#include "ofc/core.h"
+#include "ofc/types.h"
+#include "ofc/config.h"
+
+/*
+ * Streaming checksums over native buffers
+ *
+ * The algorithms are numbered in the order of FileSystem.Algorithm.
+ * CRC32C uses the SSE4.2 or ARMv8 CRC instructions where the CPU has
+ * them and a slice-by-8 table otherwise.  XXH64 is the 64 bit xxHash.
+ * Digests are returned big endian, the way each algorithm is usually
+ * printed.
+ */
+typedef enum
+  {
+    CHECKSUM_CRC32C = 0,
+    CHECKSUM_XXH64,
+    CHECKSUM_SHA256,
+    CHECKSUM_MAX
+  } CHECKSUM_ALGORITHM ;
+
+#define CHECKSUM_MAX_DIGEST 32
+
+typedef struct
+{
+  OFC_UINT64 v[4] ;
+  OFC_UINT64 total ;
+  OFC_UINT8 mem[32] ;
+  OFC_UINT32 memsize ;
+} CHECKSUM_XXH64_STATE ;
+
+typedef struct
+{
+  OFC_UINT32 h[8] ;
+  OFC_UINT64 total ;
+  OFC_UINT8 mem[64] ;
+  OFC_UINT32 memsize ;
+} CHECKSUM_SHA256_STATE ;
+
+typedef struct
+{
+  CHECKSUM_ALGORITHM algorithm ;
+  union
+  {
+    OFC_UINT32 crc ;
+    CHECKSUM_XXH64_STATE xxh64 ;
+    CHECKSUM_SHA256_STATE sha256 ;
+  } u ;
+} CHECKSUM_STATE ;
+
+/*
+ * checksum_setup is called once, from filesystem_init, before any
+ * checksum is taken
+ */
+OFC_VOID checksum_setup (OFC_VOID) ;
+OFC_SIZET checksum_digest_len (CHECKSUM_ALGORITHM algorithm) ;
+OFC_VOID checksum_init (CHECKSUM_STATE *state, CHECKSUM_ALGORITHM algorithm) ;
+OFC_VOID checksum_update (CHECKSUM_STATE *state, const OFC_VOID *data,
+			  OFC_SIZET len) ;
+OFC_SIZET checksum_final (CHECKSUM_STATE *state, OFC_UINT8 *digest) ;
+/*
+ * CRC32C of the concatenation of two ranges from the CRC32C of each and
+ * the length of the second
+ */
+OFC_UINT32 checksum_crc32c_combine (OFC_UINT32 crc1, OFC_UINT32 crc2,
+				    OFC_UINT64 len2) ;
+
+#endif
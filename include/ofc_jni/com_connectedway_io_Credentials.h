@@ -0,0 +1,87 @@
+/* DO NOT EDIT THIS FILE - it is machine generated */
+#include <jni.h>
+/* Header for class com_connectedway_io_Credentials */
+
+#ifndef _Included_com_connectedway_io_Credentials
+#define _Included_com_connectedway_io_Credentials
+#ifdef __cplusplus
+extern "C" {
+#endif
+#undef com_connectedway_io_Credentials_SESSION_NONE
+#define com_connectedway_io_Credentials_SESSION_NONE 0L
+#undef com_connectedway_io_Credentials_SESSION_PENDING
+#define com_connectedway_io_Credentials_SESSION_PENDING 1L
+#undef com_connectedway_io_Credentials_SESSION_CONNECTING
+#define com_connectedway_io_Credentials_SESSION_CONNECTING 2L
+#undef com_connectedway_io_Credentials_SESSION_UP
+#define com_connectedway_io_Credentials_SESSION_UP 3L
+#undef com_connectedway_io_Credentials_SESSION_FAILED
+#define com_connectedway_io_Credentials_SESSION_FAILED 4L
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    init
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Credentials_init
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    register
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_connectedway_io_Credentials_register
+  (JNIEnv *, jclass, jstring, jstring, jstring, jstring);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    unregister
+ * Signature: (Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Credentials_unregister
+  (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getSessionState
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_Credentials_getSessionState
+  (JNIEnv *, jclass, jstring);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getUpdates
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getUpdates
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getDuplicates
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getDuplicates
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getSessionsUp
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getSessionsUp
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getSessionFailures
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getSessionFailures
+  (JNIEnv *, jclass);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -49,6 +49,22 @@ extern "C" {
 #define com_connectedway_io_FileSystem_SEEK_CUR 1L
 #undef com_connectedway_io_FileSystem_SEEK_END
 #define com_connectedway_io_FileSystem_SEEK_END 2L
+#undef com_connectedway_io_FileSystem_DIFF_ADDED
+#define com_connectedway_io_FileSystem_DIFF_ADDED 1L
+#undef com_connectedway_io_FileSystem_DIFF_REMOVED
+#define com_connectedway_io_FileSystem_DIFF_REMOVED 2L
+#undef com_connectedway_io_FileSystem_DIFF_CHANGED
+#define com_connectedway_io_FileSystem_DIFF_CHANGED 3L
+#undef com_connectedway_io_FileSystem_DIFF_OPT_SIZE
+#define com_connectedway_io_FileSystem_DIFF_OPT_SIZE 1L
+#undef com_connectedway_io_FileSystem_DIFF_OPT_MTIME
+#define com_connectedway_io_FileSystem_DIFF_OPT_MTIME 2L
+#undef com_connectedway_io_FileSystem_DIFF_OPT_HIDDEN
+#define com_connectedway_io_FileSystem_DIFF_OPT_HIDDEN 4L
+#undef com_connectedway_io_FileSystem_DIFF_OPT_IGNORE_CASE
+#define com_connectedway_io_FileSystem_DIFF_OPT_IGNORE_CASE 8L
+#undef com_connectedway_io_FileSystem_DIFF_OPT_RECURSE
+#define com_connectedway_io_FileSystem_DIFF_OPT_RECURSE 16L
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    isRemoteFile
@@ -81,14 +97,6 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_prefixLength
 JNIEXPORT jstring JNICALL Java_com_connectedway_io_FileSystem_resolve__Ljava_lang_String_2Ljava_lang_String_2
   (JNIEnv *, jobject, jstring, jstring);
 
-/*
- * Class:     com_connectedway_io_FileSystem
- * Method:    authenticate
- * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V
- */
-JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_authenticate
-  (JNIEnv *, jobject, jstring, jstring, jstring, jstring);
-
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    isAbsolute
@@ -281,6 +289,14 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
 JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_seteof
   (JNIEnv *, jobject, jobject, jlong);
 
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    preallocate
+ * Signature: (Lcom/connectedway/io/FileDescriptor;J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_preallocate
+  (JNIEnv *, jobject, jobject, jlong);
+
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    skip
@@ -321,6 +337,102 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_close
 JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_seek
   (JNIEnv *, jobject, jobject, jint, jlong);
 
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    read
+ * Signature: (Lcom/connectedway/io/FileDescriptor;Ljava/nio/ByteBuffer;IIJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2Ljava_nio_ByteBuffer_2IIJ
+  (JNIEnv *, jobject, jobject, jobject, jint, jint, jlong);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    write
+ * Signature: (Lcom/connectedway/io/FileDescriptor;Ljava/nio/ByteBuffer;IIJ)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connectedway_io_FileDescriptor_2Ljava_nio_ByteBuffer_2IIJ
+  (JNIEnv *, jobject, jobject, jobject, jint, jint, jlong);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    size
+ * Signature: (Lcom/connectedway/io/FileDescriptor;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_size
+  (JNIEnv *, jobject, jobject);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    transfer
+ * Signature: (Lcom/connectedway/io/FileDescriptor;JJLcom/connectedway/io/FileDescriptor;J)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_transfer
+  (JNIEnv *, jobject, jobject, jlong, jlong, jobject, jlong);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    read
+ * Signature: (Lcom/connectedway/io/FileDescriptor;[Ljava/nio/ByteBuffer;J)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2_3Ljava_nio_ByteBuffer_2J
+  (JNIEnv *, jobject, jobject, jobjectArray, jlong);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    write
+ * Signature: (Lcom/connectedway/io/FileDescriptor;[Ljava/nio/ByteBuffer;J)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connectedway_io_FileDescriptor_2_3Ljava_nio_ByteBuffer_2J
+  (JNIEnv *, jobject, jobject, jobjectArray, jlong);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    readAll
+ * Signature: ([Ljava/lang/String;I[J)[[B
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_readAll
+  (JNIEnv *, jobject, jobjectArray, jint, jlongArray);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    checksum
+ * Signature: (Lcom/connectedway/io/File;IJJI)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_connectedway_io_FileSystem_checksum
+  (JNIEnv *, jobject, jobject, jint, jlong, jlong, jint);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    diffTrees
+ * Signature: (Lcom/connectedway/io/File;Lcom/connectedway/io/File;IJILcom/connectedway/io/FileSystem$DiffListener;)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_diffTrees
+  (JNIEnv *, jobject, jobject, jobject, jint, jlong, jint, jobject);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    search
+ * Signature: ([Lcom/connectedway/io/File;[BIII[J)[[Lcom/connectedway/io/FileSystem$SearchMatch;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_search
+  (JNIEnv *, jobject, jobjectArray, jbyteArray, jint, jint, jint, jlongArray);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    setHeadPrefetch
+ * Signature: (IJ)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_setHeadPrefetch
+  (JNIEnv *, jobject, jint, jlong);
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    getHead
+ * Signature: (Lcom/connectedway/io/File;)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_connectedway_io_FileSystem_getHead
+  (JNIEnv *, jobject, jobject);
+
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    getLastError
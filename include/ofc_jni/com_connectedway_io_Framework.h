@@ -215,6 +215,54 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_removeMap
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_update
   (JNIEnv *, jobject);
 
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    getHeapStats
+ * Signature: ()Lcom/connectedway/io/HeapStats;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getHeapStats
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    resetHeapStats
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_resetHeapStats
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    getStats
+ * Signature: ()Lcom/connectedway/io/Stats;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getStats
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    resetStats
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_resetStats
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    setTrace
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setTrace
+  (JNIEnv *, jobject, jboolean);
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    dumpTrace
+ * Signature: (Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_dumpTrace
+  (JNIEnv *, jobject, jstring);
+
 #ifdef __cplusplus
 }
 #endif
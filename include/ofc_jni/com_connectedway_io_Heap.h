@@ -0,0 +1,56 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_JNIHEAP_H__)
+#define __OFC_JNIHEAP_H__
+
+#include <jni.h>
+
+#include "ofc/core.h"
+#include "ofc/types.h"
+#include "ofc/config.h"
+#include "ofc/heap.h"
+
+/*
+ * Native heap accounting for the JNI layer
+ *
+ * Including this header after ofc/heap.h routes ofc_malloc, ofc_realloc
+ * and ofc_free through the heap_ functions, which keep each live block
+ * in a table so that its size and the JNI entry point that allocated it
+ * are known when it is freed.  Blocks allocated inside ofc are not seen,
+ * and freeing one here passes straight through.  The accounting costs
+ * a second allocation and the global heap lock on every allocation, so
+ * it is off unless the library is built with OFC_JNI_HEAP_STATS, and
+ * the ofc allocator is left alone.
+ *
+ * HEAP_ENTER goes after the declarations of every JNI entry point and
+ * names the entry point that the calling thread's allocations are
+ * charged to.  Allocations on ofc's own threads are charged to "native".
+ */
+#define HEAP_CLASSES 20
+#define HEAP_MAX_ENTRIES 128
+
+OFC_VOID heap_init (OFC_VOID) ;
+OFC_VOID heap_enter (OFC_CCHAR *name, OFC_INT *entry) ;
+OFC_VOID *heap_malloc (OFC_SIZET size) ;
+OFC_VOID *heap_realloc (OFC_VOID *mem, OFC_SIZET size) ;
+OFC_VOID heap_free (OFC_VOID *mem) ;
+jobject heap_snapshot (JNIEnv *env) ;
+OFC_VOID heap_reset (OFC_VOID) ;
+
+#if defined(OFC_JNI_HEAP_STATS)
+#define HEAP_ENTER()							\
+  static OFC_INT heap_entry = -1 ;					\
+  heap_enter (__func__, &heap_entry)
+#if !defined(OFC_JNI_HEAP_IMPL)
+#define ofc_malloc(size) heap_malloc (size)
+#define ofc_realloc(mem, size) heap_realloc (mem, size)
+#define ofc_free(mem) heap_free (mem)
+#endif
+#else
+#define HEAP_ENTER()
+#endif
+
+#endif
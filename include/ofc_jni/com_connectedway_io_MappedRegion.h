@@ -0,0 +1,101 @@
+/* DO NOT EDIT THIS FILE - it is machine generated */
+#include <jni.h>
+/* Header for class com_connectedway_io_MappedRegion */
+
+#ifndef _Included_com_connectedway_io_MappedRegion
+#define _Included_com_connectedway_io_MappedRegion
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    init
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_init
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    setCacheSize
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_setCacheSize
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    getCacheSize
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_MappedRegion_getCacheSize
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    getPageSize
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_MappedRegion_getPageSize
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    create
+ * Signature: (Lcom/connectedway/io/FileDescriptor;JJZ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_MappedRegion_create
+  (JNIEnv *, jobject, jobject, jlong, jlong, jboolean);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    load
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_load
+  (JNIEnv *, jobject, jlong, jlong, jlong);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    page
+ * Signature: (JJZ)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_MappedRegion_page
+  (JNIEnv *, jobject, jlong, jlong, jboolean);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    get
+ * Signature: (JJ[BII)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_get
+  (JNIEnv *, jobject, jlong, jlong, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    put
+ * Signature: (JJ[BII)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_put
+  (JNIEnv *, jobject, jlong, jlong, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    force
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_force
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    destroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_destroy
+  (JNIEnv *, jobject, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,67 @@
+/* DO NOT EDIT THIS FILE - it is machine generated */
+#include <jni.h>
+/* Header for class com_connectedway_io_RecordReader */
+
+#ifndef _Included_com_connectedway_io_RecordReader
+#define _Included_com_connectedway_io_RecordReader
+#ifdef __cplusplus
+extern "C" {
+#endif
+#undef com_connectedway_io_RecordReader_DEFAULT_BATCH
+#define com_connectedway_io_RecordReader_DEFAULT_BATCH 4096L
+#undef com_connectedway_io_RecordReader_DEFAULT_CHUNK
+#define com_connectedway_io_RecordReader_DEFAULT_CHUNK 1048576L
+#undef com_connectedway_io_RecordReader_DEFAULT_MAX_RECORD
+#define com_connectedway_io_RecordReader_DEFAULT_MAX_RECORD 65536L
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    create
+ * Signature: (Lcom/connectedway/io/File;BIII)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_RecordReader_create
+  (JNIEnv *, jclass, jobject, jbyte, jint, jint, jint);
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    buffer
+ * Signature: (JI)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_RecordReader_buffer
+  (JNIEnv *, jclass, jlong, jint);
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    next
+ * Signature: (J[I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_RecordReader_next
+  (JNIEnv *, jclass, jlong, jintArray, jintArray);
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    nextStrings
+ * Signature: (J[I[I)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_RecordReader_nextStrings
+  (JNIEnv *, jclass, jlong, jintArray, jintArray);
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    current
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_RecordReader_current
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    destroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_RecordReader_destroy
+  (JNIEnv *, jclass, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
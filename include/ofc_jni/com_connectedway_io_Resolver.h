@@ -15,6 +15,30 @@ extern "C" {
 JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_setResolverListener
   (JNIEnv *, __attribute__((unused)) jclass, jobject);
 
+/*
+ * Class:     com_connectedway_io_Resolver
+ * Method:    complete
+ * Signature: (JJ)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_complete
+  (JNIEnv *, jclass, jlong, jlong);
+
+/*
+ * Class:     com_connectedway_io_Resolver
+ * Method:    getStatCacheHits
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Resolver_getStatCacheHits
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     com_connectedway_io_Resolver
+ * Method:    getStatCacheMisses
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Resolver_getStatCacheMisses
+  (JNIEnv *, jclass);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,43 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_JNIRESOLVERASYNC_H__)
+#define __OFC_JNIRESOLVERASYNC_H__
+
+#include "ofc/core.h"
+#include "ofc/types.h"
+#include "ofc/handle.h"
+
+#include "of_resolver_fs/resolver_api.h"
+
+/*
+ * Asynchronous positioned I/O through the Resolver listener
+ *
+ * resolver_async_pread and resolver_async_pwrite start a transfer and
+ * return without waiting for it.  When the transfer completes, hEvent is
+ * set, so it can sit in a waitset alongside the server's other events.
+ * Many requests may share one event.  With an hEvent of OFC_HANDLE_NULL
+ * the request makes its own event.
+ *
+ * resolver_async_done says whether a request has completed.
+ * resolver_async_result waits for it if it has not, then frees it and
+ * returns the byte count, or (OFC_SIZET) -1 on error.  Every request
+ * must be handed to resolver_async_result exactly once.
+ *
+ * A listener that isn't a ResolverAsyncListener completes each request
+ * before it is returned.
+ */
+typedef struct _RESOLVER_ASYNC RESOLVER_ASYNC ;
+
+RESOLVER_ASYNC *resolver_async_pread (RESOLVER_FILE *rfile,
+				      OFC_LPVOID lpBuffer, OFC_SIZET count,
+				      OFC_OFFT offset, OFC_HANDLE hEvent) ;
+RESOLVER_ASYNC *resolver_async_pwrite (RESOLVER_FILE *rfile,
+				       OFC_LPCVOID lpBuffer, OFC_SIZET count,
+				       OFC_OFFT offset, OFC_HANDLE hEvent) ;
+OFC_BOOL resolver_async_done (RESOLVER_ASYNC *req) ;
+OFC_SIZET resolver_async_result (RESOLVER_ASYNC *req) ;
+
+#endif
@@ -0,0 +1,28 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_JNISEARCH_H__)
+#define __OFC_JNISEARCH_H__
+
+#include "ofc/core.h"
+#include "ofc/types.h"
+#include "ofc/config.h"
+
+/*
+ * Byte string search over native buffers
+ *
+ * Candidates are found sixteen positions at a time by comparing the
+ * first and last bytes of the pattern with SSE2 or NEON, and only the
+ * candidates are compared in full.  Other CPUs compare a byte at a
+ * time.
+ *
+ * search_find returns the offset of the first occurrence of the
+ * pattern in the buffer, or -1 if there is none.  A pattern of one
+ * byte is a byte scan.
+ */
+OFC_LONG search_find (const OFC_UINT8 *buf, OFC_SIZET len,
+		      const OFC_UINT8 *pattern, OFC_SIZET pattern_len) ;
+
+#endif
@@ -0,0 +1,73 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_JNISTATS_H__)
+#define __OFC_JNISTATS_H__
+
+#include <jni.h>
+
+#include "ofc/core.h"
+#include "ofc/types.h"
+#include "ofc/config.h"
+#include "ofc/handle.h"
+
+/*
+ * Per-operation latency statistics for the JNI entry points, and for
+ * the file reads of readAll, checksum and search
+ *
+ * Each thread counts into its own block with relaxed atomic stores, so
+ * counting takes no lock and shares no cache lines.  The share of a
+ * path or of an open handle is looked up without a lock too; only the
+ * first sight of a share, and binding a handle at open and close, take
+ * the stats lock.  A snapshot sums the blocks.  Building without
+ * OFC_JNI_STATS compiles all of it out.
+ */
+typedef enum
+  {
+    STATS_OP_OPEN = 0,
+    STATS_OP_READ,
+    STATS_OP_WRITE,
+    STATS_OP_SEEK,
+    STATS_OP_FLUSH,
+    STATS_OP_CLOSE,
+    STATS_OP_STAT,
+    STATS_OP_LIST,
+    STATS_OP_FIND,
+    STATS_OP_RENAME,
+    STATS_OP_DELETE,
+    STATS_OP_MAX
+  } STATS_OP ;
+
+#define STATS_BUCKETS 32
+#define STATS_MAX_SHARES 16
+
+OFC_VOID stats_init (OFC_VOID) ;
+OFC_UINT64 stats_now (OFC_VOID) ;
+OFC_VOID stats_record_path (STATS_OP op, OFC_UINT64 start,
+			    OFC_LPCTSTR path, OFC_UINT64 bytes) ;
+OFC_VOID stats_record_handle (STATS_OP op, OFC_UINT64 start,
+			      OFC_HANDLE hFile, OFC_UINT64 bytes) ;
+OFC_VOID stats_bind_handle (OFC_HANDLE hFile, OFC_LPCTSTR path) ;
+OFC_VOID stats_unbind_handle (OFC_HANDLE hFile) ;
+jobject stats_snapshot (JNIEnv *env) ;
+OFC_VOID stats_reset (OFC_VOID) ;
+
+#if defined(OFC_JNI_STATS)
+#define STATS_START(start) OFC_UINT64 start = stats_now ()
+#define STATS_PATH(op, start, path, bytes) \
+  stats_record_path (op, start, path, bytes)
+#define STATS_HANDLE(op, start, hFile, bytes) \
+  stats_record_handle (op, start, hFile, bytes)
+#define STATS_BIND(hFile, path) stats_bind_handle (hFile, path)
+#define STATS_UNBIND(hFile) stats_unbind_handle (hFile)
+#else
+#define STATS_START(start)
+#define STATS_PATH(op, start, path, bytes)
+#define STATS_HANDLE(op, start, hFile, bytes)
+#define STATS_BIND(hFile, path)
+#define STATS_UNBIND(hFile)
+#endif
+
+#endif
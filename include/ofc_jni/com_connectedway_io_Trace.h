@@ -0,0 +1,69 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#if !defined(__OFC_JNITRACE_H__)
+#define __OFC_JNITRACE_H__
+
+#include <jni.h>
+
+#include "ofc/core.h"
+#include "ofc/types.h"
+#include "ofc/config.h"
+#include "ofc/handle.h"
+
+/*
+ * I/O event trace
+ *
+ * Each thread records into its own fixed size ring, overwriting its
+ * oldest events, so recording takes no lock.  The rings are only
+ * allocated once tracing has been turned on, and while it is off every
+ * trace point costs a test of trace_enabled.  Building without
+ * OFC_JNI_TRACE compiles the trace points out altogether.
+ */
+typedef enum
+  {
+    TRACE_JNI_ENTER = 0,
+    TRACE_JNI_EXIT,
+    TRACE_IO_SUBMIT,
+    TRACE_IO_COMPLETE,
+    TRACE_IO_WAKEUP
+  } TRACE_TYPE ;
+
+#define TRACE_RING_EVENTS 4096
+
+extern volatile OFC_BOOL trace_enabled ;
+
+OFC_VOID trace_init (OFC_VOID) ;
+OFC_VOID trace_enable (OFC_BOOL enable) ;
+OFC_VOID trace_record (TRACE_TYPE type, OFC_CCHAR *name, OFC_HANDLE handle,
+		       OFC_VOID *id, OFC_UINT64 offset, OFC_UINT32 len) ;
+OFC_BOOL trace_dump (OFC_LPCTSTR path) ;
+
+#if defined(OFC_JNI_TRACE)
+#define TRACE_EVENT(type, name, handle, id, offset, len)		\
+  do									\
+    {									\
+      if (trace_enabled)						\
+	trace_record (type, name, handle, id, offset, len) ;		\
+    }									\
+  while (0)
+#else
+#define TRACE_EVENT(type, name, handle, id, offset, len)
+#endif
+
+#define TRACE_ENTER()							\
+  TRACE_EVENT (TRACE_JNI_ENTER, __func__, OFC_HANDLE_NULL, OFC_NULL, 0, 0)
+#define TRACE_EXIT()							\
+  TRACE_EVENT (TRACE_JNI_EXIT, __func__, OFC_HANDLE_NULL, OFC_NULL, 0, 0)
+#define TRACE_SUBMIT(bWrite, hFile, buffer, offset, len)		\
+  TRACE_EVENT (TRACE_IO_SUBMIT, (bWrite) ? "write" : "read", hFile,	\
+	       buffer, offset, len)
+#define TRACE_COMPLETE(bWrite, hFile, buffer, offset, len)		\
+  TRACE_EVENT (TRACE_IO_COMPLETE, (bWrite) ? "write" : "read", hFile,	\
+	       buffer, offset, len)
+#define TRACE_WAKEUP(hEvent)						\
+  TRACE_EVENT (TRACE_IO_WAKEUP, "wakeup", hEvent, OFC_NULL, 0, 0)
+
+#endif
@@ -30,6 +30,43 @@ jobject new_file_from_path (JNIEnv *env, OFC_LPCTSTR path) ;
 jobject new_uri (JNIEnv *env, OFC_LPCTSTR path) ;
 jobject new_fd (JNIEnv *env, jlong hFile) ;
 OFC_HANDLE file_descriptor_get_handle (JNIEnv *env, jobject objFd) ;
+void throwio (JNIEnv *env) ;
+OFC_VOID throwio_error (JNIEnv *env, OFC_DWORD error) ;
+
+/*
+ * A segment of native memory taking part in a vectored transfer
+ */
+typedef struct
+{
+  OFC_CHAR *data;
+  OFC_SIZET len;
+} OFC_IO_SEGMENT;
+
+OFC_BOOL TransferSegments(OFC_HANDLE hFile, OFC_BOOL bWrite,
+                          OFC_IO_SEGMENT *segments, OFC_INT count,
+                          OFC_LARGE_INTEGER offset, OFC_SIZET *transferred);
+OFC_BOOL TransferRegion(OFC_HANDLE hFile, OFC_BOOL bWrite,
+                        OFC_CHAR *data, OFC_SIZET len,
+                        OFC_LARGE_INTEGER offset, OFC_SIZET *transferred);
+
+/*
+ * One item of a job run on the shared worker pool
+ */
+typedef OFC_VOID (*WORK_ITEM) (OFC_VOID *context, OFC_INT index) ;
+
+OFC_VOID work_run (WORK_ITEM item, OFC_VOID *context, OFC_INT count,
+		   OFC_INT max_threads) ;
+OFC_VOID filesystem_init (OFC_VOID) ;
+OFC_VOID credentials_maps_changed (OFC_VOID) ;
+
+OFC_INT jni_thread_key (OFC_VOID (*destroy) (OFC_VOID *value)) ;
+OFC_VOID *jni_thread_get (OFC_INT key) ;
+OFC_BOOL jni_thread_set (OFC_INT key, OFC_VOID *value) ;
+JNIEnv *jni_get_env (OFC_VOID) ;
+JNIEnv *jni_exit_env (OFC_BOOL *attached) ;
+OFC_VOID jni_exit_done (OFC_BOOL attached) ;
+JNIEnv *jni_upcall_enter (jint capacity) ;
+OFC_VOID jni_upcall_exit (JNIEnv *env) ;
 #if defined(__ANDROID__)
 OFC_VOID ofc_attach_java_thread(OFC_VOID);
 OFC_VOID ofc_detach_java_thread(OFC_VOID);
@@ -0,0 +1,148 @@
+package com.connectedway.io ;
+
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException ;
+import java.util.ArrayList;
+
+import android.os.ParcelFileDescriptor;
+
+import android.database.Cursor;
+
+import android.provider.DocumentsContract.Document;
+import android.provider.DocumentsContract.Root;
+
+import com.connectedway.io.Resolver.ResolverDir;
+import com.connectedway.io.Resolver.ResolverDirent;
+import com.connectedway.io.Resolver.ResolverFile;
+import com.connectedway.io.Resolver.ResolverStat;
+import com.connectedway.io.Resolver.ResolverStatFS;
+
+/**
+ * The parts of the Resolver that a listener backed by a
+ * DocumentsProvider needs: files from ParcelFileDescriptors and stats
+ * and listings from Cursors.
+ */
+public final class AndroidResolver
+{
+    private AndroidResolver()
+    {
+    }
+
+    /**
+     * A ResolverFile reading and writing through its own duplicates of
+     * pfd.  pfd itself is closed.
+     */
+    public static ResolverFile openFile(ParcelFileDescriptor pfd)
+	throws IOException
+    {
+	ParcelFileDescriptor pfdos = pfd.dup();
+	FileOutputStream fos =
+	    new ParcelFileDescriptor.AutoCloseOutputStream(pfdos);
+
+	ParcelFileDescriptor pfdis = pfd.dup();
+	FileInputStream fis =
+	    new ParcelFileDescriptor.AutoCloseInputStream(pfdis);
+	pfd.close();
+
+	return (new ResolverFile(fis.getChannel(), fos.getChannel(),
+				 fis, fos, pfdis, pfdos));
+    }
+
+    public static void statFromCursor(Cursor cursor, ResolverStat stat)
+    {
+	int columnId;
+
+	columnId = cursor.getColumnIndex(Document.COLUMN_SIZE);
+	if (columnId >= 0)
+	    stat.Size = cursor.getLong(columnId);
+
+	columnId = cursor.getColumnIndex(Document.COLUMN_DOCUMENT_ID);
+	if (columnId >= 0) {
+	    String docId = cursor.getString(columnId);
+	    stat.FileId = ResolverStat.Hash(docId);
+	}
+
+	columnId = cursor.getColumnIndex(Document.COLUMN_LAST_MODIFIED);
+	if (columnId >= 0) {
+	    /*
+	     * Returns # ms since EPOCH 1/1/1970.
+	     * Want the equivalent of time_t which is # seconds
+	     * since epoch.
+	     */
+	    stat.MTime = cursor.getLong(columnId) / 1000;
+	}
+	columnId = cursor.getColumnIndex(Document.COLUMN_FLAGS);
+	if (columnId >= 0)
+	    stat.Flags = cursor.getInt(columnId);
+    }
+
+    public static void statFSFromCursor(Cursor cursor, ResolverStatFS statfs)
+    {
+	int columnId;
+
+	columnId = cursor.getColumnIndex(Root.COLUMN_AVAILABLE_BYTES);
+	if (columnId >= 0)
+	    statfs.Avail = cursor.getLong(columnId);
+
+	columnId = cursor.getColumnIndex(Root.COLUMN_CAPACITY_BYTES);
+	if (columnId >= 0) {
+	    statfs.Blocks = cursor.getLong(columnId);
+	}
+    }
+
+    public static ResolverDirent direntFromCursor(Cursor cursor)
+    {
+	int columnId;
+	ResolverStat stat = new ResolverStat();
+	String name = null;
+
+	columnId = cursor.getColumnIndex(Document.COLUMN_DISPLAY_NAME);
+	if (columnId >= 0)
+	    name = cursor.getString(columnId);
+
+	statFromCursor(cursor, stat);
+	return (new ResolverDirent(name, stat));
+    }
+
+    /**
+     * A directory listed from a DocumentsProvider cursor
+     */
+    public static class CursorDir extends ResolverDir {
+	private final Cursor cursor;
+
+	public CursorDir(Cursor cursor)
+	{
+	    this.cursor = cursor;
+	}
+
+	public boolean Next()
+	{
+	    return (this.cursor.moveToNext());
+	}
+
+	public Cursor getCursor()
+	{
+	    return (this.cursor);
+	}
+
+	@Override
+	public ResolverDirent[] NextBatch(int max)
+	{
+	    ArrayList<ResolverDirent> dirents = new ArrayList<>();
+
+	    while (dirents.size() < max && Next())
+		dirents.add(direntFromCursor(this.cursor));
+	    if (dirents.isEmpty())
+		return (null);
+	    return (dirents.toArray(new ResolverDirent[0]));
+	}
+
+	@Override
+	public int close()
+	{
+	    this.cursor.close();
+	    return (0);
+	}
+    }
+}
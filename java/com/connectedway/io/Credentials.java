@@ -0,0 +1,87 @@
+package com.connectedway.io ;
+
+/**
+ * Registry of credentials by server and share.
+ *
+ * Credentials registered for any path on a share cover the whole
+ * share.  Registering credentials that are already held for the share
+ * only passes them to the stack for a path it has not been given them
+ * for, so {@link File#authenticate} can be called for every file
+ * without cost.  New or changed credentials are passed to the
+ * stack and a session to the share is set up in the background, so
+ * that the first request through it does not pay for the connect and
+ * authentication.
+ */
+public class Credentials {
+
+    static {
+	/*
+	 * Insure that the JNI library is loaded
+	 */
+	FileSystem.getFileSystem() ;
+	init() ;
+    }
+
+    /**
+     * No credentials are registered for the share
+     */
+    public static final int SESSION_NONE = 0 ;
+    /**
+     * The session is queued to be set up
+     */
+    public static final int SESSION_PENDING = 1 ;
+    /**
+     * The session is being set up
+     */
+    public static final int SESSION_CONNECTING = 2 ;
+    /**
+     * The share was reached with the registered credentials
+     */
+    public static final int SESSION_UP = 3 ;
+    /**
+     * The share could not be reached with the registered credentials
+     */
+    public static final int SESSION_FAILED = 4 ;
+
+    private Credentials() {
+    }
+
+    private static native void init () ;
+
+    /**
+     * Register credentials for the share a path lies on.  Paths that
+     * are not on a remote share have their credentials passed to the
+     * stack each time.
+     *
+     * @return false if the same credentials were already registered
+     * for the share
+     * @throws OutOfMemoryError if there is no native memory to hold
+     * the credentials
+     */
+    public static native boolean register (String path, String username,
+					   String workgroup,
+					   String password) ;
+
+    /**
+     * Forget the credentials registered for the share a path lies on.
+     * Sessions already set up are left alone.
+     */
+    public static native void unregister (String path) ;
+
+    /**
+     * Return the state of the session to the share a path lies on, one
+     * of the SESSION_ constants
+     */
+    public static native int getSessionState (String path) ;
+
+    /**
+     * Number of registrations that added or changed credentials
+     */
+    public static native long getUpdates () ;
+    /**
+     * Number of registrations that matched the credentials held
+     */
+    public static native long getDuplicates () ;
+    public static native long getSessionsUp () ;
+    public static native long getSessionFailures () ;
+}
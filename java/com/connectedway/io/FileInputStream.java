@@ -27,6 +27,7 @@ import java.nio.channels.FileChannel ;
 public class FileInputStream extends InputStream {
 
     private FileDescriptor fd;
+    private FileChannel channel ;
     private final FileSystem fs = FileSystem.getFileSystem() ;
 
     /**
@@ -131,6 +132,13 @@ public class FileInputStream extends InputStream {
      * @see java.io.FileInputStream#close()
      */
     public void close() throws IOException {
+	if (channel != null && channel.isOpen()) {
+	    /*
+	     * Closing the channel closes us
+	     */
+	    channel.close() ;
+	    return ;
+	}
 	if (fd == null)
 	    throw new IOException ("File already closed");
 	else {
@@ -144,8 +152,11 @@ public class FileInputStream extends InputStream {
      *
      * @see java.io.FileInputStream#getChannel()
      */
-    public FileChannel getChannel() {
-	return null ;
+    public synchronized FileChannel getChannel() {
+	if (channel == null)
+	    channel = com.connectedway.nio.FileChannel.open (fd, true, false,
+							     false, this) ;
+	return channel ;
     }
 
     public void mark (int readLimit) {
@@ -13,6 +13,8 @@ import java.nio.channels.FileChannel ;
 public class FileOutputStream extends OutputStream {
 
     private FileDescriptor fd;
+    private FileChannel channel ;
+    private boolean append = false ;
     private final FileSystem fs = FileSystem.getFileSystem() ;
     /**
      * Creates an output file stream to write to the file with the
@@ -37,6 +39,7 @@ public class FileOutputStream extends OutputStream {
 	super() ;
 	fd = fs.open (name, append ? FileSystem.OPEN_APPEND : 
 		      FileSystem.OPEN_WRITE) ;
+	this.append = append ;
     }
 
     /**
@@ -63,8 +66,49 @@ public class FileOutputStream extends OutputStream {
 	fd = fs.open (file.getPath(), 
 		      append ? FileSystem.OPEN_APPEND :
 		      FileSystem.OPEN_WRITE) ;
+	this.append = append ;
     }
     
+    /**
+     * Creates an output file stream to write to the file with the
+     * specified name, which is expected to grow to
+     * <code>expectedSize</code> bytes.  The file is preallocated to
+     * that size and trimmed to what was written when the stream is
+     * closed.
+     *
+     * @see FileSystem#preallocate(FileDescriptor, long)
+     */
+    public FileOutputStream (String name, long expectedSize)
+	throws FileNotFoundException, SecurityException {
+	this (name) ;
+	preallocate (expectedSize) ;
+    }
+
+    /**
+     * Creates a file output stream to write to the file represented by
+     * the specified <code>BlueFile</code> object, which is expected to
+     * grow to <code>expectedSize</code> bytes.
+     *
+     * @see #FileOutputStream(String, long)
+     */
+    public FileOutputStream (java.io.File file, long expectedSize)
+	throws FileNotFoundException, SecurityException {
+	this (file) ;
+	preallocate (expectedSize) ;
+    }
+
+    private void preallocate (long expectedSize) {
+	if (expectedSize > 0) {
+	    try {
+		fs.preallocate (fd, expectedSize) ;
+	    } catch (IOException e) {
+		/*
+		 * Only a hint.  The file grows as it is written instead.
+		 */
+	    }
+	}
+    }
+
     /**
      * Creates an output file stream to write to the specified file
      * descriptor.
@@ -113,6 +157,13 @@ public class FileOutputStream extends OutputStream {
      * @see java.io.FileOutputStream#close()
      */
     public void close() throws IOException {
+	if (channel != null && channel.isOpen()) {
+	    /*
+	     * Closing the channel closes us
+	     */
+	    channel.close() ;
+	    return ;
+	}
 	if (fd == null)
 	    throw new IOException ("File already closed");
 	else {
@@ -144,8 +195,11 @@ public class FileOutputStream extends OutputStream {
      *
      * @see java.io.FileOutputStream#getChannel()
      */
-    public FileChannel getChannel() {
-	return null ;
+    public synchronized FileChannel getChannel() {
+	if (channel == null)
+	    channel = com.connectedway.nio.FileChannel.open (fd, false, true,
+							     append, this) ;
+	return channel ;
     }
 
     protected void finalize() throws IOException {
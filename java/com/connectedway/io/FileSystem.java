@@ -1,6 +1,7 @@
 package com.connectedway.io;
 
 import java.io.IOException ;
+import java.nio.ByteBuffer ;
 
 import com.connectedway.nio.directory.Directory ;
 import java.io.FileNotFoundException ;
@@ -77,8 +78,15 @@ public class FileSystem {
      */
     public native String resolve(String parent, String child) ;
 
-    public native void authenticate (String path, String username,
-    		String workgroup, String password) ;
+    /**
+     * Register credentials for the share a path lies on.
+     *
+     * @see Credentials#register
+     */
+    public void authenticate (String path, String username,
+			      String workgroup, String password) {
+	Credentials.register (path, username, workgroup, password) ;
+    }
 
     /**
      * Return the parent pathname string to be used when the parent-directory
@@ -191,6 +199,21 @@ public class FileSystem {
     public native String[] list(File f) ;
     public native File[] listFiles(File f) ;
 
+    /**
+     * Enable head prefetch for maps in thumbnail mode.  Listing a
+     * directory of such a map, through listFiles or findFile, reads
+     * the first <code>headBytes</code> of each regular file in the
+     * background into a native cache of at most <code>cacheBytes</code>.
+     * A <code>headBytes</code> of 0 disables prefetch.
+     */
+    public synchronized native void setHeadPrefetch (int headBytes,
+						     long cacheBytes) ;
+    /**
+     * Return the prefetched head of a file, or null if it is not
+     * cached.  The head may be shorter than requested if the file is.
+     */
+    public native byte[] getHead (File f) ;
+
     /**
      * Create a new directory denoted by the given abstract pathname,
      * returning <code>true</code> if and only if the operation succeeds.
@@ -307,6 +330,17 @@ public class FileSystem {
         throws IOException ;
     public native void seteof (FileDescriptor fd, long pos) 
 	throws IOException ;
+    /**
+     * Extend an open file to the size it is expected to reach before
+     * writing it, so that large and out of order writes land inside the
+     * file rather than growing it as they go.  The file pointer does
+     * not move, and a file that is already long enough is left alone.
+     * When the descriptor is closed, the file is trimmed back to the
+     * end of the data actually written, unless {@link #seteof} has set
+     * its length since.
+     */
+    public native void preallocate (FileDescriptor fd, long size)
+	throws IOException ;
     public native long skip (FileDescriptor fd, long n) 
 	throws IOException ;
     public native void flush (FileDescriptor fd) 
@@ -320,6 +354,371 @@ public class FileSystem {
     
     public native long seek (FileDescriptor fd, int mode, long pos) 
 	throws IOException ;
+    /**
+     * ByteBuffer I/O used by <code>com.connectedway.nio.FileChannel</code>.
+     * Direct buffers are read and written in place.  A negative
+     * <code>pos</code> uses, and advances, the file pointer.
+     */
+    public native int read (FileDescriptor fd, ByteBuffer b, int off,
+			    int len, long pos) throws IOException ;
+    public native int write (FileDescriptor fd, ByteBuffer b, int off,
+			     int len, long pos) throws IOException ;
+    /**
+     * Vectored ByteBuffer I/O.  The buffers map onto consecutive bytes
+     * of the file starting at <code>pos</code> and are transferred with
+     * one native call.  A negative <code>pos</code> uses, and advances,
+     * the file pointer.  Buffer positions are advanced by the bytes
+     * transferred.
+     */
+    public native long read (FileDescriptor fd, ByteBuffer[] dsts, long pos)
+	throws IOException ;
+    public native long write (FileDescriptor fd, ByteBuffer[] srcs, long pos)
+	throws IOException ;
+    /**
+     * Return the size of an open file.  The file pointer is not moved.
+     */
+    public native long size (FileDescriptor fd) throws IOException ;
+    /**
+     * Copy <code>count</code> bytes between two open files without
+     * moving the data through the java heap.
+     */
+    public native long transfer (FileDescriptor src, long srcPos, long count,
+				 FileDescriptor dst, long dstPos)
+	throws IOException ;
+    /**
+     * Read a batch of whole files.  Up to <code>maxInFlight</code>
+     * files are opened, read and closed concurrently in native code.
+     * The result holds the contents of each file in the order of
+     * <code>paths</code>, or null if that file could not be read.  If
+     * <code>errors</code> is not null, it receives the error code for
+     * each file, 0 on success.  The files are read on a native worker
+     * pool shared by all callers, so <code>maxInFlight</code> is also
+     * bounded by the size of the pool.
+     *
+     * @throws NullPointerException if an element of <code>paths</code>
+     * is null
+     */
+    public native byte[][] readAll (String[] paths, int maxInFlight,
+				    long[] errors) ;
+
+    public byte[][] readAll (String[] paths, int maxInFlight) {
+	return readAll (paths, maxInFlight, null) ;
+    }
+
+    /**
+     * Checksum algorithms.  Digests are big endian.
+     */
+    public enum Algorithm {
+	/**
+	 * CRC32C (Castagnoli), 4 bytes
+	 */
+	CRC32C,
+	/**
+	 * 64 bit xxHash with a seed of 0, 8 bytes
+	 */
+	XXH64,
+	/**
+	 * SHA-256, 32 bytes
+	 */
+	SHA256
+    }
+
+    private native byte[] checksum (File f, int algorithm, long off,
+				    long len, int parts) throws IOException ;
+
+    /**
+     * Checksum <code>len</code> bytes of a file from <code>off</code>,
+     * or up to its end if <code>len</code> is negative.  The file is
+     * read and hashed in native buffers.  A range that runs past the
+     * end of the file is hashed up to the end.
+     *
+     * For CRC32C, with more than one part, the range is split into
+     * that many ranges that are read and hashed in parallel and the
+     * part CRCs are combined, so the result does not depend on the
+     * number of parts.  XXH64 and SHA-256 cannot be combined that way
+     * and are always hashed as a single part; <code>parts</code> is
+     * ignored for them.
+     */
+    public byte[] checksum (File f, Algorithm algorithm, long off, long len,
+			    int parts) throws IOException {
+	if (len < 0)
+	    len = Math.max (f.length() - off, 0) ;
+	return checksum (f, algorithm.ordinal(), off, len, parts) ;
+    }
+
+    public byte[] checksum (File f, Algorithm algorithm, long off, long len)
+	throws IOException {
+	return checksum (f, algorithm, off, len, 1) ;
+    }
+
+    /**
+     * Kinds of {@link DiffRecord}
+     */
+    public static final int DIFF_ADDED = 1 ;
+    public static final int DIFF_REMOVED = 2 ;
+    public static final int DIFF_CHANGED = 3 ;
+
+    private static final int DIFF_OPT_SIZE = 0x01 ;
+    private static final int DIFF_OPT_MTIME = 0x02 ;
+    private static final int DIFF_OPT_HIDDEN = 0x04 ;
+    private static final int DIFF_OPT_IGNORE_CASE = 0x08 ;
+    private static final int DIFF_OPT_RECURSE = 0x10 ;
+
+    /**
+     * What {@link #diffTrees} compares
+     */
+    public static class DiffOptions {
+	/**
+	 * Files of different sizes are changed
+	 */
+	public boolean compareSize = true ;
+	/**
+	 * Files whose modification times differ by more than
+	 * mtimeToleranceMillis are changed
+	 */
+	public boolean compareMTime = true ;
+	public long mtimeToleranceMillis = 0 ;
+	/**
+	 * Walk directories that are on both sides
+	 */
+	public boolean recurse = true ;
+	/**
+	 * Include hidden entries
+	 */
+	public boolean hidden = false ;
+	/**
+	 * Match names regardless of case, as SMB does.  Only ASCII
+	 * letters are folded.
+	 */
+	public boolean ignoreCase = false ;
+	/**
+	 * Records per call to the listener
+	 */
+	public int batchSize = 256 ;
+    }
+
+    /**
+     * An entry that differs between two trees.  Sizes and times are -1
+     * on the side the entry is missing from.
+     */
+    public static class DiffRecord {
+	private final int kind ;
+	private final String path ;
+	private final boolean directory ;
+	private final long sizeA ;
+	private final long sizeB ;
+	private final long mtimeA ;
+	private final long mtimeB ;
+
+	DiffRecord (int kind, String path, boolean directory, long sizeA,
+		    long sizeB, long mtimeA, long mtimeB) {
+	    this.kind = kind ;
+	    this.path = path ;
+	    this.directory = directory ;
+	    this.sizeA = sizeA ;
+	    this.sizeB = sizeB ;
+	    this.mtimeA = mtimeA ;
+	    this.mtimeB = mtimeB ;
+	}
+
+	/**
+	 * DIFF_ADDED if only in the second tree, DIFF_REMOVED if only in
+	 * the first, DIFF_CHANGED if in both but different
+	 */
+	public int getKind() {
+	    return kind ;
+	}
+
+	/**
+	 * Path relative to the roots of the trees, separated by slashes
+	 */
+	public String getPath() {
+	    return path ;
+	}
+
+	public boolean isDirectory() {
+	    return directory ;
+	}
+
+	public long getSizeA() {
+	    return sizeA ;
+	}
+
+	public long getSizeB() {
+	    return sizeB ;
+	}
+
+	public long getMTimeA() {
+	    return mtimeA ;
+	}
+
+	public long getMTimeB() {
+	    return mtimeB ;
+	}
+    }
+
+    public interface DiffListener {
+	void onDiff (DiffRecord[] records) ;
+    }
+
+    private native long diffTrees (File a, File b, int options,
+				   long tolerance, int batchSize,
+				   DiffListener listener) throws IOException ;
+
+    /**
+     * Compare two directory trees in native code and report the
+     * entries that differ, in batches, to the listener.  Both sides of
+     * each directory are listed at the same time.  Unchanged entries
+     * are never seen in Java.  A directory on one side only is
+     * reported once, without its contents.  An exception thrown by the
+     * listener ends the walk.
+     *
+     * @return the number of records reported
+     * @throws IOException if either root is missing or not a directory,
+     * or a directory cannot be listed
+     * @throws NullPointerException if a root or <code>listener</code> is
+     * null
+     */
+    public long diffTrees (File a, File b, DiffOptions options,
+			   DiffListener listener) throws IOException {
+	int flags = 0 ;
+
+	if (a == null || b == null || listener == null)
+	    throw new NullPointerException() ;
+	if (options == null)
+	    options = new DiffOptions() ;
+	if (options.compareSize)
+	    flags |= DIFF_OPT_SIZE ;
+	if (options.compareMTime)
+	    flags |= DIFF_OPT_MTIME ;
+	if (options.hidden)
+	    flags |= DIFF_OPT_HIDDEN ;
+	if (options.ignoreCase)
+	    flags |= DIFF_OPT_IGNORE_CASE ;
+	if (options.recurse)
+	    flags |= DIFF_OPT_RECURSE ;
+	return diffTrees (a, b, flags, options.mtimeToleranceMillis,
+			  options.batchSize, listener) ;
+    }
+
+    /**
+     * How {@link #search} searches
+     */
+    public static class SearchOptions {
+	/**
+	 * Return the line of each match, up to this many bytes on
+	 * either side of it.  0 returns offsets only.
+	 */
+	public int contextBytes = 0 ;
+	/**
+	 * Stop searching a file after this many matches
+	 */
+	public int maxMatches = Integer.MAX_VALUE ;
+	/**
+	 * Files searched at once by the multi-file search
+	 */
+	public int maxInFlight = 4 ;
+    }
+
+    /**
+     * An occurrence of a pattern in a file
+     */
+    public static class SearchMatch {
+	private final long offset ;
+	private final long lineOffset ;
+	private final byte[] line ;
+
+	SearchMatch (long offset, long lineOffset, byte[] line) {
+	    this.offset = offset ;
+	    this.lineOffset = lineOffset ;
+	    this.line = line ;
+	}
+
+	/**
+	 * Offset in the file of the first byte of the match
+	 */
+	public long getOffset() {
+	    return offset ;
+	}
+
+	/**
+	 * Offset in the file of the first byte of the line, or of the
+	 * context, returned
+	 */
+	public long getLineOffset() {
+	    return lineOffset ;
+	}
+
+	/**
+	 * The line the match is on, without its line ending, or null if
+	 * no context was asked for
+	 */
+	public byte[] getLine() {
+	    return line ;
+	}
+    }
+
+    private native SearchMatch[][] search (File[] files, byte[] pattern,
+					   int context, int maxMatches,
+					   int maxInFlight, long[] errors)
+	throws IOException ;
+
+    /**
+     * Find every occurrence, overlapping ones included, of a byte
+     * pattern in a file.  The file is streamed and scanned in native
+     * buffers.  Patterns are limited to 64 KB.
+     *
+     * @return the matches in file order
+     * @throws IOException if the file could not be searched
+     */
+    public SearchMatch[] search (File f, byte[] pattern,
+				 SearchOptions options) throws IOException {
+	if (f == null)
+	    throw new NullPointerException() ;
+	if (options == null)
+	    options = new SearchOptions() ;
+	return search (new File[] { f }, pattern, options.contextBytes,
+		       options.maxMatches, options.maxInFlight, null)[0] ;
+    }
+
+    /**
+     * Search several files, up to options.maxInFlight of them at once.
+     * If <code>errors</code> is not null, it receives the error code
+     * for each file, 0 on success.
+     *
+     * @return the matches in each file, in the order of the files, or
+     * null for a file that could not be searched
+     * @throws NullPointerException if an element of <code>files</code>
+     * is null
+     */
+    public SearchMatch[][] search (File[] files, byte[] pattern,
+				   SearchOptions options, long[] errors)
+	throws IOException {
+	if (options == null)
+	    options = new SearchOptions() ;
+	if (errors == null)
+	    errors = new long[files.length] ;
+	return search (files, pattern, options.contextBytes,
+		       options.maxMatches, options.maxInFlight, errors) ;
+    }
+
+    public SearchMatch[][] search (File[] files, byte[] pattern,
+				   SearchOptions options) throws IOException {
+	return search (files, pattern, options, null) ;
+    }
+
+    /**
+     * Map a region of an open file.  The region is paged in on demand
+     * from a native page cache; see {@link MappedRegion}.
+     *
+     * @see java.nio.channels.FileChannel#map
+     */
+    public MappedRegion map (FileDescriptor fd, long pos, long size,
+			     java.nio.channels.FileChannel.MapMode mode)
+	throws IOException {
+	return new MappedRegion (fd, pos, size, mode) ;
+    }
+
     public native long getLastError () ;
     public native String getLastErrorString () ;
     public native File findFile(Directory dir) throws SecurityException, FileNotFoundException ;
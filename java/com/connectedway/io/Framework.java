@@ -3,6 +3,14 @@ package com.connectedway.io ;
 import java.lang.System ;
 
 import java.util.UUID ;
+import java.util.Arrays ;
+import java.util.HashMap ;
+import java.util.Objects ;
+
+import java.util.concurrent.Callable ;
+import java.util.concurrent.Future ;
+import java.util.concurrent.FutureTask ;
+import java.util.concurrent.atomic.AtomicInteger ;
 
 import java.io.Serializable ;
 import java.net.InetAddress ;
@@ -231,6 +239,124 @@ public class Framework implements Serializable
      * configuration can still be done after startup.
      */
     public native void startup() ;
+
+    /**
+     * Classes whose methods and fields the natives look up on their
+     * first calls.  Loading them ahead of time takes the class loading
+     * and linking out of those calls.
+     */
+    private static final String[] warmClasses = {
+	"com.connectedway.io.File",
+	"com.connectedway.io.FileDescriptor",
+	"com.connectedway.io.FileInputStream",
+	"com.connectedway.io.FileOutputStream",
+	"com.connectedway.io.RandomAccessFile",
+	"com.connectedway.io.FileSystem",
+	"com.connectedway.io.Stats",
+	"com.connectedway.io.HeapStats",
+	"com.connectedway.io.Framework$Map",
+	"com.connectedway.io.Framework$Interface",
+	"com.connectedway.io.Framework$mapType",
+	"com.connectedway.io.Framework$netBIOSMode",
+	"java.util.UUID",
+	"java.net.InetAddress"
+    } ;
+
+    /**
+     * Startup the stack on a background thread.
+     *
+     * The returned future completes once {@link #startup()} has
+     * returned, and, if warm is set, once every configured map has been
+     * warmed as by {@link #warmup()}.  It completes with the exception,
+     * if any, that startup threw.  Warm-up failures do not fail it.
+     *
+     * @param warm true to warm the configured maps before completing
+     * @return a future that completes when the stack is up
+     */
+    public Future<Void> startupAsync (final boolean warm) {
+	FutureTask<Void> task = new FutureTask<Void>
+	    (new Callable<Void>() {
+		    public Void call() {
+			startup() ;
+			if (warm)
+			    warmup() ;
+			return null ;
+		    }
+		}) ;
+	Thread thread = new Thread (task, "FrameworkStartup") ;
+	thread.setDaemon (true) ;
+	thread.start() ;
+	return task ;
+    }
+
+    /**
+     * Startup the stack on a background thread without a warm-up
+     *
+     * @return a future that completes when the stack is up
+     */
+    public Future<Void> startupAsync() {
+	return startupAsync (false) ;
+    }
+
+    /**
+     * Warm the paths to every configured map.
+     *
+     * Each map's target is looked up from its own thread, so name
+     * resolution, connection and authentication to all of the servers
+     * behind the maps proceed in parallel instead of on the first
+     * request to each.  The classes the natives look up are loaded
+     * first.  Returns once every map has been tried.
+     *
+     * @return the number of maps whose target was found
+     */
+    public int warmup() {
+	ClassLoader loader = Framework.class.getClassLoader() ;
+	for (String name : warmClasses) {
+	    try {
+		Class.forName (name, true, loader) ;
+	    } catch (ClassNotFoundException e) {
+	    }
+	}
+
+	Map[] maps = getMaps() ;
+	if (maps == null)
+	    return 0 ;
+
+	final AtomicInteger reached = new AtomicInteger() ;
+	Thread[] threads = new Thread[maps.length] ;
+	for (int i = 0 ; i < maps.length ; i++) {
+	    final File path = maps[i].getPath() ;
+	    if (path == null)
+		continue ;
+	    threads[i] = new Thread (new Runnable() {
+		    public void run() {
+			try {
+			    if (path.exists())
+				reached.incrementAndGet() ;
+			} catch (RuntimeException e) {
+			}
+		    }
+		}, "FrameworkWarmup-" + maps[i].getName()) ;
+	    threads[i].setDaemon (true) ;
+	    threads[i].start() ;
+	}
+
+	for (Thread thread : threads) {
+	    if (thread == null)
+		continue ;
+	    boolean interrupted = false ;
+	    while (thread.isAlive()) {
+		try {
+		    thread.join() ;
+		} catch (InterruptedException e) {
+		    interrupted = true ;
+		}
+	    }
+	    if (interrupted)
+		Thread.currentThread().interrupt() ;
+	}
+	return reached.get() ;
+    }
     /**
      * Load configuration from a file
      */
@@ -333,12 +459,221 @@ public class Framework implements Serializable
      */
     public native void update () ;
 
+    private static String mapKey (Map map) {
+	return map.getName() == null ? "" : map.getName().toUpperCase() ;
+    }
+
+    private static boolean sameMap (Map a, Map b) {
+	String pathA = a.getPath() == null ? null : a.getPath().getPath() ;
+	String pathB = b.getPath() == null ? null : b.getPath().getPath() ;
+
+	return Objects.equals (a.getName(), b.getName()) &&
+	    Objects.equals (a.getDescription(), b.getDescription()) &&
+	    Objects.equals (pathA, pathB) &&
+	    a.getType() == b.getType() &&
+	    a.getThumbnailMode() == b.getThumbnailMode() ;
+    }
+
+    /**
+     * A map added by {@link #reconfigure}, as it was given and as the
+     * stack reported it back
+     */
+    private static final class AppliedMap implements Serializable {
+	final Map given ;
+	final Map made ;
+
+	AppliedMap (Map given, Map made) {
+	    this.given = given ;
+	    this.made = made ;
+	}
+    }
+
+    private final HashMap<String,AppliedMap> appliedMaps =
+	new HashMap<String,AppliedMap>() ;
+
+    /**
+     * Whether a configured map already is the one wanted.  The stack
+     * may normalize the path of a map, or hide the credentials in it,
+     * so a map that reconfigure added, and that is still configured as
+     * it was added, is compared with what it was given.  Any other map
+     * is compared with the map itself.
+     */
+    private boolean unchangedMap (Map current, Map wanted) {
+	AppliedMap applied = appliedMaps.get (mapKey (wanted)) ;
+
+	if (applied != null && sameMap (applied.made, current))
+	    return sameMap (applied.given, wanted) ;
+	return sameMap (current, wanted) ;
+    }
+
+    private static boolean sameInterface (Interface a, Interface b) {
+	return a.getNetBIOSMode() == b.getNetBIOSMode() &&
+	    Objects.equals (a.getIpAddress(), b.getIpAddress()) &&
+	    Objects.equals (a.getBcastAddress(), b.getBcastAddress()) &&
+	    Objects.equals (a.getMask(), b.getMask()) &&
+	    Objects.equals (a.getDefaultLmb(), b.getDefaultLmb()) &&
+	    Arrays.equals (a.getWins(), b.getWins()) ;
+    }
+
+    /**
+     * Bring the configured maps and interfaces to the given sets,
+     * touching only the ones that differ.
+     *
+     * Maps take effect as they are added and removed, so a change to
+     * one map leaves the others, and the connections through them,
+     * alone.  A changed map is removed and then added again, so for a
+     * moment its name does not resolve, and a file opened through it
+     * in that window fails.  A map that the stack refuses to add stays
+     * removed.  Interfaces only take effect on {@link #update()}, which
+     * is called if, and only if, an interface was added, removed or
+     * changed.
+     *
+     * Map names are compared ignoring case.  Credentials are part of
+     * the map paths, so a changed credential is a changed map.
+     *
+     * @param interfaces the interfaces to end up with, or null to leave
+     * the interfaces as they are
+     * @param maps the maps to end up with, or null to leave the maps as
+     * they are
+     * @return the number of maps and interfaces added, removed or
+     * replaced
+     * @throws IllegalArgumentException if two maps have the same name.
+     * Nothing is changed.
+     */
+    public synchronized int reconfigure (Interface[] interfaces, Map[] maps) {
+	int changes = 0 ;
+
+	if (maps != null) {
+	    HashMap<String,Map> added = new HashMap<String,Map>() ;
+	    for (Map map : maps)
+		if (added.put (mapKey (map), map) != null)
+		    throw new IllegalArgumentException
+			("Duplicate map " + map.getName()) ;
+	    added.clear() ;
+
+	    HashMap<String,Map> current = new HashMap<String,Map>() ;
+	    Map[] existing = getMaps() ;
+	    if (existing != null)
+		for (Map map : existing)
+		    current.put (mapKey (map), map) ;
+
+	    for (Map map : maps) {
+		Map old = current.remove (mapKey (map)) ;
+		if (old != null && unchangedMap (old, map))
+		    continue ;
+		if (old != null)
+		    removeMap (old.getName()) ;
+		appliedMaps.remove (mapKey (map)) ;
+		if (addMap (map))
+		    added.put (mapKey (map), map) ;
+		changes++ ;
+	    }
+	    for (Map old : current.values()) {
+		removeMap (old.getName()) ;
+		appliedMaps.remove (mapKey (old)) ;
+		changes++ ;
+	    }
+
+	    /*
+	     * Remember what the stack made of the maps just added
+	     */
+	    if (!added.isEmpty()) {
+		existing = getMaps() ;
+		if (existing != null)
+		    for (Map made : existing) {
+			Map given = added.get (mapKey (made)) ;
+			if (given != null)
+			    appliedMaps.put (mapKey (made),
+					     new AppliedMap (given, made)) ;
+		    }
+	    }
+	}
+
+	if (interfaces != null) {
+	    int interfaceChanges = 0 ;
+	    HashMap<InetAddress,Interface> current =
+		new HashMap<InetAddress,Interface>() ;
+	    Interface[] existing = getInterfaces() ;
+	    if (existing != null)
+		for (Interface iface : existing)
+		    current.put (iface.getIpAddress(), iface) ;
+
+	    for (Interface iface : interfaces) {
+		Interface old = current.remove (iface.getIpAddress()) ;
+		if (old != null && sameInterface (old, iface))
+		    continue ;
+		if (old != null)
+		    removeInterface (old.getIpAddress()) ;
+		addInterface (iface) ;
+		interfaceChanges++ ;
+	    }
+	    for (Interface old : current.values()) {
+		removeInterface (old.getIpAddress()) ;
+		interfaceChanges++ ;
+	    }
+
+	    if (interfaceChanges > 0)
+		update() ;
+	    changes += interfaceChanges ;
+	}
+	return changes ;
+    }
+
     public native void println(String output);
 
     public native void dumpHeap ();
 
     public native void statsHeap();
 
+    /**
+     * Return a snapshot of the native heap used by the JNI layer: bytes
+     * currently allocated, their peak, allocation and free counts, a
+     * size class histogram, and the same per JNI entry point.  Memory
+     * allocated inside the ofc stack itself is only reported by
+     * {@link #statsHeap()}.
+     *
+     * @return the statistics, or null if the library was built without
+     * heap statistics
+     */
+    public native HeapStats getHeapStats() ;
+
+    /**
+     * Zero the heap counters and restart the peak from the bytes
+     * currently allocated
+     */
+    public native void resetHeapStats() ;
+
+    /**
+     * Return a snapshot of the per-operation latency statistics gathered
+     * since startup or since the last {@link #resetStats()}.
+     *
+     * @return the statistics, or null if the library was built without
+     * statistics
+     */
+    public native Stats getStats() ;
+
+    /**
+     * Zero the per-operation latency statistics
+     */
+    public native void resetStats() ;
+
+    /**
+     * Turn the I/O event trace on or off.  While on, every thread
+     * records JNI entry and exit, and the submission, completion and
+     * wake-ups of overlapped I/O, into its own fixed size ring holding
+     * its most recent events.
+     */
+    public native void setTrace (boolean on) ;
+
+    /**
+     * Write the trace rings to a file in Chrome trace event format,
+     * for viewing in chrome://tracing or Perfetto.  The trace is empty
+     * if the library was built without tracing.
+     *
+     * @param path the file to write
+     */
+    public native void dumpTrace (String path) throws IOException ;
+
     public native void setInterfaceFilter (int ip) ;
 
     static {
@@ -0,0 +1,147 @@
+package com.connectedway.io ;
+
+/**
+ * A snapshot of the native heap used by the JNI layer
+ *
+ * Every block the JNI layer allocates is charged to the JNI entry point
+ * that was running on the allocating thread, and to "native" when the
+ * allocation was made on one of the stack's own threads.  One entry is
+ * reported for each entry point that has allocated since startup or
+ * the last reset, or still holds memory.
+ *
+ * Allocation sizes are kept as a histogram of size classes.  Class
+ * <code>i</code> counts allocations of more than 8 &lt;&lt; i and at
+ * most 16 &lt;&lt; i bytes, with class 0 also holding anything smaller
+ * and the last class holding anything larger.
+ *
+ * @see Framework#getHeapStats()
+ */
+public class HeapStats {
+
+    public static class Entry {
+	private final String name ;
+	private final long allocs ;
+	private final long frees ;
+	private final long currentBytes ;
+	private final long totalBytes ;
+
+	Entry (String name, long allocs, long frees, long currentBytes,
+	       long totalBytes) {
+	    this.name = name ;
+	    this.allocs = allocs ;
+	    this.frees = frees ;
+	    this.currentBytes = currentBytes ;
+	    this.totalBytes = totalBytes ;
+	}
+
+	/**
+	 * The entry point, as "Class_method", such as "FileSystem_list"
+	 */
+	public String getName() {
+	    return name ;
+	}
+
+	public long getAllocCount() {
+	    return allocs ;
+	}
+
+	/**
+	 * Frees of blocks this entry point allocated, wherever they were
+	 * freed
+	 */
+	public long getFreeCount() {
+	    return frees ;
+	}
+
+	/**
+	 * Bytes allocated by this entry point and not yet freed
+	 */
+	public long getCurrentBytes() {
+	    return currentBytes ;
+	}
+
+	/**
+	 * Bytes allocated by this entry point in all
+	 */
+	public long getTotalBytes() {
+	    return totalBytes ;
+	}
+
+	public String toString() {
+	    return name + " allocs=" + allocs + " frees=" + frees +
+		" current=" + currentBytes + " total=" + totalBytes ;
+	}
+    }
+
+    private final long currentBytes ;
+    private final long peakBytes ;
+    private final long allocs ;
+    private final long frees ;
+    private final long[] histogram ;
+    private final Entry[] entries ;
+
+    HeapStats (long currentBytes, long peakBytes, long allocs, long frees,
+	       long[] histogram, Entry[] entries) {
+	this.currentBytes = currentBytes ;
+	this.peakBytes = peakBytes ;
+	this.allocs = allocs ;
+	this.frees = frees ;
+	this.histogram = histogram ;
+	this.entries = entries ;
+    }
+
+    /**
+     * Return the largest allocation size, in bytes, counted by a size
+     * class
+     */
+    public static long classLimit (int sizeClass) {
+	return 16L << sizeClass ;
+    }
+
+    public long getCurrentBytes() {
+	return currentBytes ;
+    }
+
+    public long getPeakBytes() {
+	return peakBytes ;
+    }
+
+    public long getAllocCount() {
+	return allocs ;
+    }
+
+    public long getFreeCount() {
+	return frees ;
+    }
+
+    public long[] getHistogram() {
+	return histogram.clone() ;
+    }
+
+    public Entry[] getEntries() {
+	return entries.clone() ;
+    }
+
+    /**
+     * Return the entry for a JNI entry point, or null if it has not
+     * allocated
+     */
+    public Entry getEntry (String name) {
+	for (Entry entry : entries) {
+	    if (entry.getName().equals (name))
+		return entry ;
+	}
+	return null ;
+    }
+
+    public String toString() {
+	StringBuilder sb = new StringBuilder() ;
+	sb.append ("current=").append (currentBytes)
+	    .append (" peak=").append (peakBytes)
+	    .append (" allocs=").append (allocs)
+	    .append (" frees=").append (frees).append ('\n') ;
+	for (Entry entry : entries)
+	    sb.append (entry).append ('\n') ;
+	return sb.toString() ;
+    }
+}
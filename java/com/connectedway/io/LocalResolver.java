@@ -0,0 +1,312 @@
+package com.connectedway.io ;
+
+import java.io.IOException ;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.file.DirectoryStream;
+import java.nio.file.FileStore;
+import java.nio.file.Files;
+import java.nio.file.OpenOption;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
+import java.nio.file.attribute.BasicFileAttributes;
+import java.util.ArrayList;
+import java.util.HashSet;
+import java.util.Iterator;
+import java.util.Set;
+
+import com.connectedway.io.Resolver.ResolverDir;
+import com.connectedway.io.Resolver.ResolverDirent;
+import com.connectedway.io.Resolver.ResolverFile;
+import com.connectedway.io.Resolver.ResolverListener;
+import com.connectedway.io.Resolver.ResolverStat;
+import com.connectedway.io.Resolver.ResolverStatFS;
+
+/**
+ * A ResolverListener over a local directory, using java.nio only.
+ *
+ * It is the reference listener for hosts without a DocumentsProvider,
+ * and lets the upcall bridge be exercised and measured on any JVM.
+ * Paths from the resolver are taken relative to the root, with either
+ * separator, and may not leave it.
+ */
+public class LocalResolver implements ResolverListener
+{
+    /*
+     * The Flags bit the bridge reads as a directory
+     */
+    static final int FLAG_DIR = 0x01 ;
+
+    private final Path root ;
+
+    public LocalResolver (java.io.File root)
+    {
+	this.root = Paths.get (root.getPath()).toAbsolutePath().normalize() ;
+    }
+
+    private Path resolve (String name) throws IOException
+    {
+	String relative = name.replace ('\\', '/') ;
+	while (relative.startsWith ("/"))
+	    relative = relative.substring (1) ;
+	Path path = root.resolve (relative).normalize() ;
+	if (!path.startsWith (root))
+	    throw new IOException ("Outside of " + root + ": " + name) ;
+	return path ;
+    }
+
+    /*
+     * fopen style modes
+     */
+    private static Set<OpenOption> options (String mode)
+    {
+	Set<OpenOption> options = new HashSet<OpenOption>() ;
+	boolean update = mode.indexOf ('+') >= 0 ;
+
+	switch (mode.isEmpty() ? 'r' : mode.charAt (0)) {
+	case 'w':
+	    options.add (StandardOpenOption.WRITE) ;
+	    options.add (StandardOpenOption.CREATE) ;
+	    options.add (StandardOpenOption.TRUNCATE_EXISTING) ;
+	    break ;
+	case 'a':
+	    options.add (StandardOpenOption.WRITE) ;
+	    options.add (StandardOpenOption.CREATE) ;
+	    options.add (StandardOpenOption.APPEND) ;
+	    break ;
+	default:
+	    options.add (StandardOpenOption.READ) ;
+	    if (update)
+		options.add (StandardOpenOption.WRITE) ;
+	    break ;
+	}
+	if (update)
+	    options.add (StandardOpenOption.READ) ;
+	return options ;
+    }
+
+    private static ResolverStat stat (Path path, BasicFileAttributes attrs)
+    {
+	ResolverStat stat = new ResolverStat() ;
+
+	stat.Size = attrs.size() ;
+	stat.MTime = attrs.lastModifiedTime().toMillis() ;
+	stat.Flags = attrs.isDirectory() ? FLAG_DIR : 0 ;
+	Object key = attrs.fileKey() ;
+	stat.FileId = ResolverStat.Hash (key != null ? key.toString() :
+					 path.toString()) ;
+	return stat ;
+    }
+
+    public ResolverFile Open (String FileName, String mode)
+    {
+	try {
+	    FileChannel channel =
+		FileChannel.open (resolve (FileName), options (mode)) ;
+	    return new ResolverFile (channel, channel) ;
+	} catch (IOException | UnsupportedOperationException e) {
+	    return null ;
+	}
+    }
+
+    public int MkDir (String FileName)
+    {
+	try {
+	    Files.createDirectory (resolve (FileName)) ;
+	    return 0 ;
+	} catch (IOException e) {
+	    return -1 ;
+	}
+    }
+
+    public long Write (ResolverFile rFile, ByteBuffer bb, long len)
+    {
+	return rFile.write (bb, len) ;
+    }
+
+    public long PWrite (ResolverFile rFile, ByteBuffer bb, long len,
+			long offset)
+    {
+	return rFile.pwrite (bb, len, offset) ;
+    }
+
+    public long Read (ResolverFile rFile, ByteBuffer bb, long len)
+    {
+	return rFile.read (bb, len) ;
+    }
+
+    public long PRead (ResolverFile rFile, ByteBuffer bb, long len,
+		       long offset)
+    {
+	return rFile.pread (bb, len, offset) ;
+    }
+
+    public int Close (ResolverFile rFile)
+    {
+	return rFile.close() ;
+    }
+
+    public int Unlink (String FileName)
+    {
+	try {
+	    Path path = resolve (FileName) ;
+	    if (Files.isDirectory (path))
+		return -1 ;
+	    Files.delete (path) ;
+	    return 0 ;
+	} catch (IOException e) {
+	    return -1 ;
+	}
+    }
+
+    public int RmDir (String FileName)
+    {
+	try {
+	    Path path = resolve (FileName) ;
+	    if (!Files.isDirectory (path))
+		return -1 ;
+	    Files.delete (path) ;
+	    return 0 ;
+	} catch (IOException e) {
+	    return -1 ;
+	}
+    }
+
+    public ResolverStat Stat (String FileName)
+    {
+	try {
+	    Path path = resolve (FileName) ;
+	    return stat (path, Files.readAttributes
+			 (path, BasicFileAttributes.class)) ;
+	} catch (IOException e) {
+	    return null ;
+	}
+    }
+
+    public ResolverStatFS StatFS (String FileName)
+    {
+	try {
+	    FileStore store = Files.getFileStore (resolve (FileName)) ;
+	    ResolverStatFS statfs = new ResolverStatFS() ;
+	    statfs.Avail = store.getUsableSpace() ;
+	    statfs.Blocks = store.getTotalSpace() ;
+	    return statfs ;
+	} catch (IOException e) {
+	    return null ;
+	}
+    }
+
+    /**
+     * A directory listed through a DirectoryStream, with the stat of
+     * each entry read as it is listed
+     */
+    static class LocalDir extends ResolverDir {
+	private final DirectoryStream<Path> stream ;
+	private final Iterator<Path> entries ;
+
+	LocalDir (DirectoryStream<Path> stream)
+	{
+	    this.stream = stream ;
+	    this.entries = stream.iterator() ;
+	}
+
+	@Override
+	public ResolverDirent[] NextBatch (int max)
+	{
+	    ArrayList<ResolverDirent> dirents = new ArrayList<>() ;
+
+	    while (dirents.size() < max && entries.hasNext()) {
+		Path path = entries.next() ;
+		try {
+		    BasicFileAttributes attrs =
+			Files.readAttributes (path, BasicFileAttributes.class) ;
+		    dirents.add (new ResolverDirent
+				 (path.getFileName().toString(),
+				  stat (path, attrs))) ;
+		} catch (IOException e) {
+		    /*
+		     * Gone since it was listed
+		     */
+		}
+	    }
+	    if (dirents.isEmpty())
+		return null ;
+	    return dirents.toArray (new ResolverDirent[0]) ;
+	}
+
+	@Override
+	public int close()
+	{
+	    try {
+		stream.close() ;
+		return 0 ;
+	    } catch (IOException e) {
+		return -1 ;
+	    }
+	}
+    }
+
+    public ResolverDirent[] ReadDirBatch (ResolverDir dir, int max)
+    {
+	return dir.NextBatch (max) ;
+    }
+
+    public ResolverDir OpenDir (String FileName)
+    {
+	try {
+	    return new LocalDir (Files.newDirectoryStream
+				 (resolve (FileName))) ;
+	} catch (IOException e) {
+	    return null ;
+	}
+    }
+
+    public int CloseDir (ResolverDir dir)
+    {
+	return dir.close() ;
+    }
+
+    public int Rename (String oldFile, String newFile)
+    {
+	try {
+	    Files.move (resolve (oldFile), resolve (newFile)) ;
+	    return 0 ;
+	} catch (IOException e) {
+	    return -1 ;
+	}
+    }
+
+    public int Flush (ResolverFile rFile)
+    {
+	return rFile.flush() ;
+    }
+
+    public long Seek (ResolverFile rFile, long offset, int whence)
+    {
+	return rFile.seek (offset, whence) ;
+    }
+
+    public int Truncate (ResolverFile rFile, long offset)
+    {
+	return rFile.truncate (offset) ;
+    }
+
+    public int Lock (ResolverFile rFile, long offset, long size,
+		     boolean shared)
+    {
+	return rFile.lock (offset, size, shared) ;
+    }
+
+    public int TryLock (ResolverFile rFile, long offset, long size,
+			boolean shared)
+    {
+	return rFile.trylock (offset, size, shared) ? 0 : -1 ;
+    }
+
+    public int Unlock (ResolverFile rFile, long offset, long size)
+    {
+	rFile.unlock (offset, size) ;
+	return 0 ;
+    }
+}
@@ -0,0 +1,295 @@
+package com.connectedway.io ;
+
+import java.io.Closeable ;
+import java.io.IOException ;
+import java.nio.ByteBuffer ;
+import java.nio.ByteOrder ;
+import java.nio.channels.FileChannel.MapMode ;
+import java.nio.channels.NonWritableChannelException ;
+import java.util.concurrent.locks.ReentrantReadWriteLock ;
+
+/**
+ * A memory mapped style view of a region of a file.
+ *
+ * The region is backed by a native page cache shared by all mapped
+ * regions.  Pages are read in lazily, through overlapped reads, the
+ * first time they are touched by one of the accessors or by
+ * {@link #page(long)}.  {@link #load()} prefetches a range ahead of
+ * use.  In read-write mode, modified pages are written back by
+ * {@link #force()}, by {@link #close()}, or when they are evicted to
+ * stay within the cache budget.
+ *
+ * Unlike a real memory map, writes to the file through other handles
+ * are not reflected in pages that are already cached.
+ *
+ * A region may be used from several threads.  {@link #close()} waits
+ * for the calls in progress on the region to finish.
+ *
+ * @see java.nio.MappedByteBuffer
+ */
+public class MappedRegion implements Closeable {
+
+    static {
+	/*
+	 * Insure that the JNI library is loaded
+	 */
+	FileSystem.getFileSystem() ;
+	init() ;
+    }
+
+    private final long position ;
+    private final long size ;
+    private final MapMode mode ;
+    private final int pageSize ;
+    private ByteOrder order = ByteOrder.BIG_ENDIAN ;
+    private final ReentrantReadWriteLock lock =
+	new ReentrantReadWriteLock() ;
+    private long handle ;
+
+    MappedRegion (FileDescriptor fd, long position, long size, MapMode mode)
+	throws IOException {
+	if (position < 0 || size < 0)
+	    throw new IllegalArgumentException() ;
+	if (mode == MapMode.PRIVATE)
+	    throw new UnsupportedOperationException ("PRIVATE mapping") ;
+
+	this.position = position ;
+	this.size = size ;
+	this.mode = mode ;
+	this.pageSize = getPageSize() ;
+	handle = create (fd, position, size, mode == MapMode.READ_WRITE) ;
+    }
+
+    /**
+     * Set the total amount of native memory used to cache the pages
+     * of all mapped regions.  Lowering the budget evicts pages, but
+     * never the pages held for buffers returned by {@link #page(long)}.
+     */
+    public static native void setCacheSize (long bytes) ;
+    public static native long getCacheSize () ;
+    public static native int getPageSize () ;
+
+    public long position() {
+	return position ;
+    }
+
+    public long size() {
+	return size ;
+    }
+
+    public MapMode mode() {
+	return mode ;
+    }
+
+    public ByteOrder order() {
+	return order ;
+    }
+
+    /**
+     * Set the byte order used by the multi-byte accessors
+     */
+    public MappedRegion order (ByteOrder order) {
+	this.order = order ;
+	return this ;
+    }
+
+    private void ensureOpen() throws IOException {
+	if (handle == 0)
+	    throw new IOException ("Region already closed") ;
+    }
+
+    private void checkRange (long offset, long len) {
+	if (offset < 0 || len < 0 || offset > size - len)
+	    throw new IndexOutOfBoundsException() ;
+    }
+
+    private void checkWritable() {
+	if (mode != MapMode.READ_WRITE)
+	    throw new NonWritableChannelException() ;
+    }
+
+    /**
+     * Prefetch the whole region into the page cache, as far as the
+     * cache budget allows
+     *
+     * @see java.nio.MappedByteBuffer#load()
+     */
+    public void load() throws IOException {
+	load (0, size) ;
+    }
+
+    /**
+     * Prefetch a range of the region into the page cache.  The pages
+     * of the range are read concurrently.
+     */
+    public void load (long offset, long len) throws IOException {
+	lock.readLock().lock() ;
+	try {
+	    ensureOpen() ;
+	    checkRange (offset, len) ;
+	    load (handle, offset, len) ;
+	} finally {
+	    lock.readLock().unlock() ;
+	}
+    }
+
+    /**
+     * Return a direct buffer over the cached page holding
+     * <code>offset</code>, positioned at <code>offset</code>.
+     *
+     * The page stays in the cache, held by this region, until the
+     * region is closed, and counts against the cache budget meanwhile.
+     * Once every cached page is held, faulting in another page throws
+     * an IOException.  In read-write mode a held page is written back
+     * by every {@link #force()} and by {@link #close()}.  The buffer
+     * must not be used after the region is closed: its memory stays
+     * valid, but may then be caching a page of another region, which
+     * a write through the buffer would silently corrupt.
+     */
+    public ByteBuffer page (long offset) throws IOException {
+	ByteBuffer buf ;
+	lock.readLock().lock() ;
+	try {
+	    ensureOpen() ;
+	    checkRange (offset, 1) ;
+	    buf = page (handle, offset, mode == MapMode.READ_WRITE) ;
+	} finally {
+	    lock.readLock().unlock() ;
+	}
+	buf.position ((int) (offset % pageSize)) ;
+	if (mode != MapMode.READ_WRITE)
+	    buf = buf.asReadOnlyBuffer() ;
+	return buf.order (order) ;
+    }
+
+    /**
+     * Absolute bulk get
+     */
+    public void get (long offset, byte[] dst, int off, int len)
+	throws IOException {
+	ensureOpen() ;
+	checkRange (offset, len) ;
+	if (off < 0 || len < 0 || off > dst.length - len)
+	    throw new IndexOutOfBoundsException() ;
+	lock.readLock().lock() ;
+	try {
+	    ensureOpen() ;
+	    get (handle, offset, dst, off, len) ;
+	} finally {
+	    lock.readLock().unlock() ;
+	}
+    }
+
+    /**
+     * Absolute bulk put
+     */
+    public void put (long offset, byte[] src, int off, int len)
+	throws IOException {
+	ensureOpen() ;
+	checkWritable() ;
+	checkRange (offset, len) ;
+	if (off < 0 || len < 0 || off > src.length - len)
+	    throw new IndexOutOfBoundsException() ;
+	lock.readLock().lock() ;
+	try {
+	    ensureOpen() ;
+	    put (handle, offset, src, off, len) ;
+	} finally {
+	    lock.readLock().unlock() ;
+	}
+    }
+
+    private ByteBuffer getBytes (long offset, int len) throws IOException {
+	byte[] b = new byte[len] ;
+	get (offset, b, 0, len) ;
+	return ByteBuffer.wrap (b).order (order) ;
+    }
+
+    private void putBytes (long offset, ByteBuffer b) throws IOException {
+	put (offset, b.array(), 0, b.capacity()) ;
+    }
+
+    public byte get (long offset) throws IOException {
+	return getBytes (offset, 1).get (0) ;
+    }
+
+    public short getShort (long offset) throws IOException {
+	return getBytes (offset, 2).getShort (0) ;
+    }
+
+    public int getInt (long offset) throws IOException {
+	return getBytes (offset, 4).getInt (0) ;
+    }
+
+    public long getLong (long offset) throws IOException {
+	return getBytes (offset, 8).getLong (0) ;
+    }
+
+    public void put (long offset, byte b) throws IOException {
+	putBytes (offset, ByteBuffer.allocate (1).put (0, b)) ;
+    }
+
+    public void putShort (long offset, short s) throws IOException {
+	putBytes (offset, ByteBuffer.allocate (2).order (order).putShort (0, s)) ;
+    }
+
+    public void putInt (long offset, int i) throws IOException {
+	putBytes (offset, ByteBuffer.allocate (4).order (order).putInt (0, i)) ;
+    }
+
+    public void putLong (long offset, long l) throws IOException {
+	putBytes (offset, ByteBuffer.allocate (8).order (order).putLong (0, l)) ;
+    }
+
+    /**
+     * Write back any modified pages of the region
+     *
+     * @see java.nio.MappedByteBuffer#force()
+     */
+    public void force() throws IOException {
+	lock.readLock().lock() ;
+	try {
+	    ensureOpen() ;
+	    if (mode == MapMode.READ_WRITE)
+		force (handle) ;
+	} finally {
+	    lock.readLock().unlock() ;
+	}
+    }
+
+    /**
+     * Write back any modified pages and release the region's pages to
+     * the cache, once the calls in progress on the region are done.
+     * The file descriptor is not closed.
+     */
+    public void close() throws IOException {
+	lock.writeLock().lock() ;
+	try {
+	    if (handle != 0) {
+		long h = handle ;
+		handle = 0 ;
+		destroy (h) ;
+	    }
+	} finally {
+	    lock.writeLock().unlock() ;
+	}
+    }
+
+    protected void finalize() throws IOException {
+	close() ;
+    }
+
+    private static native void init () ;
+    private native long create (FileDescriptor fd, long pos, long size,
+				boolean writable) throws IOException ;
+    private native void load (long handle, long offset, long len)
+	throws IOException ;
+    private native ByteBuffer page (long handle, long offset, boolean write)
+	throws IOException ;
+    private native void get (long handle, long offset, byte[] b, int off,
+			     int len) throws IOException ;
+    private native void put (long handle, long offset, byte[] b, int off,
+			     int len) throws IOException ;
+    private native void force (long handle) throws IOException ;
+    private native void destroy (long handle) throws IOException ;
+}
@@ -19,6 +19,8 @@ import java.nio.charset.StandardCharsets;
 public class RandomAccessFile implements DataOutput, DataInput, Closeable {
 
     private FileDescriptor fd;
+    private java.nio.channels.FileChannel channel ;
+    private boolean writable ;
     private final FileSystem fs = FileSystem.getFileSystem() ;
     
     /**
@@ -38,6 +40,7 @@ public class RandomAccessFile implements DataOutput, DataInput, Closeable {
 	    imode = FileSystem.OPEN_RW ;
 
 	fd = fs.open (name, imode) ;
+	writable = (imode != FileSystem.OPEN_READ) ;
     }
 
     /**
@@ -66,8 +69,11 @@ public class RandomAccessFile implements DataOutput, DataInput, Closeable {
      *
      * @see java.io.FileOutputStream#getChannel()
      */
-    public java.nio.channels.FileChannel getChannel() {
-	return null ;
+    public synchronized java.nio.channels.FileChannel getChannel() {
+	if (channel == null)
+	    channel = com.connectedway.nio.FileChannel.open (fd, true, writable,
+							     false, this) ;
+	return channel ;
     }
     /**
      * Reads a byte of data from this file. 
@@ -218,6 +224,13 @@ public class RandomAccessFile implements DataOutput, DataInput, Closeable {
      * @see java.io.RandomAccessFile#close()
      */
     public void close() throws IOException {
+	if (channel != null && channel.isOpen()) {
+	    /*
+	     * Closing the channel closes us
+	     */
+	    channel.close() ;
+	    return ;
+	}
 	if (fd == null)
 	    throw new IOException ("File already closed");
 	else {
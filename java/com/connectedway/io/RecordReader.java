@@ -0,0 +1,176 @@
+package com.connectedway.io ;
+
+import java.io.Closeable ;
+import java.io.IOException ;
+import java.nio.ByteBuffer ;
+
+/**
+ * Split a file into delimited records in native code.
+ *
+ * The file is streamed through two native buffers.  While the records
+ * of one buffer are being consumed, a native read-ahead thread fills
+ * the other.  Delimiters are found sixteen bytes at a time where the
+ * CPU allows it.
+ *
+ * Each call to {@link #next()} returns a batch of records as offsets
+ * and lengths into {@link #buffer()}, a direct buffer shared with the
+ * native side, so no bytes are copied into the Java heap.  The
+ * delimiter is not part of a record, and when the delimiter is a
+ * newline, neither is a carriage return in front of it.  A record
+ * longer than the maximum record size is returned in pieces.
+ *
+ * The buffer, offsets and lengths of a batch are only valid until the
+ * next call to {@link #next()} or {@link #nextStrings()}.
+ */
+public class RecordReader implements Closeable {
+
+    static {
+	/*
+	 * Insure that the JNI library is loaded
+	 */
+	FileSystem.getFileSystem() ;
+    }
+
+    public static final int DEFAULT_BATCH = 4096 ;
+    public static final int DEFAULT_CHUNK = 1024 * 1024 ;
+    public static final int DEFAULT_MAX_RECORD = 64 * 1024 ;
+
+    private final ByteBuffer[] buffers = new ByteBuffer[2] ;
+    private final int[] offsets ;
+    private final int[] lengths ;
+    private int count ;
+    private int current ;
+    private long handle ;
+
+    /**
+     * Read newline delimited records
+     */
+    public RecordReader (File file) throws IOException {
+	this (file, (byte) '\n', DEFAULT_BATCH, DEFAULT_CHUNK,
+	      DEFAULT_MAX_RECORD) ;
+    }
+
+    public RecordReader (File file, byte delimiter) throws IOException {
+	this (file, delimiter, DEFAULT_BATCH, DEFAULT_CHUNK,
+	      DEFAULT_MAX_RECORD) ;
+    }
+
+    /**
+     * @param file the file to split
+     * @param delimiter the byte that ends a record
+     * @param batch the most records returned by one call to next
+     * @param chunkSize the size of each read from the file
+     * @param maxRecord the longest record returned whole
+     */
+    public RecordReader (File file, byte delimiter, int batch, int chunkSize,
+			 int maxRecord) throws IOException {
+	if (batch <= 0 || chunkSize <= 0 || maxRecord <= 0 ||
+	    (long) chunkSize + maxRecord > Integer.MAX_VALUE)
+	    throw new IllegalArgumentException() ;
+
+	offsets = new int[batch] ;
+	lengths = new int[batch] ;
+	handle = create (file, delimiter, batch, chunkSize, maxRecord) ;
+	buffers[0] = buffer (handle, 0) ;
+	buffers[1] = buffer (handle, 1) ;
+    }
+
+    private void ensureOpen() throws IOException {
+	if (handle == 0)
+	    throw new IOException ("Reader already closed") ;
+    }
+
+    /**
+     * Split the next batch of records.
+     *
+     * @return the number of records in the batch, or zero at the end
+     * of the file
+     */
+    public int next() throws IOException {
+	ensureOpen() ;
+	count = next (handle, offsets, lengths) ;
+	current = current (handle) ;
+	return count ;
+    }
+
+    /**
+     * Split the next batch of records and decode each of them as UTF-8.
+     * Malformed input is replaced, as by {@link String#String(byte[],
+     * java.nio.charset.Charset)}, but not always by the same number of
+     * replacement characters.
+     *
+     * @return the records, or an empty array at the end of the file
+     */
+    public String[] nextStrings() throws IOException {
+	ensureOpen() ;
+	String[] strings = nextStrings (handle, offsets, lengths) ;
+	count = strings.length ;
+	current = current (handle) ;
+	return strings ;
+    }
+
+    /**
+     * The number of records in the current batch
+     */
+    public int count() {
+	return count ;
+    }
+
+    /**
+     * The buffer holding the records of the current batch
+     */
+    public ByteBuffer buffer() {
+	return buffers[current].duplicate() ;
+    }
+
+    /**
+     * The offsets of the records of the current batch in the buffer.
+     * Only the first {@link #count()} entries are meaningful.
+     */
+    public int[] offsets() {
+	return offsets ;
+    }
+
+    /**
+     * The lengths of the records of the current batch
+     */
+    public int[] lengths() {
+	return lengths ;
+    }
+
+    /**
+     * Copy one record of the current batch
+     */
+    public byte[] record (int index) {
+	if (index < 0 || index >= count)
+	    throw new IndexOutOfBoundsException() ;
+	byte[] b = new byte[lengths[index]] ;
+	ByteBuffer buf = buffer() ;
+	buf.position (offsets[index]) ;
+	buf.get (b) ;
+	return b ;
+    }
+
+    public void close() throws IOException {
+	if (handle != 0) {
+	    long h = handle ;
+	    handle = 0 ;
+	    buffers[0] = null ;
+	    buffers[1] = null ;
+	    count = 0 ;
+	    destroy (h) ;
+	}
+    }
+
+    private static native long create (File file, byte delimiter, int batch,
+				       int chunkSize, int maxRecord)
+	throws IOException ;
+    private static native ByteBuffer buffer (long handle, int index) ;
+    private static native int next (long handle, int[] offsets,
+				    int[] lengths) throws IOException ;
+    private static native String[] nextStrings (long handle, int[] offsets,
+						int[] lengths)
+	throws IOException ;
+    private static native int current (long handle) ;
+    private static native void destroy (long handle) ;
+}
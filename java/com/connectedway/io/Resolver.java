@@ -1,21 +1,13 @@
 package com.connectedway.io ;
 
-import java.util.Hashtable;
-import java.io.FileInputStream;
-import java.io.FileOutputStream;
+import java.util.concurrent.ConcurrentHashMap;
+import java.io.Closeable;
 import java.io.IOException ;
 import java.lang.System;
 import java.nio.channels.FileChannel;
 import java.nio.channels.FileLock;
 import java.nio.ByteBuffer;
 
-import android.os.ParcelFileDescriptor;
-
-import android.database.Cursor;
-
-import android.provider.DocumentsContract.Document;
-import android.provider.DocumentsContract.Root;
-
 /**
  * This class manages the configuration and initialization of the Blue 
  * Share components.
@@ -36,63 +28,70 @@ public class Resolver
      * Server Settings
      */
     public static class ResolverFile {
-	private ParcelFileDescriptor pfdos;
-	private ParcelFileDescriptor pfdis;
-	private FileOutputStream fos;
-	private FileInputStream fis;
-	private FileChannel fcoc;
-	private FileChannel fcic;
-
-	public ResolverFile (ParcelFileDescriptor pfd)
+	private final FileChannel fcoc;
+	private final FileChannel fcic;
+	private final Closeable[] resources;
+
+	/**
+	 * A file read through one channel and written through another,
+	 * which may be the same.  The resources are closed along with the
+	 * channels.
+	 *
+	 * {@link AndroidResolver#openFile} makes one from a
+	 * ParcelFileDescriptor.
+	 */
+	public ResolverFile (FileChannel in, FileChannel out,
+			     Closeable... resources)
 	{
-	    try {
-		this.pfdos = pfd.dup();
-		this.fos =
-		    new ParcelFileDescriptor.AutoCloseOutputStream(pfdos);
-		this.fcoc = this.fos.getChannel();
-
-		this.pfdis = pfd.dup();
-		this.fis =
-		    new ParcelFileDescriptor.AutoCloseInputStream(pfdis);
-		this.fcic = this.fis.getChannel();
-                pfd.close();
-	    }
-	    catch (IOException except) {
-	 	    System.out.println("Unable to Create Resolver File");
-	    }
+	    this.fcic = in;
+	    this.fcoc = out;
+	    this.resources = resources;
 	}
 
-	public int write(byte[] b, int len)
+	/*
+	 * The buffers handed to read and write are direct buffers over
+	 * the native I/O buffers, and are reused from call to call, so
+	 * their position and limit are reset before use.  Lengths and
+	 * offsets are 64 bits, but a single transfer is bounded by the
+	 * buffer it is given.
+	 */
+	private static void frame(ByteBuffer bb, long len)
 	{
-	    int ret;
+            bb.clear();
+            bb.limit((int) Math.min(len, bb.capacity()));
+	}
+
+	public long write(ByteBuffer bb, long len)
+	{
+	    long ret;
 	    
-            ByteBuffer bb = ByteBuffer.wrap(b, 0, len);
+            frame(bb, len);
             try {
                 ret = this.fcoc.write(bb);
-            } catch (IOException e) {
+            } catch (Exception e) {
                 ret = -1;
             }
 	    return(ret);
 	}
 
-	public int pwrite(ByteBuffer bb, int len, int offset)
+	public long pwrite(ByteBuffer bb, long len, long offset)
 	{
-	    int ret;
+	    long ret;
 	    
+            frame(bb, len);
             try {
                 ret = this.fcoc.write(bb, offset);
-            } catch (IOException e) {
+            } catch (Exception e) {
                 ret = -1;
             }
 	    return(ret);
 	}
 
-	public int read(byte[] b, int len)
+	public long read(ByteBuffer bb, long len)
 	{
-	    int ret;
-
-            ByteBuffer bb = ByteBuffer.wrap(b, 0, len);
+	    long ret;
 
+            frame(bb, len);
             try {
                 ret = this.fcic.read(bb);
                 if (ret == -1)
@@ -103,10 +102,11 @@ public class Resolver
 	    return (ret);
 	}
 
-	public int pread(ByteBuffer bb, int len, int offset)
+	public long pread(ByteBuffer bb, long len, long offset)
 	{
-	    int ret;
+	    long ret;
 
+            frame(bb, len);
             try {
                 ret = this.fcic.read(bb, offset);
                 if (ret == -1)
@@ -121,25 +121,35 @@ public class Resolver
 	{
 	    int ret;
 
+            ret = 0;
             try {
-                this.fis.close();
-                this.fos.close();
-                this.pfdis.close();
-                this.pfdos.close();
-                ret = 0;
+                this.fcic.close();
+                if (this.fcoc != this.fcic)
+                    this.fcoc.close();
             } catch (IOException e) {
                 ret = -1;
             }
+            for (Closeable resource : this.resources) {
+                try {
+                    resource.close();
+                } catch (IOException e) {
+                    ret = -1;
+                }
+            }
 	    return (ret);
 	}
 
-	public void flush()
+	public int flush()
 	{
+	    int ret;
+
+            ret = 0;
             try {
                 this.fcoc.force(true);
             } catch (IOException e) {
-            	System.out.println("Exception on Flush");
+                ret = -1;
             }
+	    return (ret);
 	}
 
 	public long seek(long offset, int whence)
@@ -172,13 +182,17 @@ public class Resolver
 	    return (newpos);
 	}
 
-	public void truncate(long offset)
+	public int truncate(long offset)
 	{
+	    int ret;
+
+            ret = 0;
             try {
                 this.fcoc.truncate(offset);
             } catch (IOException e) {
-            	System.out.println("Exception on Truncate");
+                ret = -1;
             }
+	    return (ret);
 	}
 
 	private static class HashKey {
@@ -190,48 +204,67 @@ public class Resolver
 		this.size = size;
 	    }
 
+	    @Override
 	    public int hashCode() {
-		return (int) this.position;
+		long h = this.position * 31 + this.size;
+		return (int) (h ^ (h >>> 32));
 	    }
 
-	    public boolean equals (HashKey other) {
-			return this.position == other.position &&
-					this.size == other.size;
+	    @Override
+	    public boolean equals (Object obj) {
+		if (!(obj instanceof HashKey))
+		    return false;
+		HashKey other = (HashKey) obj;
+		return this.position == other.position &&
+		    this.size == other.size;
 	    }
 	}
 
-	static Hashtable<HashKey,FileLock> hashtable =
-			new Hashtable<>();
-
-	public synchronized void lock(long position, long size, boolean shared)
+	/*
+	 * The OS locks held through this file.  The native lock table
+	 * only passes down a range that overlaps nothing else held
+	 * through the file, and releases it once, so these need no
+	 * further bookkeeping.
+	 */
+	private final ConcurrentHashMap<HashKey,FileLock> locks =
+	    new ConcurrentHashMap<>();
+
+	/*
+	 * A channel that cannot take the lock, an exclusive lock on one
+	 * opened for reading only for instance, throws a runtime
+	 * exception rather than an IOException.  Either is a failure.
+	 */
+	public int lock(long position, long size, boolean shared)
 	{
+	    int ret = -1;
             try {
                 FileLock fl = this.fcoc.lock(position, size, shared);
-                HashKey key = new HashKey(position, size);
-                hashtable.put(key, fl);
-            } catch (IOException e) {
+                locks.put(new HashKey(position, size), fl);
+                ret = 0;
+            } catch (IOException | RuntimeException e) {
             	System.out.println("Exception on Lock");
             }
+	    return ret;
 	}
 
-	public synchronized boolean trylock(long position,
-					    long size, boolean shared)
+	public boolean trylock(long position,
+			       long size, boolean shared)
 	{
 	    boolean ret = false;
             try {
                 FileLock fl = this.fcoc.tryLock(position, size, shared);
-                HashKey key = new HashKey(position, size);
-				hashtable.put(key, fl);
-				ret = true;
-			} catch (IOException e) {
+                if (fl != null) {
+                    locks.put(new HashKey(position, size), fl);
+                    ret = true;
+                }
+            } catch (IOException | RuntimeException e) {
             	System.out.println("Exception in tryLock");
             }
 	    return ret;
 	}
 
-	public synchronized void unlock(long position, long size) {
-            HashKey key = new HashKey(position, size);
-            FileLock fl = hashtable.remove(key);
+	public void unlock(long position, long size) {
+            FileLock fl = locks.remove(new HashKey(position, size));
             try {
                 if (fl != null)
                     fl.release();
@@ -257,118 +290,76 @@ public class Resolver
             }
             return h;
         }
-
-	public static void fromCursor(Cursor cursor, ResolverStat stat)
-	{
-	    int columnId;
-
-	    columnId = cursor.getColumnIndex(Document.COLUMN_SIZE);
-	    if (columnId >= 0)
-		stat.Size = cursor.getLong(columnId);
-
-	    columnId = cursor.getColumnIndex(Document.COLUMN_DOCUMENT_ID);
-	    if (columnId >= 0) {
-                String docId = cursor.getString(columnId);
-                stat.FileId = ResolverStat.Hash(docId);
-            }
-
-	    columnId = cursor.getColumnIndex(Document.COLUMN_LAST_MODIFIED);
-	    if (columnId >= 0) {
-		/*
-		 * Returns # ms since EPOCH 1/1/1970.
-		 * Want the equivalent of time_t which is # seconds
-		 * since epoch.
-		 */
-		stat.MTime = cursor.getLong(columnId) / 1000;
-	    }
-	    columnId = cursor.getColumnIndex(Document.COLUMN_FLAGS);
-	    if (columnId >= 0)
-		stat.Flags = cursor.getInt(columnId);
-	}
     }
 
 	public static class ResolverStatFS {
 	public long Avail;
 	public long Blocks;
-
-	public static void fromCursor(Cursor cursor, ResolverStatFS statfs)
-	{
-	    int columnId;
-
-	    columnId = cursor.getColumnIndex(Root.COLUMN_AVAILABLE_BYTES);
-	    if (columnId >= 0)
-		statfs.Avail = cursor.getLong(columnId);
-
-	    columnId = cursor.getColumnIndex(Root.COLUMN_CAPACITY_BYTES);
-	    if (columnId >= 0) {
-		statfs.Blocks = cursor.getLong(columnId);
-	    }
-	}
     }
 
-	public static class ResolverDir {
-	private final Cursor cursor;
-
-	public ResolverDir(Cursor cursor)
-	{
-	    this.cursor = cursor;
-	}
-
-	public boolean Next()
-	{
-	    return (this.cursor.moveToNext());
-	}
-
-	public int close()
-	{
-	    int ret;
-
-	    this.cursor.close();
-	    ret = 0;
-	    return (ret);
-	}
-
-	public Cursor getCursor()
-	{
-	    return (this.cursor);
-	}
+    /**
+     * An open directory.  AndroidResolver.CursorDir lists a
+     * DocumentsProvider cursor.
+     */
+    public static abstract class ResolverDir {
+	/*
+	 * Up to max entries, or null at the end
+	 */
+	public abstract ResolverDirent[] NextBatch(int max);
 
+	public abstract int close();
     }
 
 	public static class ResolverDirent {
 	public String Name;
+	/*
+	 * Same meaning as the ResolverStat fields, so that a listing
+	 * carries the stat of each entry with it
+	 */
+	public long Size;
+	public int Flags;
+	public long MTime;
+	public long FileId;
 
-	public ResolverDirent (Cursor cursor)
+	public ResolverDirent ()
 	{
-	    int columnId;
+	}
 
-	    columnId = cursor.getColumnIndex(Document.COLUMN_DISPLAY_NAME);
-	    if (columnId >= 0)
-		this.Name = cursor.getString(columnId);
+	public ResolverDirent (String name, ResolverStat stat)
+	{
+	    this.Name = name;
+	    this.Size = stat.Size;
+	    this.Flags = stat.Flags;
+	    this.MTime = stat.MTime;
+	    this.FileId = stat.FileId;
 	}
     }
 
 	public interface ResolverListener {
 	ResolverFile Open(String FileName, String mode);
 	int MkDir(String FileName);
-	int Write(ResolverFile rFile, byte[] b, int len);
-	int PWrite(ResolverFile rFile, ByteBuffer bb, int len,
-			   int offset);
-	int Read(ResolverFile rFile, byte[] b, int len);
-	int PRead(ResolverFile rFile, ByteBuffer bb, int len,
-			  int offset);
+	long Write(ResolverFile rFile, ByteBuffer bb, long len);
+	long PWrite(ResolverFile rFile, ByteBuffer bb, long len,
+			   long offset);
+	long Read(ResolverFile rFile, ByteBuffer bb, long len);
+	long PRead(ResolverFile rFile, ByteBuffer bb, long len,
+			  long offset);
 	int Close(ResolverFile rFile);
 	int Unlink(String FileName);
 	int RmDir(String FileName);
 	ResolverStat Stat(String FileName);
 	ResolverStatFS StatFS(String FileName);
-	ResolverDirent ReadDir(ResolverDir dir);
+	ResolverDirent[] ReadDirBatch(ResolverDir dir, int max);
 	ResolverDir OpenDir(String FileName);
 	int CloseDir(ResolverDir dir);
 	int Rename(String oldFile, String newFile);
 	int Flush(ResolverFile rFile);
 	long Seek(ResolverFile rFile, long offset, int whence);
 	int Truncate(ResolverFile rFile, long offset);
+	/*
+	 * Lock and TryLock return 0 once the lock is held.  They are only
+	 * called for ranges that overlap nothing else held through rFile.
+	 */
 	int Lock(ResolverFile rFile, long offset, long size,
 			 boolean shared);
 	int TryLock(ResolverFile rFile, long offset,
@@ -378,6 +369,47 @@ public class Resolver
 	//public abstract int StatFS(String FileName, ResolverStatFS stat);
     }
 
+    /**
+     * A listener that completes positioned reads and writes
+     * asynchronously.
+     *
+     * PReadAsync and PWriteAsync start the transfer and return 0, or
+     * return -1 if it could not be started.  A started transfer must be
+     * finished by passing request to {@link #complete} with the byte
+     * count, or -1 on error, from any thread.  The buffer stays valid
+     * until then.  A call that throws counts as -1.  A request that is
+     * completed before the call returns keeps its first result, even
+     * if the call then returns -1 or throws.  A request must not be
+     * completed more than once otherwise.
+     */
+    public interface ResolverAsyncListener extends ResolverListener {
+	int PReadAsync(ResolverFile rFile, ByteBuffer bb, long len,
+		       long offset, long request);
+	int PWriteAsync(ResolverFile rFile, ByteBuffer bb, long len,
+			long offset, long request);
+    }
+
     public static native void setResolverListener(ResolverListener listener);
+
+    /**
+     * Complete a request started by a ResolverAsyncListener
+     *
+     * @param request
+     * The request handed to PReadAsync or PWriteAsync
+     * @param result
+     * The number of bytes transferred, or -1 on error
+     */
+    public static native void complete(long request, long result);
+
+    /**
+     * Number of stats answered from the native stat cache
+     */
+    public static native long getStatCacheHits();
+
+    /**
+     * Number of stats that missed the native stat cache and went to
+     * the listener
+     */
+    public static native long getStatCacheMisses();
 }
 
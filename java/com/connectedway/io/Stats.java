@@ -0,0 +1,137 @@
+package com.connectedway.io ;
+
+/**
+ * A snapshot of per-operation latency statistics
+ *
+ * One entry is reported for every operation and share that has seen
+ * traffic.  Local files are reported under the share "local", and
+ * files reached through a map whose destination can not be resolved
+ * are reported under the map name followed by a colon.
+ *
+ * Latencies are kept as a log scale histogram.  Bucket <code>i</code>
+ * counts operations that took at least 2^i and less than 2^(i+1)
+ * nanoseconds, with bucket 0 also holding anything faster than 2ns and
+ * the last bucket holding anything slower.
+ *
+ * @see Framework#getStats()
+ */
+public class Stats {
+
+    public static class Entry {
+	private final String share ;
+	private final String op ;
+	private final long count ;
+	private final long bytes ;
+	private final long totalNanos ;
+	private final long[] histogram ;
+
+	Entry (String share, String op, long count, long bytes,
+	       long totalNanos, long[] histogram) {
+	    this.share = share ;
+	    this.op = op ;
+	    this.count = count ;
+	    this.bytes = bytes ;
+	    this.totalNanos = totalNanos ;
+	    this.histogram = histogram ;
+	}
+
+	/**
+	 * The server and share, as "server/share"
+	 */
+	public String getShare() {
+	    return share ;
+	}
+
+	/**
+	 * The operation: open, read, write, seek, flush, close, stat,
+	 * list, find, rename or delete
+	 */
+	public String getOp() {
+	    return op ;
+	}
+
+	public long getCount() {
+	    return count ;
+	}
+
+	/**
+	 * Bytes transferred, for reads and writes
+	 */
+	public long getBytes() {
+	    return bytes ;
+	}
+
+	public long getTotalNanos() {
+	    return totalNanos ;
+	}
+
+	public long getMeanNanos() {
+	    return count == 0 ? 0 : totalNanos / count ;
+	}
+
+	public long[] getHistogram() {
+	    return histogram.clone() ;
+	}
+
+	/**
+	 * Return an upper bound of the latency under which the given
+	 * fraction of the operations completed
+	 *
+	 * @param fraction the percentile as a fraction, such as 0.99
+	 */
+	public long getPercentileNanos (double fraction) {
+	    long target = (long) Math.ceil (count * fraction) ;
+	    long seen = 0 ;
+
+	    for (int i = 0 ; i < histogram.length ; i++) {
+		seen += histogram[i] ;
+		if (seen >= target && seen > 0)
+		    return bucketLimit (i) ;
+	    }
+	    return bucketLimit (histogram.length - 1) ;
+	}
+
+	public String toString() {
+	    return share + " " + op + " count=" + count +
+		" bytes=" + bytes + " mean=" + getMeanNanos() + "ns" +
+		" p99<" + getPercentileNanos (0.99) + "ns" ;
+	}
+    }
+
+    private final Entry[] entries ;
+
+    Stats (Entry[] entries) {
+	this.entries = entries ;
+    }
+
+    /**
+     * Return the exclusive upper latency limit, in nanoseconds, of a
+     * histogram bucket
+     */
+    public static long bucketLimit (int bucket) {
+	return 1L << (bucket + 1) ;
+    }
+
+    public Entry[] getEntries() {
+	return entries.clone() ;
+    }
+
+    /**
+     * Return the entry for an operation on a share, or null if there
+     * has been no such traffic
+     */
+    public Entry getEntry (String share, String op) {
+	for (Entry entry : entries) {
+	    if (entry.getShare().equals (share) && entry.getOp().equals (op))
+		return entry ;
+	}
+	return null ;
+    }
+
+    public String toString() {
+	StringBuilder sb = new StringBuilder() ;
+	for (Entry entry : entries)
+	    sb.append (entry).append ('\n') ;
+	return sb.toString() ;
+    }
+}
@@ -0,0 +1,439 @@
+package com.connectedway.nio ;
+
+import java.io.Closeable ;
+import java.io.IOException ;
+import java.nio.ByteBuffer ;
+import java.nio.MappedByteBuffer ;
+import java.nio.ReadOnlyBufferException ;
+import java.nio.channels.ClosedChannelException ;
+import java.nio.channels.FileLock ;
+import java.nio.channels.NonReadableChannelException ;
+import java.nio.channels.NonWritableChannelException ;
+import java.nio.channels.ReadableByteChannel ;
+import java.nio.channels.WritableByteChannel ;
+
+import com.connectedway.io.FileDescriptor ;
+import com.connectedway.io.FileSystem ;
+
+/**
+ * A channel for reading, writing and manipulating a file opened
+ * through the network aware file system.
+ *
+ * Reads and writes go through the same native I/O engine as the
+ * streams.  Direct buffers are handed to the native layer without a
+ * copy.  A transfer between two channels of this class is done
+ * entirely in native buffers.
+ *
+ * @see java.nio.channels.FileChannel
+ */
+public class FileChannel extends java.nio.channels.FileChannel {
+
+    private static final int TRANSFER_SIZE = 64 * 1024 ;
+
+    private final FileSystem fs = FileSystem.getFileSystem() ;
+    private final FileDescriptor fd ;
+    private final boolean readable ;
+    private final boolean writable ;
+    private final boolean append ;
+    private final Closeable parent ;
+
+    private FileChannel (FileDescriptor fd, boolean readable,
+			 boolean writable, boolean append, Closeable parent) {
+	this.fd = fd ;
+	this.readable = readable ;
+	this.writable = writable ;
+	this.append = append ;
+	this.parent = parent ;
+    }
+
+    /**
+     * Create a channel for an open file descriptor.  When the channel
+     * is closed, <code>parent</code> is closed if it is not null,
+     * otherwise the file descriptor is closed.
+     */
+    public static FileChannel open (FileDescriptor fd, boolean readable,
+				    boolean writable, boolean append,
+				    Closeable parent) {
+	return new FileChannel (fd, readable, writable, append, parent) ;
+    }
+
+    private void ensureOpen() throws IOException {
+	if (!isOpen())
+	    throw new ClosedChannelException() ;
+    }
+
+    private void ensureReadable() throws IOException {
+	ensureOpen() ;
+	if (!readable)
+	    throw new NonReadableChannelException() ;
+    }
+
+    private void ensureWritable() throws IOException {
+	ensureOpen() ;
+	if (!writable)
+	    throw new NonWritableChannelException() ;
+    }
+
+    private int readBuffer (ByteBuffer dst, long pos) throws IOException {
+	int ret ;
+
+	if (dst.isReadOnly())
+	    throw new ReadOnlyBufferException() ;
+
+	ret = fs.read (fd, dst, dst.position(), dst.remaining(), pos) ;
+	if (ret > 0)
+	    dst.position (dst.position() + ret) ;
+	return ret ;
+    }
+
+    private int writeBuffer (ByteBuffer src, long pos) throws IOException {
+	int ret ;
+
+	if (!src.isDirect() && !src.hasArray()) {
+	    /*
+	     * Read-only heap buffer.  There is no way to get at the
+	     * backing array so stage it through a direct buffer.
+	     */
+	    ByteBuffer tmp = ByteBuffer.allocateDirect (src.remaining()) ;
+	    tmp.put (src.duplicate()) ;
+	    tmp.flip() ;
+	    ret = fs.write (fd, tmp, 0, tmp.remaining(), pos) ;
+	}
+	else
+	    ret = fs.write (fd, src, src.position(), src.remaining(), pos) ;
+
+	if (ret > 0)
+	    src.position (src.position() + ret) ;
+	return ret ;
+    }
+
+    /**
+     * Reads a sequence of bytes from this channel into the given buffer.
+     *
+     * @see java.nio.channels.FileChannel#read(ByteBuffer)
+     */
+    public synchronized int read (ByteBuffer dst) throws IOException {
+	ensureReadable() ;
+	return readBuffer (dst, -1) ;
+    }
+
+    /**
+     * Reads a sequence of bytes from this channel into a subsequence of
+     * the given buffers.  All the buffers are filled by one native
+     * call that issues the segments concurrently.
+     *
+     * @see java.nio.channels.ScatteringByteChannel#read(ByteBuffer[], int, int)
+     */
+    public synchronized long read (ByteBuffer[] dsts, int offset, int length)
+	throws IOException {
+	if (offset < 0 || length < 0 || offset > dsts.length - length)
+	    throw new IndexOutOfBoundsException() ;
+	ensureReadable() ;
+
+	ByteBuffer[] bufs = subsequence (dsts, offset, length) ;
+	for (ByteBuffer buf : bufs) {
+	    if (buf.isReadOnly())
+		throw new ReadOnlyBufferException() ;
+	}
+	return fs.read (fd, bufs, -1) ;
+    }
+
+    /**
+     * Writes a sequence of bytes to this channel from the given buffer.
+     *
+     * @see java.nio.channels.FileChannel#write(ByteBuffer)
+     */
+    public synchronized int write (ByteBuffer src) throws IOException {
+	ensureWritable() ;
+	return writeBuffer (src, append ? fs.size (fd) : -1) ;
+    }
+
+    /**
+     * Writes a sequence of bytes to this channel from a subsequence of
+     * the given buffers.  All the buffers are written by one native
+     * call that issues the segments concurrently.
+     *
+     * @see java.nio.channels.GatheringByteChannel#write(ByteBuffer[], int, int)
+     */
+    public synchronized long write (ByteBuffer[] srcs, int offset, int length)
+	throws IOException {
+	if (offset < 0 || length < 0 || offset > srcs.length - length)
+	    throw new IndexOutOfBoundsException() ;
+	ensureWritable() ;
+
+	ByteBuffer[] bufs = subsequence (srcs, offset, length) ;
+	ByteBuffer[] staged = null ;
+	for (int i = 0 ; i < bufs.length ; i++) {
+	    if (!bufs[i].isDirect() && !bufs[i].hasArray()) {
+		/*
+		 * Read-only heap buffer.  Stage it through a direct buffer
+		 * and account for it afterwards.
+		 */
+		if (staged == null) {
+		    staged = bufs ;
+		    bufs = bufs.clone() ;
+		}
+		ByteBuffer tmp = ByteBuffer.allocateDirect (bufs[i].remaining()) ;
+		tmp.put (bufs[i].duplicate()) ;
+		tmp.flip() ;
+		bufs[i] = tmp ;
+	    }
+	}
+
+	long ret = fs.write (fd, bufs, append ? fs.size (fd) : -1) ;
+
+	if (staged != null) {
+	    for (int i = 0 ; i < bufs.length ; i++) {
+		if (bufs[i] != staged[i])
+		    staged[i].position (staged[i].position() +
+					bufs[i].position()) ;
+	    }
+	}
+	return ret ;
+    }
+
+    private static ByteBuffer[] subsequence (ByteBuffer[] bufs, int offset,
+					     int length) {
+	if (offset == 0 && length == bufs.length)
+	    return bufs ;
+	return java.util.Arrays.copyOfRange (bufs, offset, offset + length) ;
+    }
+
+    /**
+     * Reads a sequence of bytes from this channel into the given
+     * buffer, starting at the given file position.  The file pointer
+     * is not moved.
+     *
+     * @see java.nio.channels.FileChannel#read(ByteBuffer, long)
+     */
+    public int read (ByteBuffer dst, long position) throws IOException {
+	if (position < 0)
+	    throw new IllegalArgumentException ("Negative position") ;
+	ensureReadable() ;
+	return readBuffer (dst, position) ;
+    }
+
+    /**
+     * Writes a sequence of bytes to this channel from the given buffer,
+     * starting at the given file position.  The file pointer is not
+     * moved.
+     *
+     * @see java.nio.channels.FileChannel#write(ByteBuffer, long)
+     */
+    public int write (ByteBuffer src, long position) throws IOException {
+	if (position < 0)
+	    throw new IllegalArgumentException ("Negative position") ;
+	ensureWritable() ;
+	return writeBuffer (src, position) ;
+    }
+
+    /**
+     * Returns this channel's file position.
+     *
+     * @see java.nio.channels.FileChannel#position()
+     */
+    public synchronized long position() throws IOException {
+	ensureOpen() ;
+	if (append)
+	    return fs.size (fd) ;
+	return fs.seek (fd, FileSystem.SEEK_CUR, 0) ;
+    }
+
+    /**
+     * Sets this channel's file position.
+     *
+     * @see java.nio.channels.FileChannel#position(long)
+     */
+    public synchronized java.nio.channels.FileChannel position (long newPosition)
+	throws IOException {
+	if (newPosition < 0)
+	    throw new IllegalArgumentException ("Negative position") ;
+	ensureOpen() ;
+	fs.seek (fd, FileSystem.SEEK_SET, newPosition) ;
+	return this ;
+    }
+
+    /**
+     * Returns the current size of this channel's file.
+     *
+     * @see java.nio.channels.FileChannel#size()
+     */
+    public long size() throws IOException {
+	ensureOpen() ;
+	return fs.size (fd) ;
+    }
+
+    /**
+     * Truncates this channel's file to the given size.
+     *
+     * @see java.nio.channels.FileChannel#truncate(long)
+     */
+    public synchronized java.nio.channels.FileChannel truncate (long size)
+	throws IOException {
+	if (size < 0)
+	    throw new IllegalArgumentException ("Negative size") ;
+	ensureWritable() ;
+
+	long pos = fs.seek (fd, FileSystem.SEEK_CUR, 0) ;
+	if (size < fs.size (fd))
+	    fs.seteof (fd, size) ;
+	fs.seek (fd, FileSystem.SEEK_SET, Math.min (pos, size)) ;
+	return this ;
+    }
+
+    /**
+     * Forces any updates to this channel's file to be written to the
+     * storage device that contains it.
+     *
+     * @see java.nio.channels.FileChannel#force(boolean)
+     */
+    public void force (boolean metaData) throws IOException {
+	ensureOpen() ;
+	fs.flush (fd) ;
+    }
+
+    /**
+     * Transfers bytes from this channel's file to the given writable
+     * byte channel.  If the target is also a network file channel the
+     * copy is done natively.
+     *
+     * @see java.nio.channels.FileChannel#transferTo(long, long, WritableByteChannel)
+     */
+    public long transferTo (long position, long count,
+			    WritableByteChannel target) throws IOException {
+	long total = 0 ;
+
+	if (position < 0 || count < 0)
+	    throw new IllegalArgumentException() ;
+	ensureReadable() ;
+	if (!target.isOpen())
+	    throw new ClosedChannelException() ;
+
+	long size = fs.size (fd) ;
+	if (position >= size)
+	    return 0 ;
+	count = Math.min (count, size - position) ;
+
+	if (target instanceof FileChannel) {
+	    FileChannel other = (FileChannel) target ;
+	    other.ensureWritable() ;
+	    synchronized (other) {
+		long dstPos = other.position() ;
+		total = fs.transfer (fd, position, count, other.fd, dstPos) ;
+		if (!other.append)
+		    other.position (dstPos + total) ;
+	    }
+	    return total ;
+	}
+
+	ByteBuffer buf = ByteBuffer.allocateDirect
+	    ((int) Math.min (count, TRANSFER_SIZE)) ;
+	while (total < count) {
+	    buf.clear() ;
+	    buf.limit ((int) Math.min (count - total, buf.capacity())) ;
+	    int ret = readBuffer (buf, position + total) ;
+	    if (ret <= 0)
+		break ;
+	    buf.flip() ;
+	    while (buf.hasRemaining()) {
+		if (target.write (buf) == 0)
+		    break ;
+	    }
+	    total += buf.position() ;
+	    if (buf.hasRemaining())
+		break ;
+	}
+	return total ;
+    }
+
+    /**
+     * Transfers bytes into this channel's file from the given readable
+     * byte channel.  If the source is also a network file channel the
+     * copy is done natively.
+     *
+     * @see java.nio.channels.FileChannel#transferFrom(ReadableByteChannel, long, long)
+     */
+    public long transferFrom (ReadableByteChannel src, long position,
+			      long count) throws IOException {
+	long total = 0 ;
+
+	if (position < 0 || count < 0)
+	    throw new IllegalArgumentException() ;
+	ensureWritable() ;
+	if (!src.isOpen())
+	    throw new ClosedChannelException() ;
+
+	if (src instanceof FileChannel) {
+	    FileChannel other = (FileChannel) src ;
+	    other.ensureReadable() ;
+	    synchronized (other) {
+		long srcPos = other.position() ;
+		long avail = Math.max (0, other.size() - srcPos) ;
+		total = fs.transfer (other.fd, srcPos, Math.min (count, avail),
+				     fd, position) ;
+		other.position (srcPos + total) ;
+	    }
+	    return total ;
+	}
+
+	ByteBuffer buf = ByteBuffer.allocateDirect
+	    ((int) Math.min (count, TRANSFER_SIZE)) ;
+	while (total < count) {
+	    buf.clear() ;
+	    buf.limit ((int) Math.min (count - total, buf.capacity())) ;
+	    int ret = src.read (buf) ;
+	    if (ret <= 0)
+		break ;
+	    buf.flip() ;
+	    while (buf.hasRemaining()) {
+		/*
+		 * What was read from the source can not be put back, so a
+		 * write that makes no progress is an error
+		 */
+		if (writeBuffer (buf, position + total + buf.position()) <= 0)
+		    throw new IOException ("Write made no progress at " +
+					   (position + total + buf.position())) ;
+	    }
+	    total += ret ;
+	}
+	return total ;
+    }
+
+    /**
+     * A MappedByteBuffer cannot be backed by the network file system.
+     * Use FileSystem.map, which returns a page cached MappedRegion.
+     *
+     * @see java.nio.channels.FileChannel#map(MapMode, long, long)
+     */
+    public MappedByteBuffer map (MapMode mode, long position, long size)
+	throws IOException {
+	throw new UnsupportedOperationException ("map") ;
+    }
+
+    /**
+     * Byte range locks are not supported by the network file system
+     *
+     * @see java.nio.channels.FileChannel#lock(long, long, boolean)
+     */
+    public FileLock lock (long position, long size, boolean shared)
+	throws IOException {
+	throw new UnsupportedOperationException ("lock") ;
+    }
+
+    /**
+     * Byte range locks are not supported by the network file system
+     *
+     * @see java.nio.channels.FileChannel#tryLock(long, long, boolean)
+     */
+    public FileLock tryLock (long position, long size, boolean shared)
+	throws IOException {
+	throw new UnsupportedOperationException ("tryLock") ;
+    }
+
+    protected void implCloseChannel() throws IOException {
+	if (parent != null)
+	    parent.close() ;
+	else
+	    fs.close (fd) ;
+    }
+}
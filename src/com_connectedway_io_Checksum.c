@@ -0,0 +1,584 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/libc.h"
+
+#include "ofc_jni/com_connectedway_io_Checksum.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHECKSUM_CRC32C_SSE42
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CHECKSUM_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+/*
+ * CRC32C, Castagnoli polynomial, reflected
+ */
+#define CRC32C_POLY 0x82F63B78U
+
+static OFC_UINT32 crc32c_table[8][256] ;
+static OFC_BOOL crc32c_hw = OFC_FALSE ;
+
+static OFC_VOID crc32c_setup (OFC_VOID)
+{
+  OFC_UINT32 crc ;
+  OFC_INT i ;
+  OFC_INT j ;
+
+  for (i = 0 ; i < 256 ; i++)
+    {
+      crc = (OFC_UINT32) i ;
+      for (j = 0 ; j < 8 ; j++)
+	crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0) ;
+      crc32c_table[0][i] = crc ;
+    }
+  for (i = 0 ; i < 256 ; i++)
+    for (j = 1 ; j < 8 ; j++)
+      crc32c_table[j][i] = (crc32c_table[j-1][i] >> 8) ^
+	crc32c_table[0][crc32c_table[j-1][i] & 0xFF] ;
+
+#if defined(CHECKSUM_CRC32C_SSE42)
+  __builtin_cpu_init () ;
+  crc32c_hw = __builtin_cpu_supports ("sse4.2") ? OFC_TRUE : OFC_FALSE ;
+#elif defined(CHECKSUM_CRC32C_ARM)
+  crc32c_hw = OFC_TRUE ;
+#endif
+}
+
+static OFC_UINT64 load64 (const OFC_UINT8 *p)
+{
+  return ((OFC_UINT64) p[0] | ((OFC_UINT64) p[1] << 8) |
+	  ((OFC_UINT64) p[2] << 16) | ((OFC_UINT64) p[3] << 24) |
+	  ((OFC_UINT64) p[4] << 32) | ((OFC_UINT64) p[5] << 40) |
+	  ((OFC_UINT64) p[6] << 48) | ((OFC_UINT64) p[7] << 56)) ;
+}
+
+static OFC_UINT32 load32 (const OFC_UINT8 *p)
+{
+  return ((OFC_UINT32) p[0] | ((OFC_UINT32) p[1] << 8) |
+	  ((OFC_UINT32) p[2] << 16) | ((OFC_UINT32) p[3] << 24)) ;
+}
+
+static OFC_UINT32 crc32c_sw (OFC_UINT32 crc, const OFC_UINT8 *p,
+			     OFC_SIZET len)
+{
+  OFC_UINT32 lo ;
+  OFC_UINT32 hi ;
+
+  while (len >= 8)
+    {
+      lo = load32 (p) ^ crc ;
+      hi = load32 (p + 4) ;
+      crc = crc32c_table[7][lo & 0xFF] ^
+	crc32c_table[6][(lo >> 8) & 0xFF] ^
+	crc32c_table[5][(lo >> 16) & 0xFF] ^
+	crc32c_table[4][lo >> 24] ^
+	crc32c_table[3][hi & 0xFF] ^
+	crc32c_table[2][(hi >> 8) & 0xFF] ^
+	crc32c_table[1][(hi >> 16) & 0xFF] ^
+	crc32c_table[0][hi >> 24] ;
+      p += 8 ;
+      len -= 8 ;
+    }
+  while (len > 0)
+    {
+      crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF] ;
+      len-- ;
+    }
+  return (crc) ;
+}
+
+#if defined(CHECKSUM_CRC32C_SSE42)
+__attribute__ ((target ("sse4.2")))
+static OFC_UINT32 crc32c_accel (OFC_UINT32 crc, const OFC_UINT8 *p,
+				OFC_SIZET len)
+{
+  OFC_UINT64 crc64 ;
+
+  crc64 = crc ;
+  while (len >= 8)
+    {
+      crc64 = _mm_crc32_u64 (crc64, load64 (p)) ;
+      p += 8 ;
+      len -= 8 ;
+    }
+  crc = (OFC_UINT32) crc64 ;
+  while (len > 0)
+    {
+      crc = _mm_crc32_u8 (crc, *p++) ;
+      len-- ;
+    }
+  return (crc) ;
+}
+#elif defined(CHECKSUM_CRC32C_ARM)
+static OFC_UINT32 crc32c_accel (OFC_UINT32 crc, const OFC_UINT8 *p,
+				OFC_SIZET len)
+{
+  while (len >= 8)
+    {
+      crc = __crc32cd (crc, load64 (p)) ;
+      p += 8 ;
+      len -= 8 ;
+    }
+  while (len > 0)
+    {
+      crc = __crc32cb (crc, *p++) ;
+      len-- ;
+    }
+  return (crc) ;
+}
+#endif
+
+static OFC_UINT32 crc32c_update (OFC_UINT32 crc, const OFC_UINT8 *p,
+				 OFC_SIZET len)
+{
+#if defined(CHECKSUM_CRC32C_SSE42) || defined(CHECKSUM_CRC32C_ARM)
+  if (crc32c_hw)
+    return (crc32c_accel (crc, p, len)) ;
+#endif
+  return (crc32c_sw (crc, p, len)) ;
+}
+
+static OFC_UINT32 gf2_times (const OFC_UINT32 *mat, OFC_UINT32 vec)
+{
+  OFC_UINT32 sum ;
+
+  for (sum = 0 ; vec != 0 ; vec >>= 1, mat++)
+    if (vec & 1)
+      sum ^= *mat ;
+  return (sum) ;
+}
+
+static OFC_VOID gf2_square (OFC_UINT32 *square, const OFC_UINT32 *mat)
+{
+  OFC_INT n ;
+
+  for (n = 0 ; n < 32 ; n++)
+    square[n] = gf2_times (mat, mat[n]) ;
+}
+
+/*
+ * Shift crc1 over len2 zero bytes by squaring the one bit shift
+ * operator, as zlib's crc32_combine does, and add crc2
+ */
+OFC_UINT32 checksum_crc32c_combine (OFC_UINT32 crc1, OFC_UINT32 crc2,
+				    OFC_UINT64 len2)
+{
+  OFC_UINT32 even[32] ;
+  OFC_UINT32 odd[32] ;
+  OFC_UINT32 row ;
+  OFC_INT n ;
+
+  if (len2 == 0)
+    return (crc1) ;
+
+  odd[0] = CRC32C_POLY ;
+  row = 1 ;
+  for (n = 1 ; n < 32 ; n++)
+    {
+      odd[n] = row ;
+      row <<= 1 ;
+    }
+  gf2_square (even, odd) ;
+  gf2_square (odd, even) ;
+
+  do
+    {
+      gf2_square (even, odd) ;
+      if (len2 & 1)
+	crc1 = gf2_times (even, crc1) ;
+      len2 >>= 1 ;
+      if (len2 == 0)
+	break ;
+      gf2_square (odd, even) ;
+      if (len2 & 1)
+	crc1 = gf2_times (odd, crc1) ;
+      len2 >>= 1 ;
+    }
+  while (len2 != 0) ;
+
+  return (crc1 ^ crc2) ;
+}
+
+/*
+ * XXH64 with a seed of 0
+ */
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static OFC_UINT64 xxh64_round (OFC_UINT64 acc, OFC_UINT64 input)
+{
+  acc += input * XXH_P2 ;
+  acc = ROTL64 (acc, 31) ;
+  return (acc * XXH_P1) ;
+}
+
+static OFC_UINT64 xxh64_merge (OFC_UINT64 acc, OFC_UINT64 val)
+{
+  acc ^= xxh64_round (0, val) ;
+  return (acc * XXH_P1 + XXH_P4) ;
+}
+
+static OFC_VOID xxh64_init (CHECKSUM_XXH64_STATE *state)
+{
+  state->v[0] = XXH_P1 + XXH_P2 ;
+  state->v[1] = XXH_P2 ;
+  state->v[2] = 0 ;
+  state->v[3] = 0 - XXH_P1 ;
+  state->total = 0 ;
+  state->memsize = 0 ;
+}
+
+/*
+ * The four lanes are independent, so each 32 byte stripe is four
+ * multiplies the CPU can run side by side
+ */
+static OFC_VOID xxh64_stripes (OFC_UINT64 *v, const OFC_UINT8 *p,
+			       OFC_SIZET len)
+{
+  OFC_UINT64 v0 ;
+  OFC_UINT64 v1 ;
+  OFC_UINT64 v2 ;
+  OFC_UINT64 v3 ;
+
+  v0 = v[0] ;
+  v1 = v[1] ;
+  v2 = v[2] ;
+  v3 = v[3] ;
+  while (len >= 32)
+    {
+      v0 = xxh64_round (v0, load64 (p)) ;
+      v1 = xxh64_round (v1, load64 (p + 8)) ;
+      v2 = xxh64_round (v2, load64 (p + 16)) ;
+      v3 = xxh64_round (v3, load64 (p + 24)) ;
+      p += 32 ;
+      len -= 32 ;
+    }
+  v[0] = v0 ;
+  v[1] = v1 ;
+  v[2] = v2 ;
+  v[3] = v3 ;
+}
+
+static OFC_VOID xxh64_update (CHECKSUM_XXH64_STATE *state,
+			      const OFC_UINT8 *p, OFC_SIZET len)
+{
+  OFC_SIZET fill ;
+  OFC_SIZET bulk ;
+
+  state->total += len ;
+  if (state->memsize > 0)
+    {
+      fill = OFC_MIN (len, 32 - state->memsize) ;
+      ofc_memcpy (state->mem + state->memsize, p, fill) ;
+      state->memsize += (OFC_UINT32) fill ;
+      p += fill ;
+      len -= fill ;
+      if (state->memsize < 32)
+	return ;
+      xxh64_stripes (state->v, state->mem, 32) ;
+      state->memsize = 0 ;
+    }
+
+  bulk = len & ~(OFC_SIZET) 31 ;
+  xxh64_stripes (state->v, p, bulk) ;
+  p += bulk ;
+  len -= bulk ;
+
+  if (len > 0)
+    {
+      ofc_memcpy (state->mem, p, len) ;
+      state->memsize = (OFC_UINT32) len ;
+    }
+}
+
+static OFC_UINT64 xxh64_final (CHECKSUM_XXH64_STATE *state)
+{
+  OFC_UINT64 h ;
+  const OFC_UINT8 *p ;
+  const OFC_UINT8 *end ;
+
+  if (state->total >= 32)
+    {
+      h = ROTL64 (state->v[0], 1) + ROTL64 (state->v[1], 7) +
+	ROTL64 (state->v[2], 12) + ROTL64 (state->v[3], 18) ;
+      h = xxh64_merge (h, state->v[0]) ;
+      h = xxh64_merge (h, state->v[1]) ;
+      h = xxh64_merge (h, state->v[2]) ;
+      h = xxh64_merge (h, state->v[3]) ;
+    }
+  else
+    h = XXH_P5 ;
+  h += state->total ;
+
+  p = state->mem ;
+  end = p + state->memsize ;
+  while (p + 8 <= end)
+    {
+      h ^= xxh64_round (0, load64 (p)) ;
+      h = ROTL64 (h, 27) * XXH_P1 + XXH_P4 ;
+      p += 8 ;
+    }
+  if (p + 4 <= end)
+    {
+      h ^= (OFC_UINT64) load32 (p) * XXH_P1 ;
+      h = ROTL64 (h, 23) * XXH_P2 + XXH_P3 ;
+      p += 4 ;
+    }
+  while (p < end)
+    {
+      h ^= (OFC_UINT64) *p * XXH_P5 ;
+      h = ROTL64 (h, 11) * XXH_P1 ;
+      p++ ;
+    }
+
+  h ^= h >> 33 ;
+  h *= XXH_P2 ;
+  h ^= h >> 29 ;
+  h *= XXH_P3 ;
+  h ^= h >> 32 ;
+  return (h) ;
+}
+
+/*
+ * SHA-256, FIPS 180-4
+ */
+static const OFC_UINT32 sha256_k[64] =
+  {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  } ;
+
+#define ROTR32(x, r) (((x) >> (r)) | ((x) << (32 - (r))))
+
+static OFC_VOID sha256_init (CHECKSUM_SHA256_STATE *state)
+{
+  state->h[0] = 0x6a09e667 ;
+  state->h[1] = 0xbb67ae85 ;
+  state->h[2] = 0x3c6ef372 ;
+  state->h[3] = 0xa54ff53a ;
+  state->h[4] = 0x510e527f ;
+  state->h[5] = 0x9b05688c ;
+  state->h[6] = 0x1f83d9ab ;
+  state->h[7] = 0x5be0cd19 ;
+  state->total = 0 ;
+  state->memsize = 0 ;
+}
+
+static OFC_VOID sha256_blocks (OFC_UINT32 *h, const OFC_UINT8 *p,
+			       OFC_SIZET len)
+{
+  OFC_UINT32 w[64] ;
+  OFC_UINT32 a, b, c, d, e, f, g, k ;
+  OFC_UINT32 s0 ;
+  OFC_UINT32 s1 ;
+  OFC_UINT32 t1 ;
+  OFC_UINT32 t2 ;
+  OFC_INT i ;
+
+  while (len >= 64)
+    {
+      for (i = 0 ; i < 16 ; i++)
+	w[i] = ((OFC_UINT32) p[i*4] << 24) | ((OFC_UINT32) p[i*4+1] << 16) |
+	  ((OFC_UINT32) p[i*4+2] << 8) | (OFC_UINT32) p[i*4+3] ;
+      for (i = 16 ; i < 64 ; i++)
+	{
+	  s0 = ROTR32 (w[i-15], 7) ^ ROTR32 (w[i-15], 18) ^ (w[i-15] >> 3) ;
+	  s1 = ROTR32 (w[i-2], 17) ^ ROTR32 (w[i-2], 19) ^ (w[i-2] >> 10) ;
+	  w[i] = w[i-16] + s0 + w[i-7] + s1 ;
+	}
+
+      a = h[0] ; b = h[1] ; c = h[2] ; d = h[3] ;
+      e = h[4] ; f = h[5] ; g = h[6] ; k = h[7] ;
+      for (i = 0 ; i < 64 ; i++)
+	{
+	  s1 = ROTR32 (e, 6) ^ ROTR32 (e, 11) ^ ROTR32 (e, 25) ;
+	  t1 = k + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i] ;
+	  s0 = ROTR32 (a, 2) ^ ROTR32 (a, 13) ^ ROTR32 (a, 22) ;
+	  t2 = s0 + ((a & b) ^ (a & c) ^ (b & c)) ;
+	  k = g ; g = f ; f = e ; e = d + t1 ;
+	  d = c ; c = b ; b = a ; a = t1 + t2 ;
+	}
+      h[0] += a ; h[1] += b ; h[2] += c ; h[3] += d ;
+      h[4] += e ; h[5] += f ; h[6] += g ; h[7] += k ;
+
+      p += 64 ;
+      len -= 64 ;
+    }
+}
+
+static OFC_VOID sha256_update (CHECKSUM_SHA256_STATE *state,
+			       const OFC_UINT8 *p, OFC_SIZET len)
+{
+  OFC_SIZET fill ;
+  OFC_SIZET bulk ;
+
+  state->total += len ;
+  if (state->memsize > 0)
+    {
+      fill = OFC_MIN (len, 64 - state->memsize) ;
+      ofc_memcpy (state->mem + state->memsize, p, fill) ;
+      state->memsize += (OFC_UINT32) fill ;
+      p += fill ;
+      len -= fill ;
+      if (state->memsize < 64)
+	return ;
+      sha256_blocks (state->h, state->mem, 64) ;
+      state->memsize = 0 ;
+    }
+
+  bulk = len & ~(OFC_SIZET) 63 ;
+  sha256_blocks (state->h, p, bulk) ;
+  p += bulk ;
+  len -= bulk ;
+
+  if (len > 0)
+    {
+      ofc_memcpy (state->mem, p, len) ;
+      state->memsize = (OFC_UINT32) len ;
+    }
+}
+
+static OFC_VOID sha256_final (CHECKSUM_SHA256_STATE *state,
+			      OFC_UINT8 *digest)
+{
+  OFC_UINT8 pad[72] ;
+  OFC_UINT64 bits ;
+  OFC_SIZET padlen ;
+  OFC_INT i ;
+
+  bits = state->total * 8 ;
+  padlen = (state->memsize < 56 ? 56 : 120) - state->memsize ;
+  ofc_memset (pad, 0, sizeof (pad)) ;
+  pad[0] = 0x80 ;
+  for (i = 0 ; i < 8 ; i++)
+    pad[padlen + i] = (OFC_UINT8) (bits >> (56 - i * 8)) ;
+  sha256_update (state, pad, padlen + 8) ;
+
+  for (i = 0 ; i < 8 ; i++)
+    {
+      digest[i*4] = (OFC_UINT8) (state->h[i] >> 24) ;
+      digest[i*4+1] = (OFC_UINT8) (state->h[i] >> 16) ;
+      digest[i*4+2] = (OFC_UINT8) (state->h[i] >> 8) ;
+      digest[i*4+3] = (OFC_UINT8) state->h[i] ;
+    }
+}
+
+OFC_VOID checksum_setup (OFC_VOID)
+{
+  crc32c_setup () ;
+}
+
+OFC_SIZET checksum_digest_len (CHECKSUM_ALGORITHM algorithm)
+{
+  OFC_SIZET len ;
+
+  switch (algorithm)
+    {
+    case CHECKSUM_CRC32C:
+      len = 4 ;
+      break ;
+    case CHECKSUM_XXH64:
+      len = 8 ;
+      break ;
+    case CHECKSUM_SHA256:
+      len = 32 ;
+      break ;
+    default:
+      len = 0 ;
+      break ;
+    }
+  return (len) ;
+}
+
+OFC_VOID checksum_init (CHECKSUM_STATE *state, CHECKSUM_ALGORITHM algorithm)
+{
+  state->algorithm = algorithm ;
+  switch (algorithm)
+    {
+    case CHECKSUM_CRC32C:
+      state->u.crc = 0xFFFFFFFF ;
+      break ;
+    case CHECKSUM_XXH64:
+      xxh64_init (&state->u.xxh64) ;
+      break ;
+    case CHECKSUM_SHA256:
+      sha256_init (&state->u.sha256) ;
+      break ;
+    default:
+      break ;
+    }
+}
+
+OFC_VOID checksum_update (CHECKSUM_STATE *state, const OFC_VOID *data,
+			  OFC_SIZET len)
+{
+  switch (state->algorithm)
+    {
+    case CHECKSUM_CRC32C:
+      state->u.crc = crc32c_update (state->u.crc, data, len) ;
+      break ;
+    case CHECKSUM_XXH64:
+      xxh64_update (&state->u.xxh64, data, len) ;
+      break ;
+    case CHECKSUM_SHA256:
+      sha256_update (&state->u.sha256, data, len) ;
+      break ;
+    default:
+      break ;
+    }
+}
+
+OFC_SIZET checksum_final (CHECKSUM_STATE *state, OFC_UINT8 *digest)
+{
+  OFC_UINT64 value ;
+  OFC_SIZET len ;
+  OFC_SIZET i ;
+
+  len = checksum_digest_len (state->algorithm) ;
+  switch (state->algorithm)
+    {
+    case CHECKSUM_CRC32C:
+    case CHECKSUM_XXH64:
+      if (state->algorithm == CHECKSUM_CRC32C)
+	value = state->u.crc ^ 0xFFFFFFFF ;
+      else
+	value = xxh64_final (&state->u.xxh64) ;
+      for (i = 0 ; i < len ; i++)
+	digest[i] = (OFC_UINT8) (value >> ((len - 1 - i) * 8)) ;
+      break ;
+    case CHECKSUM_SHA256:
+      sha256_final (&state->u.sha256, digest) ;
+      break ;
+    default:
+      break ;
+    }
+  return (len) ;
+}
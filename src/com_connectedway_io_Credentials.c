@@ -0,0 +1,793 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+#include <jni.h>
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/heap.h"
+#include "ofc/libc.h"
+#include "ofc/handle.h"
+#include "ofc/lock.h"
+#include "ofc/queue.h"
+#include "ofc/event.h"
+#include "ofc/thread.h"
+#include "ofc/path.h"
+#include "ofc/fstype.h"
+#include "ofc/file.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_Credentials.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
+
+/*
+ * Credential and session registry
+ *
+ * Credentials are kept per server and share.  New or changed
+ * credentials are handed to ofc and queued for a small pool of native
+ * threads that set up the session by looking up the share's root, so
+ * the connect and authentication are done before the first request.
+ *
+ * ofc is handed credentials by path, so each path they were registered
+ * for is remembered along with the generation of the share's
+ * credentials it was handed.  Registering the same credentials again
+ * for a remembered path compares the Java strings with the ones held,
+ * without converting or mapping anything, so authenticating every File
+ * on the hot path costs a lookup.  A path that is not remembered, or
+ * was handed older credentials, is mapped and handed the share's
+ * credentials even when they have not changed.  The paths are cached
+ * direct mapped, so a path that collides with another is only mapped
+ * again.  Which share a path lies on depends on the maps, so the
+ * remembered paths are forgotten whenever a map is added or removed
+ * or the configuration is loaded.
+ */
+#define CRED_SESSION_THREADS 2
+#define CRED_PATH_SLOTS 256
+
+typedef struct _CRED_ENTRY
+{
+  struct _CRED_ENTRY *next ;
+  OFC_LPTSTR server ;
+  OFC_LPTSTR share ;
+  OFC_LPTSTR username ;
+  OFC_LPTSTR workgroup ;
+  OFC_LPTSTR password ;
+  OFC_UINT generation ;
+  jint state ;
+} CRED_ENTRY ;
+
+typedef struct
+{
+  OFC_LPTSTR path ;
+  OFC_UINT32 hash ;
+  CRED_ENTRY *entry ;
+  OFC_UINT generation ;
+} CRED_PATH ;
+
+typedef struct
+{
+  OFC_LPTSTR server ;
+  OFC_LPTSTR share ;
+  OFC_UINT generation ;
+} CRED_REQUEST ;
+
+static OFC_LOCK cred_lock = OFC_NULL ;
+static CRED_ENTRY *cred_entries = OFC_NULL ;
+static OFC_HANDLE cred_queue = OFC_HANDLE_NULL ;
+static OFC_HANDLE cred_event = OFC_HANDLE_NULL ;
+static OFC_UINT cred_generation = 0 ;
+static OFC_UINT cred_maps_generation = 0 ;
+static OFC_UINT64 cred_updates = 0 ;
+static OFC_UINT64 cred_duplicates = 0 ;
+static OFC_UINT64 cred_sessions_up = 0 ;
+static OFC_UINT64 cred_session_failures = 0 ;
+static CRED_PATH cred_paths[CRED_PATH_SLOTS] ;
+
+static OFC_BOOL cred_name_equal (OFC_LPCTSTR a, OFC_LPCTSTR b)
+{
+  OFC_SIZET len ;
+
+  len = ofc_tstrlen (a) ;
+  return (len == ofc_tstrlen (b) && ofc_tstrnicmp (a, b, len) == 0) ;
+}
+
+/*
+ * Compare a Java string with a held one without converting it.  A null
+ * Java string matches an empty one.
+ */
+static OFC_BOOL cred_jstr_equal (JNIEnv *env, jstring jstr, OFC_LPCTSTR tstr)
+{
+  const jchar *jchars ;
+  jsize len ;
+  jsize i ;
+  OFC_BOOL ret ;
+
+  if (jstr == OFC_NULL)
+    return (tstr[0] == TCHAR_EOS) ;
+
+  len = (*env)->GetStringLength (env, jstr) ;
+  if ((OFC_SIZET) len != ofc_tstrlen (tstr))
+    return (OFC_FALSE) ;
+
+  jchars = (*env)->GetStringChars (env, jstr, NULL) ;
+  ret = OFC_TRUE ;
+  for (i = 0 ; i < len && ret ; i++)
+    if ((OFC_TCHAR) jchars[i] != tstr[i])
+      ret = OFC_FALSE ;
+  (*env)->ReleaseStringChars (env, jstr, jchars) ;
+  return (ret) ;
+}
+
+static OFC_LPTSTR cred_jstr2tchar (JNIEnv *env, jstring jstr)
+{
+  OFC_LPTSTR tstr ;
+
+  if (jstr != OFC_NULL)
+    tstr = jstr2tchar (env, jstr) ;
+  else
+    {
+      tstr = ofc_malloc (sizeof (OFC_TCHAR)) ;
+      if (tstr != OFC_NULL)
+	tstr[0] = TCHAR_EOS ;
+    }
+  return (tstr) ;
+}
+
+static OFC_VOID cred_nomem (JNIEnv *env)
+{
+  jclass exCls ;
+
+  exCls = (*env)->FindClass (env, "java/lang/OutOfMemoryError") ;
+  if (exCls != NULL)
+    (*env)->ThrowNew (env, exCls, "Cannot register credentials") ;
+}
+
+static OFC_UINT32 cred_path_hash (JNIEnv *env, jstring jstrPath)
+{
+  const jchar *jchars ;
+  jsize len ;
+  jsize i ;
+  OFC_UINT32 hash ;
+
+  len = (*env)->GetStringLength (env, jstrPath) ;
+  jchars = (*env)->GetStringChars (env, jstrPath, NULL) ;
+  hash = 2166136261U ;
+  for (i = 0 ; i < len ; i++)
+    hash = (hash ^ (OFC_UINT32) jchars[i]) * 16777619U ;
+  (*env)->ReleaseStringChars (env, jstrPath, jchars) ;
+  return (hash) ;
+}
+
+/*
+ * Find the entry a path was handed credentials for.  Called with the
+ * credential lock held.
+ */
+static CRED_PATH *cred_path_find (JNIEnv *env, jstring jstrPath,
+				  OFC_UINT32 hash)
+{
+  CRED_PATH *slot ;
+
+  slot = &cred_paths[hash % CRED_PATH_SLOTS] ;
+  if (slot->entry == OFC_NULL || slot->hash != hash ||
+      !cred_jstr_equal (env, jstrPath, slot->path))
+    slot = OFC_NULL ;
+  return (slot) ;
+}
+
+/*
+ * Remember that a path was handed an entry's credentials.  Called with
+ * the credential lock held.  A path that can not be remembered, or
+ * that was mapped before the maps last changed, is only mapped again
+ * next time.
+ */
+static OFC_VOID cred_path_put (OFC_LPCTSTR path, OFC_UINT32 hash,
+			       CRED_ENTRY *entry, OFC_UINT maps)
+{
+  CRED_PATH *slot ;
+  OFC_LPTSTR copy ;
+
+  if (maps != cred_maps_generation)
+    return ;
+
+  copy = ofc_tstrdup (path) ;
+  if (copy != OFC_NULL)
+    {
+      slot = &cred_paths[hash % CRED_PATH_SLOTS] ;
+      if (slot->path != OFC_NULL)
+	ofc_free (slot->path) ;
+      slot->path = copy ;
+      slot->hash = hash ;
+      slot->entry = entry ;
+      slot->generation = entry->generation ;
+    }
+}
+
+/*
+ * Forget the paths of an entry.  Called with the credential lock held.
+ */
+static OFC_VOID cred_path_drop (CRED_ENTRY *entry)
+{
+  OFC_INT i ;
+
+  for (i = 0 ; i < CRED_PATH_SLOTS ; i++)
+    if (cred_paths[i].entry == entry)
+      {
+	ofc_free (cred_paths[i].path) ;
+	cred_paths[i].path = OFC_NULL ;
+	cred_paths[i].entry = OFC_NULL ;
+      }
+}
+
+/*
+ * Forget every remembered path.  The maps a path was resolved through
+ * have changed, so it may lie on another share now.  A path that is
+ * being mapped meanwhile is not remembered either.
+ */
+OFC_VOID credentials_maps_changed (OFC_VOID)
+{
+  OFC_INT i ;
+
+  /*
+   * Nothing is remembered before the registry is set up
+   */
+  if (cred_lock == OFC_NULL)
+    return ;
+
+  ofc_lock (cred_lock) ;
+  cred_maps_generation++ ;
+  for (i = 0 ; i < CRED_PATH_SLOTS ; i++)
+    if (cred_paths[i].path != OFC_NULL)
+      {
+	ofc_free (cred_paths[i].path) ;
+	cred_paths[i].path = OFC_NULL ;
+	cred_paths[i].entry = OFC_NULL ;
+      }
+  ofc_unlock (cred_lock) ;
+}
+
+/*
+ * Resolve a path through the maps and return the server and share it
+ * lies on.  Returns false for a path that is not on a remote share, or
+ * that there was no memory to resolve.
+ */
+static OFC_BOOL cred_key (OFC_LPCTSTR tstrPath,
+			  OFC_LPTSTR *server, OFC_LPTSTR *share)
+{
+  OFC_LPTSTR tstrResolved ;
+  OFC_FST_TYPE fsType ;
+  OFC_PATH *path ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  *server = OFC_NULL ;
+  *share = OFC_NULL ;
+
+  tstrResolved = OFC_NULL ;
+  ofc_path_mapW (tstrPath, &tstrResolved, &fsType) ;
+
+  if (tstrResolved != OFC_NULL)
+    {
+      if (fsType == OFC_FST_SMB)
+	{
+	  path = ofc_path_createW (tstrResolved) ;
+	  if (path != OFC_NULL &&
+	      ofc_path_server (path) != OFC_NULL &&
+	      ofc_path_share (path) != OFC_NULL)
+	    {
+	      *server = ofc_tstrdup (ofc_path_server (path)) ;
+	      *share = ofc_tstrdup (ofc_path_share (path)) ;
+	      ret = (*server != OFC_NULL && *share != OFC_NULL) ;
+	      if (!ret)
+		{
+		  if (*server != OFC_NULL)
+		    ofc_free (*server) ;
+		  if (*share != OFC_NULL)
+		    ofc_free (*share) ;
+		  *server = OFC_NULL ;
+		  *share = OFC_NULL ;
+		}
+	    }
+	  if (path != OFC_NULL)
+	    ofc_path_delete (path) ;
+	}
+      ofc_free (tstrResolved) ;
+    }
+  return (ret) ;
+}
+
+static OFC_BOOL cred_jkey (JNIEnv *env, jstring jstrPath,
+			   OFC_LPTSTR *server, OFC_LPTSTR *share)
+{
+  OFC_LPTSTR tstrPath ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  tstrPath = jstr2tchar (env, jstrPath) ;
+  if (tstrPath != OFC_NULL)
+    {
+      ret = cred_key (tstrPath, server, share) ;
+      ofc_free (tstrPath) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Find the entry for a share.  Called with the credential lock held.
+ */
+static CRED_ENTRY *cred_find (OFC_LPCTSTR server, OFC_LPCTSTR share)
+{
+  CRED_ENTRY *entry ;
+
+  for (entry = cred_entries ;
+       entry != OFC_NULL &&
+	 !(cred_name_equal (entry->server, server) &&
+	   cred_name_equal (entry->share, share)) ;
+       entry = entry->next) ;
+  return (entry) ;
+}
+
+static OFC_VOID cred_free_secrets (CRED_ENTRY *entry)
+{
+  if (entry->username != OFC_NULL)
+    ofc_free (entry->username) ;
+  if (entry->workgroup != OFC_NULL)
+    ofc_free (entry->workgroup) ;
+  /*
+   * Do not leave the password behind in the heap
+   */
+  if (entry->password != OFC_NULL)
+    {
+      ofc_memset (entry->password, 0,
+		  ofc_tstrlen (entry->password) * sizeof (OFC_TCHAR)) ;
+      ofc_free (entry->password) ;
+    }
+  entry->username = OFC_NULL ;
+  entry->workgroup = OFC_NULL ;
+  entry->password = OFC_NULL ;
+}
+
+/*
+ * Called with the credential lock held
+ */
+static OFC_BOOL cred_same (JNIEnv *env, CRED_ENTRY *entry,
+			   jstring jstrUsername, jstring jstrWorkgroup,
+			   jstring jstrPassword)
+{
+  return (entry->username != OFC_NULL &&
+	  cred_jstr_equal (env, jstrUsername, entry->username) &&
+	  cred_jstr_equal (env, jstrWorkgroup, entry->workgroup) &&
+	  cred_jstr_equal (env, jstrPassword, entry->password)) ;
+}
+
+static OFC_VOID cred_entry_free (CRED_ENTRY *entry)
+{
+  CRED_ENTRY **link ;
+
+  for (link = &cred_entries ; *link != entry ; link = &(*link)->next) ;
+  *link = entry->next ;
+  cred_path_drop (entry) ;
+  cred_free_secrets (entry) ;
+  ofc_free (entry->server) ;
+  ofc_free (entry->share) ;
+  ofc_free (entry) ;
+}
+
+/*
+ * The share root, //server/share, that a session is set up through
+ */
+static OFC_LPTSTR cred_root (OFC_LPCTSTR server, OFC_LPCTSTR share)
+{
+  OFC_LPTSTR root ;
+  OFC_SIZET server_len ;
+  OFC_SIZET share_len ;
+
+  server_len = ofc_tstrlen (server) ;
+  share_len = ofc_tstrlen (share) ;
+  root = ofc_malloc ((server_len + share_len + 4) * sizeof (OFC_TCHAR)) ;
+  if (root == OFC_NULL)
+    return (OFC_NULL) ;
+  root[0] = TCHAR_SLASH ;
+  root[1] = TCHAR_SLASH ;
+  ofc_tstrcpy (root + 2, server) ;
+  root[server_len + 2] = TCHAR_SLASH ;
+  ofc_tstrcpy (root + server_len + 3, share) ;
+  return (root) ;
+}
+
+/*
+ * Set the state of the entry a request was queued for, if it has not
+ * been replaced or removed since
+ */
+static OFC_VOID cred_set_state (CRED_REQUEST *request, jint state)
+{
+  CRED_ENTRY *entry ;
+
+  ofc_lock (cred_lock) ;
+  entry = cred_find (request->server, request->share) ;
+  if (entry != OFC_NULL && entry->generation == request->generation)
+    {
+      entry->state = state ;
+      if (state == com_connectedway_io_Credentials_SESSION_UP)
+	cred_sessions_up++ ;
+      else if (state == com_connectedway_io_Credentials_SESSION_FAILED)
+	cred_session_failures++ ;
+    }
+  ofc_unlock (cred_lock) ;
+}
+
+static OFC_DWORD cred_session_worker (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  CRED_REQUEST *request ;
+  OFC_WIN32_FILE_ATTRIBUTE_DATA fadRoot ;
+  OFC_LPTSTR root ;
+
+  for (;;)
+    {
+      ofc_lock (cred_lock) ;
+      request = ofc_dequeue (cred_queue) ;
+      ofc_unlock (cred_lock) ;
+
+      if (request == OFC_NULL)
+	ofc_event_wait (cred_event) ;
+      else
+	{
+	  cred_set_state (request,
+			  com_connectedway_io_Credentials_SESSION_CONNECTING) ;
+	  root = cred_root (request->server, request->share) ;
+	  if (root != OFC_NULL &&
+	      OfcGetFileAttributesExW (root, OfcGetFileExInfoStandard,
+				       &fadRoot) == OFC_TRUE)
+	    cred_set_state (request,
+			    com_connectedway_io_Credentials_SESSION_UP) ;
+	  else
+	    cred_set_state (request,
+			    com_connectedway_io_Credentials_SESSION_FAILED) ;
+	  if (root != OFC_NULL)
+	    ofc_free (root) ;
+	  ofc_free (request->server) ;
+	  ofc_free (request->share) ;
+	  ofc_free (request) ;
+	}
+    }
+  return (0) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    init
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Credentials_init
+  (JNIEnv *env, jclass clsCredentials)
+{
+  OFC_INT i ;
+  HEAP_ENTER () ;
+
+  if (cred_lock == OFC_NULL)
+    {
+      cred_lock = ofc_lock_init () ;
+      cred_queue = ofc_queue_create () ;
+      cred_event = ofc_event_create (OFC_EVENT_AUTO) ;
+      for (i = 0 ; i < CRED_SESSION_THREADS ; i++)
+	ofc_thread_create (&cred_session_worker, "CredSession", i,
+			   OFC_NULL, OFC_THREAD_DETACH, OFC_HANDLE_NULL) ;
+    }
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    register
+ * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_connectedway_io_Credentials_register
+  (JNIEnv *env, jclass clsCredentials, jstring jstrPath,
+   jstring jstrUsername, jstring jstrWorkgroup, jstring jstrPassword)
+{
+  OFC_LPTSTR server ;
+  OFC_LPTSTR share ;
+  OFC_LPTSTR tstrPath ;
+  OFC_LPTSTR tstrUsername ;
+  OFC_LPTSTR tstrWorkgroup ;
+  OFC_LPTSTR tstrPassword ;
+  CRED_ENTRY *entry ;
+  CRED_PATH *slot ;
+  CRED_REQUEST *request ;
+  OFC_UINT32 hash ;
+  OFC_UINT maps ;
+  OFC_BOOL remote ;
+  OFC_BOOL nomem ;
+  jboolean ret ;
+  HEAP_ENTER () ;
+
+  /*
+   * The hot path.  A path already handed these credentials.
+   */
+  hash = cred_path_hash (env, jstrPath) ;
+  ret = JNI_TRUE ;
+  ofc_lock (cred_lock) ;
+  maps = cred_maps_generation ;
+  slot = cred_path_find (env, jstrPath, hash) ;
+  if (slot != OFC_NULL && slot->generation == slot->entry->generation &&
+      cred_same (env, slot->entry, jstrUsername, jstrWorkgroup,
+		 jstrPassword))
+    {
+      cred_duplicates++ ;
+      ret = JNI_FALSE ;
+    }
+  ofc_unlock (cred_lock) ;
+  if (ret == JNI_FALSE)
+    return (ret) ;
+
+  tstrPath = jstr2tchar (env, jstrPath) ;
+  if (tstrPath == OFC_NULL)
+    {
+      cred_nomem (env) ;
+      return (JNI_FALSE) ;
+    }
+
+  nomem = OFC_FALSE ;
+  request = OFC_NULL ;
+  remote = cred_key (tstrPath, &server, &share) ;
+
+  if (remote)
+    {
+      ofc_lock (cred_lock) ;
+      entry = cred_find (server, share) ;
+      if (entry != OFC_NULL &&
+	  cred_same (env, entry, jstrUsername, jstrWorkgroup, jstrPassword))
+	{
+	  /*
+	   * Held for the share, but this path has not been handed them
+	   */
+	  ofc_path_update_credentialsW (tstrPath, entry->username,
+					entry->password, entry->workgroup) ;
+	  cred_path_put (tstrPath, hash, entry, maps) ;
+	  cred_duplicates++ ;
+	  ret = JNI_FALSE ;
+	}
+      else
+	{
+	  if (entry == OFC_NULL)
+	    {
+	      entry = ofc_malloc (sizeof (CRED_ENTRY)) ;
+	      if (entry != OFC_NULL)
+		{
+		  entry->server = server ;
+		  entry->share = share ;
+		  entry->username = OFC_NULL ;
+		  entry->workgroup = OFC_NULL ;
+		  entry->password = OFC_NULL ;
+		  entry->next = cred_entries ;
+		  cred_entries = entry ;
+		  server = OFC_NULL ;
+		  share = OFC_NULL ;
+		}
+	    }
+	  else
+	    cred_free_secrets (entry) ;
+
+	  if (entry != OFC_NULL)
+	    {
+	      entry->username = cred_jstr2tchar (env, jstrUsername) ;
+	      entry->workgroup = cred_jstr2tchar (env, jstrWorkgroup) ;
+	      entry->password = cred_jstr2tchar (env, jstrPassword) ;
+	      entry->generation = ++cred_generation ;
+	      entry->state = com_connectedway_io_Credentials_SESSION_PENDING ;
+
+	      request = ofc_malloc (sizeof (CRED_REQUEST)) ;
+	      if (request != OFC_NULL)
+		{
+		  request->server = ofc_tstrdup (entry->server) ;
+		  request->share = ofc_tstrdup (entry->share) ;
+		  request->generation = entry->generation ;
+		}
+	    }
+
+	  if (entry == OFC_NULL || entry->username == OFC_NULL ||
+	      entry->workgroup == OFC_NULL || entry->password == OFC_NULL ||
+	      request == OFC_NULL || request->server == OFC_NULL ||
+	      request->share == OFC_NULL)
+	    {
+	      /*
+	       * Nothing is registered that was not registered whole
+	       */
+	      if (entry != OFC_NULL)
+		cred_entry_free (entry) ;
+	      if (request != OFC_NULL)
+		{
+		  if (request->server != OFC_NULL)
+		    ofc_free (request->server) ;
+		  if (request->share != OFC_NULL)
+		    ofc_free (request->share) ;
+		  ofc_free (request) ;
+		  request = OFC_NULL ;
+		}
+	      nomem = OFC_TRUE ;
+	    }
+	  else
+	    {
+	      cred_updates++ ;
+	      ofc_path_update_credentialsW (tstrPath, entry->username,
+					    entry->password, entry->workgroup) ;
+	      cred_path_put (tstrPath, hash, entry, maps) ;
+	      ofc_enqueue (cred_queue, request) ;
+	    }
+	}
+      ofc_unlock (cred_lock) ;
+
+      if (server != OFC_NULL)
+	ofc_free (server) ;
+      if (share != OFC_NULL)
+	ofc_free (share) ;
+      if (request != OFC_NULL)
+	ofc_event_set (cred_event) ;
+    }
+  else
+    {
+      /*
+       * Not on a share, so there is no session to set up.  Hand the
+       * credentials to ofc as they are.
+       */
+      tstrUsername = cred_jstr2tchar (env, jstrUsername) ;
+      tstrWorkgroup = cred_jstr2tchar (env, jstrWorkgroup) ;
+      tstrPassword = cred_jstr2tchar (env, jstrPassword) ;
+
+      if (tstrUsername != OFC_NULL && tstrWorkgroup != OFC_NULL &&
+	  tstrPassword != OFC_NULL)
+	ofc_path_update_credentialsW (tstrPath, tstrUsername, tstrPassword,
+				      tstrWorkgroup) ;
+      else
+	nomem = OFC_TRUE ;
+
+      if (tstrUsername != OFC_NULL)
+	ofc_free (tstrUsername) ;
+      if (tstrWorkgroup != OFC_NULL)
+	ofc_free (tstrWorkgroup) ;
+      if (tstrPassword != OFC_NULL)
+	ofc_free (tstrPassword) ;
+    }
+
+  ofc_free (tstrPath) ;
+  if (nomem)
+    {
+      cred_nomem (env) ;
+      ret = JNI_FALSE ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    unregister
+ * Signature: (Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Credentials_unregister
+  (JNIEnv *env, jclass clsCredentials, jstring jstrPath)
+{
+  OFC_LPTSTR server ;
+  OFC_LPTSTR share ;
+  CRED_ENTRY *entry ;
+  HEAP_ENTER () ;
+
+  if (cred_jkey (env, jstrPath, &server, &share))
+    {
+      ofc_lock (cred_lock) ;
+      entry = cred_find (server, share) ;
+      if (entry != OFC_NULL)
+	cred_entry_free (entry) ;
+      ofc_unlock (cred_lock) ;
+      ofc_free (server) ;
+      ofc_free (share) ;
+    }
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getSessionState
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_Credentials_getSessionState
+  (JNIEnv *env, jclass clsCredentials, jstring jstrPath)
+{
+  OFC_LPTSTR server ;
+  OFC_LPTSTR share ;
+  CRED_ENTRY *entry ;
+  CRED_PATH *slot ;
+  OFC_UINT32 hash ;
+  jint state ;
+  OFC_BOOL found ;
+  HEAP_ENTER () ;
+
+  state = com_connectedway_io_Credentials_SESSION_NONE ;
+
+  hash = cred_path_hash (env, jstrPath) ;
+  ofc_lock (cred_lock) ;
+  slot = cred_path_find (env, jstrPath, hash) ;
+  found = (slot != OFC_NULL) ;
+  if (found)
+    state = slot->entry->state ;
+  ofc_unlock (cred_lock) ;
+
+  if (!found && cred_jkey (env, jstrPath, &server, &share))
+    {
+      ofc_lock (cred_lock) ;
+      entry = cred_find (server, share) ;
+      if (entry != OFC_NULL)
+	state = entry->state ;
+      ofc_unlock (cred_lock) ;
+      ofc_free (server) ;
+      ofc_free (share) ;
+    }
+  return (state) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getUpdates
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getUpdates
+  (JNIEnv *env, jclass clsCredentials)
+{
+  jlong ret ;
+  HEAP_ENTER () ;
+
+  ofc_lock (cred_lock) ;
+  ret = (jlong) cred_updates ;
+  ofc_unlock (cred_lock) ;
+  return (ret) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getDuplicates
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getDuplicates
+  (JNIEnv *env, jclass clsCredentials)
+{
+  jlong ret ;
+  HEAP_ENTER () ;
+
+  ofc_lock (cred_lock) ;
+  ret = (jlong) cred_duplicates ;
+  ofc_unlock (cred_lock) ;
+  return (ret) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getSessionsUp
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getSessionsUp
+  (JNIEnv *env, jclass clsCredentials)
+{
+  jlong ret ;
+  HEAP_ENTER () ;
+
+  ofc_lock (cred_lock) ;
+  ret = (jlong) cred_sessions_up ;
+  ofc_unlock (cred_lock) ;
+  return (ret) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Credentials
+ * Method:    getSessionFailures
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Credentials_getSessionFailures
+  (JNIEnv *env, jclass clsCredentials)
+{
+  jlong ret ;
+  HEAP_ENTER () ;
+
+  ofc_lock (cred_lock) ;
+  ret = (jlong) cred_session_failures ;
+  ofc_unlock (cred_lock) ;
+  return (ret) ;
+}
@@ -25,11 +25,24 @@
 #include "ofc/event.h"
 #include "ofc/waitset.h"
 #include "ofc/process.h"
+#include "ofc/lock.h"
 
 #include "ofc_jni/com_connectedway_io_Utils.h"
 #include "ofc_jni/com_connectedway_io_FileSystem.h"
+#include "ofc_jni/com_connectedway_io_Stats.h"
+#include "ofc_jni/com_connectedway_io_Trace.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
+#include "ofc_jni/com_connectedway_io_Checksum.h"
+#include "ofc_jni/com_connectedway_io_Search.h"
 
+/*
+ * The multi-buffered overlapped engine is the default.  Defining
+ * OFC_JNI_SYNC_IO builds the synchronous one instead, which is mostly
+ * useful to compare the two.
+ */
+#if !defined(OFC_JNI_SYNC_IO)
 #define OVERLAPPED_IO
+#endif
 
 /*
  * Class:     com_connectedway_io_FileSystem
@@ -42,6 +55,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_isRemoteFile
   jboolean ret ;
   OFC_LPTSTR tstrPathName ;
   OFC_FST_TYPE fsType ;
+  HEAP_ENTER () ;
 
   ret = JNI_FALSE ;
   tstrPathName = jstr2tchar (env, jstrPathName) ;
@@ -82,6 +96,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_FileSystem_normalize
   OFC_PATH *path ;
   OFC_SIZET len ;
   OFC_SIZET rem ;
+  HEAP_ENTER () ;
 
   tstrPathName = jstr2tchar (env, jstrPathName) ;
 #if 0
@@ -129,6 +144,7 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_prefixLength
   jint ret ;
   OFC_LPTSTR tstrPathName ;
   OFC_PATH *path ;
+  HEAP_ENTER () ;
 
   /*
    * The prefix is the drive specifier (device), absolute specifier, or 
@@ -193,6 +209,7 @@ Java_com_connectedway_io_FileSystem_resolve__Ljava_lang_String_2Ljava_lang_Strin
   OFC_LPTSTR tstrResolveName ;
   jstring jstrResolveName ;
   OFC_LPTSTR tstrCursor ;
+  HEAP_ENTER () ;
 
   tstrParentName = jstr2tchar (env, jstrParentName) ;
   pathParent = ofc_path_createW (tstrParentName) ;
@@ -230,34 +247,6 @@ Java_com_connectedway_io_FileSystem_resolve__Ljava_lang_String_2Ljava_lang_Strin
   return (jstrResolveName) ;
 }
 
-/*
- * Signature: (Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;
- * Ljava/lang/String)Z
- */
-JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_authenticate
-(JNIEnv *env, jobject objFs, jstring jstrPath, jstring jstrUsername,
- jstring jstrWorkgroup, jstring jstrPassword) 
-{
-  OFC_LPTSTR tstrPath ;
-  OFC_LPTSTR tstrUsername ;
-  OFC_LPTSTR tstrWorkgroup ;
-  OFC_LPTSTR tstrPassword ;
-
-  tstrPath = jstr2tchar (env, jstrPath) ;
-  tstrUsername = jstr2tchar (env, jstrUsername) ;
-  tstrWorkgroup = jstr2tchar (env, jstrWorkgroup) ;
-  tstrPassword = jstr2tchar (env, jstrPassword) ;
-
-  ofc_path_update_credentialsW (tstrPath, tstrUsername, tstrPassword,
-				tstrWorkgroup) ;
-
-  ofc_free (tstrPath) ;
-  ofc_free (tstrUsername) ;
-  ofc_free (tstrWorkgroup) ;
-  ofc_free (tstrPassword) ;
-
-}
-
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    isAbsolute
@@ -279,6 +268,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_isAbsolute
 
   OFC_PATH *path ;
   jboolean ret ;
+  HEAP_ENTER () ;
 
   clsFile = (*env)->FindClass (env, "com/connectedway/io/File") ;
   midGetPath = (*env)->GetMethodID(env, clsFile, "getPath",
@@ -331,6 +321,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_FileSystem_resolve__Lcom_conn
   OFC_PATH *path ;
   OFC_SIZET rem ;
   OFC_SIZET len ;
+  HEAP_ENTER () ;
 
   clsFile = (*env)->FindClass (env, "com/connectedway/io/File") ;
   midGetPath = (*env)->GetMethodID(env, clsFile, "getPath",
@@ -381,6 +372,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_FileSystem_canonicalize
   OFC_LPTSTR tstrResolveName ;
   jstring jstrResolveName ;
   OFC_FST_TYPE fsType ;
+  HEAP_ENTER () ;
 
   tstrPathName = jstr2tchar (env, jstrPathName) ;
 
@@ -479,6 +471,7 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_getBooleanAttributes
 {
   jint booleanAttributes ;
   OFC_LPTSTR tstrPath ;
+  HEAP_ENTER () ;
 
   ofc_thread_set_variable (OfcLastError, 
 			 (OFC_DWORD_PTR) OFC_ERROR_SUCCESS) ;
@@ -488,8 +481,12 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_getBooleanAttributes
   ofc_printf ("%s:%s:%d %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPath) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   booleanAttributes = get_boolean_attributes (tstrPath) ;
 
+  STATS_PATH (STATS_OP_STAT, start, tstrPath, 0) ;
+  TRACE_EXIT () ;
   ofc_free (tstrPath) ;
 
   return (booleanAttributes) ;
@@ -503,6 +500,7 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_getBooleanAttributes
 JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_checkAccess
 (JNIEnv *env, jobject objFs, jobject objFile, jint access) 
 {
+  HEAP_ENTER () ;
 
   /**
    * Right now we don't support reading access writes in the CIFS client
@@ -520,6 +518,8 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_setPermission
 (JNIEnv *env , jobject objFs, jobject objFile, jint perm, 
  jboolean enabled, jboolean owner) 
 {
+  HEAP_ENTER () ;
+
   /*
    * We also don't support setting file permissions after a file has been
    * created.  This will have to be added
@@ -543,6 +543,7 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLastModifiedTime
   OFC_ULONG tv_nsec ;
 
   OFC_WIN32_FILE_ATTRIBUTE_DATA fadFile ;
+  HEAP_ENTER () ;
 
   tv_sec = 0 ;
   tv_nsec = 0 ;
@@ -552,6 +553,8 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLastModifiedTime
   ofc_printf ("%s:%s:%d %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPath) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   if (OfcGetFileAttributesExW (tstrPath, 
 				OfcGetFileExInfoStandard,
 				&fadFile) == OFC_TRUE)
@@ -559,6 +562,8 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLastModifiedTime
       file_time_to_epoch_time (&fadFile.ftLastWriteTime,
 			   &tv_sec, &tv_nsec) ;
     }
+  STATS_PATH (STATS_OP_STAT, start, tstrPath, 0) ;
+  TRACE_EXIT () ;
   ofc_free (tstrPath) ;
 
   modifiedTime = ((jlong) tv_sec * 1000) + ((jlong) tv_nsec / (1000 * 1000)) ;
@@ -579,6 +584,7 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLength
   jlong size ;
 
   OFC_WIN32_FILE_ATTRIBUTE_DATA fadFile ;
+  HEAP_ENTER () ;
 
   size = 0 ;
   tstrPath = file_get_path (env, objFile) ;
@@ -587,6 +593,8 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLength
   ofc_printf ("%s:%s:%d %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPath) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   if (OfcGetFileAttributesExW (tstrPath, 
 				OfcGetFileExInfoStandard,
 				&fadFile) == OFC_TRUE)
@@ -595,6 +603,8 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLength
       size = size << 32 ;
       size = size | fadFile.nFileSizeLow ;
     }
+  STATS_PATH (STATS_OP_STAT, start, tstrPath, 0) ;
+  TRACE_EXIT () ;
   ofc_free (tstrPath) ;
 
   return (size) ;
@@ -614,6 +624,39 @@ void throwio (JNIEnv *env)
     }
 }
 
+/*
+ * Throw an IOException for an error seen on another thread, whose last
+ * error is not ours
+ */
+OFC_VOID throwio_error (JNIEnv *env, OFC_DWORD error)
+{
+  jclass newExcCls ;
+  char code[10] ;
+
+  ofc_snprintf (code, 10, "%d", error) ;
+  newExcCls = (*env)->FindClass(env, "java/io/IOException");
+  if (newExcCls != NULL)
+    {
+      (*env)->ThrowNew(env, newExcCls, code) ;
+      (*env)->DeleteLocalRef (env, newExcCls) ;
+    }
+}
+
+/*
+ * Throw an unchecked exception of the named class
+ */
+static OFC_VOID throw_new (JNIEnv *env, OFC_CCHAR *cls, OFC_CCHAR *msg)
+{
+  jclass newExcCls ;
+
+  newExcCls = (*env)->FindClass(env, cls);
+  if (newExcCls != NULL)
+    {
+      (*env)->ThrowNew(env, newExcCls, msg) ;
+      (*env)->DeleteLocalRef (env, newExcCls) ;
+    }
+}
+
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    createFileExclusively
@@ -627,6 +670,7 @@ Java_com_connectedway_io_FileSystem_createFileExclusively
   OFC_HANDLE hFile ;
   OFC_LPTSTR tstrPath ;
   jboolean ret ;
+  HEAP_ENTER () ;
 
   ret = JNI_FALSE ;
   tstrPath = jstr2tchar (env, strPath) ;
@@ -669,6 +713,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_delete
   OFC_DWORD dwLastError;
   jboolean ret ;
   jint booleanAttributes ;
+  HEAP_ENTER () ;
 
   ret = JNI_FALSE ;
 
@@ -677,6 +722,8 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_delete
   ofc_printf ("%s:%s:%d %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPath) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   booleanAttributes = get_boolean_attributes (tstrPath) ;
 
   if (booleanAttributes & com_connectedway_io_FileSystem_BA_DIRECTORY)
@@ -720,6 +767,8 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_delete
   else
     retDelete = OfcDeleteFileW (tstrPath) ;
 
+  STATS_PATH (STATS_OP_DELETE, start, tstrPath, 0) ;
+  TRACE_EXIT () ;
   ofc_free (tstrPath) ;
 
   if (retDelete == OFC_TRUE)
@@ -728,6 +777,479 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_delete
   return (ret) ;
 }
 
+/*
+ * Head prefetch for maps in thumbnail mode
+ *
+ * When enabled, listing a directory in a map whose thumbnail flag is
+ * set queues every regular file for a read of its first bytes.  A
+ * small pool of native threads fetches the heads into a bounded cache
+ * keyed by path, so that a gallery opening the entry can get its head
+ * with getHead rather than another open and read.
+ *
+ * The lock, queue and event are created by filesystem_init.  The
+ * workers are started when prefetch is enabled and stopped when it is
+ * disabled.  Each set of workers has a generation, and a worker exits
+ * once the generation has moved on, so a set that is being stopped
+ * never picks up work meant for its successor.  Whether a listing
+ * prefetches is decided once, when it is opened, and a find handle
+ * that does is remembered until findClose.
+ */
+#define HEAD_CACHE_BUCKETS 256
+#define HEAD_PREFETCH_THREADS 4
+#define HEAD_PREFETCH_QUEUE_MAX 1024
+
+typedef struct _HEAD_ENTRY
+{
+  struct _HEAD_ENTRY *next ;
+  struct _HEAD_ENTRY *newer ;
+  struct _HEAD_ENTRY *older ;
+  OFC_LPTSTR path ;
+  OFC_FILETIME mtime ;
+  OFC_CHAR *data ;
+  OFC_SIZET len ;
+} HEAD_ENTRY ;
+
+typedef struct
+{
+  OFC_LPTSTR path ;
+  OFC_FILETIME mtime ;
+} HEAD_REQUEST ;
+
+static OFC_LOCK head_lock = OFC_NULL ;
+static HEAD_ENTRY *head_buckets[HEAD_CACHE_BUCKETS] ;
+static HEAD_ENTRY *head_newest = OFC_NULL ;
+static HEAD_ENTRY *head_oldest = OFC_NULL ;
+static OFC_SIZET head_cache_bytes = 0 ;
+static OFC_SIZET head_cache_limit = 0 ;
+static OFC_SIZET head_len = 0 ;
+static OFC_HANDLE head_queue = OFC_HANDLE_NULL ;
+static OFC_INT head_queue_len = 0 ;
+static OFC_HANDLE head_event = OFC_HANDLE_NULL ;
+static OFC_HANDLE head_threads[HEAD_PREFETCH_THREADS] ;
+static OFC_INT head_generation = 0 ;
+static OFC_BOOL head_running = OFC_FALSE ;
+
+typedef struct _HEAD_LIST
+{
+  struct _HEAD_LIST *next ;
+  OFC_HANDLE list_handle ;
+} HEAD_LIST ;
+
+static HEAD_LIST *head_lists = OFC_NULL ;
+
+static OFC_UINT head_hash (OFC_LPCTSTR path)
+{
+  OFC_UINT hash ;
+
+  for (hash = 5381 ; *path != TCHAR_EOS ; path++)
+    hash = (hash * 33) ^ (OFC_UINT) *path ;
+  return (hash % HEAD_CACHE_BUCKETS) ;
+}
+
+/*
+ * Find an entry.  Called with the head lock held.
+ */
+static HEAD_ENTRY *head_find (OFC_LPCTSTR path)
+{
+  HEAD_ENTRY *entry ;
+
+  for (entry = head_buckets[head_hash (path)] ;
+       entry != OFC_NULL && ofc_tstrcmp (entry->path, path) != 0 ;
+       entry = entry->next) ;
+  return (entry) ;
+}
+
+/*
+ * Unlink and free an entry.  Called with the head lock held.
+ */
+static OFC_VOID head_remove (HEAD_ENTRY *entry)
+{
+  HEAD_ENTRY **link ;
+
+  for (link = &head_buckets[head_hash (entry->path)] ;
+       *link != entry ;
+       link = &(*link)->next) ;
+  *link = entry->next ;
+
+  if (entry->newer != OFC_NULL)
+    entry->newer->older = entry->older ;
+  else
+    head_newest = entry->older ;
+  if (entry->older != OFC_NULL)
+    entry->older->newer = entry->newer ;
+  else
+    head_oldest = entry->newer ;
+
+  head_cache_bytes -= entry->len ;
+  ofc_free (entry->path) ;
+  ofc_free (entry->data) ;
+  ofc_free (entry) ;
+}
+
+/*
+ * Add the head of a file to the cache, evicting the oldest heads to
+ * stay within the budget.  Takes ownership of path and data.
+ */
+static OFC_VOID head_insert (OFC_LPTSTR path, OFC_FILETIME *mtime,
+			     OFC_CHAR *data, OFC_SIZET len)
+{
+  HEAD_ENTRY *entry ;
+  OFC_UINT hash ;
+
+  ofc_lock (head_lock) ;
+  entry = head_find (path) ;
+  if (entry != OFC_NULL)
+    head_remove (entry) ;
+
+  while (head_oldest != OFC_NULL && head_cache_bytes + len > head_cache_limit)
+    head_remove (head_oldest) ;
+
+  entry = OFC_NULL ;
+  if (len <= head_cache_limit)
+    entry = ofc_malloc (sizeof (HEAD_ENTRY)) ;
+  if (entry != OFC_NULL)
+    {
+      entry->path = path ;
+      entry->mtime = *mtime ;
+      entry->data = data ;
+      entry->len = len ;
+      hash = head_hash (path) ;
+      entry->next = head_buckets[hash] ;
+      head_buckets[hash] = entry ;
+      entry->older = head_newest ;
+      entry->newer = OFC_NULL ;
+      if (head_newest != OFC_NULL)
+	head_newest->newer = entry ;
+      else
+	head_oldest = entry ;
+      head_newest = entry ;
+      head_cache_bytes += len ;
+    }
+  else
+    {
+      ofc_free (path) ;
+      ofc_free (data) ;
+    }
+  ofc_unlock (head_lock) ;
+}
+
+static OFC_DWORD head_prefetch_worker (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  HEAD_REQUEST *request ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *data ;
+  OFC_SIZET len ;
+  OFC_SIZET nRead ;
+  OFC_INT generation ;
+  OFC_BOOL stop ;
+
+  generation = (OFC_INT) (OFC_DWORD_PTR) context ;
+  for (;;)
+    {
+      ofc_lock (head_lock) ;
+      stop = generation != head_generation ;
+      request = OFC_NULL ;
+      if (!stop)
+	{
+	  request = ofc_dequeue (head_queue) ;
+	  if (request != OFC_NULL)
+	    head_queue_len-- ;
+	}
+      len = head_len ;
+      ofc_unlock (head_lock) ;
+
+      if (stop)
+	{
+	  /*
+	   * Sets of the event may have merged, so wake the next worker
+	   * of this generation in turn
+	   */
+	  ofc_event_set (head_event) ;
+	  break ;
+	}
+
+      if (request == OFC_NULL)
+	ofc_event_wait (head_event) ;
+      else
+	{
+	  hFile = OfcCreateFileW (request->path, OFC_GENERIC_READ,
+				  OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+				  OFC_NULL, OFC_OPEN_EXISTING,
+				  OFC_FILE_ATTRIBUTE_NORMAL, OFC_HANDLE_NULL) ;
+	  if (hFile != OFC_INVALID_HANDLE_VALUE)
+	    {
+	      data = ofc_malloc (len) ;
+	      if (data != OFC_NULL &&
+		  TransferRegion (hFile, OFC_FALSE, data, len, 0, &nRead) ==
+		  OFC_TRUE && nRead > 0)
+		{
+		  head_insert (request->path, &request->mtime, data, nRead) ;
+		  request->path = OFC_NULL ;
+		}
+	      else if (data != OFC_NULL)
+		ofc_free (data) ;
+	      OfcCloseHandle (hFile) ;
+	    }
+	  if (request->path != OFC_NULL)
+	    ofc_free (request->path) ;
+	  ofc_free (request) ;
+	}
+    }
+  return (0) ;
+}
+
+/*
+ * Whether head prefetch is enabled.  head_len is set under the head
+ * lock by setHeadPrefetch while listings run on other threads.
+ */
+static OFC_BOOL head_enabled (OFC_VOID)
+{
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  if (head_lock != OFC_NULL)
+    {
+      ofc_lock (head_lock) ;
+      ret = head_len > 0 ;
+      ofc_unlock (head_lock) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Determine whether a listing of a path should prefetch heads.  It
+ * should if prefetch is enabled and the path is in a map, by prefix or
+ * by destination, that is in thumbnail mode.
+ */
+static OFC_BOOL head_prefetch_wanted (OFC_LPCTSTR path)
+{
+  OFC_FRAMEWORK_MAPS *maps ;
+  OFC_INT i ;
+  OFC_SIZET len ;
+  OFC_BOOL ret ;
+
+  ret = OFC_FALSE ;
+  if (head_enabled ())
+    {
+      maps = ofc_framework_get_maps () ;
+      if (maps != OFC_NULL)
+	{
+	  for (i = 0 ; i < maps->numMaps && !ret ; i++)
+	    {
+	      if (!maps->map[i].thumbnail)
+		continue ;
+	      len = ofc_tstrlen (maps->map[i].prefix) ;
+	      if (ofc_tstrnicmp (path, maps->map[i].prefix, len) == 0 &&
+		  path[len] == TCHAR_COLON)
+		ret = OFC_TRUE ;
+	      else if (maps->map[i].path != OFC_NULL)
+		{
+		  len = ofc_tstrlen (maps->map[i].path) ;
+		  if (len > 0 &&
+		      ofc_tstrnicmp (path, maps->map[i].path, len) == 0)
+		    ret = OFC_TRUE ;
+		}
+	    }
+	}
+      ofc_framework_free_maps (maps) ;
+    }
+  return (ret) ;
+}
+
+/*
+ * Queue a listed entry for head prefetch.  Directories, empty files
+ * and files whose head is already cached at the same modification
+ * time are skipped.
+ */
+static OFC_VOID head_prefetch_queue (JNIEnv *env, jobject objFile,
+				     OFC_WIN32_FIND_DATAW *find_data)
+{
+  HEAD_ENTRY *entry ;
+  HEAD_REQUEST *request ;
+  OFC_LPTSTR path ;
+  OFC_BOOL cached ;
+
+  if (find_data->dwFileAttributes & (OFC_FILE_ATTRIBUTE_DIRECTORY |
+				     OFC_FILE_ATTRIBUTE_BOOKMARK) ||
+      (find_data->nFileSizeHigh == 0 && find_data->nFileSizeLow == 0))
+    return ;
+
+  path = file_get_path (env, objFile) ;
+  if (path == OFC_NULL)
+    return ;
+
+  ofc_lock (head_lock) ;
+  entry = head_find (path) ;
+  cached = entry != OFC_NULL &&
+    entry->mtime.dwLowDateTime == find_data->ftLastWriteTime.dwLowDateTime &&
+    entry->mtime.dwHighDateTime == find_data->ftLastWriteTime.dwHighDateTime ;
+  if (!cached && head_running && head_queue_len < HEAD_PREFETCH_QUEUE_MAX &&
+      (request = ofc_malloc (sizeof (HEAD_REQUEST))) != OFC_NULL)
+    {
+      request->path = path ;
+      request->mtime = find_data->ftLastWriteTime ;
+      ofc_enqueue (head_queue, request) ;
+      head_queue_len++ ;
+      path = OFC_NULL ;
+    }
+  ofc_unlock (head_lock) ;
+
+  if (path == OFC_NULL)
+    ofc_event_set (head_event) ;
+  else
+    file_free_path (path) ;
+}
+
+/*
+ * Remember that a find handle prefetches the heads of what it lists
+ */
+static OFC_VOID head_list_add (OFC_HANDLE list_handle)
+{
+  HEAD_LIST *list ;
+
+  list = ofc_malloc (sizeof (HEAD_LIST)) ;
+  if (list != OFC_NULL)
+    {
+      list->list_handle = list_handle ;
+      ofc_lock (head_lock) ;
+      list->next = head_lists ;
+      head_lists = list ;
+      ofc_unlock (head_lock) ;
+    }
+}
+
+static OFC_BOOL head_list_find (OFC_HANDLE list_handle)
+{
+  HEAD_LIST *list ;
+
+  ofc_lock (head_lock) ;
+  for (list = head_lists ;
+       list != OFC_NULL && list->list_handle != list_handle ;
+       list = list->next) ;
+  ofc_unlock (head_lock) ;
+  return (list != OFC_NULL) ;
+}
+
+static OFC_VOID head_list_remove (OFC_HANDLE list_handle)
+{
+  HEAD_LIST *list ;
+  HEAD_LIST **link ;
+
+  if (head_lock == OFC_NULL)
+    return ;
+
+  ofc_lock (head_lock) ;
+  for (link = &head_lists ;
+       *link != OFC_NULL && (*link)->list_handle != list_handle ;
+       link = &(*link)->next) ;
+  list = *link ;
+  if (list != OFC_NULL)
+    *link = list->next ;
+  ofc_unlock (head_lock) ;
+
+  if (list != OFC_NULL)
+    ofc_free (list) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    setHeadPrefetch
+ * Signature: (IJ)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_setHeadPrefetch
+  (JNIEnv *env, jobject objFs, jint jiHeadLen, jlong jlCacheSize)
+{
+  OFC_HANDLE threads[HEAD_PREFETCH_THREADS] ;
+  HEAD_REQUEST *request ;
+  OFC_BOOL stop ;
+  OFC_INT i ;
+  HEAP_ENTER () ;
+
+  /*
+   * Before Framework.init there is nothing to prefetch with
+   */
+  if (head_lock == OFC_NULL)
+    return ;
+
+  ofc_lock (head_lock) ;
+  head_len = jiHeadLen > 0 ? (OFC_SIZET) jiHeadLen : 0 ;
+  head_cache_limit = jlCacheSize > 0 ? (OFC_SIZET) jlCacheSize : 0 ;
+  while (head_oldest != OFC_NULL && head_cache_bytes > head_cache_limit)
+    head_remove (head_oldest) ;
+
+  stop = head_running && head_len == 0 ;
+  if (stop)
+    {
+      /*
+       * Retire this generation of workers and what was queued for it
+       */
+      head_running = OFC_FALSE ;
+      head_generation++ ;
+      for (i = 0 ; i < HEAD_PREFETCH_THREADS ; i++)
+	{
+	  threads[i] = head_threads[i] ;
+	  head_threads[i] = OFC_HANDLE_NULL ;
+	}
+      while ((request = ofc_dequeue (head_queue)) != OFC_NULL)
+	{
+	  ofc_free (request->path) ;
+	  ofc_free (request) ;
+	}
+      head_queue_len = 0 ;
+    }
+  else if (!head_running && head_len > 0)
+    {
+      head_running = OFC_TRUE ;
+      for (i = 0 ; i < HEAD_PREFETCH_THREADS ; i++)
+	head_threads[i] =
+	  ofc_thread_create (&head_prefetch_worker, "HeadPrefetch", i,
+			     (OFC_VOID *) (OFC_DWORD_PTR) head_generation,
+			     OFC_THREAD_JOIN, OFC_HANDLE_NULL) ;
+    }
+  ofc_unlock (head_lock) ;
+
+  if (stop)
+    {
+      ofc_event_set (head_event) ;
+      for (i = 0 ; i < HEAD_PREFETCH_THREADS ; i++)
+	{
+	  if (threads[i] != OFC_HANDLE_NULL)
+	    ofc_thread_wait (threads[i]) ;
+	}
+    }
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    getHead
+ * Signature: (Lcom/connectedway/io/File;)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_connectedway_io_FileSystem_getHead
+  (JNIEnv *env, jobject objFs, jobject objFile)
+{
+  HEAD_ENTRY *entry ;
+  OFC_LPTSTR path ;
+  jbyteArray arrayB ;
+  HEAP_ENTER () ;
+
+  arrayB = OFC_NULL ;
+  if (head_lock != OFC_NULL)
+    {
+      path = file_get_path (env, objFile) ;
+      ofc_lock (head_lock) ;
+      entry = head_find (path) ;
+      if (entry != OFC_NULL)
+	{
+	  arrayB = (*env)->NewByteArray (env, (jsize) entry->len) ;
+	  (*env)->SetByteArrayRegion (env, arrayB, 0, (jsize) entry->len,
+				      (jbyte *) entry->data) ;
+	}
+      ofc_unlock (head_lock) ;
+      file_free_path (path) ;
+    }
+  return (arrayB) ;
+}
+
 /*
  * Class:     com_connectedway_io_FileSystem
  * Method:    listFiles
@@ -757,6 +1279,8 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_listFiles
   jint booleanAttributes ;
 
   jmethodID midSetAttributes ;
+  OFC_BOOL thumbnail ;
+  HEAP_ENTER () ;
 
   clsOfcFile = (*env)->FindClass (env, "com/connectedway/io/File") ;
 
@@ -772,10 +1296,13 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_listFiles
   ofc_printf ("%s:%s:%d %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPath) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   jarrayFiles = NULL ;
   jint attributes ;
 
   booleanAttributes = get_boolean_attributes (tstrPath) ;
+  thumbnail = head_prefetch_wanted (tstrPath) ;
 
   if (booleanAttributes & com_connectedway_io_FileSystem_BA_DIRECTORY)
     {
@@ -801,7 +1328,6 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_listFiles
 
   find_data = ofc_malloc (sizeof (OFC_WIN32_FIND_DATAW)) ;
   list_handle = OfcFindFirstFileW (tstrPath, find_data, &more) ;
-  ofc_free (tstrPath) ;
         
   jarrayFiles = OFC_NULL ;
 
@@ -904,6 +1430,9 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_listFiles
 		  jlong size = ((jlong) find_data->nFileSizeHigh << 32) | (jlong) find_data->nFileSizeLow ;
 		  (*env)->CallVoidMethod (env, objFile2, midSetLength, size) ;
 
+		  if (thumbnail)
+		    head_prefetch_queue (env, objFile2, find_data) ;
+
 #if 0
 		  jmethodID midSetDate = (*env)->GetMethodID(env, clsOfcFile, 
 							     "setDate",
@@ -930,6 +1459,10 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_listFiles
 
   (*env)->DeleteLocalRef (env, clsOfcFile) ;
 
+  STATS_PATH (STATS_OP_LIST, start, tstrPath, 0) ;
+  TRACE_EXIT () ;
+  ofc_free (tstrPath) ;
+
   return (jarrayFiles) ;
 }
 
@@ -959,6 +1492,7 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_list
 
   jclass clsString ;
   jint booleanAttributes ;
+  HEAP_ENTER () ;
 
   status = OFC_FALSE ;
   hList = ofc_queue_create() ;
@@ -972,6 +1506,8 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_list
   ofc_printf ("%s:%s:%d %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPath) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   jarrayStrings = NULL ;
 
   booleanAttributes = get_boolean_attributes (tstrPath) ;
@@ -999,7 +1535,6 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_list
     }
 
   list_handle = OfcFindFirstFileW (tstrPath, &find_data, &more) ;
-  ofc_free (tstrPath) ;
         
   if (list_handle != OFC_INVALID_HANDLE_VALUE)
     {
@@ -1037,6 +1572,9 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_list
       OfcFindClose (list_handle) ;
     }
 
+  STATS_PATH (STATS_OP_LIST, start, tstrPath, 0) ;
+  ofc_free (tstrPath) ;
+
   clsString = (*env)->FindClass (env, "java/lang/String") ;
   jarrayStrings = (*env)->NewObjectArray (env, depth, clsString, NULL) ;
   (*env)->DeleteLocalRef (env, clsString) ;
@@ -1066,6 +1604,7 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_list
     }
   ofc_queue_destroy (hList) ;
 
+  TRACE_EXIT () ;
   return (jarrayStrings) ;
 }
 
@@ -1081,6 +1620,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_createDirectory
   OFC_LPTSTR tstrPath ;
   jboolean ret ;
   OFC_BOOL dirRet ;
+  HEAP_ENTER () ;
 
   ret = JNI_FALSE ;
   tstrPath = file_get_path (env, objFile) ;
@@ -1111,6 +1651,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_rename
   OFC_LPTSTR tstrTo ;
   jboolean ret ;
   OFC_BOOL moveRet ;
+  HEAP_ENTER () ;
 
   ret = JNI_FALSE ;
   tstrFrom = file_get_path (env, objFrom) ;
@@ -1119,7 +1660,11 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_rename
   ofc_printf ("%s:%s:%d %S %S\n", __FILE__, __func__, __LINE__, 
 	       tstrFrom, tstrTo) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   moveRet = OfcMoveFileW (tstrFrom, tstrTo) ;
+  STATS_PATH (STATS_OP_RENAME, start, tstrFrom, 0) ;
+  TRACE_EXIT () ;
   ofc_free (tstrFrom) ;
   ofc_free (tstrTo) ;
 
@@ -1139,6 +1684,8 @@ JNIEXPORT jboolean JNICALL
 Java_com_connectedway_io_FileSystem_setLastModifiedTime
 (JNIEnv *env, jobject objFs, jobject objFile, jlong modifiedTime) 
 {
+  HEAP_ENTER () ;
+
   /*
    * This is not supported
    */
@@ -1153,6 +1700,7 @@ Java_com_connectedway_io_FileSystem_setLastModifiedTime
 JNIEXPORT jboolean JNICALL Java_com_connectedway_io_FileSystem_setReadOnly
 (JNIEnv *env, jobject objFs, jobject objFile) 
 {
+  HEAP_ENTER () ;
 
   /*
    * This isn't supported either??
@@ -1180,6 +1728,7 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_listRoots
 
   jstring jstrFile ;
   jobject objFile ;
+  HEAP_ENTER () ;
 
   clsOfcFile = (*env)->FindClass (env, "com/connectedway/io/File") ;
   jarrayFiles = (*env)->NewObjectArray (env, 1, clsOfcFile, NULL) ;
@@ -1242,6 +1791,7 @@ JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getSpace
   OFC_DWORD bytesPerSector ;
   OFC_DWORD numberOfFreeClusters ;
   OFC_DWORD totalNumberOfClusters ; 
+  HEAP_ENTER () ;
 
   usage = 0 ;
   tstrPath = file_get_path (env, objFile) ;
@@ -1300,12 +1850,15 @@ JNIEXPORT jobject JNICALL Java_com_connectedway_io_FileSystem_open
   OFC_DWORD dwShare ;
   OFC_DWORD dwCreate ;
   OFC_DWORD dwLastError ;
+  HEAP_ENTER () ;
 
   tstrPathName = jstr2tchar (env, jstrPathName) ;
 #if 0
   ofc_printf ("%s:%s:%d %S %S\n", __FILE__, __func__, __LINE__, 
 	       tstrPathName) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   dwAccess = OFC_GENERIC_READ ;
   dwShare = OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE ;
   dwCreate = OFC_OPEN_EXISTING ;
@@ -1359,9 +1912,12 @@ JNIEXPORT jobject JNICALL Java_com_connectedway_io_FileSystem_open
     }
   else
     {
+      STATS_BIND (hFile, tstrPathName) ;
       objFd = new_fd (env, hFile) ;
     }
 
+  STATS_PATH (STATS_OP_OPEN, start, tstrPathName, 0) ;
+  TRACE_EXIT () ;
   ofc_free (tstrPathName) ;
   return (objFd) ;
 }
@@ -1377,12 +1933,16 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedw
   OFC_HANDLE hFile ;
   jint jiByte ;
   OFC_DWORD nRead ;
+  HEAP_ENTER () ;
+
   /*
    * Read a byte
    */
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   hFile = file_descriptor_get_handle (env, objFd) ;
 
   if (OfcReadFile (hFile, &jiByte, 1, &nRead, OFC_HANDLE_NULL) == 
@@ -1393,6 +1953,9 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedw
 	throwio(env) ;
     }
 
+  STATS_HANDLE (STATS_OP_READ, start, hFile, jiByte == -1 ? 0 : 1) ;
+  TRACE_EXIT () ;
+
   return (jiByte) ;
 }
 
@@ -1412,10 +1975,13 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedw
   jint jiWorkingOffset ;
   OFC_BOOL eof ;
   jint jiLen;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   hFile = file_descriptor_get_handle (env, objFd) ;
   jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
 
@@ -1444,6 +2010,9 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedw
 
   (*env)->ReleaseByteArrayElements (env,arrayB, jbBuffer, 0) ;
 
+  STATS_HANDLE (STATS_OP_READ, start, hFile, jiBytesRead) ;
+  TRACE_EXIT () ;
+
   if (jiBytesRead == 0)
     jiBytesRead = -1 ;
 
@@ -1451,54 +2020,505 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedw
 }
 
 /*
- * Class:     com_connectedway_io_FileSystem
- * Method:    read
- * Signature: (Lcom/connectedway/io/FileDescriptor;[BII)I
+ * Preallocated files
+ *
+ * FileSystem.preallocate sets the end of file of an open handle to the
+ * size the file is expected to reach, so that writes, and overlapped
+ * writes completing out of order in particular, land inside the file
+ * instead of growing it a chunk at a time.  The handle is remembered
+ * along with the end of the data actually written to it, and close
+ * trims the file back to that.
  */
-#if !defined(OVERLAPPED_IO)
-JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2_3BII
-  (JNIEnv *env, jobject objFs, jobject objFd, jbyteArray arrayB, 
-   jint jiOffset, jint jiLen) {
-
+typedef struct _PREALLOC
+{
   OFC_HANDLE hFile ;
-  jint jiBytesRead ;
-  OFC_DWORD nRead ;
-  jbyte *jbBuffer ;
-  OFC_CHAR *lpcBuffer ;
-  OFC_SIZET bsizeBuffer ;
-  jint jiWorkingOffset ;
-  OFC_BOOL eof ;
+  OFC_LARGE_INTEGER size ;
+  OFC_LARGE_INTEGER written ;
+  struct _PREALLOC *next ;
+} PREALLOC ;
 
-#if 0
-  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
-#endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
-  jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
+/*
+ * The lock is created by filesystem_init.  prealloc_count is only
+ * changed under the lock, but is read without it so that writes to
+ * handles that were never preallocated stay lock free.  A stale zero
+ * can only be seen for a handle whose preallocate has not returned, and
+ * a write racing its own preallocate is unordered with it anyway.  A
+ * stale non-zero just takes the lock and finds nothing.
+ */
+static OFC_LOCK prealloc_lock = OFC_NULL ;
+static PREALLOC *prealloc_list = OFC_NULL ;
+static volatile OFC_INT prealloc_count = 0 ;
 
-  jiWorkingOffset = jiOffset ;
-  jiBytesRead = 0 ;
+static OFC_BOOL get_file_pointer (OFC_HANDLE hFile, OFC_LARGE_INTEGER *pos) ;
+static OFC_BOOL set_file_pointer (OFC_HANDLE hFile, OFC_LARGE_INTEGER pos) ;
 
-  for (eof = OFC_FALSE ; !eof && jiLen > 0 ; )
-    {
-      lpcBuffer = (OFC_CHAR *) jbBuffer + jiWorkingOffset ;
-      bsizeBuffer = OFC_MIN(jiLen, OFC_MAX_IO) ;
+/*
+ * Find the entry of a handle.  Called with the lock held.
+ */
+static PREALLOC *prealloc_find (OFC_HANDLE hFile)
+{
+  PREALLOC *prealloc ;
 
-      if (OfcReadFile (hFile, lpcBuffer, (OFC_DWORD) bsizeBuffer, &nRead, 
-			OFC_HANDLE_NULL) == OFC_FALSE)
+  for (prealloc = prealloc_list ;
+       prealloc != OFC_NULL && prealloc->hFile != hFile ;
+       prealloc = prealloc->next) ;
+  return (prealloc) ;
+}
 
-	{
-	  nRead = 0 ;
-	  eof = 1 ;
-	  if (OfcGetLastError() != OFC_ERROR_HANDLE_EOF) 
-	    throwio(env) ;
-	}
-      jiBytesRead += nRead ;
-      jiWorkingOffset += nRead ;
+/*
+ * Note that a write to a handle ended at offset end.  Hardly any handle
+ * is preallocated, so the lock is only taken when one is.
+ */
+static OFC_VOID prealloc_written (OFC_HANDLE hFile, OFC_LARGE_INTEGER end)
+{
+  PREALLOC *prealloc ;
+
+  if (prealloc_count > 0)
+    {
+      ofc_lock (prealloc_lock) ;
+      prealloc = prealloc_find (hFile) ;
+      if (prealloc != OFC_NULL && end > prealloc->written)
+	prealloc->written = end ;
+      ofc_unlock (prealloc_lock) ;
+    }
+}
+
+/*
+ * The same for a write at the file pointer
+ */
+static OFC_VOID prealloc_written_here (OFC_HANDLE hFile)
+{
+  OFC_LARGE_INTEGER pos ;
+
+  if (prealloc_count > 0 && get_file_pointer (hFile, &pos) == OFC_TRUE)
+    prealloc_written (hFile, pos) ;
+}
+
+/*
+ * Forget a handle, returning its entry if it had one
+ */
+static PREALLOC *prealloc_remove (OFC_HANDLE hFile)
+{
+  PREALLOC *prealloc ;
+  PREALLOC **link ;
+
+  prealloc = OFC_NULL ;
+  if (prealloc_count > 0)
+    {
+      ofc_lock (prealloc_lock) ;
+      for (link = &prealloc_list ;
+	   *link != OFC_NULL && (*link)->hFile != hFile ;
+	   link = &(*link)->next) ;
+      if (*link != OFC_NULL)
+	{
+	  prealloc = *link ;
+	  *link = prealloc->next ;
+	  prealloc_count-- ;
+	}
+      ofc_unlock (prealloc_lock) ;
+    }
+  return (prealloc) ;
+}
+
+/*
+ * A pool of worker threads shared by the bulk calls
+ *
+ * readAll, checksum, search and diffTrees split their work into items
+ * numbered from zero.  work_run queues the job, wakes as many pool workers as
+ * the job may use, and works on it itself until no item is left.  It
+ * then takes the job off the queue and waits for the workers still on
+ * an item.  Pool threads are created as they are first needed, up to
+ * WORK_MAX_THREADS, and then stay, so a call creates no thread once
+ * the pool has grown, and the number of threads stays bounded however
+ * many calls run at once.
+ */
+#define WORK_MAX_THREADS 32
+
+typedef struct _WORK_JOB
+{
+  struct _WORK_JOB *next ;
+  WORK_ITEM item ;
+  OFC_VOID *context ;
+  OFC_INT count ;
+  OFC_INT index ;
+  OFC_INT helpers ;		/* Workers the job may still take */
+  OFC_INT active ;		/* Workers on the job, besides the caller */
+  OFC_HANDLE done ;
+} WORK_JOB ;
+
+static OFC_LOCK work_lock = OFC_NULL ;
+static OFC_HANDLE work_event = OFC_HANDLE_NULL ;
+static WORK_JOB *work_jobs = OFC_NULL ;
+static OFC_INT work_threads = 0 ;
+static OFC_INT work_idle = 0 ;
+
+/*
+ * Find a job that wants another worker.  Called with the lock held.
+ */
+static WORK_JOB *work_wanted (OFC_VOID)
+{
+  WORK_JOB *job ;
+
+  for (job = work_jobs ;
+       job != OFC_NULL && (job->helpers == 0 || job->index >= job->count) ;
+       job = job->next) ;
+  return (job) ;
+}
+
+/*
+ * Run items of a job until there are none left
+ */
+static OFC_VOID work_items (WORK_JOB *job)
+{
+  OFC_INT index ;
+
+  for (;;)
+    {
+      ofc_lock (work_lock) ;
+      index = job->index ;
+      if (index < job->count)
+	job->index++ ;
+      ofc_unlock (work_lock) ;
+
+      if (index >= job->count)
+	break ;
+      (*job->item) (job->context, index) ;
+    }
+}
+
+static OFC_DWORD work_worker (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  WORK_JOB *job ;
+
+  ofc_lock (work_lock) ;
+  for (;;)
+    {
+      job = work_wanted () ;
+      if (job == OFC_NULL)
+	{
+	  work_idle++ ;
+	  ofc_unlock (work_lock) ;
+	  ofc_event_wait (work_event) ;
+	  ofc_lock (work_lock) ;
+	  work_idle-- ;
+	}
+      else
+	{
+	  job->helpers-- ;
+	  job->active++ ;
+	  /*
+	   * One wakeup may stand for several wanted workers, so pass it
+	   * on while there is still work to hand out
+	   */
+	  if (work_idle > 0 && work_wanted () != OFC_NULL)
+	    ofc_event_set (work_event) ;
+	  ofc_unlock (work_lock) ;
+
+	  work_items (job) ;
+
+	  ofc_lock (work_lock) ;
+	  job->active-- ;
+	  if (job->active == 0)
+	    ofc_event_set (job->done) ;
+	}
+    }
+  ofc_unlock (work_lock) ;
+  return (0) ;
+}
+
+/*
+ * Call item (context, i) for each i below count, on up to max_threads
+ * threads at once, the calling thread among them.  Returns when every
+ * item has returned.
+ */
+OFC_VOID work_run (WORK_ITEM item, OFC_VOID *context, OFC_INT count,
+		   OFC_INT max_threads)
+{
+  WORK_JOB job ;
+  WORK_JOB **link ;
+  OFC_HANDLE hThread ;
+  OFC_INT spawn ;
+
+  job.next = OFC_NULL ;
+  job.item = item ;
+  job.context = context ;
+  job.count = count ;
+  job.index = 0 ;
+  job.helpers = OFC_MIN (max_threads, count) - 1 ;
+  job.active = 0 ;
+  job.done = OFC_HANDLE_NULL ;
+  if (job.helpers > 0 && work_lock != OFC_NULL)
+    job.done = ofc_event_create (OFC_EVENT_AUTO) ;
+
+  if (job.done == OFC_HANDLE_NULL)
+    {
+      /*
+       * Nothing to share, or no way to wait for it
+       */
+      for (job.index = 0 ; job.index < job.count ; job.index++)
+	(*item) (context, job.index) ;
+      return ;
+    }
+
+  ofc_lock (work_lock) ;
+  for (link = &work_jobs ; *link != OFC_NULL ; link = &(*link)->next) ;
+  *link = &job ;
+
+  spawn = OFC_MIN (job.helpers - work_idle, WORK_MAX_THREADS - work_threads) ;
+  for (; spawn > 0 ; spawn--)
+    {
+      hThread = ofc_thread_create (&work_worker, "Work", work_threads,
+				   OFC_NULL, OFC_THREAD_DETACH,
+				   OFC_HANDLE_NULL) ;
+      if (hThread == OFC_HANDLE_NULL)
+	break ;
+      work_threads++ ;
+    }
+  if (work_idle > 0)
+    ofc_event_set (work_event) ;
+  ofc_unlock (work_lock) ;
+
+  work_items (&job) ;
+
+  /*
+   * No worker picks the job up once it is off the queue.  The done
+   * event may be left over from a worker that finished before another
+   * one joined, so the count is what is waited on.
+   */
+  ofc_lock (work_lock) ;
+  for (link = &work_jobs ; *link != &job ; link = &(*link)->next) ;
+  *link = job.next ;
+  while (job.active > 0)
+    {
+      ofc_unlock (work_lock) ;
+      ofc_event_wait (job.done) ;
+      ofc_lock (work_lock) ;
+    }
+  ofc_unlock (work_lock) ;
+  ofc_event_destroy (job.done) ;
+}
+
+/*
+ * State of the file system calls that is shared between threads.
+ * Created once from Framework.init.
+ */
+OFC_VOID filesystem_init (OFC_VOID)
+{
+  if (work_lock == OFC_NULL)
+    {
+      work_event = ofc_event_create (OFC_EVENT_AUTO) ;
+      work_lock = ofc_lock_init () ;
+
+      head_queue = ofc_queue_create () ;
+      head_event = ofc_event_create (OFC_EVENT_AUTO) ;
+      head_lock = ofc_lock_init () ;
+
+      prealloc_lock = ofc_lock_init () ;
+
+      checksum_setup () ;
+    }
+}
+
+#if !defined(OVERLAPPED_IO)
+/*
+ * Synchronous transfer between a region of native memory and a region
+ * of a file.  This is the non-overlapped counterpart of the buffered
+ * engine.  Each piece is issued at its offset through an overlapped
+ * handle and waited for, so that, like the overlapped engine, it
+ * neither uses nor moves the file pointer.
+ */
+OFC_BOOL TransferRegion(OFC_HANDLE hFile, OFC_BOOL bWrite,
+                        OFC_CHAR *data, OFC_SIZET len,
+                        OFC_LARGE_INTEGER offset,
+                        OFC_SIZET *transferred)
+{
+  OFC_BOOL ret ;
+  OFC_BOOL eof ;
+  OFC_BOOL status ;
+  OFC_DWORD dwLen ;
+  OFC_DWORD nXfer ;
+  OFC_DWORD dwLastError ;
+  OFC_HANDLE hOverlapped ;
+
+  *transferred = 0 ;
+  ret = OFC_TRUE ;
+  dwLastError = OFC_ERROR_SUCCESS ;
+
+  hOverlapped = OfcCreateOverlapped (hFile) ;
+  if (hOverlapped == OFC_HANDLE_NULL)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_FALSE) ;
+    }
+
+  for (eof = OFC_FALSE ; !eof && *transferred < len ; )
+    {
+      dwLen = (OFC_DWORD) OFC_MIN (len - *transferred, OFC_MAX_IO) ;
+      OfcSetOverlappedOffset (hFile, hOverlapped, offset + *transferred) ;
+      if (bWrite)
+	status = OfcWriteFile (hFile, data + *transferred, dwLen, OFC_NULL,
+			       hOverlapped) ;
+      else
+	status = OfcReadFile (hFile, data + *transferred, dwLen, OFC_NULL,
+			      hOverlapped) ;
+      if (status == OFC_FALSE && OfcGetLastError () == OFC_ERROR_IO_PENDING)
+	status = OFC_TRUE ;
+
+      nXfer = 0 ;
+      if (status == OFC_TRUE)
+	status = OfcGetOverlappedResult (hFile, hOverlapped, &nXfer,
+					 OFC_TRUE) ;
+
+      if (status == OFC_FALSE)
+	{
+	  nXfer = 0 ;
+	  eof = OFC_TRUE ;
+	  dwLastError = OfcGetLastError () ;
+	  if (bWrite || dwLastError != OFC_ERROR_HANDLE_EOF)
+	    ret = OFC_FALSE ;
+	}
+      else if (nXfer == 0)
+	eof = OFC_TRUE ;
+      *transferred += nXfer ;
+    }
+
+  OfcDestroyOverlapped (hFile, hOverlapped) ;
+
+  if (bWrite && *transferred > 0)
+    prealloc_written (hFile, offset + *transferred) ;
+
+  if (ret == OFC_FALSE)
+    ofc_thread_set_variable (OfcLastError, (OFC_DWORD_PTR) dwLastError) ;
+
+  return (ret) ;
+}
+
+/*
+ * Synchronous copy of a region of one file to another through a single
+ * native buffer
+ */
+static OFC_BOOL CopyRegion(OFC_HANDLE hSrc, OFC_LARGE_INTEGER src_offset,
+                           OFC_SIZET len, OFC_HANDLE hDst,
+                           OFC_LARGE_INTEGER dst_offset, OFC_SIZET *copied)
+{
+  OFC_BOOL ret ;
+  OFC_CHAR *data ;
+  OFC_SIZET nRead ;
+  OFC_SIZET nWritten ;
+  OFC_SIZET dwLen ;
+
+  ret = OFC_TRUE ;
+  *copied = 0 ;
+  data = ofc_malloc (OFC_MAX_IO) ;
+  if (data == OFC_NULL)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_FALSE) ;
+    }
+
+  while (ret == OFC_TRUE && *copied < len)
+    {
+      dwLen = OFC_MIN (len - *copied, OFC_MAX_IO) ;
+      ret = TransferRegion (hSrc, OFC_FALSE, data, dwLen,
+			    src_offset + *copied, &nRead) ;
+      if (ret == OFC_TRUE && nRead > 0)
+	{
+	  ret = TransferRegion (hDst, OFC_TRUE, data, nRead,
+				dst_offset + *copied, &nWritten) ;
+	  *copied += nWritten ;
+	}
+      if (nRead < dwLen)
+	break ;
+    }
+
+  ofc_free (data) ;
+  return (ret) ;
+}
+
+/*
+ * Synchronous vectored transfer.  The segments are transferred one
+ * after the other against consecutive regions of the file.
+ */
+OFC_BOOL TransferSegments(OFC_HANDLE hFile, OFC_BOOL bWrite,
+                          OFC_IO_SEGMENT *segments, OFC_INT count,
+                          OFC_LARGE_INTEGER offset,
+                          OFC_SIZET *transferred)
+{
+  OFC_BOOL ret ;
+  OFC_INT i ;
+  OFC_SIZET nXfer ;
+
+  ret = OFC_TRUE ;
+  *transferred = 0 ;
+
+  for (i = 0 ; ret == OFC_TRUE && i < count ; i++)
+    {
+      ret = TransferRegion (hFile, bWrite, segments[i].data,
+			    segments[i].len, offset + *transferred, &nXfer) ;
+      *transferred += nXfer ;
+      if (nXfer < segments[i].len)
+	break ;
+    }
+
+  return (ret) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    read
+ * Signature: (Lcom/connectedway/io/FileDescriptor;[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2_3BII
+  (JNIEnv *env, jobject objFs, jobject objFd, jbyteArray arrayB, 
+   jint jiOffset, jint jiLen) {
+
+  OFC_HANDLE hFile ;
+  jint jiBytesRead ;
+  OFC_DWORD nRead ;
+  jbyte *jbBuffer ;
+  OFC_CHAR *lpcBuffer ;
+  OFC_SIZET bsizeBuffer ;
+  jint jiWorkingOffset ;
+  OFC_BOOL eof ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+  jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
+
+  jiWorkingOffset = jiOffset ;
+  jiBytesRead = 0 ;
+
+  for (eof = OFC_FALSE ; !eof && jiLen > 0 ; )
+    {
+      lpcBuffer = (OFC_CHAR *) jbBuffer + jiWorkingOffset ;
+      bsizeBuffer = OFC_MIN(jiLen, OFC_MAX_IO) ;
+
+      if (OfcReadFile (hFile, lpcBuffer, (OFC_DWORD) bsizeBuffer, &nRead, 
+			OFC_HANDLE_NULL) == OFC_FALSE)
+
+	{
+	  nRead = 0 ;
+	  eof = 1 ;
+	  if (OfcGetLastError() != OFC_ERROR_HANDLE_EOF) 
+	    throwio(env) ;
+	}
+      jiBytesRead += nRead ;
+      jiWorkingOffset += nRead ;
       jiLen -= nRead ;
     }
 
   (*env)->ReleaseByteArrayElements (env,arrayB, jbBuffer, 0) ;
 
+  STATS_HANDLE (STATS_OP_READ, start, hFile, jiBytesRead) ;
+  TRACE_EXIT () ;
+
   if (jiBytesRead == 0)
     jiBytesRead = -1 ;
 
@@ -1600,6 +2620,7 @@ AsyncRead(OFC_HANDLE wait_set, OFC_HANDLE read_file,
   /*
    * Issue the read (this will be non blocking)
    */
+  TRACE_SUBMIT(OFC_FALSE, read_file, buffer, buffer->offset, dwLen);
   status = OfcReadFile(read_file, buffer->data, dwLen,
                        OFC_NULL, buffer->readOverlapped);
   /*
@@ -1642,6 +2663,10 @@ AsyncRead(OFC_HANDLE wait_set, OFC_HANDLE read_file,
         }
     }
 
+  if (result != ASYNC_RESULT_PENDING)
+    TRACE_COMPLETE(OFC_FALSE, read_file, buffer, buffer->offset,
+                   result == ASYNC_RESULT_DONE ? dwLen : 0);
+
   return (result);
 }
 
@@ -1721,6 +2746,8 @@ static ASYNC_RESULT AsyncReadResult(OFC_HANDLE wait_set,
        */
       buffer->state = BUFFER_STATE_IDLE;
       ofc_waitset_remove(wait_set, buffer->readOverlapped);
+      TRACE_COMPLETE(OFC_FALSE, read_file, buffer, buffer->offset,
+                     result == ASYNC_RESULT_DONE ? *dwLen : 0);
     }
 
   return (result);
@@ -1742,6 +2769,7 @@ static ASYNC_RESULT AsyncWrite(OFC_HANDLE wait_set, OFC_HANDLE write_file,
   buffer->state = BUFFER_STATE_WRITE;
   ofc_waitset_add(wait_set, (OFC_HANDLE) buffer, buffer->writeOverlapped);
 
+  TRACE_SUBMIT(OFC_TRUE, write_file, buffer, buffer->offset, dwLen);
   status = OfcWriteFile(write_file, buffer->data, dwLen, OFC_NULL,
                         buffer->writeOverlapped);
 
@@ -1760,6 +2788,11 @@ static ASYNC_RESULT AsyncWrite(OFC_HANDLE wait_set, OFC_HANDLE write_file,
           ofc_waitset_remove(wait_set, buffer->writeOverlapped);
         }
     }
+
+  if (result != ASYNC_RESULT_PENDING)
+    TRACE_COMPLETE(OFC_TRUE, write_file, buffer, buffer->offset,
+                   result == ASYNC_RESULT_DONE ? dwLen : 0);
+
   return (result);
 }
 
@@ -1793,21 +2826,75 @@ static ASYNC_RESULT AsyncWriteResult(OFC_HANDLE wait_set,
     {
       buffer->state = BUFFER_STATE_IDLE;
       ofc_waitset_remove(wait_set, buffer->writeOverlapped);
+      TRACE_COMPLETE(OFC_TRUE, write_file, buffer, buffer->offset,
+                     result == ASYNC_RESULT_DONE ? *dwLen : 0);
     }
 
   return (result);
 }
- 
-JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2_3BII
-  (JNIEnv *env, jobject objFs, jobject objFd, jbyteArray arrayB, 
-   jint jiOffset, jint jiLen) {
 
-  OFC_HANDLE hFile ;
-  jint jiBytesRead ;
-  jbyte *jbBuffer ;
-  OFC_BOOL eof ;
+/*
+ * Submit an asynchronous read or write depending on the direction of
+ * the transfer
+ */
+static ASYNC_RESULT AsyncSubmit(OFC_HANDLE wait_set, OFC_HANDLE hFile,
+                                OFC_FILE_BUFFER *buffer, OFC_BOOL bWrite,
+                                OFC_DWORD dwLen)
+{
+  ASYNC_RESULT result;
+
+  if (bWrite)
+    result = AsyncWrite(wait_set, hFile, buffer, dwLen);
+  else
+    result = AsyncRead(wait_set, hFile, buffer, dwLen);
+  return (result);
+}
+
+/*
+ * Multi-buffered vectored transfer between native memory and a region
+ * of a file.
+ *
+ * The segments map onto consecutive bytes of the file starting at
+ * offset.  Each segment is carved into BUFFER_SIZE chunks and up to
+ * NUM_FILE_BUFFERS chunks, from any segment, are kept in flight on one
+ * wait set.  As each chunk completes, the buffer descriptor is reused
+ * for the next chunk.  The memory is used in place so the caller
+ * decides whether it is a pinned java array, a direct ByteBuffer or
+ * something it allocated itself.
+ *
+ * \param hFile
+ * Handle of the file
+ *
+ * \param bWrite
+ * OFC_TRUE to write the memory to the file, OFC_FALSE to read into it
+ *
+ * \param segments
+ * Array of memory segments
+ *
+ * \param count
+ * Number of segments
+ *
+ * \param offset
+ * Offset in the file of the first byte of the first segment
+ *
+ * \param transferred
+ * Returns the number of bytes actually transferred
+ *
+ * \returns
+ * OFC_FALSE if an I/O error other than EOF occurred.  The last error is
+ * left set for the caller.
+ */
+OFC_BOOL TransferSegments(OFC_HANDLE hFile, OFC_BOOL bWrite,
+                          OFC_IO_SEGMENT *segments, OFC_INT count,
+                          OFC_LARGE_INTEGER offset,
+                          OFC_SIZET *transferred)
+{
+  OFC_BOOL ret;
+  OFC_BOOL eof;
+  OFC_DWORD dwLastError;
   OFC_LARGE_INTEGER file_offset;
-  OFC_OFFT buffer_offset;
+  OFC_INT segment;
+  OFC_SIZET segment_offset;
   OFC_INT pending;
   OFC_HANDLE buffer_list;
   OFC_FILE_BUFFER *buffer;
@@ -1816,159 +2903,394 @@ JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedw
   OFC_DWORD dwLen;
   ASYNC_RESULT result;
   OFC_HANDLE hEvent;
-  
-#if 0
-  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
-#endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
-  jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
 
-  jiBytesRead = 0 ;
+  ret = OFC_TRUE;
+  dwLastError = OFC_ERROR_SUCCESS;
+  *transferred = 0;
 
   wait_set = ofc_waitset_create();
   buffer_list = ofc_queue_create();
 
-  file_offset = jiOffset ;
-  buffer_offset = 0;
+  file_offset = offset;
+  segment = 0;
+  segment_offset = 0;
+  while (segment < count && segments[segment].len == 0)
+    segment++;
   eof = OFC_FALSE;
   pending = 0;
-  
-  for (i = 0; i < NUM_FILE_BUFFERS && !eof && buffer_offset < jiLen; i++)
+
+  for (i = 0; i < NUM_FILE_BUFFERS && !eof && segment < count; i++)
     {
-      /*
-       * Get the buffer descriptor and the data buffer
-       */
       buffer = ofc_malloc(sizeof(OFC_FILE_BUFFER));
       if (buffer == OFC_NULL)
         {
-          ofc_log(OFC_LOG_WARN, "test_file: Failed to alloc buffer context\n");
+          ofc_log(OFC_LOG_WARN, "%s: Failed to alloc buffer context\n",
+                  __func__);
           eof = OFC_TRUE;
         }
       else
         {
-          buffer->data = (OFC_CHAR *) jbBuffer + buffer_offset ;
-          buffer->offset = file_offset;
-          buffer->readOverlapped = OfcCreateOverlapped(hFile);
-          if (buffer->readOverlapped == OFC_HANDLE_NULL)
+          buffer->readOverlapped = OFC_HANDLE_NULL;
+          buffer->writeOverlapped = OFC_HANDLE_NULL;
+          if (bWrite)
+            buffer->writeOverlapped = OfcCreateOverlapped(hFile);
+          else
+            buffer->readOverlapped = OfcCreateOverlapped(hFile);
+          if (buffer->readOverlapped == OFC_HANDLE_NULL &&
+              buffer->writeOverlapped == OFC_HANDLE_NULL)
             ofc_process_crash("An Overlapped Handle is NULL");
 
-          /*
-           * Add it to our buffer list
-           */
           ofc_enqueue(buffer_list, buffer);
 
+          dwLen = (OFC_DWORD) OFC_MIN(BUFFER_SIZE,
+                                      segments[segment].len - segment_offset);
+          buffer->data = segments[segment].data + segment_offset;
+          buffer->offset = file_offset;
+
           pending++;
-          dwLen = OFC_MIN(BUFFER_SIZE, jiLen - buffer_offset);
-          result = AsyncRead(wait_set, hFile, buffer, dwLen);
+          result = AsyncSubmit(wait_set, hFile, buffer, bWrite, dwLen);
           if (result != ASYNC_RESULT_PENDING)
             {
-              /*
-               * discount pending and set eof
-               */
+              if (result == ASYNC_RESULT_ERROR)
+                {
+                  dwLastError = OfcGetLastError();
+                  ret = OFC_FALSE;
+                }
               pending--;
-              /*
-               * Set eof either because it really is eof, or we
-               * want to clean up.
-               */
               eof = OFC_TRUE;
             }
-          /*
-           * Prepare for the next buffer
-           */
-          buffer_offset += dwLen;
+
           file_offset += dwLen;
+          segment_offset += dwLen;
+          while (segment < count && segment_offset == segments[segment].len)
+            {
+              segment++;
+              segment_offset = 0;
+            }
         }
     }
 
   /*
-   * Now all our buffers should be busy doing reads.  Keep pumping
-   * more data to read and service writes
+   * Keep every buffer busy until the segments are exhausted, then drain
    */
   while (pending > 0)
     {
-      /*
-       * Wait for some buffer to finish (may be a read if we've
-       * just finished priming, but it may be a write also if
-       * we've been in this loop a bit
-       */
       hEvent = ofc_waitset_wait(wait_set);
+      TRACE_WAKEUP(hEvent);
       if (hEvent != OFC_HANDLE_NULL)
         {
-          /*
-           * We use the app of the event as a pointer to the
-           * buffer descriptor.  Yeah, this isn't really nice but
-           * the alternative is to add a context to each handle.
-           * That may be cleaner, but basically unnecessary.  If
-           * we did this kind of thing a lot, I'm all for a
-           * new property of a handle
-           */
           buffer = (OFC_FILE_BUFFER *) ofc_handle_get_app(hEvent);
 
           if (buffer->state == BUFFER_STATE_READ)
+            result = AsyncReadResult(wait_set, hFile, buffer, &dwLen);
+          else if (buffer->state == BUFFER_STATE_WRITE)
+            result = AsyncWriteResult(wait_set, hFile, buffer, &dwLen);
+          else
+            continue;
+
+          if (result == ASYNC_RESULT_DONE)
             {
-              /*
-               * Read, so let's see the result of the read
-               */
-              result = AsyncReadResult(wait_set, hFile,
-                                       buffer, &dwLen);
-              if (result == ASYNC_RESULT_DONE)
-                {
-                  jiBytesRead += dwLen ;
+              *transferred += dwLen;
 
-                  dwLen = OFC_MIN(BUFFER_SIZE, jiLen - buffer_offset);
-                  if (dwLen > 0)
+              if (!eof && segment < count)
+                {
+                  dwLen = (OFC_DWORD)
+                    OFC_MIN(BUFFER_SIZE,
+                            segments[segment].len - segment_offset);
+                  buffer->data = segments[segment].data + segment_offset;
+                  buffer->offset = file_offset;
+                  result = AsyncSubmit(wait_set, hFile, buffer, bWrite,
+                                       dwLen);
+                  file_offset += dwLen;
+                  segment_offset += dwLen;
+                  while (segment < count &&
+                         segment_offset == segments[segment].len)
                     {
-                      buffer->data = (OFC_CHAR *) jbBuffer + buffer_offset ;
-                      buffer->offset = file_offset;
-                      /*
-                       * And start a read on the next chunk
-                       */
-                      result = AsyncRead(wait_set, hFile,
-                                         buffer, dwLen);
-                      buffer_offset += dwLen;
-                      file_offset += dwLen;
+                      segment++;
+                      segment_offset = 0;
                     }
                 }
+            }
+
+          if (result == ASYNC_RESULT_ERROR && ret == OFC_TRUE)
+            {
+              dwLastError = OfcGetLastError();
+              ret = OFC_FALSE;
+            }
+
+          if (result != ASYNC_RESULT_PENDING)
+            {
+              pending--;
+              eof = OFC_TRUE;
+            }
+        }
+    }
+
+  for (buffer = ofc_dequeue(buffer_list);
+       buffer != OFC_NULL;
+       buffer = ofc_dequeue(buffer_list))
+    {
+      if (buffer->readOverlapped != OFC_HANDLE_NULL)
+        OfcDestroyOverlapped(hFile, buffer->readOverlapped);
+      if (buffer->writeOverlapped != OFC_HANDLE_NULL)
+        OfcDestroyOverlapped(hFile, buffer->writeOverlapped);
+      ofc_free(buffer);
+    }
+  ofc_queue_destroy(buffer_list);
+  ofc_waitset_destroy(wait_set);
+
+  if (bWrite && *transferred > 0)
+    prealloc_written(hFile, offset + *transferred);
+
+  if (ret == OFC_FALSE)
+    ofc_thread_set_variable(OfcLastError, (OFC_DWORD_PTR) dwLastError);
+
+  return (ret);
+}
+
+/*
+ * Multi-buffered transfer between a single region of native memory
+ * and a region of a file
+ */
+OFC_BOOL TransferRegion(OFC_HANDLE hFile, OFC_BOOL bWrite,
+                        OFC_CHAR *data, OFC_SIZET len,
+                        OFC_LARGE_INTEGER offset,
+                        OFC_SIZET *transferred)
+{
+  OFC_IO_SEGMENT segment;
+
+  segment.data = data;
+  segment.len = len;
+  return (TransferSegments(hFile, bWrite, &segment, 1, offset,
+                           transferred));
+}
+
+/*
+ * Copy a region of one file into another without staging it through
+ * the JVM.
+ *
+ * Each buffer ping-pongs between a read on the source and a write of the
+ * same bytes to the destination.  When the write completes the buffer
+ * picks up the next unread chunk of the source.
+ *
+ * \param hSrc
+ * Handle of the file to read from
+ *
+ * \param src_offset
+ * Offset in the source of the first byte to copy
+ *
+ * \param len
+ * Maximum number of bytes to copy
+ *
+ * \param hDst
+ * Handle of the file to write to
+ *
+ * \param dst_offset
+ * Offset in the destination of the first byte
+ *
+ * \param copied
+ * Returns the number of bytes written to the destination
+ *
+ * \returns
+ * OFC_FALSE if an I/O error other than EOF occurred.
+ */
+static OFC_BOOL CopyRegion(OFC_HANDLE hSrc, OFC_LARGE_INTEGER src_offset,
+                           OFC_SIZET len, OFC_HANDLE hDst,
+                           OFC_LARGE_INTEGER dst_offset, OFC_SIZET *copied)
+{
+  OFC_BOOL ret;
+  OFC_BOOL eof;
+  OFC_DWORD dwLastError;
+  OFC_LARGE_INTEGER file_offset;
+  OFC_SIZET remaining;
+  OFC_INT pending;
+  OFC_HANDLE buffer_list;
+  OFC_FILE_BUFFER *buffer;
+  OFC_INT i;
+  OFC_HANDLE wait_set;
+  OFC_DWORD dwLen;
+  ASYNC_RESULT result;
+  OFC_HANDLE hEvent;
+
+  ret = OFC_TRUE;
+  dwLastError = OFC_ERROR_SUCCESS;
+  *copied = 0;
+
+  wait_set = ofc_waitset_create();
+  buffer_list = ofc_queue_create();
+
+  file_offset = src_offset;
+  remaining = len;
+  eof = OFC_FALSE;
+  pending = 0;
 
+  for (i = 0; i < NUM_FILE_BUFFERS && !eof && remaining > 0; i++)
+    {
+      buffer = ofc_malloc(sizeof(OFC_FILE_BUFFER));
+      if (buffer == OFC_NULL)
+        {
+          ofc_log(OFC_LOG_WARN, "%s: Failed to alloc buffer context\n",
+                  __func__);
+          eof = OFC_TRUE;
+        }
+      else
+        {
+          buffer->data = ofc_malloc(BUFFER_SIZE);
+          if (buffer->data == OFC_NULL)
+            {
+              ofc_log(OFC_LOG_WARN, "%s: Failed to alloc buffer\n",
+                      __func__);
+              ofc_free(buffer);
+              eof = OFC_TRUE;
+            }
+          else
+            {
+              buffer->offset = file_offset;
+              buffer->readOverlapped = OfcCreateOverlapped(hSrc);
+              buffer->writeOverlapped = OfcCreateOverlapped(hDst);
+              if (buffer->readOverlapped == OFC_HANDLE_NULL ||
+                  buffer->writeOverlapped == OFC_HANDLE_NULL)
+                ofc_process_crash("An Overlapped Handle is NULL");
+
+              ofc_enqueue(buffer_list, buffer);
+
+              pending++;
+              dwLen = (OFC_DWORD) OFC_MIN(BUFFER_SIZE, remaining);
+              result = AsyncRead(wait_set, hSrc, buffer, dwLen);
               if (result != ASYNC_RESULT_PENDING)
                 {
+                  if (result == ASYNC_RESULT_ERROR)
+                    {
+                      dwLastError = OfcGetLastError();
+                      ret = OFC_FALSE;
+                    }
                   pending--;
                   eof = OFC_TRUE;
                 }
+              remaining -= dwLen;
+              file_offset += dwLen;
+            }
+        }
+    }
+
+  while (pending > 0)
+    {
+      hEvent = ofc_waitset_wait(wait_set);
+      TRACE_WAKEUP(hEvent);
+      if (hEvent != OFC_HANDLE_NULL)
+        {
+          buffer = (OFC_FILE_BUFFER *) ofc_handle_get_app(hEvent);
+
+          if (buffer->state == BUFFER_STATE_READ)
+            {
+              result = AsyncReadResult(wait_set, hSrc, buffer, &dwLen);
+              if (result == ASYNC_RESULT_DONE)
+                {
+                  /*
+                   * Write what we got to the same relative offset in the
+                   * destination
+                   */
+                  buffer->offset = dst_offset +
+                    (buffer->offset - src_offset);
+                  result = AsyncWrite(wait_set, hDst, buffer, dwLen);
+                }
+            }
+          else if (buffer->state == BUFFER_STATE_WRITE)
+            {
+              result = AsyncWriteResult(wait_set, hDst, buffer, &dwLen);
+              if (result == ASYNC_RESULT_DONE)
+                {
+                  *copied += dwLen;
+                  if (!eof && remaining > 0)
+                    {
+                      dwLen = (OFC_DWORD) OFC_MIN(BUFFER_SIZE, remaining);
+                      buffer->offset = file_offset;
+                      result = AsyncRead(wait_set, hSrc, buffer, dwLen);
+                      remaining -= dwLen;
+                      file_offset += dwLen;
+                    }
+                }
+            }
+          else
+            continue;
+
+          if (result == ASYNC_RESULT_ERROR && ret == OFC_TRUE)
+            {
+              dwLastError = OfcGetLastError();
+              ret = OFC_FALSE;
+            }
+
+          if (result != ASYNC_RESULT_PENDING)
+            {
+              pending--;
+              eof = OFC_TRUE;
             }
         }
     }
 
-  /*
-   * The pending count is zero so we've gotten completions
-   * either due to errors or eof on all of our outstanding
-   * reads and writes.
-   */
   for (buffer = ofc_dequeue(buffer_list);
        buffer != OFC_NULL;
        buffer = ofc_dequeue(buffer_list))
     {
-      /*
-       * Destroy the overlapped I/O handle for each buffer
-       */
-      OfcDestroyOverlapped(hFile, buffer->readOverlapped);
-      /*
-       * Free the buffer descriptor
-       */
+      OfcDestroyOverlapped(hSrc, buffer->readOverlapped);
+      OfcDestroyOverlapped(hDst, buffer->writeOverlapped);
+      ofc_free(buffer->data);
       ofc_free(buffer);
     }
-  /*
-   * Destroy the buffer list
-   */
   ofc_queue_destroy(buffer_list);
+  ofc_waitset_destroy(wait_set);
+
+  if (*copied > 0)
+    prealloc_written(hDst, dst_offset + *copied);
+
+  if (ret == OFC_FALSE)
+    ofc_thread_set_variable(OfcLastError, (OFC_DWORD_PTR) dwLastError);
+
+  return (ret);
+}
+ 
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2_3BII
+  (JNIEnv *env, jobject objFs, jobject objFd, jbyteArray arrayB, 
+   jint jiOffset, jint jiLen) {
+
+  OFC_HANDLE hFile ;
+  jint jiBytesRead ;
+  jbyte *jbBuffer ;
+  OFC_SIZET nRead ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_BOOL status ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+  jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
+
   /*
-   * And destroy the wait list
+   * The engine transfers at an explicit offset, so read from the file
+   * pointer and move it past what was read
    */
-  ofc_waitset_destroy(wait_set);
-  
+  nRead = 0 ;
+  status = get_file_pointer (hFile, &pos) ;
+  if (status == OFC_TRUE && jiLen > 0)
+    status = TransferRegion (hFile, OFC_FALSE,
+			     (OFC_CHAR *) jbBuffer + jiOffset, jiLen,
+			     pos, &nRead) ;
+  if (status == OFC_TRUE && nRead > 0)
+    status = set_file_pointer (hFile, pos + nRead) ;
+  jiBytesRead = (jint) nRead ;
+
   (*env)->ReleaseByteArrayElements (env,arrayB, jbBuffer, 0) ;
 
-  if (jiBytesRead == 0)
+  STATS_HANDLE (STATS_OP_READ, start, hFile, jiBytesRead) ;
+  TRACE_EXIT () ;
+
+  if (status == OFC_FALSE)
+    throwio (env) ;
+  else if (jiBytesRead == 0 && jiLen > 0)
     jiBytesRead = -1 ;
 
   return (jiBytesRead) ;
@@ -1984,12 +3306,16 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
 (JNIEnv *env, jobject objFs, jobject objFd, jint iByte) {
   OFC_HANDLE hFile ;
   OFC_DWORD nWritten ;
+  HEAP_ENTER () ;
+
   /*
    * Read a byte
    */
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   hFile = file_descriptor_get_handle (env,objFd) ;
 
   if (OfcWriteFile (hFile, &iByte, 1, &nWritten, OFC_HANDLE_NULL) == 
@@ -1998,6 +3324,10 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
       throwio(env) ;
     }
 
+  prealloc_written_here (hFile) ;
+
+  STATS_HANDLE (STATS_OP_WRITE, start, hFile, 1) ;
+  TRACE_EXIT () ;
 }
 
 /*
@@ -2016,10 +3346,13 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
   jint jiBytesWritten ;
   OFC_BOOL eof ;
   jint jiLen;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   hFile = file_descriptor_get_handle (env, objFd) ;
   jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
 
@@ -2045,6 +3378,9 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
       jiLen -= nWritten ;
     }
   (*env)->ReleaseByteArrayElements (env, arrayB, jbBuffer, 0) ;
+  prealloc_written_here (hFile) ;
+  STATS_HANDLE (STATS_OP_WRITE, start, hFile, jiBytesWritten) ;
+  TRACE_EXIT () ;
 }
 
 /*
@@ -2064,10 +3400,13 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
   jint jiWorkingOffset ;
   jint jiBytesWritten ;
   OFC_BOOL eof ;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   hFile = file_descriptor_get_handle (env, objFd) ;
   jbBuffer = (*env)->GetByteArrayElements (env, jarrayByte, NULL) ;
 
@@ -2092,6 +3431,9 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
       jiLen -= nWritten ;
     }
   (*env)->ReleaseByteArrayElements (env, jarrayByte, jbBuffer, 0) ;
+  prealloc_written_here (hFile) ;
+  STATS_HANDLE (STATS_OP_WRITE, start, hFile, jiBytesWritten) ;
+  TRACE_EXIT () ;
 }
 #else
 JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connectedway_io_FileDescriptor_2_3BII
@@ -2099,366 +3441,2271 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connected
  jint jiOffset, jint jiLen) {
 
   OFC_HANDLE hFile ;
-  jint jiBytesWritten ;
   jbyte *jbBuffer ;
-  OFC_BOOL eof ;
-  OFC_LARGE_INTEGER file_offset;
-  OFC_OFFT buffer_offset;
-  OFC_INT pending;
-  OFC_HANDLE buffer_list;
-  OFC_FILE_BUFFER *buffer;
-  OFC_INT i;
-  OFC_HANDLE wait_set;
-  OFC_DWORD dwLen;
-  ASYNC_RESULT result;
-  OFC_HANDLE hEvent;
+  OFC_SIZET nWritten ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_BOOL status ;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
   hFile = file_descriptor_get_handle (env, objFd) ;
   jbBuffer = (*env)->GetByteArrayElements (env, arrayB, NULL) ;
 
-  jiBytesWritten = 0 ;
+  /*
+   * Write at the file pointer and move it past what was written
+   */
+  nWritten = 0 ;
+  status = get_file_pointer (hFile, &pos) ;
+  if (status == OFC_TRUE && jiLen > 0)
+    status = TransferRegion (hFile, OFC_TRUE,
+			     (OFC_CHAR *) jbBuffer + jiOffset, jiLen,
+			     pos, &nWritten) ;
+  if (status == OFC_TRUE && nWritten > 0)
+    status = set_file_pointer (hFile, pos + nWritten) ;
 
-  wait_set = ofc_waitset_create();
-  buffer_list = ofc_queue_create();
+  (*env)->ReleaseByteArrayElements (env,arrayB, jbBuffer, JNI_ABORT) ;
 
-  file_offset = jiOffset;
-  buffer_offset = 0;
-  eof = OFC_FALSE;
-  pending = 0;
-      
-  for (i = 0; i < NUM_FILE_BUFFERS && !eof && buffer_offset < jiLen; i++)
-    {
-      /*
-       * Get the buffer descriptor and the data buffer
-       */
-      buffer = ofc_malloc(sizeof(OFC_FILE_BUFFER));
-      if (buffer == OFC_NULL)
-        {
-          ofc_log(OFC_LOG_WARN, "test_file: Failed to alloc buffer context\n");
-          eof = OFC_TRUE;
-        }
-      else
-        {
-          buffer->data = (OFC_CHAR *) jbBuffer + buffer_offset;
-          buffer->offset = file_offset;
+  STATS_HANDLE (STATS_OP_WRITE, start, hFile, nWritten) ;
+  TRACE_EXIT () ;
 
-          buffer->writeOverlapped = OfcCreateOverlapped(hFile);
-          if (buffer->writeOverlapped == OFC_HANDLE_NULL)
-            ofc_process_crash("An Overlapped Handle is NULL");
+  if (status == OFC_FALSE || nWritten != (OFC_SIZET) jiLen)
+    throwio(env) ;
+}
+#endif
 
-          /*
-           * Add it to our buffer list
-           */
-          ofc_enqueue(buffer_list, buffer);
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    seteof
+ * Signature: (Lcom/connectedway/io/FileDescriptor;J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_seteof
+  (JNIEnv *env, jobject objFs, jobject objFd, jlong jlPos) 
+{
+  OFC_HANDLE hFile ;
+  OFC_LONG lPos ;
+  OFC_DWORD dwLastError ;
+  OFC_BOOL bStatus ;
+  OFC_LONG lLow ;
+  OFC_LONG lHigh ;
+  PREALLOC *prealloc ;
+  HEAP_ENTER () ;
 
-          pending++;
-          dwLen = OFC_MIN(BUFFER_SIZE, jiLen - buffer_offset);
-          result = AsyncWrite(wait_set, hFile, buffer, dwLen);
-          if (result != ASYNC_RESULT_PENDING)
-            {
-              /*
-               * discount pending and set eof
-               */
-              pending--;
-              /*
-               * Set eof either because it really is eof, or we
-               * want to clean up.
-               */
-              eof = OFC_TRUE;
-            }
-          /*
-           * Prepare for the next buffer
-           */
-          buffer_offset += dwLen;
-          file_offset += dwLen;
-        }
-    }
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  hFile = file_descriptor_get_handle (env, objFd) ;
 
-  /*
-   * Now all our buffers should be busy doing writes.  Keep writing
-   */
-  while (pending > 0)
+  lLow = (OFC_LONG) jlPos & 0xFFFFFFFF ;
+  lHigh = (OFC_LONG) (jlPos >> 32) & 0xFFFFFFFF ;
+
+  lPos = OfcSetFilePointer (hFile, lLow, &lHigh, OFC_FILE_BEGIN) ;
+  dwLastError = OfcGetLastError () ;
+
+  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+      dwLastError != OFC_ERROR_SUCCESS)
     {
-      /*
-       * Wait for some buffer to finish (may be a read if we've
-       * just finished priming, but it may be a write also if
-       * we've been in this loop a bit
-       */
-      hEvent = ofc_waitset_wait(wait_set);
-      if (hEvent != OFC_HANDLE_NULL)
-        {
-          /*
-           * We use the app of the event as a pointer to the
-           * buffer descriptor.  Yeah, this isn't really nice but
-           * the alternative is to add a context to each handle.
-           * That may be cleaner, but basically unnecessary.  If
-           * we did this kind of thing a lot, I'm all for a
-           * new property of a handle
-           */
-          buffer = (OFC_FILE_BUFFER *) ofc_handle_get_app(hEvent);
+      throwio(env) ;
+    }
+  else
+    {
+      bStatus = OfcSetEndOfFile (hFile) ;
+      if (bStatus != OFC_TRUE)
+	{
+	  throwio(env) ;
+	}
+      else
+	{
+	  /*
+	   * An explicit length overrides a preallocation
+	   */
+	  prealloc = prealloc_remove (hFile) ;
+	  if (prealloc != OFC_NULL)
+	    ofc_free (prealloc) ;
+	}
+    }
 
-          if (buffer->state == BUFFER_STATE_WRITE)
-            {
-              /*
-               * Write, so let's see the result of the write
-               */
-              result = AsyncWriteResult(wait_set, hFile,
-                                        buffer, &dwLen);
-              if (result == ASYNC_RESULT_DONE)
-                {
-                  jiBytesWritten += dwLen;
+}
 
-                  dwLen = OFC_MIN(BUFFER_SIZE, jiLen - buffer_offset);
-                  if (dwLen > 0)
-                    {
-                      buffer->data = (OFC_CHAR *) jbBuffer + buffer_offset;
-                      buffer->offset = file_offset;
-                      
-                      result = AsyncWrite(wait_set, hFile,
-                                          buffer, dwLen);
-                      buffer_offset += dwLen;
-                      file_offset += dwLen;
-                    }
-                }
-              if (result != ASYNC_RESULT_PENDING)
-                {
-                  pending--;
-                  eof = OFC_TRUE;
-                }
-            }
-        }
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    preallocate
+ * Signature: (Lcom/connectedway/io/FileDescriptor;J)V
+ *
+ * Extend the file to the size it is expected to reach.  A file that is
+ * already at least that long is left alone.  The file pointer does not
+ * move.
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_preallocate
+  (JNIEnv *env, jobject objFs, jobject objFd, jlong jlSize)
+{
+  OFC_HANDLE hFile ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_LARGE_INTEGER eof ;
+  OFC_LONG lPos ;
+  OFC_LONG lHigh ;
+  OFC_DWORD dwLastError ;
+  OFC_BOOL bStatus ;
+  PREALLOC *prealloc ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  bStatus = get_file_pointer (hFile, &pos) ;
+  if (bStatus == OFC_TRUE)
+    {
+      lHigh = 0 ;
+      lPos = OfcSetFilePointer (hFile, 0, &lHigh, OFC_FILE_END) ;
+      if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+	  OfcGetLastError () != OFC_ERROR_SUCCESS)
+	bStatus = OFC_FALSE ;
+      else
+	eof = ((OFC_LARGE_INTEGER) lHigh << 32) | (OFC_ULONG) lPos ;
+
+      if (bStatus == OFC_TRUE && jlSize > eof)
+	{
+	  bStatus = set_file_pointer (hFile, jlSize) ;
+	  if (bStatus == OFC_TRUE)
+	    bStatus = OfcSetEndOfFile (hFile) ;
+	  if (bStatus == OFC_TRUE)
+	    {
+	      /*
+	       * Whatever is in the file already counts as written
+	       */
+	      ofc_lock (prealloc_lock) ;
+	      prealloc = prealloc_find (hFile) ;
+	      if (prealloc == OFC_NULL)
+		{
+		  prealloc = ofc_malloc (sizeof (PREALLOC)) ;
+		  if (prealloc != OFC_NULL)
+		    {
+		      prealloc->hFile = hFile ;
+		      prealloc->written = eof ;
+		      prealloc->next = prealloc_list ;
+		      prealloc_list = prealloc ;
+		      prealloc_count++ ;
+		    }
+		}
+	      if (prealloc != OFC_NULL)
+		prealloc->size = jlSize ;
+	      ofc_unlock (prealloc_lock) ;
+	      if (prealloc == OFC_NULL)
+		{
+		  ofc_thread_set_variable (OfcLastError,
+					   (OFC_DWORD_PTR)
+					   OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+		  bStatus = OFC_FALSE ;
+		}
+	    }
+	}
+
+      dwLastError = OfcGetLastError () ;
+      if (set_file_pointer (hFile, pos) == OFC_FALSE && bStatus == OFC_TRUE)
+	{
+	  bStatus = OFC_FALSE ;
+	  dwLastError = OfcGetLastError () ;
+	}
+      if (bStatus == OFC_FALSE)
+	throwio_error (env, dwLastError) ;
+    }
+  else
+    throwio (env) ;
+}
+	
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    skip
+ * Signature: (Lcom/connectedway/io/FileDescriptor;J)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_skip
+  (JNIEnv *env, jobject objFs, jobject objFd, jlong jlPos)
+{
+  OFC_HANDLE hFile ;
+  OFC_LONG lPos ;
+  OFC_DWORD dwLastError ;
+  OFC_LONG lLow ;
+  OFC_LONG lHigh ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  lLow = (OFC_LONG) jlPos & 0xFFFFFFFF ;
+  lHigh = (OFC_LONG) (jlPos >> 32) & 0xFFFFFFFF ;
+
+  lPos = OfcSetFilePointer (hFile, lLow, &lHigh, OFC_FILE_CURRENT) ;
+  dwLastError = OfcGetLastError () ;
+
+  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+      dwLastError != OFC_ERROR_SUCCESS)
+    {
+      jlPos = 0 ;
+      throwio(env) ;
+    }
+  else
+    {
+      jlPos = ((jlong) lHigh) << 32 | lPos  ;
+    }
+
+  STATS_HANDLE (STATS_OP_SEEK, start, hFile, 0) ;
+  TRACE_EXIT () ;
+
+  return (jlPos) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    flush
+
+ * Signature: (Lcom/connectedway/io/FileDescriptor;)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_flush
+  (JNIEnv *env, jobject objFs, jobject objFd)
+{
+  OFC_HANDLE hFile ;
+  OFC_BOOL bStatus ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+  bStatus = OfcFlushFileBuffers (hFile) ;
+  if (bStatus != OFC_TRUE)
+    {
+      throwio(env) ;
+    }
+  STATS_HANDLE (STATS_OP_FLUSH, start, hFile, 0) ;
+  TRACE_EXIT () ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    available
+ * Signature: (Lcom/connectedway/io/FileDescriptor;)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_available
+  (JNIEnv *env, jobject objFs, jobject objFd)
+{
+  HEAP_ENTER () ;
+
+  /*
+   * We have no way of testing whether we'd block so always return 0.
+   */
+  return 0 ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    close
+ * Signature: (Lcom/connectedway/io/FileDescriptor;)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_close
+  (JNIEnv *env, jobject objFs, jobject objFd)
+{
+  OFC_HANDLE hFile ;
+  OFC_BOOL bStatus ;
+  OFC_BOOL bTrim ;
+  OFC_DWORD dwLastError ;
+  PREALLOC *prealloc ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  /*
+   * Give back what was preallocated and never written
+   */
+  bTrim = OFC_TRUE ;
+  dwLastError = OFC_ERROR_SUCCESS ;
+  prealloc = prealloc_remove (hFile) ;
+  if (prealloc != OFC_NULL)
+    {
+      if (prealloc->written < prealloc->size)
+	{
+	  bTrim = set_file_pointer (hFile, prealloc->written) ;
+	  if (bTrim == OFC_TRUE)
+	    bTrim = OfcSetEndOfFile (hFile) ;
+	  if (bTrim != OFC_TRUE)
+	    dwLastError = OfcGetLastError () ;
+	}
+      ofc_free (prealloc) ;
+    }
+
+  bStatus = OfcCloseHandle (hFile) ;
+  if (bStatus != OFC_TRUE)
+    {
+      throwio(env) ;
+    }
+  else if (bTrim != OFC_TRUE)
+    {
+      throwio_error (env, dwLastError) ;
+    }
+  STATS_HANDLE (STATS_OP_CLOSE, start, hFile, 0) ;
+  TRACE_EXIT () ;
+  STATS_UNBIND (hFile) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    seek
+ * Signature: (Lcom/connectedway/io/FileDescriptor;IJ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_seek
+  (JNIEnv *env, jobject objFs, jobject objFd, jint jiMode, jlong jlPos)
+{
+  OFC_HANDLE hFile ;
+  OFC_LONG lPos ;
+  OFC_DWORD dwLastError ;
+  OFC_LONG lLow ;
+  OFC_LONG lHigh ;
+  OFC_DWORD dwMode ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  lLow = (OFC_LONG) jlPos & 0xFFFFFFFF ;
+  lHigh = (OFC_LONG) (jlPos >> 32) & 0xFFFFFFFF ;
+
+  if (jiMode == com_connectedway_io_FileSystem_SEEK_SET)
+    dwMode = OFC_FILE_BEGIN ;
+  else if (jiMode == com_connectedway_io_FileSystem_SEEK_CUR)
+    dwMode = OFC_FILE_CURRENT ;
+  else if (jiMode == com_connectedway_io_FileSystem_SEEK_END)
+    dwMode = OFC_FILE_END ;
+  else
+    dwMode = OFC_FILE_BEGIN ;
+
+  lPos = OfcSetFilePointer (hFile, lLow, &lHigh, dwMode) ;
+  dwLastError = OfcGetLastError () ;
+
+  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+      dwLastError != OFC_ERROR_SUCCESS)
+    {
+      jlPos = 0 ;
+      throwio(env) ;
+    }
+  else
+    {
+      jlPos = ((jlong) lHigh) << 32 | lPos  ;
+    }
+
+  STATS_HANDLE (STATS_OP_SEEK, start, hFile, 0) ;
+  TRACE_EXIT () ;
+
+  return (jlPos) ;
+}
+
+/*
+ * Return the file pointer of an open file
+ */
+static OFC_BOOL get_file_pointer (OFC_HANDLE hFile, OFC_LARGE_INTEGER *pos)
+{
+  OFC_LONG lPos ;
+  OFC_LONG lHigh ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  lHigh = 0 ;
+  lPos = OfcSetFilePointer (hFile, 0, &lHigh, OFC_FILE_CURRENT) ;
+  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+      OfcGetLastError () != OFC_ERROR_SUCCESS)
+    ret = OFC_FALSE ;
+  else
+    *pos = ((OFC_LARGE_INTEGER) lHigh << 32) | (OFC_ULONG) lPos ;
+  return (ret) ;
+}
+
+/*
+ * Set the file pointer of an open file
+ */
+static OFC_BOOL set_file_pointer (OFC_HANDLE hFile, OFC_LARGE_INTEGER pos)
+{
+  OFC_LONG lPos ;
+  OFC_LONG lHigh ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  lHigh = (OFC_LONG) ((pos >> 32) & 0xFFFFFFFF) ;
+  lPos = OfcSetFilePointer (hFile, (OFC_LONG) (pos & 0xFFFFFFFF), &lHigh,
+			    OFC_FILE_BEGIN) ;
+  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+      OfcGetLastError () != OFC_ERROR_SUCCESS)
+    ret = OFC_FALSE ;
+  return (ret) ;
+}
+
+/*
+ * Get the native memory behind a ByteBuffer
+ *
+ * Direct buffers are used in place.  Heap buffers are staged through a
+ * native bounce buffer of just the region being transferred so that a
+ * java array is never pinned across an I/O.  The caller must release
+ * the region with bytebuffer_release_data.  Returns OFC_NULL if there
+ * is no memory for the bounce buffer.
+ */
+static OFC_CHAR *bytebuffer_get_data (JNIEnv *env, jobject objBuffer,
+				      jint off, jint len, OFC_BOOL bWrite,
+				      OFC_CHAR **bounce)
+{
+  OFC_CHAR *data ;
+  jclass clsByteBuffer ;
+  jmethodID midArray ;
+  jmethodID midArrayOffset ;
+  jbyteArray arrayB ;
+  jint jiArrayOffset ;
+
+  *bounce = OFC_NULL ;
+  data = (OFC_CHAR *) (*env)->GetDirectBufferAddress (env, objBuffer) ;
+  if (data != OFC_NULL)
+    data += off ;
+  else
+    {
+      *bounce = ofc_malloc (len > 0 ? len : 1) ;
+      data = *bounce ;
+      if (data != OFC_NULL && bWrite && len > 0)
+	{
+	  clsByteBuffer = (*env)->FindClass (env, "java/nio/ByteBuffer") ;
+	  midArray = (*env)->GetMethodID (env, clsByteBuffer, "array", "()[B") ;
+	  midArrayOffset = (*env)->GetMethodID (env, clsByteBuffer,
+						"arrayOffset", "()I") ;
+	  (*env)->DeleteLocalRef (env, clsByteBuffer) ;
+
+	  arrayB = (*env)->CallObjectMethod (env, objBuffer, midArray) ;
+	  jiArrayOffset = (*env)->CallIntMethod (env, objBuffer,
+						 midArrayOffset) ;
+	  (*env)->GetByteArrayRegion (env, arrayB, jiArrayOffset + off, len,
+				      (jbyte *) data) ;
+	  (*env)->DeleteLocalRef (env, arrayB) ;
+	}
+    }
+  return (data) ;
+}
+
+/*
+ * Release the memory obtained from bytebuffer_get_data.  For reads into
+ * a heap buffer, the count bytes actually read are copied back.
+ */
+static OFC_VOID bytebuffer_release_data (JNIEnv *env, jobject objBuffer,
+					 jint off, jint count,
+					 OFC_CHAR *bounce)
+{
+  jclass clsByteBuffer ;
+  jmethodID midArray ;
+  jmethodID midArrayOffset ;
+  jbyteArray arrayB ;
+  jint jiArrayOffset ;
+
+  if (bounce != OFC_NULL)
+    {
+      if (count > 0)
+	{
+	  clsByteBuffer = (*env)->FindClass (env, "java/nio/ByteBuffer") ;
+	  midArray = (*env)->GetMethodID (env, clsByteBuffer, "array", "()[B") ;
+	  midArrayOffset = (*env)->GetMethodID (env, clsByteBuffer,
+						"arrayOffset", "()I") ;
+	  (*env)->DeleteLocalRef (env, clsByteBuffer) ;
+
+	  arrayB = (*env)->CallObjectMethod (env, objBuffer, midArray) ;
+	  jiArrayOffset = (*env)->CallIntMethod (env, objBuffer,
+						 midArrayOffset) ;
+	  (*env)->SetByteArrayRegion (env, arrayB, jiArrayOffset + off, count,
+				      (jbyte *) bounce) ;
+	  (*env)->DeleteLocalRef (env, arrayB) ;
+	}
+      ofc_free (bounce) ;
+    }
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    read
+ * Signature: (Lcom/connectedway/io/FileDescriptor;Ljava/nio/ByteBuffer;IIJ)I
+ *
+ * Read into a ByteBuffer at a file position.  A negative position reads
+ * at the file pointer and advances it.
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2Ljava_nio_ByteBuffer_2IIJ
+(JNIEnv *env, jobject objFs, jobject objFd, jobject objBuffer,
+ jint jiOffset, jint jiLen, jlong jlPos)
+{
+  OFC_HANDLE hFile ;
+  OFC_CHAR *data ;
+  OFC_CHAR *bounce ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_SIZET nRead ;
+  OFC_BOOL status ;
+  jint jiBytesRead ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  status = OFC_TRUE ;
+  pos = jlPos ;
+  if (jlPos < 0)
+    status = get_file_pointer (hFile, &pos) ;
+
+  nRead = 0 ;
+  if (status == OFC_TRUE && jiLen > 0)
+    {
+      data = bytebuffer_get_data (env, objBuffer, jiOffset, jiLen,
+				  OFC_FALSE, &bounce) ;
+      if (data == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	  status = OFC_FALSE ;
+	}
+      else
+	{
+	  status = TransferRegion (hFile, OFC_FALSE, data, jiLen, pos,
+				   &nRead) ;
+	  bytebuffer_release_data (env, objBuffer, jiOffset, (jint) nRead,
+				   bounce) ;
+	}
+    }
+
+  if (status == OFC_TRUE && jlPos < 0)
+    status = set_file_pointer (hFile, pos + nRead) ;
+
+  STATS_HANDLE (STATS_OP_READ, start, hFile, nRead) ;
+  TRACE_EXIT () ;
+  jiBytesRead = (jint) nRead ;
+  if (status == OFC_FALSE)
+    throwio (env) ;
+  else if (jiBytesRead == 0 && jiLen > 0)
+    jiBytesRead = -1 ;
+
+  return (jiBytesRead) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    write
+ * Signature: (Lcom/connectedway/io/FileDescriptor;Ljava/nio/ByteBuffer;IIJ)I
+ *
+ * Write from a ByteBuffer at a file position.  A negative position
+ * writes at the file pointer and advances it.
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connectedway_io_FileDescriptor_2Ljava_nio_ByteBuffer_2IIJ
+(JNIEnv *env, jobject objFs, jobject objFd, jobject objBuffer,
+ jint jiOffset, jint jiLen, jlong jlPos)
+{
+  OFC_HANDLE hFile ;
+  OFC_CHAR *data ;
+  OFC_CHAR *bounce ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_SIZET nWritten ;
+  OFC_BOOL status ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  status = OFC_TRUE ;
+  pos = jlPos ;
+  if (jlPos < 0)
+    status = get_file_pointer (hFile, &pos) ;
+
+  nWritten = 0 ;
+  if (status == OFC_TRUE && jiLen > 0)
+    {
+      data = bytebuffer_get_data (env, objBuffer, jiOffset, jiLen,
+				  OFC_TRUE, &bounce) ;
+      if (data == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	  status = OFC_FALSE ;
+	}
+      else
+	{
+	  status = TransferRegion (hFile, OFC_TRUE, data, jiLen, pos,
+				   &nWritten) ;
+	  bytebuffer_release_data (env, objBuffer, jiOffset, 0, bounce) ;
+	}
+    }
+
+  if (status == OFC_TRUE && jlPos < 0)
+    status = set_file_pointer (hFile, pos + nWritten) ;
+
+  STATS_HANDLE (STATS_OP_WRITE, start, hFile, nWritten) ;
+  TRACE_EXIT () ;
+
+  if (status == OFC_FALSE)
+    throwio (env) ;
+
+  return ((jint) nWritten) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    size
+ * Signature: (Lcom/connectedway/io/FileDescriptor;)J
+ *
+ * Return the size of an open file without disturbing its file pointer
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_size
+  (JNIEnv *env, jobject objFs, jobject objFd)
+{
+  OFC_HANDLE hFile ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_LONG lPos ;
+  OFC_LONG lHigh ;
+  jlong jlSize ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  hFile = file_descriptor_get_handle (env, objFd) ;
+
+  jlSize = 0 ;
+  if (get_file_pointer (hFile, &pos) == OFC_FALSE)
+    throwio (env) ;
+  else
+    {
+      lHigh = 0 ;
+      lPos = OfcSetFilePointer (hFile, 0, &lHigh, OFC_FILE_END) ;
+      if (lPos == OFC_INVALID_SET_FILE_POINTER &&
+	  OfcGetLastError () != OFC_ERROR_SUCCESS)
+	throwio (env) ;
+      else
+	{
+	  jlSize = ((jlong) lHigh << 32) | (OFC_ULONG) lPos ;
+	  if (set_file_pointer (hFile, pos) == OFC_FALSE)
+	    throwio (env) ;
+	}
+    }
+
+  return (jlSize) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    transfer
+ * Signature: (Lcom/connectedway/io/FileDescriptor;JJLcom/connectedway/io/FileDescriptor;J)J
+ *
+ * Copy count bytes starting at srcPos in one open file to dstPos in
+ * another, entirely in native buffers.
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_transfer
+  (JNIEnv *env, jobject objFs, jobject objSrcFd, jlong jlSrcPos,
+   jlong jlCount, jobject objDstFd, jlong jlDstPos)
+{
+  OFC_HANDLE hSrc ;
+  OFC_HANDLE hDst ;
+  OFC_SIZET copied ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  hSrc = file_descriptor_get_handle (env, objSrcFd) ;
+  hDst = file_descriptor_get_handle (env, objDstFd) ;
+
+  copied = 0 ;
+  if (jlCount > 0 &&
+      CopyRegion (hSrc, jlSrcPos, (OFC_SIZET) jlCount, hDst, jlDstPos,
+		  &copied) == OFC_FALSE)
+    throwio (env) ;
+
+  return ((jlong) copied) ;
+}
+
+/*
+ * Vectored read or write between an array of ByteBuffers and
+ * consecutive bytes of a file.  Each buffer contributes the bytes
+ * between its position and limit and has its position advanced by the
+ * bytes transferred into or out of it.
+ */
+static jlong bytebuffers_transfer (JNIEnv *env, jobject objFd,
+				   jobjectArray arrayBuffers, jlong jlPos,
+				   OFC_BOOL bWrite)
+{
+  OFC_HANDLE hFile ;
+  jclass clsBuffer ;
+  jmethodID midPosition ;
+  jmethodID midRemaining ;
+  jmethodID midSetPosition ;
+  jobject objBuffer ;
+  jobject objRet ;
+  jsize count ;
+  jsize built ;
+  jsize i ;
+  jint *positions ;
+  OFC_CHAR **bounces ;
+  OFC_IO_SEGMENT *segments ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_SIZET nXfer ;
+  OFC_SIZET requested ;
+  OFC_SIZET remaining ;
+  OFC_SIZET len ;
+  OFC_BOOL status ;
+  jlong jlXfer ;
+
+  hFile = file_descriptor_get_handle (env, objFd) ;
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+
+  clsBuffer = (*env)->FindClass (env, "java/nio/Buffer") ;
+  midPosition = (*env)->GetMethodID (env, clsBuffer, "position", "()I") ;
+  midRemaining = (*env)->GetMethodID (env, clsBuffer, "remaining", "()I") ;
+  midSetPosition = (*env)->GetMethodID (env, clsBuffer, "position",
+					"(I)Ljava/nio/Buffer;") ;
+  (*env)->DeleteLocalRef (env, clsBuffer) ;
+
+  count = (*env)->GetArrayLength (env, arrayBuffers) ;
+  positions = ofc_malloc (sizeof (jint) * (count > 0 ? count : 1)) ;
+  bounces = ofc_malloc (sizeof (OFC_CHAR *) * (count > 0 ? count : 1)) ;
+  segments = ofc_malloc (sizeof (OFC_IO_SEGMENT) * (count > 0 ? count : 1)) ;
+  if (positions == OFC_NULL || bounces == OFC_NULL || segments == OFC_NULL)
+    {
+      if (positions != OFC_NULL)
+	ofc_free (positions) ;
+      if (bounces != OFC_NULL)
+	ofc_free (bounces) ;
+      if (segments != OFC_NULL)
+	ofc_free (segments) ;
+      TRACE_EXIT () ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+
+  status = OFC_TRUE ;
+  requested = 0 ;
+  built = 0 ;
+  for (i = 0 ; i < count && status == OFC_TRUE ; i++)
+    {
+      objBuffer = (*env)->GetObjectArrayElement (env, arrayBuffers, i) ;
+      positions[i] = (*env)->CallIntMethod (env, objBuffer, midPosition) ;
+      segments[i].len = (*env)->CallIntMethod (env, objBuffer, midRemaining) ;
+      segments[i].data = bytebuffer_get_data (env, objBuffer, positions[i],
+					      (jint) segments[i].len, bWrite,
+					      &bounces[i]) ;
+      if (segments[i].data == OFC_NULL)
+	{
+	  /*
+	   * Nothing is transferred, and only the buffers before this one
+	   * have memory to give back
+	   */
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	  status = OFC_FALSE ;
+	}
+      else
+	{
+	  requested += segments[i].len ;
+	  built = i + 1 ;
+	}
+      (*env)->DeleteLocalRef (env, objBuffer) ;
+    }
+
+  pos = jlPos ;
+  if (status == OFC_TRUE && jlPos < 0)
+    status = get_file_pointer (hFile, &pos) ;
+
+  nXfer = 0 ;
+  if (status == OFC_TRUE && requested > 0)
+    status = TransferSegments (hFile, bWrite, segments, count, pos, &nXfer) ;
+
+  if (status == OFC_TRUE && jlPos < 0)
+    status = set_file_pointer (hFile, pos + nXfer) ;
+
+  /*
+   * Hand the bytes back to the buffers in order
+   */
+  remaining = nXfer ;
+  for (i = 0 ; i < built ; i++)
+    {
+      len = OFC_MIN (remaining, segments[i].len) ;
+      remaining -= len ;
+      objBuffer = (*env)->GetObjectArrayElement (env, arrayBuffers, i) ;
+      bytebuffer_release_data (env, objBuffer, positions[i],
+			       bWrite ? 0 : (jint) len, bounces[i]) ;
+      if (len > 0)
+	{
+	  objRet = (*env)->CallObjectMethod (env, objBuffer, midSetPosition,
+					     positions[i] + (jint) len) ;
+	  (*env)->DeleteLocalRef (env, objRet) ;
+	}
+      (*env)->DeleteLocalRef (env, objBuffer) ;
+    }
+
+  ofc_free (segments) ;
+  ofc_free (bounces) ;
+  ofc_free (positions) ;
+
+  STATS_HANDLE (bWrite ? STATS_OP_WRITE : STATS_OP_READ, start, hFile,
+		nXfer) ;
+  TRACE_EXIT () ;
+  jlXfer = (jlong) nXfer ;
+  if (status == OFC_FALSE)
+    throwio (env) ;
+  else if (!bWrite && jlXfer == 0 && requested > 0)
+    jlXfer = -1 ;
+
+  return (jlXfer) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    read
+ * Signature: (Lcom/connectedway/io/FileDescriptor;[Ljava/nio/ByteBuffer;J)J
+ *
+ * Scatter consecutive bytes of a file into an array of buffers.  The
+ * segments are issued concurrently and waited for together.
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_read__Lcom_connectedway_io_FileDescriptor_2_3Ljava_nio_ByteBuffer_2J
+  (JNIEnv *env, jobject objFs, jobject objFd, jobjectArray arrayBuffers,
+   jlong jlPos)
+{
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  return (bytebuffers_transfer (env, objFd, arrayBuffers, jlPos,
+				OFC_FALSE)) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    write
+ * Signature: (Lcom/connectedway/io/FileDescriptor;[Ljava/nio/ByteBuffer;J)J
+ *
+ * Gather an array of buffers into consecutive bytes of a file.  The
+ * segments are issued concurrently and waited for together.
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_write__Lcom_connectedway_io_FileDescriptor_2_3Ljava_nio_ByteBuffer_2J
+  (JNIEnv *env, jobject objFs, jobject objFd, jobjectArray arrayBuffers,
+   jlong jlPos)
+{
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  return (bytebuffers_transfer (env, objFd, arrayBuffers, jlPos,
+				OFC_TRUE)) ;
+}
+
+/*
+ * Bulk fetch of small files
+ *
+ * Each file is one item of a job on the worker pool, and a worker runs
+ * open, read and close for it.  With maxInFlight workers, that many
+ * files are at different stages of the open/read/close round trips at
+ * any time.
+ */
+#define READ_ALL_INITIAL_SIZE (32 * 1024)
+
+typedef struct
+{
+  OFC_LPTSTR path ;
+  OFC_CHAR *data ;
+  OFC_SIZET len ;
+  OFC_DWORD error ;
+} READ_ALL_FILE ;
+
+static OFC_VOID read_all_file (OFC_VOID *context, OFC_INT index)
+{
+  READ_ALL_FILE *file ;
+  OFC_HANDLE hFile ;
+  OFC_SIZET size ;
+  OFC_SIZET nRead ;
+  OFC_CHAR *data ;
+  OFC_CHAR *grown ;
+  OFC_BOOL status ;
+
+  file = (READ_ALL_FILE *) context + index ;
+
+  file->data = OFC_NULL ;
+  file->len = 0 ;
+  file->error = OFC_ERROR_SUCCESS ;
+
+  STATS_START (start) ;
+  hFile = OfcCreateFileW (file->path, OFC_GENERIC_READ,
+			  OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			  OFC_NULL, OFC_OPEN_EXISTING,
+			  OFC_FILE_ATTRIBUTE_NORMAL, OFC_HANDLE_NULL) ;
+  if (hFile == OFC_INVALID_HANDLE_VALUE)
+    file->error = OfcGetLastError () ;
+  else
+    {
+      /*
+       * Most files fit in the first read.  A short read is EOF so a
+       * small file costs exactly one read round trip.
+       */
+      size = READ_ALL_INITIAL_SIZE ;
+      data = ofc_malloc (size) ;
+      status = OFC_TRUE ;
+      if (data == OFC_NULL)
+	{
+	  ofc_thread_set_variable (OfcLastError,
+				   (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	  status = OFC_FALSE ;
+	}
+      while (status == OFC_TRUE)
+	{
+	  status = TransferRegion (hFile, OFC_FALSE, data + file->len,
+				   size - file->len, file->len, &nRead) ;
+	  file->len += nRead ;
+	  if (status == OFC_FALSE || file->len < size)
+	    break ;
+	  grown = ofc_realloc (data, size * 2) ;
+	  if (grown == OFC_NULL)
+	    {
+	      ofc_thread_set_variable
+		(OfcLastError, (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	      status = OFC_FALSE ;
+	    }
+	  else
+	    {
+	      data = grown ;
+	      size *= 2 ;
+	    }
+	}
+
+      if (status == OFC_FALSE)
+	{
+	  file->error = OfcGetLastError () ;
+	  if (data != OFC_NULL)
+	    ofc_free (data) ;
+	  file->len = 0 ;
+	}
+      else
+	file->data = data ;
+
+      OfcCloseHandle (hFile) ;
+    }
+  STATS_PATH (STATS_OP_READ, start, file->path, file->len) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    readAll
+ * Signature: ([Ljava/lang/String;I[J)[[B
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_readAll
+  (JNIEnv *env, jobject objFs, jobjectArray arrayPaths, jint jiMaxInFlight,
+   jlongArray arrayErrors)
+{
+  READ_ALL_FILE *files ;
+  OFC_INT count ;
+  OFC_INT i ;
+  jstring jstrPath ;
+  jclass clsBytes ;
+  jbyteArray arrayB ;
+  jobjectArray arrayResults ;
+  jlong jlError ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  count = (*env)->GetArrayLength (env, arrayPaths) ;
+  files = ofc_malloc (sizeof (READ_ALL_FILE) * (count > 0 ? count : 1)) ;
+  if (files == OFC_NULL)
+    {
+      throw_new (env, "java/lang/OutOfMemoryError", "Cannot read files") ;
+      return (OFC_NULL) ;
+    }
+
+  for (i = 0 ; i < count ; i++)
+    {
+      jstrPath = (*env)->GetObjectArrayElement (env, arrayPaths, i) ;
+      if (jstrPath == OFC_NULL)
+	{
+	  while (i > 0)
+	    ofc_free (files[--i].path) ;
+	  ofc_free (files) ;
+	  throw_new (env, "java/lang/NullPointerException", "Null path") ;
+	  return (OFC_NULL) ;
+	}
+      files[i].path = jstr2tchar (env, jstrPath) ;
+      files[i].data = OFC_NULL ;
+      files[i].len = 0 ;
+      (*env)->DeleteLocalRef (env, jstrPath) ;
+    }
+
+  /*
+   * The calling thread is one of the workers
+   */
+  work_run (&read_all_file, files, count, OFC_MAX (jiMaxInFlight, 1)) ;
+
+  clsBytes = (*env)->FindClass (env, "[B") ;
+  arrayResults = (*env)->NewObjectArray (env, count, clsBytes, NULL) ;
+  (*env)->DeleteLocalRef (env, clsBytes) ;
+
+  /*
+   * Once the VM is out of memory, the rest is only freed
+   */
+  for (i = 0 ; i < count ; i++)
+    {
+      if (files[i].data != OFC_NULL && arrayResults != OFC_NULL)
+	{
+	  arrayB = (*env)->NewByteArray (env, (jsize) files[i].len) ;
+	  if (arrayB == OFC_NULL)
+	    {
+	      (*env)->DeleteLocalRef (env, arrayResults) ;
+	      arrayResults = OFC_NULL ;
+	    }
+	  else
+	    {
+	      (*env)->SetByteArrayRegion (env, arrayB, 0,
+					  (jsize) files[i].len,
+					  (jbyte *) files[i].data) ;
+	      (*env)->SetObjectArrayElement (env, arrayResults, i, arrayB) ;
+	      (*env)->DeleteLocalRef (env, arrayB) ;
+	    }
+	}
+      if (files[i].data != OFC_NULL)
+	ofc_free (files[i].data) ;
+      if (arrayResults != OFC_NULL && arrayErrors != OFC_NULL &&
+	  i < (*env)->GetArrayLength (env, arrayErrors))
+	{
+	  jlError = files[i].error ;
+	  (*env)->SetLongArrayRegion (env, arrayErrors, i, 1, &jlError) ;
+	}
+      ofc_free (files[i].path) ;
+    }
+  ofc_free (files) ;
+
+  return (arrayResults) ;
+}
+
+/*
+ * Checksum of a range of a file
+ *
+ * The range is split into parts that are hashed in parallel on the
+ * worker pool.  Each part is streamed on its own handle through
+ * TransferRegion, so the overlapped read pipeline fills a native
+ * buffer of CHECKSUM_CHUNK bytes that is hashed in place and reused.
+ * Nothing is copied into the JVM but the digest.
+ *
+ * CRC32C parts combine into the CRC32C of the whole range.  XXH64 and
+ * SHA-256 do not combine, so they are always taken as a single part.
+ */
+#define CHECKSUM_CHUNK (1024 * 1024)
+#define CHECKSUM_MAX_PARTS 64
+
+typedef struct
+{
+  OFC_LPCTSTR path ;
+  CHECKSUM_ALGORITHM algorithm ;
+  OFC_LARGE_INTEGER offset ;
+  OFC_LARGE_INTEGER len ;
+  OFC_LARGE_INTEGER done ;
+  OFC_UINT8 digest[CHECKSUM_MAX_DIGEST] ;
+  OFC_DWORD error ;
+} CHECKSUM_PART ;
+
+static OFC_VOID checksum_part (OFC_VOID *context, OFC_INT index)
+{
+  CHECKSUM_PART *part ;
+  CHECKSUM_STATE state ;
+  OFC_HANDLE hFile ;
+  OFC_CHAR *data ;
+  OFC_SIZET want ;
+  OFC_SIZET nRead ;
+  OFC_BOOL status ;
+
+  part = (CHECKSUM_PART *) context + index ;
+  part->done = 0 ;
+  part->error = OFC_ERROR_SUCCESS ;
+  checksum_init (&state, part->algorithm) ;
+
+  STATS_START (start) ;
+  hFile = OfcCreateFileW (part->path, OFC_GENERIC_READ,
+			  OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			  OFC_NULL, OFC_OPEN_EXISTING,
+			  OFC_FILE_ATTRIBUTE_NORMAL, OFC_HANDLE_NULL) ;
+  if (hFile == OFC_INVALID_HANDLE_VALUE)
+    part->error = OfcGetLastError () ;
+  else
+    {
+      data = ofc_malloc (CHECKSUM_CHUNK) ;
+      if (data == OFC_NULL)
+	part->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      while (data != OFC_NULL && part->done < part->len)
+	{
+	  want = (OFC_SIZET) OFC_MIN (CHECKSUM_CHUNK,
+				      part->len - part->done) ;
+	  status = TransferRegion (hFile, OFC_FALSE, data, want,
+				   part->offset + part->done, &nRead) ;
+	  if (status == OFC_FALSE)
+	    {
+	      part->error = OfcGetLastError () ;
+	      break ;
+	    }
+	  checksum_update (&state, data, nRead) ;
+	  part->done += nRead ;
+	  /*
+	   * A short read is EOF
+	   */
+	  if (nRead < want)
+	    break ;
+	}
+      if (data != OFC_NULL)
+	ofc_free (data) ;
+      OfcCloseHandle (hFile) ;
+    }
+  STATS_PATH (STATS_OP_READ, start, part->path, part->done) ;
+  checksum_final (&state, part->digest) ;
+}
+
+/*
+ * Class:     com_connectedway_io_FileSystem
+ * Method:    checksum
+ * Signature: (Lcom/connectedway/io/File;IJJI)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_connectedway_io_FileSystem_checksum
+  (JNIEnv *env, jobject objFs, jobject objFile, jint jiAlgorithm,
+   jlong jlOffset, jlong jlLen, jint jiParts)
+{
+  CHECKSUM_PART *parts ;
+  CHECKSUM_ALGORITHM algorithm ;
+  OFC_LPTSTR tstrPath ;
+  OFC_INT count ;
+  OFC_LARGE_INTEGER part_len ;
+  OFC_UINT8 digest[CHECKSUM_MAX_DIGEST] ;
+  OFC_SIZET digest_len ;
+  OFC_UINT32 crc ;
+  OFC_UINT32 part_crc ;
+  OFC_DWORD error ;
+  OFC_INT i ;
+  OFC_SIZET j ;
+  jbyteArray arrayDigest ;
+  HEAP_ENTER () ;
+
+#if 0
+  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
+#endif
+  if (jiAlgorithm < 0 || jiAlgorithm >= CHECKSUM_MAX ||
+      jlOffset < 0 || jlLen < 0)
+    {
+      throwio_error (env, OFC_ERROR_INVALID_PARAMETER) ;
+      return (OFC_NULL) ;
+    }
+  algorithm = (CHECKSUM_ALGORITHM) jiAlgorithm ;
+
+  /*
+   * Only CRC32C parts combine into the digest of the whole range
+   */
+  count = 1 ;
+  if (algorithm == CHECKSUM_CRC32C)
+    count = OFC_MIN (OFC_MAX (jiParts, 1), CHECKSUM_MAX_PARTS) ;
+  /*
+   * Parts smaller than a chunk are not worth a thread
+   */
+  if (jlLen / count < CHECKSUM_CHUNK)
+    count = (OFC_INT) OFC_MAX (jlLen / CHECKSUM_CHUNK, 1) ;
+  parts = ofc_malloc (sizeof (CHECKSUM_PART) * count) ;
+  if (parts == OFC_NULL)
+    {
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_NULL) ;
+    }
+
+  tstrPath = file_get_path (env, objFile) ;
+  part_len = jlLen / count ;
+  for (i = 0 ; i < count ; i++)
+    {
+      parts[i].path = tstrPath ;
+      parts[i].algorithm = algorithm ;
+      parts[i].offset = jlOffset + part_len * i ;
+      parts[i].len = i + 1 < count ? part_len : jlLen - part_len * i ;
+    }
+
+  /*
+   * The calling thread is one of the workers
+   */
+  work_run (&checksum_part, parts, count, count) ;
+  file_free_path (tstrPath) ;
+
+  arrayDigest = OFC_NULL ;
+  error = OFC_ERROR_SUCCESS ;
+  for (i = 0 ; i < count && error == OFC_ERROR_SUCCESS ; i++)
+    {
+      error = parts[i].error ;
+      /*
+       * A range past EOF ends with the last part that reached it
+       */
+      if (parts[i].done < parts[i].len)
+	count = i + 1 ;
+    }
+
+  if (error != OFC_ERROR_SUCCESS)
+    throwio_error (env, error) ;
+  else
+    {
+      digest_len = checksum_digest_len (algorithm) ;
+      if (count == 1)
+	ofc_memcpy (digest, parts[0].digest, digest_len) ;
+      else
+	{
+	  crc = 0 ;
+	  for (i = 0 ; i < count ; i++)
+	    {
+	      part_crc = 0 ;
+	      for (j = 0 ; j < digest_len ; j++)
+		part_crc = (part_crc << 8) | parts[i].digest[j] ;
+	      crc = i == 0 ? part_crc :
+		checksum_crc32c_combine (crc, part_crc, parts[i].done) ;
+	    }
+	  for (j = 0 ; j < digest_len ; j++)
+	    digest[j] = (OFC_UINT8) (crc >> ((digest_len - 1 - j) * 8)) ;
+	}
+
+      arrayDigest = (*env)->NewByteArray (env, (jsize) digest_len) ;
+      if (arrayDigest != OFC_NULL)
+	(*env)->SetByteArrayRegion (env, arrayDigest, 0, (jsize) digest_len,
+				    (jbyte *) digest) ;
+    }
+  ofc_free (parts) ;
+
+  return (arrayDigest) ;
+}
+
+/*
+ * Directory tree diff
+ *
+ * The two trees are walked together, one directory pair at a time.
+ * Each side of a pair is listed into an array of entries, the two
+ * sides as a job of two items on the worker pool, so a remote and a
+ * local side, or two shares, are enumerated at the same time by the
+ * calling thread and a pool worker.  Both arrays are sorted by name and merged.  Entries
+ * that are on one side only are added or removed, entries on both
+ * that differ in type, size or modification time are changed, and
+ * directories on both sides are queued to be walked in turn.  Only
+ * the differences are turned into Java objects, a batch at a time.
+ *
+ * A directory on one side only is reported once, not its contents.
+ * Both roots must be directories, so that a missing root fails the
+ * diff rather than reading as an empty tree.
+ */
+#define DIFF_INITIAL_ENTRIES 64
+#define DIFF_DEFAULT_BATCH 256
+
+typedef struct
+{
+  OFC_LPTSTR name ;
+  OFC_BOOL directory ;
+  jlong size ;
+  jlong mtime ;
+} DIFF_ENTRY ;
+
+typedef struct
+{
+  OFC_LPTSTR path ;
+  jint options ;
+  DIFF_ENTRY **entries ;
+  OFC_INT count ;
+  OFC_INT alloc ;
+  OFC_DWORD error ;
+} DIFF_LIST ;
+
+typedef struct
+{
+  jint kind ;
+  OFC_LPTSTR path ;
+  OFC_BOOL directory ;
+  jlong size_a ;
+  jlong size_b ;
+  jlong mtime_a ;
+  jlong mtime_b ;
+} DIFF_RECORD ;
+
+typedef struct
+{
+  JNIEnv *env ;
+  jobject objListener ;
+  jclass clsRecord ;
+  jmethodID midRecord ;
+  jmethodID midOnDiff ;
+  DIFF_RECORD *records ;
+  OFC_INT count ;
+  OFC_INT batch ;
+  jlong total ;
+  OFC_DWORD error ;
+} DIFF_SINK ;
+
+/*
+ * Compare two names.  Ignoring case only folds ASCII letters.
+ */
+static OFC_INT diff_compare (OFC_LPCTSTR a, OFC_LPCTSTR b, jint options)
+{
+  OFC_TCHAR ca ;
+  OFC_TCHAR cb ;
+
+  for (;; a++, b++)
+    {
+      ca = *a ;
+      cb = *b ;
+      if (options & com_connectedway_io_FileSystem_DIFF_OPT_IGNORE_CASE)
+	{
+	  if (ca >= 'a' && ca <= 'z')
+	    ca = ca - 'a' + 'A' ;
+	  if (cb >= 'a' && cb <= 'z')
+	    cb = cb - 'a' + 'A' ;
+	}
+      if (ca != cb || ca == TCHAR_EOS)
+	break ;
+    }
+  return (ca < cb ? -1 : (ca > cb ? 1 : 0)) ;
+}
+
+/*
+ * Merge sort of the entry pointers by name
+ */
+static OFC_VOID diff_sort (DIFF_ENTRY **entries, DIFF_ENTRY **scratch,
+			   OFC_INT count, jint options)
+{
+  OFC_INT mid ;
+  OFC_INT i ;
+  OFC_INT j ;
+  OFC_INT k ;
+
+  if (count < 2)
+    return ;
+
+  mid = count / 2 ;
+  diff_sort (entries, scratch, mid, options) ;
+  diff_sort (entries + mid, scratch, count - mid, options) ;
+
+  for (i = 0, j = mid, k = 0 ; i < mid && j < count ; k++)
+    {
+      if (diff_compare (entries[j]->name, entries[i]->name, options) < 0)
+	scratch[k] = entries[j++] ;
+      else
+	scratch[k] = entries[i++] ;
+    }
+  while (i < mid)
+    scratch[k++] = entries[i++] ;
+  while (j < count)
+    scratch[k++] = entries[j++] ;
+  ofc_memcpy (entries, scratch, sizeof (DIFF_ENTRY *) * count) ;
+}
+
+static OFC_VOID diff_list_add (DIFF_LIST *list,
+			       OFC_WIN32_FIND_DATAW *find_data)
+{
+  DIFF_ENTRY **entries ;
+  DIFF_ENTRY *entry ;
+  OFC_ULONG tv_sec ;
+  OFC_ULONG tv_nsec ;
+
+  if (ofc_tstrcmp (find_data->cFileName, TSTR("..")) == 0 ||
+      ofc_tstrcmp (find_data->cFileName, TSTR(".")) == 0)
+    return ;
+  if ((find_data->dwFileAttributes & OFC_FILE_ATTRIBUTE_HIDDEN) &&
+      !(list->options & com_connectedway_io_FileSystem_DIFF_OPT_HIDDEN))
+    return ;
+
+  if (list->count == list->alloc)
+    {
+      entries = ofc_realloc (list->entries,
+			     sizeof (DIFF_ENTRY *) * list->alloc * 2) ;
+      if (entries == OFC_NULL)
+	{
+	  list->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+	  return ;
+	}
+      list->entries = entries ;
+      list->alloc *= 2 ;
+    }
+
+  entry = ofc_malloc (sizeof (DIFF_ENTRY)) ;
+  if (entry == OFC_NULL)
+    {
+      list->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      return ;
+    }
+  entry->name = ofc_tstrdup (find_data->cFileName) ;
+  if (entry->name == OFC_NULL)
+    {
+      ofc_free (entry) ;
+      list->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      return ;
+    }
+  entry->directory =
+    (find_data->dwFileAttributes & OFC_FILE_ATTRIBUTE_DIRECTORY) ?
+    OFC_TRUE : OFC_FALSE ;
+  entry->size = ((jlong) find_data->nFileSizeHigh << 32) |
+    (jlong) find_data->nFileSizeLow ;
+  tv_sec = 0 ;
+  tv_nsec = 0 ;
+  file_time_to_epoch_time (&find_data->ftLastWriteTime, &tv_sec, &tv_nsec) ;
+  entry->mtime = ((jlong) tv_sec * 1000) + ((jlong) tv_nsec / (1000 * 1000)) ;
+  list->entries[list->count++] = entry ;
+}
+
+/*
+ * List and sort one side of a directory pair.  A directory that is
+ * empty lists as empty rather than as an error, and so does one that
+ * went away since its parent was listed.  The roots are checked up
+ * front.  Called as an item of a job over both sides.
+ */
+static OFC_VOID diff_list (OFC_VOID *context, OFC_INT index)
+{
+  DIFF_LIST *list ;
+  OFC_WIN32_FIND_DATAW find_data ;
+  OFC_HANDLE list_handle ;
+  OFC_LPTSTR pattern ;
+  OFC_SIZET len ;
+  OFC_BOOL more ;
+  OFC_DWORD error ;
+  DIFF_ENTRY **scratch ;
+
+  list = (DIFF_LIST *) context + index ;
+  len = 0 ;
+  list->count = 0 ;
+  list->alloc = DIFF_INITIAL_ENTRIES ;
+  list->error = OFC_ERROR_SUCCESS ;
+  list->entries = OFC_NULL ;
+  pattern = OFC_NULL ;
+  if (list->path != OFC_NULL)
+    list->entries = ofc_malloc (sizeof (DIFF_ENTRY *) * list->alloc) ;
+  if (list->entries != OFC_NULL)
+    {
+      len = ofc_tstrlen (list->path) ;
+      pattern = ofc_malloc ((len + 3) * sizeof (OFC_TCHAR)) ;
+    }
+  if (pattern == OFC_NULL)
+    {
+      list->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      return ;
+    }
+
+  ofc_tstrcpy (pattern, list->path) ;
+  if (len > 0 && list->path[len-1] != TCHAR_SLASH &&
+      list->path[len-1] != TCHAR_BACKSLASH)
+    ofc_tstrcpy (pattern + len, TSTR("/*")) ;
+  else
+    ofc_tstrcpy (pattern + len, TSTR("*")) ;
+
+  list_handle = OfcFindFirstFileW (pattern, &find_data, &more) ;
+  if (list_handle == OFC_INVALID_HANDLE_VALUE)
+    {
+      error = OfcGetLastError () ;
+      if (error != OFC_ERROR_NO_MORE_FILES &&
+	  error != OFC_ERROR_FILE_NOT_FOUND)
+	list->error = error ;
+    }
+  else
+    {
+      diff_list_add (list, &find_data) ;
+      while (more && list->error == OFC_ERROR_SUCCESS)
+	{
+	  if (OfcFindNextFileW (list_handle, &find_data, &more) == OFC_FALSE)
+	    {
+	      error = OfcGetLastError () ;
+	      if (error != OFC_ERROR_NO_MORE_FILES)
+		list->error = error ;
+	      more = OFC_FALSE ;
+	    }
+	  else
+	    diff_list_add (list, &find_data) ;
+	}
+      OfcFindClose (list_handle) ;
+    }
+  ofc_free (pattern) ;
+
+  scratch = ofc_malloc (sizeof (DIFF_ENTRY *) * list->alloc) ;
+  if (scratch == OFC_NULL)
+    list->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+  else
+    {
+      diff_sort (list->entries, scratch, list->count, list->options) ;
+      ofc_free (scratch) ;
+    }
+}
+
+static OFC_VOID diff_list_free (DIFF_LIST *list)
+{
+  OFC_INT i ;
+
+  for (i = 0 ; i < list->count ; i++)
+    {
+      ofc_free (list->entries[i]->name) ;
+      ofc_free (list->entries[i]) ;
+    }
+  if (list->entries != OFC_NULL)
+    ofc_free (list->entries) ;
+  if (list->path != OFC_NULL)
+    ofc_free (list->path) ;
+}
+
+/*
+ * Join a directory and a name with a slash.  An empty directory is
+ * the root of a walk.  Returns null if there is no memory.
+ */
+static OFC_LPTSTR diff_join (OFC_LPCTSTR dir, OFC_LPCTSTR name)
+{
+  OFC_LPTSTR path ;
+  OFC_SIZET dir_len ;
+  OFC_SIZET name_len ;
+
+  dir_len = ofc_tstrlen (dir) ;
+  name_len = ofc_tstrlen (name) ;
+  path = ofc_malloc ((dir_len + name_len + 2) * sizeof (OFC_TCHAR)) ;
+  if (path == OFC_NULL)
+    return (OFC_NULL) ;
+  ofc_tstrcpy (path, dir) ;
+  if (dir_len > 0 && name_len > 0 && dir[dir_len-1] != TCHAR_SLASH &&
+      dir[dir_len-1] != TCHAR_BACKSLASH)
+    path[dir_len++] = TCHAR_SLASH ;
+  ofc_tstrcpy (path + dir_len, name) ;
+  return (path) ;
+}
+
+/*
+ * Hand the records gathered so far to the listener.  Once a JNI call
+ * leaves an exception pending, the rest of the batch is only freed.
+ */
+static OFC_BOOL diff_flush (DIFF_SINK *sink)
+{
+  JNIEnv *env ;
+  jobjectArray arrayRecords ;
+  jobject objRecord ;
+  jstring jstrPath ;
+  OFC_INT count ;
+  OFC_INT i ;
+
+  env = sink->env ;
+  count = sink->count ;
+  sink->count = 0 ;
+  if (count == 0)
+    return (OFC_TRUE) ;
+
+  arrayRecords = (*env)->NewObjectArray (env, count, sink->clsRecord, NULL) ;
+  for (i = 0 ; i < count ; i++)
+    {
+      if (arrayRecords != OFC_NULL)
+	{
+	  objRecord = OFC_NULL ;
+	  jstrPath = tchar2jstr (env, sink->records[i].path) ;
+	  if (jstrPath != OFC_NULL)
+	    {
+	      objRecord = (*env)->NewObject
+		(env, sink->clsRecord, sink->midRecord,
+		 sink->records[i].kind, jstrPath,
+		 sink->records[i].directory ? JNI_TRUE : JNI_FALSE,
+		 sink->records[i].size_a, sink->records[i].size_b,
+		 sink->records[i].mtime_a, sink->records[i].mtime_b) ;
+	      (*env)->DeleteLocalRef (env, jstrPath) ;
+	    }
+	  if (objRecord == OFC_NULL)
+	    {
+	      (*env)->DeleteLocalRef (env, arrayRecords) ;
+	      arrayRecords = OFC_NULL ;
+	    }
+	  else
+	    {
+	      (*env)->SetObjectArrayElement (env, arrayRecords, i,
+					     objRecord) ;
+	      (*env)->DeleteLocalRef (env, objRecord) ;
+	    }
+	}
+      ofc_free (sink->records[i].path) ;
+    }
+  if (arrayRecords == OFC_NULL)
+    return (OFC_FALSE) ;
+  sink->total += count ;
+
+  (*env)->CallVoidMethod (env, sink->objListener, sink->midOnDiff,
+			  arrayRecords) ;
+  (*env)->DeleteLocalRef (env, arrayRecords) ;
+
+  return ((*env)->ExceptionCheck (env) ? OFC_FALSE : OFC_TRUE) ;
+}
+
+static OFC_BOOL diff_record (DIFF_SINK *sink, jint kind, OFC_LPCTSTR dir,
+			     DIFF_ENTRY *a, DIFF_ENTRY *b)
+{
+  DIFF_RECORD *record ;
+  DIFF_ENTRY *entry ;
+
+  entry = a != OFC_NULL ? a : b ;
+  record = &sink->records[sink->count] ;
+  record->kind = kind ;
+  record->path = diff_join (dir, entry->name) ;
+  if (record->path == OFC_NULL)
+    {
+      sink->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      return (OFC_FALSE) ;
+    }
+  sink->count++ ;
+  record->directory = b != OFC_NULL ? b->directory : a->directory ;
+  record->size_a = a != OFC_NULL ? a->size : -1 ;
+  record->size_b = b != OFC_NULL ? b->size : -1 ;
+  record->mtime_a = a != OFC_NULL ? a->mtime : -1 ;
+  record->mtime_b = b != OFC_NULL ? b->mtime : -1 ;
+
+  if (sink->count < sink->batch)
+    return (OFC_TRUE) ;
+  return (diff_flush (sink)) ;
+}
+
+/*
+ * Check that a root of the diff is a directory.  Returns the error if
+ * it is not.
+ */
+static OFC_DWORD diff_root (OFC_LPCTSTR root)
+{
+  OFC_WIN32_FILE_ATTRIBUTE_DATA fadRoot ;
+  OFC_DWORD error ;
+
+  if (root == OFC_NULL)
+    return (OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+  if (OfcGetFileAttributesExW (root, OfcGetFileExInfoStandard,
+			       &fadRoot) == OFC_FALSE)
+    {
+      error = OfcGetLastError () ;
+      return (error != OFC_ERROR_SUCCESS ? error : OFC_ERROR_FILE_NOT_FOUND) ;
     }
+  if (!(fadRoot.dwFileAttributes & OFC_FILE_ATTRIBUTE_DIRECTORY))
+    return (OFC_ERROR_INVALID_PARAMETER) ;
+  return (OFC_ERROR_SUCCESS) ;
+}
 
-  /*
-   * The pending count is zero so we've gotten completions
-   * either due to errors or eof on all of our outstanding
-   * reads and writes.
-   */
-  for (buffer = ofc_dequeue(buffer_list);
-       buffer != OFC_NULL;
-       buffer = ofc_dequeue(buffer_list))
+static OFC_BOOL diff_changed (DIFF_ENTRY *a, DIFF_ENTRY *b, jint options,
+			      jlong tolerance)
+{
+  jlong delta ;
+
+  if (a->directory != b->directory)
+    return (OFC_TRUE) ;
+  if (a->directory)
+    return (OFC_FALSE) ;
+  if ((options & com_connectedway_io_FileSystem_DIFF_OPT_SIZE) &&
+      a->size != b->size)
+    return (OFC_TRUE) ;
+  if (options & com_connectedway_io_FileSystem_DIFF_OPT_MTIME)
     {
-      /*
-       * Destroy the overlapped I/O handle for each buffer
-       */
-      OfcDestroyOverlapped(hFile, buffer->writeOverlapped);
-      /*
-       * Free the buffer descriptor
-       */
-      ofc_free(buffer);
+      delta = a->mtime - b->mtime ;
+      if (delta > tolerance || delta < -tolerance)
+	return (OFC_TRUE) ;
     }
-  /*
-   * Destroy the buffer list
-   */
-  ofc_queue_destroy(buffer_list);
-  /*
-   * And destroy the wait list
-   */
-  ofc_waitset_destroy(wait_set);
-
-  (*env)->ReleaseByteArrayElements (env,arrayB, jbBuffer, 0) ;
-
-  if (jiBytesWritten != jiLen)
-    throwio(env) ;
+  return (OFC_FALSE) ;
 }
-#endif
 
 /*
  * Class:     com_connectedway_io_FileSystem
- * Method:    seteof
- * Signature: (Lcom/connectedway/io/FileDescriptor;J)V
+ * Method:    diffTrees
+ * Signature: (Lcom/connectedway/io/File;Lcom/connectedway/io/File;IJILcom/connectedway/io/FileSystem$DiffListener;)J
  */
-JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_seteof
-  (JNIEnv *env, jobject objFs, jobject objFd, jlong jlPos) 
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_diffTrees
+  (JNIEnv *env, jobject objFs, jobject objFileA, jobject objFileB,
+   jint jiOptions, jlong jlTolerance, jint jiBatch, jobject objListener)
 {
-  OFC_HANDLE hFile ;
-  OFC_LONG lPos ;
-  OFC_DWORD dwLastError ;
-  OFC_BOOL bStatus ;
-  OFC_LONG lLow ;
-  OFC_LONG lHigh ;
+  DIFF_SINK sink ;
+  DIFF_LIST lists[2] ;
+  OFC_LPTSTR root_a ;
+  OFC_LPTSTR root_b ;
+  OFC_LPTSTR dir ;
+  OFC_LPTSTR sub ;
+  OFC_HANDLE hPending ;
+  OFC_DWORD error ;
+  OFC_BOOL ok ;
+  OFC_INT cmp ;
+  OFC_INT i ;
+  OFC_INT j ;
+  jclass clsListener ;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
+  if (objListener == OFC_NULL || objFileA == OFC_NULL ||
+      objFileB == OFC_NULL)
+    {
+      throw_new (env, "java/lang/NullPointerException",
+		 objListener == OFC_NULL ? "Null listener" : "Null root") ;
+      return (0) ;
+    }
 
-  lLow = (OFC_LONG) jlPos & 0xFFFFFFFF ;
-  lHigh = (OFC_LONG) (jlPos >> 32) & 0xFFFFFFFF ;
+  sink.env = env ;
+  sink.objListener = objListener ;
+  sink.clsRecord = (*env)->FindClass
+    (env, "com/connectedway/io/FileSystem$DiffRecord") ;
+  if (sink.clsRecord == OFC_NULL)
+    return (0) ;
+  sink.midRecord = (*env)->GetMethodID
+    (env, sink.clsRecord, "<init>", "(ILjava/lang/String;ZJJJJ)V") ;
+  clsListener = (*env)->GetObjectClass (env, objListener) ;
+  sink.midOnDiff = (*env)->GetMethodID
+    (env, clsListener, "onDiff",
+     "([Lcom/connectedway/io/FileSystem$DiffRecord;)V") ;
+  (*env)->DeleteLocalRef (env, clsListener) ;
+  sink.batch = jiBatch > 0 ? jiBatch : DIFF_DEFAULT_BATCH ;
+  sink.records = OFC_NULL ;
+  if (sink.midRecord != OFC_NULL && sink.midOnDiff != OFC_NULL)
+    {
+      sink.records = ofc_malloc (sizeof (DIFF_RECORD) * sink.batch) ;
+      if (sink.records == OFC_NULL)
+	throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+    }
+  if (sink.records == OFC_NULL)
+    {
+      (*env)->DeleteLocalRef (env, sink.clsRecord) ;
+      return (0) ;
+    }
+  sink.count = 0 ;
+  sink.total = 0 ;
+  sink.error = OFC_ERROR_SUCCESS ;
 
-  lPos = OfcSetFilePointer (hFile, lLow, &lHigh, OFC_FILE_BEGIN) ;
-  dwLastError = OfcGetLastError () ;
+  root_a = file_get_path (env, objFileA) ;
+  root_b = file_get_path (env, objFileB) ;
 
-  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
-      dwLastError != OFC_ERROR_SUCCESS)
+  error = diff_root (root_a) ;
+  if (error == OFC_ERROR_SUCCESS)
+    error = diff_root (root_b) ;
+
+  /*
+   * Pending directories, relative to both roots
+   */
+  hPending = ofc_queue_create () ;
+  dir = OFC_NULL ;
+  if (error == OFC_ERROR_SUCCESS)
     {
-      throwio(env) ;
+      dir = ofc_tstrdup (TSTR("")) ;
+      if (dir != OFC_NULL)
+	ofc_enqueue (hPending, dir) ;
+      else
+	error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
     }
-  else
+
+  ok = OFC_TRUE ;
+  while (ok && (dir = ofc_dequeue (hPending)) != OFC_NULL)
     {
-      bStatus = OfcSetEndOfFile (hFile) ;
-      if (bStatus != OFC_TRUE)
+      lists[0].path = diff_join (root_a, dir) ;
+      lists[0].options = jiOptions ;
+      lists[1].path = diff_join (root_b, dir) ;
+      lists[1].options = jiOptions ;
+
+      /*
+       * The calling thread lists one side while a pool worker lists
+       * the other
+       */
+      work_run (&diff_list, lists, 2, 2) ;
+
+      if (lists[0].error != OFC_ERROR_SUCCESS)
+	error = lists[0].error ;
+      else if (lists[1].error != OFC_ERROR_SUCCESS)
+	error = lists[1].error ;
+      if (error != OFC_ERROR_SUCCESS)
+	ok = OFC_FALSE ;
+
+      i = 0 ;
+      j = 0 ;
+      while (ok && (i < lists[0].count || j < lists[1].count))
 	{
-	  throwio(env) ;
+	  if (i == lists[0].count)
+	    cmp = 1 ;
+	  else if (j == lists[1].count)
+	    cmp = -1 ;
+	  else
+	    cmp = diff_compare (lists[0].entries[i]->name,
+				lists[1].entries[j]->name, jiOptions) ;
+
+	  if (cmp < 0)
+	    ok = diff_record (&sink, com_connectedway_io_FileSystem_DIFF_REMOVED,
+			      dir, lists[0].entries[i++], OFC_NULL) ;
+	  else if (cmp > 0)
+	    ok = diff_record (&sink, com_connectedway_io_FileSystem_DIFF_ADDED,
+			      dir, OFC_NULL, lists[1].entries[j++]) ;
+	  else
+	    {
+	      if (diff_changed (lists[0].entries[i], lists[1].entries[j],
+				jiOptions, jlTolerance))
+		ok = diff_record (&sink,
+				  com_connectedway_io_FileSystem_DIFF_CHANGED,
+				  dir, lists[0].entries[i], lists[1].entries[j]) ;
+	      else if (lists[0].entries[i]->directory &&
+		       (jiOptions &
+			com_connectedway_io_FileSystem_DIFF_OPT_RECURSE))
+		{
+		  sub = diff_join (dir, lists[0].entries[i]->name) ;
+		  if (sub != OFC_NULL)
+		    ofc_enqueue (hPending, sub) ;
+		  else
+		    {
+		      error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+		      ok = OFC_FALSE ;
+		    }
+		}
+	      i++ ;
+	      j++ ;
+	    }
 	}
+
+      diff_list_free (&lists[0]) ;
+      diff_list_free (&lists[1]) ;
+      ofc_free (dir) ;
     }
 
+  if (error == OFC_ERROR_SUCCESS)
+    error = sink.error ;
+  if (!(*env)->ExceptionCheck (env))
+    diff_flush (&sink) ;
+
+  for (i = 0 ; i < sink.count ; i++)
+    ofc_free (sink.records[i].path) ;
+  ofc_free (sink.records) ;
+  while ((dir = ofc_dequeue (hPending)) != OFC_NULL)
+    ofc_free (dir) ;
+  ofc_queue_destroy (hPending) ;
+  if (root_a != OFC_NULL)
+    file_free_path (root_a) ;
+  if (root_b != OFC_NULL)
+    file_free_path (root_b) ;
+  (*env)->DeleteLocalRef (env, sink.clsRecord) ;
+
+  if (error != OFC_ERROR_SUCCESS && !(*env)->ExceptionCheck (env))
+    throwio_error (env, error) ;
+
+  return (sink.total) ;
 }
-	
+
 /*
- * Class:     com_connectedway_io_FileSystem
- * Method:    skip
- * Signature: (Lcom/connectedway/io/FileDescriptor;J)J
+ * Content search
+ *
+ * Each file is streamed through TransferRegion in SEARCH_CHUNK reads
+ * into one native buffer and scanned in place with search_find.  The
+ * end of each buffer that a match, or the context of a match, could
+ * still extend past is carried over to the front of the buffer before
+ * the next read, so matches spanning reads are found once.  Several
+ * files are searched at once on the worker pool, the calling thread
+ * among the workers, as in readAll.
+ *
+ * With context, a match carries the line it is on, up to the context
+ * length on either side of the match.  Patterns and context are capped,
+ * so a buffer is never much larger than a chunk.
  */
-JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_skip
-  (JNIEnv *env, jobject objFs, jobject objFd, jlong jlPos)
-{
-  OFC_HANDLE hFile ;
-  OFC_LONG lPos ;
-  OFC_DWORD dwLastError ;
-  OFC_LONG lLow ;
-  OFC_LONG lHigh ;
-
-#if 0
-  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
-#endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
+#define SEARCH_CHUNK (1024 * 1024)
+#define SEARCH_MAX_PATTERN (64 * 1024)
+#define SEARCH_MAX_CONTEXT (64 * 1024)
+#define SEARCH_INITIAL_MATCHES 16
 
-  lLow = (OFC_LONG) jlPos & 0xFFFFFFFF ;
-  lHigh = (OFC_LONG) (jlPos >> 32) & 0xFFFFFFFF ;
+typedef struct
+{
+  jlong offset ;
+  jlong line_offset ;
+  OFC_UINT8 *line ;
+  OFC_SIZET line_len ;
+} SEARCH_MATCH ;
 
-  lPos = OfcSetFilePointer (hFile, lLow, &lHigh, OFC_FILE_CURRENT) ;
-  dwLastError = OfcGetLastError () ;
+typedef struct
+{
+  OFC_LPTSTR path ;
+  SEARCH_MATCH *matches ;
+  OFC_INT count ;
+  OFC_INT alloc ;
+  OFC_DWORD error ;
+} SEARCH_FILE ;
+
+typedef struct
+{
+  SEARCH_FILE *files ;
+  OFC_INT count ;
+  OFC_UINT8 *pattern ;
+  OFC_SIZET pattern_len ;
+  OFC_SIZET context ;
+  OFC_INT max_matches ;
+} SEARCH_CONTEXT ;
 
-  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
-      dwLastError != OFC_ERROR_SUCCESS)
+/*
+ * Record a match at buf[pos], where buf holds the file from base.
+ * Returns false, with the file's error set, if there is no memory for
+ * it.
+ */
+static OFC_BOOL search_add (SEARCH_CONTEXT *ctx, SEARCH_FILE *file,
+			    const OFC_UINT8 *buf, OFC_SIZET len,
+			    OFC_SIZET pos, OFC_LARGE_INTEGER base)
+{
+  SEARCH_MATCH *match ;
+  SEARCH_MATCH *matches ;
+  OFC_SIZET start ;
+  OFC_SIZET end ;
+  OFC_SIZET floor ;
+  OFC_SIZET ceiling ;
+
+  if (file->count == file->alloc)
     {
-      jlPos = 0 ;
-      throwio(env) ;
+      matches = ofc_realloc (file->matches,
+			     sizeof (SEARCH_MATCH) * file->alloc * 2) ;
+      if (matches == OFC_NULL)
+	{
+	  file->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+	  return (OFC_FALSE) ;
+	}
+      file->matches = matches ;
+      file->alloc *= 2 ;
     }
-  else
+  match = &file->matches[file->count++] ;
+  match->offset = base + pos ;
+  match->line = OFC_NULL ;
+  match->line_len = 0 ;
+  match->line_offset = match->offset ;
+
+  if (ctx->context > 0)
     {
-      jlPos = ((jlong) lHigh) << 32 | lPos  ;
+      floor = pos > ctx->context ? pos - ctx->context : 0 ;
+      for (start = pos ; start > floor && buf[start-1] != '\n' ; start--) ;
+
+      end = pos + ctx->pattern_len ;
+      ceiling = OFC_MIN (end + ctx->context, len) ;
+      for (; end < ceiling && buf[end] != '\n' ; end++) ;
+      if (end > start && buf[end-1] == '\r')
+	end-- ;
+
+      match->line_offset = base + start ;
+      match->line = ofc_malloc (end > start ? end - start : 1) ;
+      if (match->line == OFC_NULL)
+	{
+	  file->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+	  return (OFC_FALSE) ;
+	}
+      match->line_len = end - start ;
+      ofc_memcpy (match->line, buf + start, match->line_len) ;
     }
-
-  return (jlPos) ;
+  return (OFC_TRUE) ;
 }
 
-/*
- * Class:     com_connectedway_io_FileSystem
- * Method:    flush
-
- * Signature: (Lcom/connectedway/io/FileDescriptor;)V
- */
-JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_flush
-  (JNIEnv *env, jobject objFs, jobject objFd)
+static OFC_VOID search_file (OFC_VOID *context, OFC_INT index)
 {
+  SEARCH_CONTEXT *ctx ;
+  SEARCH_FILE *file ;
   OFC_HANDLE hFile ;
-  OFC_BOOL bStatus ;
+  OFC_UINT8 *buf ;
+  OFC_SIZET size ;
+  OFC_SIZET len ;
+  OFC_SIZET scan ;
+  OFC_SIZET limit ;
+  OFC_SIZET keep ;
+  OFC_SIZET lookahead ;
+  OFC_SIZET nRead ;
+  OFC_LARGE_INTEGER base ;
+  OFC_LONG found ;
+  OFC_BOOL eof ;
 
-#if 0
-  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
-#endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
-  bStatus = OfcFlushFileBuffers (hFile) ;
-  if (bStatus != OFC_TRUE)
+  ctx = context ;
+  file = &ctx->files[index] ;
+  file->count = 0 ;
+  file->alloc = SEARCH_INITIAL_MATCHES ;
+  file->matches = ofc_malloc (sizeof (SEARCH_MATCH) * file->alloc) ;
+  file->error = OFC_ERROR_SUCCESS ;
+  if (file->matches == OFC_NULL)
     {
-      throwio(env) ;
+      file->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      return ;
+    }
+
+  STATS_START (start) ;
+  hFile = OfcCreateFileW (file->path, OFC_GENERIC_READ,
+			  OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			  OFC_NULL, OFC_OPEN_EXISTING,
+			  OFC_FILE_ATTRIBUTE_NORMAL, OFC_HANDLE_NULL) ;
+  if (hFile == OFC_INVALID_HANDLE_VALUE)
+    {
+      file->error = OfcGetLastError () ;
+      STATS_PATH (STATS_OP_READ, start, file->path, 0) ;
+      return ;
     }
-}
 
-/*
- * Class:     com_connectedway_io_FileSystem
- * Method:    available
- * Signature: (Lcom/connectedway/io/FileDescriptor;)I
- */
-JNIEXPORT jint JNICALL Java_com_connectedway_io_FileSystem_available
-  (JNIEnv *env, jobject objFs, jobject objFd)
-{
   /*
-   * We have no way of testing whether we'd block so always return 0.
+   * A candidate needs pattern_len - 1 bytes after its start, and its
+   * line up to context bytes on either side of the match
    */
-  return 0 ;
-}
-
-/*
- * Class:     com_connectedway_io_FileSystem
- * Method:    close
- * Signature: (Lcom/connectedway/io/FileDescriptor;)V
- */
-JNIEXPORT void JNICALL Java_com_connectedway_io_FileSystem_close
-  (JNIEnv *env, jobject objFs, jobject objFd)
-{
-  OFC_HANDLE hFile ;
-  OFC_BOOL bStatus ;
+  lookahead = ctx->pattern_len - 1 + ctx->context ;
+  size = SEARCH_CHUNK + lookahead + ctx->context ;
+  buf = ofc_malloc (size) ;
+  if (buf == OFC_NULL)
+    {
+      file->error = OFC_ERROR_NOT_ENOUGH_MEMORY ;
+      OfcCloseHandle (hFile) ;
+      return ;
+    }
 
-#if 0
-  ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
-#endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
-  bStatus = OfcCloseHandle (hFile) ;
-  if (bStatus != OFC_TRUE)
+  base = 0 ;
+  len = 0 ;
+  scan = 0 ;
+  eof = OFC_FALSE ;
+  while (!eof && file->count < ctx->max_matches)
     {
-      throwio(env) ;
+      if (TransferRegion (hFile, OFC_FALSE, (OFC_CHAR *) buf + len,
+			  size - len, base + len, &nRead) == OFC_FALSE)
+	{
+	  file->error = OfcGetLastError () ;
+	  break ;
+	}
+      eof = nRead < size - len ;
+      len += nRead ;
+
+      /*
+       * Candidates from scan up to limit have all they need in the
+       * buffer, or are at the end of the file
+       */
+      if (eof)
+	limit = len >= ctx->pattern_len ? len - ctx->pattern_len + 1 : 0 ;
+      else
+	limit = len > lookahead ? len - lookahead : 0 ;
+
+      while (scan < limit && file->count < ctx->max_matches)
+	{
+	  found = search_find (buf + scan,
+			       limit - scan + ctx->pattern_len - 1,
+			       ctx->pattern, ctx->pattern_len) ;
+	  if (found < 0)
+	    scan = limit ;
+	  else if (search_add (ctx, file, buf, len, scan + found, base))
+	    scan += found + 1 ;
+	  else
+	    {
+	      scan = limit ;
+	      eof = OFC_TRUE ;
+	    }
+	}
+
+      if (!eof)
+	{
+	  /*
+	   * Carry the unscanned tail, and the context before it, over
+	   * to the front
+	   */
+	  keep = scan > ctx->context ? scan - ctx->context : 0 ;
+	  ofc_memmove (buf, buf + keep, len - keep) ;
+	  base += keep ;
+	  len -= keep ;
+	  scan -= keep ;
+	}
     }
+
+  STATS_PATH (STATS_OP_READ, start, file->path, base + len) ;
+  ofc_free (buf) ;
+  OfcCloseHandle (hFile) ;
 }
 
 /*
  * Class:     com_connectedway_io_FileSystem
- * Method:    seek
- * Signature: (Lcom/connectedway/io/FileDescriptor;IJ)J
+ * Method:    search
+ * Signature: ([Lcom/connectedway/io/File;[BIII[J)[[Lcom/connectedway/io/FileSystem$SearchMatch;
+ *
+ * Without an errors array, the first file that cannot be searched
+ * throws an IOException carrying its error.
  */
-JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_seek
-  (JNIEnv *env, jobject objFs, jobject objFd, jint jiMode, jlong jlPos)
+JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_FileSystem_search
+  (JNIEnv *env, jobject objFs, jobjectArray arrayFiles, jbyteArray arrayPattern,
+   jint jiContext, jint jiMaxMatches, jint jiMaxInFlight,
+   jlongArray arrayErrors)
 {
-  OFC_HANDLE hFile ;
-  OFC_LONG lPos ;
-  OFC_DWORD dwLastError ;
-  OFC_LONG lLow ;
-  OFC_LONG lHigh ;
-  OFC_DWORD dwMode ;
+  SEARCH_CONTEXT ctx ;
+  SEARCH_MATCH *match ;
+  OFC_INT i ;
+  OFC_INT j ;
+  jobject objFile ;
+  jclass clsMatch ;
+  jclass clsMatches ;
+  jmethodID midMatch ;
+  jobjectArray arrayResults ;
+  jobjectArray arrayMatches ;
+  jbyteArray arrayLine ;
+  jobject objMatch ;
+  jlong jlError ;
+  OFC_DWORD error ;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
-  hFile = file_descriptor_get_handle (env, objFd) ;
+  ctx.pattern_len = (*env)->GetArrayLength (env, arrayPattern) ;
+  if (ctx.pattern_len == 0 || ctx.pattern_len > SEARCH_MAX_PATTERN)
+    {
+      throwio_error (env, OFC_ERROR_INVALID_PARAMETER) ;
+      return (OFC_NULL) ;
+    }
+  ctx.pattern = ofc_malloc (ctx.pattern_len) ;
+  if (ctx.pattern == OFC_NULL)
+    {
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_NULL) ;
+    }
+  (*env)->GetByteArrayRegion (env, arrayPattern, 0, (jsize) ctx.pattern_len,
+			      (jbyte *) ctx.pattern) ;
+  ctx.context = jiContext > 0 ?
+    OFC_MIN ((OFC_SIZET) jiContext, SEARCH_MAX_CONTEXT) : 0 ;
+  ctx.max_matches = jiMaxMatches > 0 ? jiMaxMatches : 0x7FFFFFFF ;
+
+  ctx.count = (*env)->GetArrayLength (env, arrayFiles) ;
+  ctx.files = ofc_malloc (sizeof (SEARCH_FILE) *
+			  (ctx.count > 0 ? ctx.count : 1)) ;
+  if (ctx.files == OFC_NULL)
+    {
+      ofc_free (ctx.pattern) ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_NULL) ;
+    }
+  for (i = 0 ; i < ctx.count ; i++)
+    {
+      objFile = (*env)->GetObjectArrayElement (env, arrayFiles, i) ;
+      if (objFile == OFC_NULL)
+	{
+	  while (i > 0)
+	    file_free_path (ctx.files[--i].path) ;
+	  ofc_free (ctx.files) ;
+	  ofc_free (ctx.pattern) ;
+	  throw_new (env, "java/lang/NullPointerException", "Null file") ;
+	  return (OFC_NULL) ;
+	}
+      ctx.files[i].path = file_get_path (env, objFile) ;
+      ctx.files[i].matches = OFC_NULL ;
+      ctx.files[i].count = 0 ;
+      (*env)->DeleteLocalRef (env, objFile) ;
+    }
 
-  lLow = (OFC_LONG) jlPos & 0xFFFFFFFF ;
-  lHigh = (OFC_LONG) (jlPos >> 32) & 0xFFFFFFFF ;
+  work_run (&search_file, &ctx, ctx.count, OFC_MAX (jiMaxInFlight, 1)) ;
 
-  if (jiMode == com_connectedway_io_FileSystem_SEEK_SET)
-    dwMode = OFC_FILE_BEGIN ;
-  else if (jiMode == com_connectedway_io_FileSystem_SEEK_CUR)
-    dwMode = OFC_FILE_CURRENT ;
-  else if (jiMode == com_connectedway_io_FileSystem_SEEK_END)
-    dwMode = OFC_FILE_END ;
+  /*
+   * Without an errors array, a file that could not be searched fails
+   * the call
+   */
+  error = OFC_ERROR_SUCCESS ;
+  if (arrayErrors == OFC_NULL)
+    for (i = 0 ; i < ctx.count && error == OFC_ERROR_SUCCESS ; i++)
+      error = ctx.files[i].error ;
+
+  arrayResults = OFC_NULL ;
+  clsMatch = OFC_NULL ;
+  clsMatches = OFC_NULL ;
+  midMatch = OFC_NULL ;
+  if (error != OFC_ERROR_SUCCESS)
+    throwio_error (env, error) ;
   else
-    dwMode = OFC_FILE_BEGIN ;
-
-  lPos = OfcSetFilePointer (hFile, lLow, &lHigh, dwMode) ;
-  dwLastError = OfcGetLastError () ;
-
-  if (lPos == OFC_INVALID_SET_FILE_POINTER &&
-      dwLastError != OFC_ERROR_SUCCESS)
     {
-      jlPos = 0 ;
-      throwio(env) ;
+      clsMatch = (*env)->FindClass
+	(env, "com/connectedway/io/FileSystem$SearchMatch") ;
+      if (clsMatch != OFC_NULL)
+	midMatch = (*env)->GetMethodID (env, clsMatch, "<init>",
+					"(JJ[B)V") ;
+      if (midMatch != OFC_NULL)
+	clsMatches = (*env)->FindClass
+	  (env, "[Lcom/connectedway/io/FileSystem$SearchMatch;") ;
+      if (clsMatches != OFC_NULL)
+	arrayResults = (*env)->NewObjectArray (env, ctx.count, clsMatches,
+					       NULL) ;
     }
-  else
+
+  /*
+   * Once a JNI call has failed, the rest is only freed
+   */
+  for (i = 0 ; i < ctx.count ; i++)
     {
-      jlPos = ((jlong) lHigh) << 32 | lPos  ;
+      if (arrayResults != OFC_NULL &&
+	  ctx.files[i].error == OFC_ERROR_SUCCESS)
+	{
+	  arrayMatches = (*env)->NewObjectArray (env, ctx.files[i].count,
+						 clsMatch, NULL) ;
+	  for (j = 0 ; arrayMatches != OFC_NULL &&
+		 j < ctx.files[i].count ; j++)
+	    {
+	      match = &ctx.files[i].matches[j] ;
+	      arrayLine = OFC_NULL ;
+	      if (match->line != OFC_NULL)
+		{
+		  arrayLine = (*env)->NewByteArray (env,
+						    (jsize) match->line_len) ;
+		  if (arrayLine == OFC_NULL)
+		    break ;
+		  (*env)->SetByteArrayRegion (env, arrayLine, 0,
+					      (jsize) match->line_len,
+					      (jbyte *) match->line) ;
+		}
+	      objMatch = (*env)->NewObject (env, clsMatch, midMatch,
+					    match->offset, match->line_offset,
+					    arrayLine) ;
+	      if (arrayLine != OFC_NULL)
+		(*env)->DeleteLocalRef (env, arrayLine) ;
+	      if (objMatch == OFC_NULL)
+		break ;
+	      (*env)->SetObjectArrayElement (env, arrayMatches, j, objMatch) ;
+	      (*env)->DeleteLocalRef (env, objMatch) ;
+	    }
+	  if (arrayMatches == OFC_NULL || j < ctx.files[i].count)
+	    {
+	      if (arrayMatches != OFC_NULL)
+		(*env)->DeleteLocalRef (env, arrayMatches) ;
+	      (*env)->DeleteLocalRef (env, arrayResults) ;
+	      arrayResults = OFC_NULL ;
+	    }
+	  else
+	    {
+	      (*env)->SetObjectArrayElement (env, arrayResults, i,
+					     arrayMatches) ;
+	      (*env)->DeleteLocalRef (env, arrayMatches) ;
+	    }
+	}
+      if (arrayResults != OFC_NULL && arrayErrors != OFC_NULL &&
+	  i < (*env)->GetArrayLength (env, arrayErrors))
+	{
+	  jlError = ctx.files[i].error ;
+	  (*env)->SetLongArrayRegion (env, arrayErrors, i, 1, &jlError) ;
+	}
+      for (j = 0 ; j < ctx.files[i].count ; j++)
+	{
+	  if (ctx.files[i].matches[j].line != OFC_NULL)
+	    ofc_free (ctx.files[i].matches[j].line) ;
+	}
+      if (ctx.files[i].matches != OFC_NULL)
+	ofc_free (ctx.files[i].matches) ;
+      file_free_path (ctx.files[i].path) ;
     }
-
-  return (jlPos) ;
+  if (clsMatches != OFC_NULL)
+    (*env)->DeleteLocalRef (env, clsMatches) ;
+  if (clsMatch != OFC_NULL)
+    (*env)->DeleteLocalRef (env, clsMatch) ;
+  ofc_free (ctx.files) ;
+  ofc_free (ctx.pattern) ;
+
+  return (arrayResults) ;
 }
 
 JNIEXPORT jlong JNICALL Java_com_connectedway_io_FileSystem_getLastError
 (JNIEnv *env, jobject objFs) 
 {
   OFC_DWORD lerror ;
+  HEAP_ENTER () ;
 
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
@@ -2472,6 +5719,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_FileSystem_getLastErrorString
 {
   jstring jstr = (jstring) 0 ;
   const char *errstr ;
+  HEAP_ENTER () ;
 #if 0
   ofc_printf ("%s:%s:%d\n", __FILE__, __func__, __LINE__) ;
 #endif
@@ -2504,6 +5752,7 @@ JNIEXPORT jobject Java_com_connectedway_io_FileSystem_findFile(JNIEnv *env, jobj
   jint booleanAttributes ;
   jobject objFile ;
   jobject objParent ;
+  HEAP_ENTER () ;
 
   // 
   // File methods
@@ -2521,6 +5770,9 @@ JNIEXPORT jobject Java_com_connectedway_io_FileSystem_findFile(JNIEnv *env, jobj
   jclass clsDir ;
   jclass clsOfcFile ;
 
+  STATS_START (start) ;
+  TRACE_ENTER () ;
+
   //
   // Get File class and methods
   //
@@ -2581,6 +5833,12 @@ JNIEXPORT jobject Java_com_connectedway_io_FileSystem_findFile(JNIEnv *env, jobj
        * Now do the open and get the first file
        */
       list_handle = OfcFindFirstFileW (tstrPath, find_data, &more) ;
+      if (list_handle != OFC_INVALID_HANDLE_VALUE)
+	{
+	  STATS_BIND (list_handle, tstrPath) ;
+	  if (head_prefetch_wanted (tstrPath))
+	    head_list_add (list_handle) ;
+	}
       ofc_free (tstrPath) ;
         
       if (list_handle == OFC_INVALID_HANDLE_VALUE)
@@ -2701,10 +5959,16 @@ JNIEXPORT jobject Java_com_connectedway_io_FileSystem_findFile(JNIEnv *env, jobj
       jlong date = ((jlong) tv_sec * 1000) + ((jlong) tv_nsec / (1000 * 1000)) ;
       (*env)->CallVoidMethod (env, objFile, midSetDate, date) ;
 
+      if (head_enabled () && head_list_find (list_handle))
+	head_prefetch_queue (env, objFile, find_data) ;
+
       ofc_free (find_data) ;
       find_data = OFC_NULL ;
     }
       
+  STATS_HANDLE (STATS_OP_FIND, start, list_handle, 0) ;
+  TRACE_EXIT () ;
+
   (*env)->DeleteLocalRef (env, objParent) ;
   (*env)->DeleteLocalRef (env, clsOfcFile) ;
   (*env)->DeleteLocalRef (env, clsDir) ;
@@ -2719,6 +5983,7 @@ JNIEXPORT void Java_com_connectedway_io_FileSystem_findClose(JNIEnv *env, jobjec
   jclass clsDir ;
   jmethodID midGetHandle ;
   jmethodID midSetHandle ;
+  HEAP_ENTER () ;
 
   clsDir = (*env)->FindClass (env, "com/connectedway/nio/directory/Directory") ;
 
@@ -2729,6 +5994,8 @@ JNIEXPORT void Java_com_connectedway_io_FileSystem_findClose(JNIEnv *env, jobjec
   if (list_handle != OFC_INVALID_HANDLE_VALUE)
     {
       OfcFindClose (list_handle) ;
+      STATS_UNBIND (list_handle) ;
+      head_list_remove (list_handle) ;
       list_handle = OFC_INVALID_HANDLE_VALUE ;
       (*env)->CallVoidMethod (env, objDir, midSetHandle, (jlong) list_handle) ;
     }      
@@ -19,6 +19,9 @@
 
 #include "ofc_jni/com_connectedway_io_Utils.h"
 #include "ofc_jni/com_connectedway_io_Framework.h"
+#include "ofc_jni/com_connectedway_io_Stats.h"
+#include "ofc_jni/com_connectedway_io_Trace.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
 
 #if defined(__ANDROID__) || defined(ANDROID)
 static OFC_UINT get_library_address() 
@@ -95,7 +98,13 @@ static OFC_UINT get_library_address()
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_init
   (JNIEnv *env, jobject objFramework)
 {
+  HEAP_ENTER () ;
+
   ofc_framework_init() ;
+  heap_init () ;
+  stats_init () ;
+  trace_init () ;
+  filesystem_init () ;
 
 #if defined(__ANDROID__) || defined(ANDROID)
   /* TBD: Fix get_library_addresses on latest android */
@@ -114,6 +123,8 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_init
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_startup
   (JNIEnv *env, jobject objFramework)
 {
+  HEAP_ENTER () ;
+
   ofc_framework_startup() ;
 }
 
@@ -132,6 +143,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_load
   jclass clsBlueFile ;
 
   jstring jstringFile ;
+  HEAP_ENTER () ;
 
   clsBlueFile = (*env)->FindClass
     (env, "com/connectedway/io/File") ;
@@ -149,6 +161,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_load
 
   ofc_framework_load(str) ;
   file_free_path (str) ;
+  credentials_maps_changed () ;
 }
 
 /*
@@ -160,6 +173,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_save
 (JNIEnv *env, jobject objFramework, jobject objFile)
 {
   OFC_LPTSTR str ;
+  HEAP_ENTER () ;
 
   str = file_get_path (env, objFile) ;
   ofc_framework_save(str) ;
@@ -178,6 +192,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setHostname
   OFC_LPTSTR tstrHostname ;
   OFC_LPTSTR tstrWorkgroup ;
   OFC_LPTSTR tstrDesc ;
+  HEAP_ENTER () ;
 
   tstrHostname = jstr2tchar (env, jstrHostname) ;
   tstrWorkgroup = jstr2tchar (env, jstrWorkgroup) ;
@@ -200,6 +215,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_Framework_getHostname
 {
   jstring jstrHostname ;
   OFC_LPTSTR tstrHostname ;
+  HEAP_ENTER () ;
 
   tstrHostname = ofc_framework_get_host_name() ;
 
@@ -220,6 +236,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_Framework_getWorkgroup
 {
   jstring jstrWorkgroup ;
   OFC_LPTSTR tstrWorkgroup ;
+  HEAP_ENTER () ;
 
   tstrWorkgroup = ofc_framework_get_workgroup () ;
 
@@ -240,6 +257,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_Framework_getDescription
 {
   jstring jstrDesc ;
   OFC_LPTSTR tstrDesc ;
+  HEAP_ENTER () ;
 
   tstrDesc = ofc_framework_get_description () ;
 
@@ -262,6 +280,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setUUID
   jstring jstrUUID ;
   jmethodID midToString ;
   jclass clsUUID ;
+  HEAP_ENTER () ;
   
   clsUUID = (*env)->FindClass 
     (env, "java/util/UUID") ;
@@ -291,6 +310,7 @@ JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getUUID
   jobject objUUID ;
   jmethodID midFromString ;
   jclass clsUUID ;
+  HEAP_ENTER () ;
 
   jUUID = ofc_framework_get_uuid() ;
 
@@ -321,6 +341,7 @@ JNIEXPORT jstring JNICALL Java_com_connectedway_io_Framework_getRootDir
 {
   jstring jstrRootDir ;
   OFC_LPTSTR tstrRootDir ;
+  HEAP_ENTER () ;
 
   tstrRootDir = ofc_framework_get_root_dir() ;
 
@@ -340,6 +361,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setInterfaceDiscovery
   (JNIEnv *env, jobject objFramework, jboolean jon)
 {
   OFC_BOOL on ;
+  HEAP_ENTER () ;
 
   on = OFC_FALSE ;
   if (jon)
@@ -356,6 +378,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setNetworkHandle
   (JNIEnv *env, jobject objFramework, jlong handle)
 {
   OFC_UINT64 network_handle;
+  HEAP_ENTER () ;
   
   network_handle = handle;
   ofc_framework_set_network_handle(network_handle) ;
@@ -371,6 +394,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_Framework_getInterfaceDiscov
 {
   OFC_BOOL on ;
   jboolean jon ;
+  HEAP_ENTER () ;
 
   on = ofc_framework_get_interface_discovery() ;
   jon = JNI_FALSE ;
@@ -964,6 +988,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_Framework_setLMB
   OFC_CCHAR *strLmb ;
   jboolean ret ;
   OFC_CHAR ip_addr[IP6STR_LEN] ;
+  HEAP_ENTER () ;
   
   ret = JNI_FALSE ;
   inet_address_to_ipaddr (env, objInetAddress, &ipaddr) ;
@@ -995,6 +1020,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_addInterface
 (JNIEnv *env, jobject objFramework, jobject objInterface)
 {
   OFC_FRAMEWORK_INTERFACE iface ;
+  HEAP_ENTER () ;
 
   iface.netBiosMode = interface_get_netbios_mode (env, objInterface) ;
   interface_get_ip_address (env, objInterface, &iface.ip) ;
@@ -1019,6 +1045,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_removeInterface
   (JNIEnv *env, jobject objFramework, jobject objInetAddress)
 {
   OFC_IPADDR ip ;
+  HEAP_ENTER () ;
 
   inet_address_to_ipaddr (env, objInetAddress, &ip) ;
   ofc_framework_remove_interface (&ip) ;
@@ -1195,6 +1222,7 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_Framework_getInterfaces
 {
   OFC_FRAMEWORK_INTERFACES *interfaces ;
   jobjectArray jinterfaces ;
+  HEAP_ENTER () ;
 
   jinterfaces = OFC_NULL ;
   interfaces = ofc_framework_get_interfaces() ;
@@ -1218,6 +1246,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_Framework_addMap
 {
   OFC_FRAMEWORK_MAP map ;
   jboolean jret ;
+  HEAP_ENTER () ;
 
   jret = JNI_FALSE ;
  
@@ -1231,6 +1260,7 @@ JNIEXPORT jboolean JNICALL Java_com_connectedway_io_Framework_addMap
     jret = JNI_TRUE;
  
   map_free_map (&map) ;
+  credentials_maps_changed () ;
   return (jret);
 }
  
@@ -1244,6 +1274,7 @@ JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_Framework_getMaps
 {
   OFC_FRAMEWORK_MAPS *maps ;
   jobjectArray jmaps ;
+  HEAP_ENTER () ;
  
   jmaps = OFC_NULL ;
   maps = ofc_framework_get_maps() ;
@@ -1265,11 +1296,13 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_removeMap
   (JNIEnv *env, jobject objFramework, jstring prefix)
 {
   OFC_LPTSTR tstrPrefix ;
+  HEAP_ENTER () ;
  
   tstrPrefix = jstr2tchar (env, prefix) ;
  
   ofc_framework_remove_map(tstrPrefix) ;
   ofc_free (tstrPrefix) ;
+  credentials_maps_changed () ;
 }
 
 
@@ -1281,46 +1314,9 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_removeMap
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_update
   (JNIEnv *env, jobject objFramework)
 {
-  ofc_framework_update() ;
-}
-
+  HEAP_ENTER () ;
 
-static jmethodID g_method = 0 ;
-static jobject g_interface = OFC_NULL ;
-static JavaVM* g_jvm = OFC_NULL ;
-static jclass g_serverevent = OFC_NULL ;
-static jmethodID g_midvalueof = 0 ;
-
-static JNIEnv *get_env() 
-{
-  JNIEnv *env;
-  int status ;
-  /* ok, ugly but the Java environment on Darwin has a slightly incorrect
-   * prototype.  
-   */
-#if defined(__ANDROID__) || defined(ANDROID)
-  JNIEnv *envx;
-#elif defined(__APPLE__) || defined(__linux__)
-  void *envx ;
-#else
-  JNIEnv *envx;
-#endif
-
-  if (g_jvm != OFC_NULL)
-    {
-      status = (*g_jvm)->GetEnv(g_jvm, (void **) &env, JNI_VERSION_1_6);
-      if (status < 0) 
-	{
-	  status = (*g_jvm)->AttachCurrentThread (g_jvm, &envx, NULL);
-	  if (status < 0)
-	    env = OFC_NULL ;
-	  else
-	    env = (JNIEnv *) envx ;
-	}
-    }
-  else
-    env = OFC_NULL ;
-  return (env) ;
+  ofc_framework_update() ;
 }
 
 /*
@@ -1332,6 +1328,7 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_println
   (JNIEnv *env, jobject objFramework, jstring out)
 {
   OFC_LPTSTR tstrout ;
+  HEAP_ENTER () ;
 
   tstrout = jstr2tchar (env, out) ;
 
@@ -1343,20 +1340,108 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_println
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setInterfaceFilter
 (JNIEnv *env, jobject objFramework, jint ip)
 {
+  HEAP_ENTER () ;
+
   ofc_framework_set_wifi_ip(ip) ;
 }
   
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_dumpHeap
 (JNIEnv *env, jobject objFramework)
 {
+  HEAP_ENTER () ;
+
   ofc_framework_dump_heap() ;
 }
   
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_statsHeap
 (JNIEnv *env, jobject objFramework)
 {
+  HEAP_ENTER () ;
+
   ofc_framework_stats_heap() ;
 }
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    getHeapStats
+ * Signature: ()Lcom/connectedway/io/HeapStats;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getHeapStats
+(JNIEnv *env, jobject objFramework)
+{
+  HEAP_ENTER () ;
+
+  return (heap_snapshot (env)) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    resetHeapStats
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_resetHeapStats
+(JNIEnv *env, jobject objFramework)
+{
+  HEAP_ENTER () ;
+
+  heap_reset () ;
+}
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    getStats
+ * Signature: ()Lcom/connectedway/io/Stats;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getStats
+(JNIEnv *env, jobject objFramework)
+{
+  HEAP_ENTER () ;
+
+  return (stats_snapshot (env)) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    resetStats
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_resetStats
+(JNIEnv *env, jobject objFramework)
+{
+  HEAP_ENTER () ;
+
+  stats_reset () ;
+}
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    setTrace
+ * Signature: (Z)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setTrace
+(JNIEnv *env, jobject objFramework, jboolean on)
+{
+  HEAP_ENTER () ;
+
+  trace_enable (on == JNI_TRUE ? OFC_TRUE : OFC_FALSE) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Framework
+ * Method:    dumpTrace
+ * Signature: (Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_dumpTrace
+(JNIEnv *env, jobject objFramework, jstring jstrPath)
+{
+  OFC_LPTSTR tstrPath ;
+  HEAP_ENTER () ;
+
+  tstrPath = jstr2tchar (env, jstrPath) ;
+  if (trace_dump (tstrPath) != OFC_TRUE)
+    throwio (env) ;
+  ofc_free (tstrPath) ;
+}
   
 JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getConfig
 (JNIEnv *env, jobject objFramework)
@@ -1364,6 +1449,7 @@ JNIEXPORT jobject JNICALL Java_com_connectedway_io_Framework_getConfig
   OFC_LPVOID buf;
   OFC_SIZET len;
   jbyteArray bArray ;
+  HEAP_ENTER () ;
 
   ofc_framework_savebuf(&buf, &len);
   bArray = (*env)->NewByteArray(env, len) ;
@@ -1377,19 +1463,30 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_putConfig
 {
   OFC_LPVOID buf;
   OFC_SIZET len;
+  jclass exCls ;
+  HEAP_ENTER () ;
 
   len = (OFC_SIZET) (*env)->GetArrayLength(env, plainConfig);
   buf = ofc_malloc(len);
+  if (buf == OFC_NULL)
+    {
+      exCls = (*env)->FindClass (env, "java/lang/OutOfMemoryError") ;
+      if (exCls != NULL)
+	(*env)->ThrowNew (env, exCls, "Cannot load configuration") ;
+      return ;
+    }
 
-  ofc_memcpy(buf, (*env)->GetByteArrayElements(env, plainConfig, 0), len);
+  (*env)->GetByteArrayRegion(env, plainConfig, 0, (jsize) len, buf);
   ofc_framework_loadbuf(buf, len);
   ofc_free(buf);
+  credentials_maps_changed () ;
 }             
 
 JNIEXPORT void JNICALL Java_com_connectedway_io_Framework_setConfigPath
 (JNIEnv *env, jobject objFramework, jstring jstringFile)
 {
   OFC_LPTSTR tstrFile ;
+  HEAP_ENTER () ;
 
   tstrFile = jstr2tchar (env, jstringFile) ;
   ofc_set_config_path(tstrFile);
@@ -0,0 +1,402 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+#define OFC_JNI_HEAP_IMPL
+#include <jni.h>
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/heap.h"
+#include "ofc/libc.h"
+#include "ofc/lock.h"
+#include "ofc/thread.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
+
+#if defined(OFC_JNI_HEAP_STATS)
+/*
+ * A live block.  The table is chained on the block address.
+ */
+typedef struct _HEAP_BLOCK
+{
+  struct _HEAP_BLOCK *next ;
+  OFC_VOID *mem ;
+  OFC_SIZET size ;
+  OFC_INT entry ;
+} HEAP_BLOCK ;
+
+typedef struct
+{
+  OFC_CCHAR *name ;
+  OFC_UINT64 allocs ;
+  OFC_UINT64 frees ;
+  OFC_UINT64 bytes ;
+  OFC_UINT64 total ;
+} HEAP_ENTRY ;
+
+typedef struct
+{
+  OFC_UINT64 bytes ;
+  OFC_UINT64 peak ;
+  OFC_UINT64 allocs ;
+  OFC_UINT64 frees ;
+  OFC_UINT64 hist[HEAP_CLASSES] ;
+} HEAP_TOTALS ;
+
+#define HEAP_TABLE_SLOTS 4096
+#define HEAP_NAME_SIZE 64
+
+/*
+ * Entry 0 is everything allocated outside a JNI entry point
+ */
+static OFC_LOCK heap_lock = OFC_NULL ;
+static OFC_DWORD heap_variable ;
+static HEAP_BLOCK *heap_table[HEAP_TABLE_SLOTS] ;
+static HEAP_TOTALS heap_totals ;
+static HEAP_ENTRY heap_entries[HEAP_MAX_ENTRIES] = { { "native" } } ;
+static volatile OFC_INT heap_entry_count = 1 ;
+
+OFC_VOID heap_init (OFC_VOID)
+{
+  if (heap_lock == OFC_NULL)
+    {
+      heap_variable = ofc_thread_create_variable () ;
+      heap_lock = ofc_lock_init () ;
+    }
+}
+
+/*
+ * Charge the calling thread's allocations to a JNI entry point.  entry
+ * caches the entry point's slot so it is only looked up once.
+ */
+OFC_VOID heap_enter (OFC_CCHAR *name, OFC_INT *entry)
+{
+  OFC_INT i ;
+
+  if (heap_lock == OFC_NULL)
+    return ;
+
+  if (*entry < 0)
+    {
+      ofc_lock (heap_lock) ;
+      for (i = 1 ; i < heap_entry_count && heap_entries[i].name != name ;
+	   i++) ;
+      if (i == heap_entry_count)
+	{
+	  if (i < HEAP_MAX_ENTRIES)
+	    {
+	      heap_entries[i].name = name ;
+	      heap_entry_count = i + 1 ;
+	    }
+	  else
+	    i = 0 ;
+	}
+      *entry = i ;
+      ofc_unlock (heap_lock) ;
+    }
+  ofc_thread_set_variable (heap_variable, (OFC_DWORD_PTR) *entry) ;
+}
+
+static OFC_UINT heap_hash (OFC_VOID *mem)
+{
+  return ((OFC_UINT) ((((OFC_DWORD_PTR) mem >> 4) * 2654435761u) %
+		      HEAP_TABLE_SLOTS)) ;
+}
+
+static OFC_INT heap_class (OFC_SIZET size)
+{
+  OFC_INT class ;
+
+  for (class = 0 ; class < HEAP_CLASSES - 1 &&
+	 size > ((OFC_SIZET) 16 << class) ; class++) ;
+  return (class) ;
+}
+
+static HEAP_BLOCK *heap_untrack (OFC_VOID *mem) ;
+
+/*
+ * Enter a new block in the table.  Called with the heap lock held.  An
+ * entry still held for the address is for a block that ofc freed
+ * without us seeing it, and is dropped.
+ */
+static OFC_VOID heap_track (HEAP_BLOCK *block, OFC_VOID *mem, OFC_SIZET size)
+{
+  HEAP_BLOCK *stale ;
+  HEAP_ENTRY *entry ;
+  OFC_UINT slot ;
+
+  stale = heap_untrack (mem) ;
+  if (stale != OFC_NULL)
+    ofc_free (stale) ;
+
+  block->mem = mem ;
+  block->size = size ;
+  block->entry = (OFC_INT) ofc_thread_get_variable (heap_variable) ;
+
+  slot = heap_hash (mem) ;
+  block->next = heap_table[slot] ;
+  heap_table[slot] = block ;
+
+  heap_totals.allocs++ ;
+  heap_totals.bytes += size ;
+  if (heap_totals.bytes > heap_totals.peak)
+    heap_totals.peak = heap_totals.bytes ;
+  heap_totals.hist[heap_class (size)]++ ;
+
+  entry = &heap_entries[block->entry] ;
+  entry->allocs++ ;
+  entry->bytes += size ;
+  entry->total += size ;
+}
+
+/*
+ * Take a block out of the table.  Called with the heap lock held.
+ * Returns OFC_NULL if the block was not allocated through us.
+ */
+static HEAP_BLOCK *heap_untrack (OFC_VOID *mem)
+{
+  HEAP_BLOCK **link ;
+  HEAP_BLOCK *block ;
+  HEAP_ENTRY *entry ;
+
+  for (link = &heap_table[heap_hash (mem)] ;
+       *link != OFC_NULL && (*link)->mem != mem ; link = &(*link)->next) ;
+
+  block = *link ;
+  if (block != OFC_NULL)
+    {
+      *link = block->next ;
+
+      heap_totals.frees++ ;
+      heap_totals.bytes -= block->size ;
+
+      entry = &heap_entries[block->entry] ;
+      entry->frees++ ;
+      entry->bytes -= block->size ;
+    }
+  return (block) ;
+}
+
+OFC_VOID *heap_malloc (OFC_SIZET size)
+{
+  OFC_VOID *mem ;
+  HEAP_BLOCK *block ;
+
+  mem = ofc_malloc (size) ;
+  if (mem != OFC_NULL && heap_lock != OFC_NULL)
+    {
+      block = ofc_malloc (sizeof (HEAP_BLOCK)) ;
+      if (block != OFC_NULL)
+	{
+	  ofc_lock (heap_lock) ;
+	  heap_track (block, mem, size) ;
+	  ofc_unlock (heap_lock) ;
+	}
+    }
+  return (mem) ;
+}
+
+OFC_VOID *heap_realloc (OFC_VOID *mem, OFC_SIZET size)
+{
+  OFC_VOID *newmem ;
+  HEAP_BLOCK *block ;
+
+  if (mem == OFC_NULL)
+    return (heap_malloc (size)) ;
+
+  newmem = ofc_realloc (mem, size) ;
+  if (newmem != OFC_NULL && heap_lock != OFC_NULL)
+    {
+      /*
+       * Charge the new size to whoever is growing the block.  A block
+       * allocated inside ofc stays untracked, since ofc may free it
+       * without us seeing it.
+       */
+      ofc_lock (heap_lock) ;
+      block = heap_untrack (mem) ;
+      if (block != OFC_NULL)
+	heap_track (block, newmem, size) ;
+      else if (newmem != mem)
+	{
+	  block = heap_untrack (newmem) ;
+	  if (block != OFC_NULL)
+	    ofc_free (block) ;
+	}
+      ofc_unlock (heap_lock) ;
+    }
+  return (newmem) ;
+}
+
+OFC_VOID heap_free (OFC_VOID *mem)
+{
+  HEAP_BLOCK *block ;
+
+  if (mem != OFC_NULL && heap_lock != OFC_NULL)
+    {
+      ofc_lock (heap_lock) ;
+      block = heap_untrack (mem) ;
+      ofc_unlock (heap_lock) ;
+      if (block != OFC_NULL)
+	ofc_free (block) ;
+    }
+  ofc_free (mem) ;
+}
+
+/*
+ * Zero the counters.  Live blocks stay charged to their entry points
+ * and the peak restarts from the bytes currently allocated.
+ */
+OFC_VOID heap_reset (OFC_VOID)
+{
+  OFC_INT i ;
+
+  ofc_lock (heap_lock) ;
+  heap_totals.peak = heap_totals.bytes ;
+  heap_totals.allocs = 0 ;
+  heap_totals.frees = 0 ;
+  ofc_memset (heap_totals.hist, 0, sizeof (heap_totals.hist)) ;
+  for (i = 0 ; i < heap_entry_count ; i++)
+    {
+      heap_entries[i].allocs = 0 ;
+      heap_entries[i].frees = 0 ;
+      heap_entries[i].total = 0 ;
+    }
+  ofc_unlock (heap_lock) ;
+}
+
+/*
+ * Shorten a JNI entry point name, so that
+ * "Java_com_connectedway_io_FileSystem_list" reads as "FileSystem_list"
+ */
+static OFC_VOID heap_name (OFC_CCHAR *name, OFC_CHAR *out)
+{
+  static OFC_CCHAR prefix[] = "Java_com_connectedway_io_" ;
+  OFC_SIZET len ;
+  OFC_INT i ;
+
+  len = ofc_strlen (prefix) ;
+  if (ofc_strncmp (name, prefix, len) == 0)
+    name += len ;
+
+  for (i = 0 ; name[i] != '\0' && i < HEAP_NAME_SIZE - 1 &&
+	 !(name[i] == '_' && name[i+1] == '_') ; i++)
+    out[i] = name[i] ;
+  out[i] = '\0' ;
+}
+
+jobject heap_snapshot (JNIEnv *env)
+{
+  HEAP_TOTALS totals ;
+  HEAP_ENTRY *entries ;
+  OFC_INT entry_count ;
+  OFC_INT i ;
+  OFC_INT j ;
+  jclass clsHeapStats ;
+  jclass clsEntry ;
+  jmethodID midNewHeapStats ;
+  jmethodID midNewEntry ;
+  jobjectArray arrayEntries ;
+  jobject objEntry ;
+  jobject objHeapStats ;
+  jstring jstrName ;
+  jlongArray arrayHist ;
+  OFC_CHAR name[HEAP_NAME_SIZE] ;
+
+  entries = ofc_malloc (sizeof (HEAP_ENTRY) * HEAP_MAX_ENTRIES) ;
+  ofc_lock (heap_lock) ;
+  totals = heap_totals ;
+  entry_count = heap_entry_count ;
+  ofc_memcpy (entries, heap_entries, sizeof (HEAP_ENTRY) * entry_count) ;
+  ofc_unlock (heap_lock) ;
+
+  clsHeapStats = (*env)->FindClass (env, "com/connectedway/io/HeapStats") ;
+  clsEntry = (*env)->FindClass (env, "com/connectedway/io/HeapStats$Entry") ;
+  midNewHeapStats = (*env)->GetMethodID
+    (env, clsHeapStats, "<init>",
+     "(JJJJ[J[Lcom/connectedway/io/HeapStats$Entry;)V") ;
+  midNewEntry = (*env)->GetMethodID
+    (env, clsEntry, "<init>", "(Ljava/lang/String;JJJJ)V") ;
+
+  j = 0 ;
+  for (i = 0 ; i < entry_count ; i++)
+    if (entries[i].allocs > 0 || entries[i].bytes > 0)
+      j++ ;
+
+  arrayEntries = (*env)->NewObjectArray (env, j, clsEntry, NULL) ;
+  j = 0 ;
+  for (i = 0 ; i < entry_count ; i++)
+    {
+      if (entries[i].allocs == 0 && entries[i].bytes == 0)
+	continue ;
+
+      heap_name (entries[i].name, name) ;
+      jstrName = (*env)->NewStringUTF (env, name) ;
+      objEntry = (*env)->NewObject (env, clsEntry, midNewEntry, jstrName,
+				    (jlong) entries[i].allocs,
+				    (jlong) entries[i].frees,
+				    (jlong) entries[i].bytes,
+				    (jlong) entries[i].total) ;
+      (*env)->SetObjectArrayElement (env, arrayEntries, j++, objEntry) ;
+      (*env)->DeleteLocalRef (env, objEntry) ;
+      (*env)->DeleteLocalRef (env, jstrName) ;
+    }
+
+  arrayHist = (*env)->NewLongArray (env, HEAP_CLASSES) ;
+  (*env)->SetLongArrayRegion (env, arrayHist, 0, HEAP_CLASSES,
+			      (jlong *) totals.hist) ;
+
+  objHeapStats = (*env)->NewObject (env, clsHeapStats, midNewHeapStats,
+				    (jlong) totals.bytes,
+				    (jlong) totals.peak,
+				    (jlong) totals.allocs,
+				    (jlong) totals.frees,
+				    arrayHist, arrayEntries) ;
+
+  (*env)->DeleteLocalRef (env, arrayHist) ;
+  (*env)->DeleteLocalRef (env, arrayEntries) ;
+  (*env)->DeleteLocalRef (env, clsEntry) ;
+  (*env)->DeleteLocalRef (env, clsHeapStats) ;
+  ofc_free (entries) ;
+
+  return (objHeapStats) ;
+}
+
+#else
+
+OFC_VOID heap_init (OFC_VOID)
+{
+}
+
+OFC_VOID heap_enter (OFC_CCHAR *name, OFC_INT *entry)
+{
+}
+
+OFC_VOID *heap_malloc (OFC_SIZET size)
+{
+  return (ofc_malloc (size)) ;
+}
+
+OFC_VOID *heap_realloc (OFC_VOID *mem, OFC_SIZET size)
+{
+  return (ofc_realloc (mem, size)) ;
+}
+
+OFC_VOID heap_free (OFC_VOID *mem)
+{
+  ofc_free (mem) ;
+}
+
+OFC_VOID heap_reset (OFC_VOID)
+{
+}
+
+jobject heap_snapshot (JNIEnv *env)
+{
+  return (OFC_NULL) ;
+}
+
+#endif
@@ -0,0 +1,950 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+#include <jni.h>
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/heap.h"
+#include "ofc/libc.h"
+#include "ofc/handle.h"
+#include "ofc/lock.h"
+#include "ofc/event.h"
+#include "ofc/thread.h"
+#include "ofc/file.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_MappedRegion.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
+
+/*
+ * Native page cache behind MappedRegion
+ *
+ * A mapped region is a window on a file divided into MAP_PAGE_SIZE
+ * pages.  A page has no memory until it is touched, at which point a
+ * frame is taken from the cache and filled with an overlapped read.
+ * Frames are shared by every region and bounded by the cache budget.
+ * When the budget is reached, the least recently used frame is
+ * written back if dirty and reassigned.
+ *
+ * Each region has its own lock, which orders the faults, copies and
+ * writebacks of that region, so regions do not wait on each other's
+ * I/O.  The map lock only guards the frames and the page tables, and
+ * is never held across a transfer.  A frame is pinned while a region
+ * is reading into it, copying through it or writing it back, and a
+ * pinned frame is never evicted.  A fault that finds every frame
+ * pinned waits for one to be unpinned.  Evicting a dirty frame of
+ * another region marks that region busy until the writeback is done,
+ * and destroying a region waits until it is not busy.  The Java side
+ * keeps a region from being destroyed under any of its own calls.
+ *
+ * A frame handed out to Java as a ByteBuffer is held: it keeps a pin
+ * and stays with its region until the region is destroyed, so the
+ * buffer never aliases another page.  Held frames count against the
+ * budget, and a fault that finds every frame held fails rather than
+ * waits.  The pages of a writable region that are held are written
+ * back on every writeback, since Java may have changed them at any
+ * time.
+ *
+ * Frames are recycled rather than freed so that a ByteBuffer handed
+ * out for a page never points at released memory, even when used
+ * after its region was closed.  When the budget is lowered, frames
+ * that were never handed out are freed, and the rest are retired, to
+ * be reused before any new frame is allocated.
+ */
+#define MAP_PAGE_SIZE (64 * 1024)
+#define MAP_DEFAULT_CACHE_SIZE (64 * 1024 * 1024)
+
+typedef struct _MAP_REGION MAP_REGION ;
+
+typedef struct _MAP_FRAME
+{
+  struct _MAP_FRAME *next ;
+  OFC_CHAR *data ;
+  MAP_REGION *region ;
+  OFC_ULONG page ;
+  OFC_BOOL dirty ;
+  OFC_BOOL exposed ;
+  OFC_BOOL held ;
+  OFC_INT pins ;
+  OFC_UINT64 stamp ;
+} MAP_FRAME ;
+
+struct _MAP_REGION
+{
+  OFC_HANDLE hFile ;
+  OFC_LARGE_INTEGER pos ;
+  OFC_LARGE_INTEGER size ;
+  OFC_BOOL writable ;
+  OFC_ULONG page_count ;
+  MAP_FRAME **pages ;
+  OFC_LOCK lock ;
+  OFC_INT busy ;
+  OFC_HANDLE idle ;
+} ;
+
+typedef struct _MAP_WAITER
+{
+  struct _MAP_WAITER *next ;
+  OFC_HANDLE event ;
+} MAP_WAITER ;
+
+static OFC_LOCK map_lock = OFC_NULL ;
+static MAP_FRAME **map_frames = OFC_NULL ;
+static OFC_ULONG map_frame_count = 0 ;
+static OFC_ULONG map_frame_limit = MAP_DEFAULT_CACHE_SIZE / MAP_PAGE_SIZE ;
+static MAP_FRAME *map_retired = OFC_NULL ;
+static MAP_WAITER *map_waiters = OFC_NULL ;
+static OFC_UINT64 map_clock = 0 ;
+
+/*
+ * Number of valid bytes in a page.  Only the last page of a region is
+ * short.
+ */
+static OFC_SIZET map_page_len (MAP_REGION *region, OFC_ULONG page)
+{
+  OFC_LARGE_INTEGER start ;
+
+  start = (OFC_LARGE_INTEGER) page * MAP_PAGE_SIZE ;
+  return ((OFC_SIZET) OFC_MIN (MAP_PAGE_SIZE, region->size - start)) ;
+}
+
+/*
+ * Wait for a frame to be unpinned.  Called with the map lock held,
+ * which is dropped while waiting.
+ */
+static OFC_VOID map_wait (OFC_VOID)
+{
+  MAP_WAITER waiter ;
+
+  waiter.event = ofc_event_create (OFC_EVENT_AUTO) ;
+  waiter.next = map_waiters ;
+  map_waiters = &waiter ;
+  ofc_unlock (map_lock) ;
+  ofc_event_wait (waiter.event) ;
+  ofc_lock (map_lock) ;
+  ofc_event_destroy (waiter.event) ;
+}
+
+/*
+ * Called with the map lock held.  Waiters are woken once only the hold,
+ * if any, is left, so that a fault can see that it would wait forever.
+ */
+static OFC_VOID map_unpin_frame (MAP_FRAME *frame)
+{
+  MAP_WAITER *waiter ;
+
+  frame->pins-- ;
+  if (frame->pins == (frame->held ? 1 : 0))
+    {
+      while (map_waiters != OFC_NULL)
+	{
+	  waiter = map_waiters ;
+	  map_waiters = waiter->next ;
+	  ofc_event_set (waiter->event) ;
+	}
+    }
+}
+
+/*
+ * Unpin pages [first, last] of a region
+ */
+static OFC_VOID map_unpin (MAP_REGION *region, OFC_ULONG first,
+			   OFC_ULONG last)
+{
+  OFC_ULONG page ;
+
+  ofc_lock (map_lock) ;
+  for (page = first ; page <= last ; page++)
+    if (region->pages[page] != OFC_NULL)
+      map_unpin_frame (region->pages[page]) ;
+  ofc_unlock (map_lock) ;
+}
+
+/*
+ * Write back a run of consecutive pages of a region in one vectored
+ * transfer.  The pages are pinned, so no lock is held.
+ */
+static OFC_BOOL map_write_run (MAP_REGION *region, OFC_ULONG first,
+			       OFC_ULONG count)
+{
+  OFC_IO_SEGMENT *segments ;
+  OFC_ULONG i ;
+  OFC_SIZET len ;
+  OFC_SIZET written ;
+  OFC_BOOL ret ;
+
+  segments = ofc_malloc (sizeof (OFC_IO_SEGMENT) * count) ;
+  if (segments == OFC_NULL)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_FALSE) ;
+    }
+
+  len = 0 ;
+  for (i = 0 ; i < count ; i++)
+    {
+      segments[i].data = region->pages[first + i]->data ;
+      segments[i].len = map_page_len (region, first + i) ;
+      len += segments[i].len ;
+    }
+
+  ret = TransferSegments (region->hFile, OFC_TRUE, segments, count,
+			  region->pos + (OFC_LARGE_INTEGER) first * MAP_PAGE_SIZE,
+			  &written) ;
+  if (ret == OFC_TRUE && written != len)
+    ret = OFC_FALSE ;
+
+  ofc_free (segments) ;
+  return (ret) ;
+}
+
+/*
+ * Write back every dirty page of a region.  Called with the region's
+ * lock held.  A run is marked clean before it is written, so that a
+ * page dirtied again meanwhile is written again, and dirty again if
+ * the write fails.  A held page of a writable region is always dirty.
+ */
+static OFC_BOOL map_page_dirty (MAP_REGION *region, OFC_ULONG page)
+{
+  MAP_FRAME *frame ;
+
+  frame = region->pages[page] ;
+  return (frame != OFC_NULL &&
+	  (frame->dirty || (frame->held && region->writable))) ;
+}
+
+static OFC_BOOL map_writeback (MAP_REGION *region)
+{
+  OFC_ULONG page ;
+  OFC_ULONG first ;
+  OFC_ULONG i ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  page = 0 ;
+  ofc_lock (map_lock) ;
+  while (page < region->page_count)
+    {
+      if (map_page_dirty (region, page))
+	{
+	  first = page ;
+	  while (page < region->page_count && map_page_dirty (region, page))
+	    {
+	      region->pages[page]->dirty = OFC_FALSE ;
+	      region->pages[page]->pins++ ;
+	      page++ ;
+	    }
+
+	  ofc_unlock (map_lock) ;
+	  if (map_write_run (region, first, page - first) == OFC_FALSE)
+	    ret = OFC_FALSE ;
+	  ofc_lock (map_lock) ;
+
+	  for (i = first ; i < page ; i++)
+	    {
+	      if (ret == OFC_FALSE)
+		region->pages[i]->dirty = OFC_TRUE ;
+	      map_unpin_frame (region->pages[i]) ;
+	    }
+	}
+      else
+	page++ ;
+    }
+  ofc_unlock (map_lock) ;
+  return (ret) ;
+}
+
+/*
+ * Detach an unpinned frame from the page it caches, writing it back
+ * first if it is dirty.  Called with the map lock held, which is
+ * dropped for the writeback.  Returns false if the frame was pinned or
+ * dirtied again meanwhile and so was left in place.
+ */
+static OFC_BOOL map_frame_evict (MAP_FRAME *frame)
+{
+  MAP_REGION *region ;
+
+  region = frame->region ;
+  if (frame->dirty)
+    {
+      frame->dirty = OFC_FALSE ;
+      frame->pins++ ;
+      region->busy++ ;
+      ofc_unlock (map_lock) ;
+      /*
+       * A failed writeback of the victim loses its updates.  Report
+       * it rather than stall the fault.
+       */
+      if (map_write_run (region, frame->page, 1) == OFC_FALSE)
+	ofc_log (OFC_LOG_WARN, "%s: Failed to write back evicted page\n",
+		 __func__) ;
+      ofc_lock (map_lock) ;
+      region->busy-- ;
+      if (region->busy == 0)
+	ofc_event_set (region->idle) ;
+      map_unpin_frame (frame) ;
+    }
+
+  if (frame->pins > 0 || frame->dirty)
+    return (OFC_FALSE) ;
+
+  region->pages[frame->page] = OFC_NULL ;
+  frame->region = OFC_NULL ;
+  return (OFC_TRUE) ;
+}
+
+/*
+ * A frame for a cache that is under budget.  Retired frames are reused
+ * first.  Called with the map lock held.
+ */
+static MAP_FRAME *map_frame_new (OFC_VOID)
+{
+  MAP_FRAME *frame ;
+  MAP_FRAME **frames ;
+
+  frames = ofc_realloc (map_frames, sizeof (MAP_FRAME *) *
+			(map_frame_count + 1)) ;
+  if (frames == OFC_NULL)
+    return (OFC_NULL) ;
+  map_frames = frames ;
+
+  frame = map_retired ;
+  if (frame != OFC_NULL)
+    map_retired = frame->next ;
+  else
+    {
+      frame = ofc_malloc (sizeof (MAP_FRAME)) ;
+      if (frame != OFC_NULL)
+	{
+	  frame->data = ofc_malloc (MAP_PAGE_SIZE) ;
+	  if (frame->data == OFC_NULL)
+	    {
+	      ofc_free (frame) ;
+	      frame = OFC_NULL ;
+	    }
+	  else
+	    frame->exposed = OFC_FALSE ;
+	}
+    }
+
+  if (frame != OFC_NULL)
+    {
+      frame->next = OFC_NULL ;
+      frame->region = OFC_NULL ;
+      frame->dirty = OFC_FALSE ;
+      frame->held = OFC_FALSE ;
+      frame->pins = 0 ;
+      frame->stamp = 0 ;
+      map_frames[map_frame_count++] = frame ;
+    }
+  return (frame) ;
+}
+
+/*
+ * Get a pinned frame for a page.  Prefers an unused frame, then grows
+ * the cache up to the budget, then evicts the least recently used
+ * unpinned frame.  Returns null if there is none, with busy set if
+ * a frame is pinned by something other than its hold and so will come
+ * free.  Called with the map lock held, which may be dropped.
+ */
+static MAP_FRAME *map_frame_get (OFC_BOOL *busy)
+{
+  MAP_FRAME *frame ;
+  MAP_FRAME *victim ;
+  OFC_ULONG i ;
+
+  do
+    {
+      *busy = OFC_FALSE ;
+      frame = OFC_NULL ;
+      victim = OFC_NULL ;
+      for (i = 0 ; i < map_frame_count && frame == OFC_NULL ; i++)
+	{
+	  if (map_frames[i]->pins > 0)
+	    {
+	      if (map_frames[i]->pins > (map_frames[i]->held ? 1 : 0))
+		*busy = OFC_TRUE ;
+	    }
+	  else if (map_frames[i]->region == OFC_NULL)
+	    frame = map_frames[i] ;
+	  else if (victim == OFC_NULL ||
+		   map_frames[i]->stamp < victim->stamp)
+	    victim = map_frames[i] ;
+	}
+
+      if (frame == OFC_NULL && map_frame_count < map_frame_limit)
+	frame = map_frame_new () ;
+
+      if (frame == OFC_NULL && victim == OFC_NULL)
+	return (OFC_NULL) ;
+    }
+  while (frame == OFC_NULL && map_frame_evict (victim) == OFC_FALSE) ;
+
+  if (frame == OFC_NULL)
+    frame = victim ;
+  frame->pins = 1 ;
+  *busy = OFC_FALSE ;
+  return (frame) ;
+}
+
+/*
+ * Fault in pages [first, *last] of a region and pin them.  Runs of
+ * missing pages are read with one vectored transfer each so the pages
+ * of a run are in flight together.  If frames run out part way, *last
+ * is pulled in to the pages that were pinned.  The caller unpins
+ * [first, *last] when done with them.  Called with the region's lock
+ * held.
+ */
+static OFC_BOOL map_fault (MAP_REGION *region, OFC_ULONG first,
+			   OFC_ULONG *last, OFC_BOOL dirty)
+{
+  OFC_ULONG page ;
+  OFC_ULONG run ;
+  OFC_ULONG count ;
+  OFC_IO_SEGMENT *segments ;
+  OFC_SIZET nRead ;
+  OFC_SIZET len ;
+  OFC_BOOL ret ;
+  OFC_BOOL busy ;
+  MAP_FRAME *frame ;
+
+  /*
+   * Never fault more pages at once than the cache can hold
+   */
+  if (*last - first + 1 > map_frame_limit)
+    *last = first + map_frame_limit - 1 ;
+
+  segments = ofc_malloc (sizeof (OFC_IO_SEGMENT) * (*last - first + 1)) ;
+  if (segments == OFC_NULL)
+    {
+      ofc_thread_set_variable (OfcLastError,
+			       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_FALSE) ;
+    }
+
+  ret = OFC_TRUE ;
+  ofc_lock (map_lock) ;
+  page = first ;
+  while (ret == OFC_TRUE && page <= *last)
+    {
+      frame = region->pages[page] ;
+      if (frame != OFC_NULL)
+	{
+	  frame->pins++ ;
+	  frame->stamp = ++map_clock ;
+	  if (dirty)
+	    frame->dirty = OFC_TRUE ;
+	  page++ ;
+	  continue ;
+	}
+
+      run = page ;
+      count = 0 ;
+      len = 0 ;
+      while (page <= *last && region->pages[page] == OFC_NULL)
+	{
+	  frame = map_frame_get (&busy) ;
+	  if (frame == OFC_NULL)
+	    {
+	      /*
+	       * Settle for the pages already pinned rather than wait
+	       * while holding them
+	       */
+	      if (page > first)
+		*last = page - 1 ;
+	      else if (busy)
+		map_wait () ;
+	      else
+		break ;
+	      continue ;
+	    }
+	  frame->region = region ;
+	  frame->page = page ;
+	  frame->dirty = OFC_FALSE ;
+	  frame->stamp = ++map_clock ;
+	  region->pages[page] = frame ;
+	  segments[count].data = frame->data ;
+	  segments[count].len = map_page_len (region, page) ;
+	  len += segments[count].len ;
+	  count++ ;
+	  page++ ;
+	}
+
+      if (count == 0)
+	{
+	  if (page <= *last)
+	    {
+	      ofc_thread_set_variable (OfcLastError,
+				       (OFC_DWORD_PTR) OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+	      ret = OFC_FALSE ;
+	    }
+	  continue ;
+	}
+
+      /*
+       * The frames of the run are pinned and the region is ours, so
+       * nobody else touches them during the read
+       */
+      ofc_unlock (map_lock) ;
+      ret = TransferSegments (region->hFile, OFC_FALSE, segments, count,
+			      region->pos +
+			      (OFC_LARGE_INTEGER) run * MAP_PAGE_SIZE,
+			      &nRead) ;
+      if (ret == OFC_TRUE && nRead < len)
+	{
+	  /*
+	   * A region may extend beyond the end of the file
+	   */
+	  OFC_ULONG i ;
+	  OFC_SIZET seen ;
+
+	  seen = 0 ;
+	  for (i = 0 ; i < count ; i++)
+	    {
+	      if (seen + segments[i].len > nRead)
+		ofc_memset (segments[i].data +
+			    (nRead > seen ? nRead - seen : 0), 0,
+			    segments[i].len -
+			    (nRead > seen ? nRead - seen : 0)) ;
+	      seen += segments[i].len ;
+	    }
+	}
+      ofc_lock (map_lock) ;
+
+      for (; count > 0 ; count--)
+	{
+	  frame = region->pages[run + count - 1] ;
+	  if (ret == OFC_TRUE)
+	    frame->dirty = dirty ;
+	  else
+	    {
+	      region->pages[run + count - 1] = OFC_NULL ;
+	      frame->region = OFC_NULL ;
+	      map_unpin_frame (frame) ;
+	    }
+	}
+    }
+
+  if (ret == OFC_FALSE)
+    {
+      for (; page > first ; page--)
+	if (region->pages[page - 1] != OFC_NULL)
+	  map_unpin_frame (region->pages[page - 1]) ;
+    }
+  ofc_unlock (map_lock) ;
+
+  ofc_free (segments) ;
+  return (ret) ;
+}
+
+static MAP_REGION *map_region (jlong jlHandle)
+{
+  return ((MAP_REGION *) (OFC_DWORD_PTR) jlHandle) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    init
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_init
+  (JNIEnv *env, jclass clsRegion)
+{
+  HEAP_ENTER () ;
+
+  if (map_lock == OFC_NULL)
+    map_lock = ofc_lock_init () ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    setCacheSize
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_setCacheSize
+  (JNIEnv *env, jclass clsRegion, jlong jlSize)
+{
+  OFC_ULONG i ;
+  OFC_ULONG limit ;
+  MAP_FRAME *frame ;
+  HEAP_ENTER () ;
+
+  limit = (OFC_ULONG) (jlSize / MAP_PAGE_SIZE) ;
+  if (limit == 0)
+    limit = 1 ;
+
+  ofc_lock (map_lock) ;
+  map_frame_limit = limit ;
+  /*
+   * Shed frames over the new budget, unused ones first, then least
+   * recently used.  Pinned frames are left for a later call.
+   */
+  while (map_frame_count > map_frame_limit)
+    {
+      frame = OFC_NULL ;
+      for (i = 0 ; i < map_frame_count ; i++)
+	{
+	  if (map_frames[i]->pins == 0 &&
+	      (frame == OFC_NULL ||
+	       (frame->region != OFC_NULL &&
+		(map_frames[i]->region == OFC_NULL ||
+		 map_frames[i]->stamp < frame->stamp))))
+	    frame = map_frames[i] ;
+	}
+      if (frame == OFC_NULL)
+	break ;
+
+      if (frame->region != OFC_NULL && map_frame_evict (frame) == OFC_FALSE)
+	continue ;
+
+      for (i = 0 ; map_frames[i] != frame ; i++) ;
+      map_frames[i] = map_frames[--map_frame_count] ;
+      /*
+       * Java may still hold a buffer over a frame it was handed
+       */
+      if (frame->exposed)
+	{
+	  frame->next = map_retired ;
+	  map_retired = frame ;
+	}
+      else
+	{
+	  ofc_free (frame->data) ;
+	  ofc_free (frame) ;
+	}
+    }
+  ofc_unlock (map_lock) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    getCacheSize
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_MappedRegion_getCacheSize
+  (JNIEnv *env, jclass clsRegion)
+{
+  HEAP_ENTER () ;
+
+  return ((jlong) map_frame_limit * MAP_PAGE_SIZE) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    getPageSize
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_MappedRegion_getPageSize
+  (JNIEnv *env, jclass clsRegion)
+{
+  HEAP_ENTER () ;
+
+  return (MAP_PAGE_SIZE) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    create
+ * Signature: (Lcom/connectedway/io/FileDescriptor;JJZ)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_MappedRegion_create
+  (JNIEnv *env, jobject objRegion, jobject objFd, jlong jlPos, jlong jlSize,
+   jboolean zWritable)
+{
+  MAP_REGION *region ;
+  OFC_ULONG slots ;
+  HEAP_ENTER () ;
+
+  region = ofc_malloc (sizeof (MAP_REGION)) ;
+  if (region == OFC_NULL)
+    {
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+
+  region->hFile = file_descriptor_get_handle (env, objFd) ;
+  if ((*env)->ExceptionCheck (env) || region->hFile == OFC_HANDLE_NULL ||
+      region->hFile == OFC_INVALID_HANDLE_VALUE)
+    {
+      ofc_free (region) ;
+      if (!(*env)->ExceptionCheck (env))
+	throwio_error (env, OFC_ERROR_INVALID_HANDLE) ;
+      return (0) ;
+    }
+  region->pos = jlPos ;
+  region->size = jlSize ;
+  region->writable = zWritable == JNI_TRUE ? OFC_TRUE : OFC_FALSE ;
+  region->page_count = (OFC_ULONG) ((jlSize + MAP_PAGE_SIZE - 1) /
+				    MAP_PAGE_SIZE) ;
+  slots = region->page_count > 0 ? region->page_count : 1 ;
+  region->pages = ofc_malloc (sizeof (MAP_FRAME *) * slots) ;
+  if (region->pages == OFC_NULL)
+    {
+      ofc_free (region) ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+  ofc_memset (region->pages, 0, sizeof (MAP_FRAME *) * slots) ;
+  region->lock = ofc_lock_init () ;
+  region->busy = 0 ;
+  region->idle = ofc_event_create (OFC_EVENT_AUTO) ;
+  if (region->lock == OFC_NULL || region->idle == OFC_HANDLE_NULL)
+    {
+      if (region->lock != OFC_NULL)
+	ofc_lock_destroy (region->lock) ;
+      if (region->idle != OFC_HANDLE_NULL)
+	ofc_event_destroy (region->idle) ;
+      ofc_free (region->pages) ;
+      ofc_free (region) ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+
+  return ((jlong) (OFC_DWORD_PTR) region) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    load
+ * Signature: (JJJ)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_load
+  (JNIEnv *env, jobject objRegion, jlong jlHandle, jlong jlOffset,
+   jlong jlLen)
+{
+  MAP_REGION *region ;
+  OFC_ULONG first ;
+  OFC_ULONG last ;
+  OFC_BOOL ret ;
+  HEAP_ENTER () ;
+
+  region = map_region (jlHandle) ;
+  if (jlLen > 0)
+    {
+      first = (OFC_ULONG) (jlOffset / MAP_PAGE_SIZE) ;
+      last = (OFC_ULONG) ((jlOffset + jlLen - 1) / MAP_PAGE_SIZE) ;
+      ofc_lock (region->lock) ;
+      ret = map_fault (region, first, &last, OFC_FALSE) ;
+      if (ret == OFC_TRUE)
+	map_unpin (region, first, last) ;
+      ofc_unlock (region->lock) ;
+      if (ret == OFC_FALSE)
+	throwio (env) ;
+    }
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    page
+ * Signature: (JJZ)Ljava/nio/ByteBuffer;
+ *
+ * Fault in the page holding offset and return a direct buffer over its
+ * frame.  The frame is held by the region until it is destroyed.
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_MappedRegion_page
+  (JNIEnv *env, jobject objRegion, jlong jlHandle, jlong jlOffset,
+   jboolean zWrite)
+{
+  MAP_REGION *region ;
+  MAP_FRAME *frame ;
+  OFC_ULONG page ;
+  OFC_ULONG last ;
+  jobject objBuffer ;
+  HEAP_ENTER () ;
+
+  region = map_region (jlHandle) ;
+  page = (OFC_ULONG) (jlOffset / MAP_PAGE_SIZE) ;
+  last = page ;
+
+  objBuffer = OFC_NULL ;
+  ofc_lock (region->lock) ;
+  if (map_fault (region, page, &last, zWrite == JNI_TRUE) == OFC_TRUE)
+    {
+      frame = region->pages[page] ;
+      objBuffer = (*env)->NewDirectByteBuffer (env, frame->data,
+					       map_page_len (region, page)) ;
+      ofc_lock (map_lock) ;
+      /*
+       * The pin from the fault becomes the hold, unless the page is
+       * held already or no buffer was made
+       */
+      if (objBuffer != OFC_NULL)
+	frame->exposed = OFC_TRUE ;
+      if (objBuffer != OFC_NULL && !frame->held)
+	frame->held = OFC_TRUE ;
+      else
+	map_unpin_frame (frame) ;
+      ofc_unlock (map_lock) ;
+    }
+  ofc_unlock (region->lock) ;
+
+  if (objBuffer == OFC_NULL && !(*env)->ExceptionCheck (env))
+    throwio (env) ;
+  return (objBuffer) ;
+}
+
+/*
+ * Copy between a java array and a range of the region, faulting pages
+ * as needed
+ */
+static OFC_BOOL map_copy (JNIEnv *env, MAP_REGION *region, jlong jlOffset,
+			  jbyteArray arrayB, jint jiOff, jint jiLen,
+			  OFC_BOOL bWrite)
+{
+  OFC_ULONG first ;
+  OFC_ULONG page ;
+  OFC_ULONG last ;
+  OFC_SIZET page_off ;
+  OFC_SIZET len ;
+  OFC_BOOL ret ;
+
+  ret = OFC_TRUE ;
+  ofc_lock (region->lock) ;
+  while (ret == OFC_TRUE && jiLen > 0)
+    {
+      first = (OFC_ULONG) (jlOffset / MAP_PAGE_SIZE) ;
+      page_off = (OFC_SIZET) (jlOffset % MAP_PAGE_SIZE) ;
+      /*
+       * Fault the whole remaining range up front so that the pages are
+       * read together
+       */
+      last = (OFC_ULONG) ((jlOffset + jiLen - 1) / MAP_PAGE_SIZE) ;
+      ret = map_fault (region, first, &last, bWrite) ;
+      for (page = first ; ret == OFC_TRUE && page <= last ; page++)
+	{
+	  len = OFC_MIN ((OFC_SIZET) jiLen,
+			 map_page_len (region, page) - page_off) ;
+	  if (bWrite)
+	    (*env)->GetByteArrayRegion (env, arrayB, jiOff, (jsize) len,
+					(jbyte *) region->pages[page]->data +
+					page_off) ;
+	  else
+	    (*env)->SetByteArrayRegion (env, arrayB, jiOff, (jsize) len,
+					(jbyte *) region->pages[page]->data +
+					page_off) ;
+	  jlOffset += len ;
+	  jiOff += (jint) len ;
+	  jiLen -= (jint) len ;
+	  page_off = 0 ;
+	}
+      if (ret == OFC_TRUE)
+	map_unpin (region, first, last) ;
+    }
+  ofc_unlock (region->lock) ;
+  return (ret) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    get
+ * Signature: (JJ[BII)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_get
+  (JNIEnv *env, jobject objRegion, jlong jlHandle, jlong jlOffset,
+   jbyteArray arrayB, jint jiOff, jint jiLen)
+{
+  HEAP_ENTER () ;
+
+  if (map_copy (env, map_region (jlHandle), jlOffset, arrayB, jiOff, jiLen,
+		OFC_FALSE) == OFC_FALSE)
+    throwio (env) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    put
+ * Signature: (JJ[BII)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_put
+  (JNIEnv *env, jobject objRegion, jlong jlHandle, jlong jlOffset,
+   jbyteArray arrayB, jint jiOff, jint jiLen)
+{
+  HEAP_ENTER () ;
+
+  if (map_copy (env, map_region (jlHandle), jlOffset, arrayB, jiOff, jiLen,
+		OFC_TRUE) == OFC_FALSE)
+    throwio (env) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    force
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_force
+  (JNIEnv *env, jobject objRegion, jlong jlHandle)
+{
+  MAP_REGION *region ;
+  OFC_BOOL ret ;
+  HEAP_ENTER () ;
+
+  region = map_region (jlHandle) ;
+  ofc_lock (region->lock) ;
+  ret = map_writeback (region) ;
+  ofc_unlock (region->lock) ;
+
+  if (ret == OFC_FALSE)
+    throwio (env) ;
+}
+
+/*
+ * Class:     com_connectedway_io_MappedRegion
+ * Method:    destroy
+ * Signature: (J)V
+ *
+ * Write back the region and give its frames back to the cache.  Java
+ * only calls this once no other call on the region is in progress.
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_MappedRegion_destroy
+  (JNIEnv *env, jobject objRegion, jlong jlHandle)
+{
+  MAP_REGION *region ;
+  OFC_ULONG page ;
+  OFC_BOOL ret ;
+  HEAP_ENTER () ;
+
+  region = map_region (jlHandle) ;
+
+  ofc_lock (region->lock) ;
+  ret = map_writeback (region) ;
+
+  /*
+   * Wait out the writeback of any of our pages evicted by a fault on
+   * another region
+   */
+  ofc_lock (map_lock) ;
+  while (region->busy > 0)
+    {
+      ofc_unlock (map_lock) ;
+      ofc_event_wait (region->idle) ;
+      ofc_lock (map_lock) ;
+    }
+  for (page = 0 ; page < region->page_count ; page++)
+    {
+      if (region->pages[page] != OFC_NULL)
+	{
+	  region->pages[page]->region = OFC_NULL ;
+	  region->pages[page]->dirty = OFC_FALSE ;
+	  if (region->pages[page]->held)
+	    {
+	      region->pages[page]->held = OFC_FALSE ;
+	      map_unpin_frame (region->pages[page]) ;
+	    }
+	}
+    }
+  ofc_unlock (map_lock) ;
+  ofc_unlock (region->lock) ;
+
+  ofc_lock_destroy (region->lock) ;
+  ofc_event_destroy (region->idle) ;
+  ofc_free (region->pages) ;
+  ofc_free (region) ;
+
+  if (ret == OFC_FALSE)
+    throwio (env) ;
+}
@@ -0,0 +1,537 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+#include <jni.h>
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/heap.h"
+#include "ofc/libc.h"
+#include "ofc/handle.h"
+#include "ofc/thread.h"
+#include "ofc/event.h"
+#include "ofc/file.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_RecordReader.h"
+#include "ofc_jni/com_connectedway_io_Search.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
+
+/*
+ * Native record splitter behind RecordReader
+ *
+ * Each of the two buffers is a reserve of max record bytes followed by
+ * a chunk that the read-ahead thread fills from the file.  While Java
+ * consumes the records of one buffer, the chunk of the other is being
+ * read.  When the records of a buffer run out, the unterminated record
+ * at its end is copied into the reserve of the other, just in front of
+ * the new chunk, so that every record of a batch is contiguous and a
+ * batch never spans both buffers.
+ *
+ * There is at most one read outstanding.  The read-ahead thread only
+ * touches the buffer that Java is not looking at, and hands it back by
+ * setting the ready event.
+ */
+typedef struct
+{
+  OFC_HANDLE hFile ;
+  OFC_UINT8 delimiter ;
+  OFC_INT batch ;
+  OFC_SIZET chunk ;
+  OFC_SIZET reserve ;
+  OFC_UINT8 *buffers[2] ;
+  jint *offsets ;
+  jint *lengths ;
+  /*
+   * Records of the current buffer not yet returned are in [pos, end).
+   * last is set once the current buffer holds the end of the file.
+   */
+  OFC_INT current ;
+  OFC_SIZET pos ;
+  OFC_SIZET end ;
+  OFC_BOOL last ;
+  /*
+   * Read-ahead state.  Written by the read-ahead thread before it sets
+   * ready, and read by the caller after it has waited for it.
+   */
+  OFC_HANDLE thread ;
+  OFC_HANDLE want ;
+  OFC_HANDLE ready ;
+  OFC_BOOL stop ;
+  OFC_LARGE_INTEGER offset ;
+  OFC_SIZET filled ;
+  OFC_BOOL eof ;
+  OFC_DWORD error ;
+} RECORD_READER ;
+
+static RECORD_READER *record_reader (jlong jlHandle)
+{
+  return ((RECORD_READER *) (OFC_DWORD_PTR) jlHandle) ;
+}
+
+/*
+ * Release a reader whose read-ahead thread is not running, or was
+ * never started.  Anything create failed to set up is null.
+ */
+static OFC_VOID record_reader_free (RECORD_READER *reader)
+{
+  if (reader->want != OFC_HANDLE_NULL)
+    ofc_event_destroy (reader->want) ;
+  if (reader->ready != OFC_HANDLE_NULL)
+    ofc_event_destroy (reader->ready) ;
+  OfcCloseHandle (reader->hFile) ;
+  if (reader->buffers[0] != OFC_NULL)
+    ofc_free (reader->buffers[0]) ;
+  if (reader->buffers[1] != OFC_NULL)
+    ofc_free (reader->buffers[1]) ;
+  if (reader->offsets != OFC_NULL)
+    ofc_free (reader->offsets) ;
+  if (reader->lengths != OFC_NULL)
+    ofc_free (reader->lengths) ;
+  ofc_free (reader) ;
+}
+
+static OFC_DWORD record_readahead (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  RECORD_READER *reader ;
+  OFC_UINT8 *data ;
+  OFC_SIZET nRead ;
+
+  reader = context ;
+  for (;;)
+    {
+      ofc_event_wait (reader->want) ;
+      if (reader->stop)
+	break ;
+
+      data = reader->buffers[1 - reader->current] + reader->reserve ;
+      if (TransferRegion (reader->hFile, OFC_FALSE, (OFC_CHAR *) data,
+			  reader->chunk, reader->offset, &nRead) == OFC_FALSE)
+	{
+	  reader->error = OfcGetLastError () ;
+	  reader->filled = 0 ;
+	  reader->eof = OFC_TRUE ;
+	}
+      else
+	{
+	  reader->filled = nRead ;
+	  reader->eof = nRead < reader->chunk ;
+	  reader->offset += nRead ;
+	}
+      ofc_event_set (reader->ready) ;
+    }
+  return (0) ;
+}
+
+static OFC_VOID record_add (RECORD_READER *reader, OFC_INT count,
+			    OFC_SIZET start, OFC_SIZET len,
+			    OFC_BOOL delimited)
+{
+  OFC_UINT8 *buf ;
+
+  buf = reader->buffers[reader->current] ;
+  if (delimited && reader->delimiter == '\n' && len > 0 &&
+      buf[start + len - 1] == '\r')
+    len-- ;
+  reader->offsets[count] = (jint) start ;
+  reader->lengths[count] = (jint) len ;
+}
+
+/*
+ * Split the next batch into the offsets and lengths of the reader.
+ * Returns the number of records, zero at the end of the file, or -1 if
+ * a read failed.
+ */
+static OFC_INT record_next (RECORD_READER *reader, OFC_DWORD *error)
+{
+  OFC_UINT8 *buf ;
+  OFC_LONG found ;
+  OFC_SIZET carry ;
+  OFC_SIZET start ;
+  OFC_INT other ;
+  OFC_INT count ;
+
+  count = 0 ;
+  while (count < reader->batch)
+    {
+      buf = reader->buffers[reader->current] ;
+      if (reader->pos < reader->end)
+	{
+	  found = search_find (buf + reader->pos, reader->end - reader->pos,
+			       &reader->delimiter, 1) ;
+	  if (found >= 0)
+	    {
+	      record_add (reader, count++, reader->pos, (OFC_SIZET) found,
+			  OFC_TRUE) ;
+	      reader->pos += found + 1 ;
+	      continue ;
+	    }
+	}
+
+      /*
+       * What is left of the buffer is an unterminated record
+       */
+      if (reader->last)
+	{
+	  if (reader->pos < reader->end)
+	    {
+	      record_add (reader, count++, reader->pos,
+			  reader->end - reader->pos, OFC_FALSE) ;
+	      reader->pos = reader->end ;
+	    }
+	  break ;
+	}
+
+      if (count > 0)
+	break ;
+
+      carry = reader->end - reader->pos ;
+      if (carry > reader->reserve)
+	{
+	  /*
+	   * Too long to carry over.  Return what we have as a piece of
+	   * the record.
+	   */
+	  record_add (reader, count++, reader->pos, carry, OFC_FALSE) ;
+	  reader->pos = reader->end ;
+	  continue ;
+	}
+
+      ofc_event_wait (reader->ready) ;
+      if (reader->error != OFC_ERROR_SUCCESS)
+	{
+	  *error = reader->error ;
+	  reader->last = OFC_TRUE ;
+	  reader->pos = reader->end ;
+	  return (-1) ;
+	}
+
+      other = 1 - reader->current ;
+      start = reader->reserve - carry ;
+      ofc_memcpy (reader->buffers[other] + start, buf + reader->pos, carry) ;
+      reader->current = other ;
+      reader->pos = start ;
+      reader->end = reader->reserve + reader->filled ;
+      reader->last = reader->eof ;
+      /*
+       * Start filling the buffer we just left
+       */
+      if (!reader->last)
+	ofc_event_set (reader->want) ;
+    }
+  return (count) ;
+}
+
+/*
+ * Decode UTF-8 into UTF-16.  out must have room for len characters,
+ * which is always enough.  Malformed sequences become U+FFFD a byte at
+ * a time.
+ */
+static jsize record_utf8 (const OFC_UINT8 *p, OFC_SIZET len, jchar *out)
+{
+  OFC_SIZET i ;
+  OFC_SIZET need ;
+  OFC_SIZET k ;
+  OFC_UINT32 cp ;
+  OFC_UINT32 min ;
+  OFC_UINT8 c ;
+  jsize n ;
+
+  i = 0 ;
+  n = 0 ;
+  while (i < len)
+    {
+      c = p[i] ;
+      if (c < 0x80)
+	{
+	  out[n++] = c ;
+	  i++ ;
+	  continue ;
+	}
+
+      if ((c & 0xE0) == 0xC0)
+	{
+	  need = 1 ;
+	  cp = c & 0x1F ;
+	  min = 0x80 ;
+	}
+      else if ((c & 0xF0) == 0xE0)
+	{
+	  need = 2 ;
+	  cp = c & 0x0F ;
+	  min = 0x800 ;
+	}
+      else if ((c & 0xF8) == 0xF0)
+	{
+	  need = 3 ;
+	  cp = c & 0x07 ;
+	  min = 0x10000 ;
+	}
+      else
+	need = 0 ;
+
+      for (k = 1 ; need > 0 && k <= need ; k++)
+	{
+	  if (i + k >= len || (p[i + k] & 0xC0) != 0x80)
+	    need = 0 ;
+	  else
+	    cp = (cp << 6) | (p[i + k] & 0x3F) ;
+	}
+
+      if (need == 0 || cp < min || cp > 0x10FFFF ||
+	  (cp >= 0xD800 && cp <= 0xDFFF))
+	{
+	  out[n++] = 0xFFFD ;
+	  i++ ;
+	}
+      else if (cp >= 0x10000)
+	{
+	  cp -= 0x10000 ;
+	  out[n++] = (jchar) (0xD800 | (cp >> 10)) ;
+	  out[n++] = (jchar) (0xDC00 | (cp & 0x3FF)) ;
+	  i += need + 1 ;
+	}
+      else
+	{
+	  out[n++] = (jchar) cp ;
+	  i += need + 1 ;
+	}
+    }
+  return (n) ;
+}
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    create
+ * Signature: (Lcom/connectedway/io/File;BIII)J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_RecordReader_create
+  (JNIEnv *env, jclass cls, jobject objFile, jbyte jbDelimiter,
+   jint jiBatch, jint jiChunk, jint jiMaxRecord)
+{
+  RECORD_READER *reader ;
+  OFC_LPTSTR tstrPath ;
+  OFC_HANDLE hFile ;
+  HEAP_ENTER () ;
+
+  tstrPath = file_get_path (env, objFile) ;
+  hFile = OfcCreateFileW (tstrPath, OFC_GENERIC_READ,
+			  OFC_FILE_SHARE_READ | OFC_FILE_SHARE_WRITE,
+			  OFC_NULL, OFC_OPEN_EXISTING,
+			  OFC_FILE_ATTRIBUTE_NORMAL, OFC_HANDLE_NULL) ;
+  file_free_path (tstrPath) ;
+  if (hFile == OFC_INVALID_HANDLE_VALUE)
+    {
+      throwio (env) ;
+      return (0) ;
+    }
+
+  reader = ofc_malloc (sizeof (RECORD_READER)) ;
+  if (reader == OFC_NULL)
+    {
+      OfcCloseHandle (hFile) ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+
+  reader->hFile = hFile ;
+  reader->delimiter = (OFC_UINT8) jbDelimiter ;
+  reader->batch = jiBatch ;
+  reader->chunk = (OFC_SIZET) jiChunk ;
+  reader->reserve = (OFC_SIZET) jiMaxRecord ;
+  reader->buffers[0] = ofc_malloc (reader->reserve + reader->chunk) ;
+  reader->buffers[1] = ofc_malloc (reader->reserve + reader->chunk) ;
+  reader->offsets = ofc_malloc (sizeof (jint) * jiBatch) ;
+  reader->lengths = ofc_malloc (sizeof (jint) * jiBatch) ;
+  reader->want = ofc_event_create (OFC_EVENT_AUTO) ;
+  reader->ready = ofc_event_create (OFC_EVENT_AUTO) ;
+  reader->thread = OFC_HANDLE_NULL ;
+
+  if (reader->buffers[0] == OFC_NULL || reader->buffers[1] == OFC_NULL ||
+      reader->offsets == OFC_NULL || reader->lengths == OFC_NULL ||
+      reader->want == OFC_HANDLE_NULL || reader->ready == OFC_HANDLE_NULL)
+    {
+      record_reader_free (reader) ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+
+  /*
+   * Start with an empty buffer 0 and the first chunk on its way into
+   * buffer 1
+   */
+  reader->current = 0 ;
+  reader->pos = reader->reserve ;
+  reader->end = reader->reserve ;
+  reader->last = OFC_FALSE ;
+
+  reader->stop = OFC_FALSE ;
+  reader->offset = 0 ;
+  reader->filled = 0 ;
+  reader->eof = OFC_FALSE ;
+  reader->error = OFC_ERROR_SUCCESS ;
+  reader->thread = ofc_thread_create (&record_readahead, "RecordReadAhead",
+				      0, reader, OFC_THREAD_JOIN,
+				      OFC_HANDLE_NULL) ;
+  if (reader->thread == OFC_HANDLE_NULL)
+    {
+      record_reader_free (reader) ;
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (0) ;
+    }
+  ofc_event_set (reader->want) ;
+
+  return ((jlong) (OFC_DWORD_PTR) reader) ;
+}
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    buffer
+ * Signature: (JI)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_com_connectedway_io_RecordReader_buffer
+  (JNIEnv *env, jclass cls, jlong jlHandle, jint jiIndex)
+{
+  RECORD_READER *reader ;
+  HEAP_ENTER () ;
+
+  reader = record_reader (jlHandle) ;
+  return ((*env)->NewDirectByteBuffer (env, reader->buffers[jiIndex & 1],
+				       reader->reserve + reader->chunk)) ;
+}
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    next
+ * Signature: (J[I[I)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_RecordReader_next
+  (JNIEnv *env, jclass cls, jlong jlHandle, jintArray arrayOffsets,
+   jintArray arrayLengths)
+{
+  RECORD_READER *reader ;
+  OFC_DWORD error ;
+  OFC_INT count ;
+  HEAP_ENTER () ;
+
+  reader = record_reader (jlHandle) ;
+  count = record_next (reader, &error) ;
+  if (count < 0)
+    {
+      throwio_error (env, error) ;
+      return (0) ;
+    }
+
+  (*env)->SetIntArrayRegion (env, arrayOffsets, 0, count, reader->offsets) ;
+  (*env)->SetIntArrayRegion (env, arrayLengths, 0, count, reader->lengths) ;
+  return (count) ;
+}
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    nextStrings
+ * Signature: (J[I[I)[Ljava/lang/String;
+ *
+ * Split the next batch and decode it in one call, so that the strings
+ * are built without a JNI round trip per record
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_connectedway_io_RecordReader_nextStrings
+  (JNIEnv *env, jclass cls, jlong jlHandle, jintArray arrayOffsets,
+   jintArray arrayLengths)
+{
+  RECORD_READER *reader ;
+  OFC_DWORD error ;
+  OFC_INT count ;
+  OFC_INT i ;
+  OFC_SIZET longest ;
+  OFC_UINT8 *buf ;
+  jchar *chars ;
+  jsize len ;
+  jclass clsString ;
+  jobjectArray arrayStrings ;
+  jstring str ;
+  HEAP_ENTER () ;
+
+  reader = record_reader (jlHandle) ;
+  count = record_next (reader, &error) ;
+  if (count < 0)
+    {
+      throwio_error (env, error) ;
+      return (OFC_NULL) ;
+    }
+
+  (*env)->SetIntArrayRegion (env, arrayOffsets, 0, count, reader->offsets) ;
+  (*env)->SetIntArrayRegion (env, arrayLengths, 0, count, reader->lengths) ;
+
+  clsString = (*env)->FindClass (env, "java/lang/String") ;
+  arrayStrings = (*env)->NewObjectArray (env, count, clsString, OFC_NULL) ;
+  (*env)->DeleteLocalRef (env, clsString) ;
+  if (arrayStrings == OFC_NULL)
+    return (OFC_NULL) ;
+
+  longest = 1 ;
+  for (i = 0 ; i < count ; i++)
+    if ((OFC_SIZET) reader->lengths[i] > longest)
+      longest = reader->lengths[i] ;
+  chars = ofc_malloc (sizeof (jchar) * longest) ;
+  if (chars == OFC_NULL)
+    {
+      throwio_error (env, OFC_ERROR_NOT_ENOUGH_MEMORY) ;
+      return (OFC_NULL) ;
+    }
+
+  buf = reader->buffers[reader->current] ;
+  for (i = 0 ; i < count ; i++)
+    {
+      len = record_utf8 (buf + reader->offsets[i], reader->lengths[i],
+			 chars) ;
+      str = (*env)->NewString (env, chars, len) ;
+      if (str == OFC_NULL)
+	break ;
+      (*env)->SetObjectArrayElement (env, arrayStrings, i, str) ;
+      (*env)->DeleteLocalRef (env, str) ;
+    }
+
+  ofc_free (chars) ;
+  return (arrayStrings) ;
+}
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    current
+ * Signature: (J)I
+ */
+JNIEXPORT jint JNICALL Java_com_connectedway_io_RecordReader_current
+  (JNIEnv *env, jclass cls, jlong jlHandle)
+{
+  HEAP_ENTER () ;
+
+  return (record_reader (jlHandle)->current) ;
+}
+
+/*
+ * Class:     com_connectedway_io_RecordReader
+ * Method:    destroy
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_RecordReader_destroy
+  (JNIEnv *env, jclass cls, jlong jlHandle)
+{
+  RECORD_READER *reader ;
+  HEAP_ENTER () ;
+
+  reader = record_reader (jlHandle) ;
+
+  /*
+   * A read that is in flight finishes first, and the thread then sees
+   * the stop on its next wait
+   */
+  reader->stop = OFC_TRUE ;
+  ofc_event_set (reader->want) ;
+  ofc_thread_wait (reader->thread) ;
+
+  record_reader_free (reader) ;
+}
@@ -19,6 +19,9 @@
 #include "ofc/libc.h"
 #include "ofc/path.h"
 #include "ofc/thread.h"
+#include "ofc/lock.h"
+#include "ofc/event.h"
+#include "ofc/time.h"
 #include "ofc/file.h"
 #include "ofc/fs.h"
 #include "ofc/path.h"
@@ -27,19 +30,25 @@
 
 #include "ofc_jni/com_connectedway_io_Utils.h"
 #include "ofc_jni/com_connectedway_io_Resolver.h"
+#include "ofc_jni/com_connectedway_io_ResolverAsync.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
 
 #define OPEN_FUNC "Open"
 #define OPEN_SIG "(Ljava/lang/String;Ljava/lang/String;)Lcom/connectedway/io/Resolver$ResolverFile;"
 #define MKDIR_FUNC "MkDir"
 #define MKDIR_SIG "(Ljava/lang/String;)I"
 #define WRITE_FUNC "Write"
-#define WRITE_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;[BI)I"
+#define WRITE_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;J)J"
 #define PWRITE_FUNC "PWrite"
-#define PWRITE_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;II)I"
+#define PWRITE_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;JJ)J"
 #define READ_FUNC "Read"
-#define READ_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;[BI)I"
+#define READ_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;J)J"
 #define PREAD_FUNC "PRead"
-#define PREAD_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;II)I"
+#define PREAD_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;JJ)J"
+#define PWRITEASYNC_FUNC "PWriteAsync"
+#define PWRITEASYNC_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;JJJ)I"
+#define PREADASYNC_FUNC "PReadAsync"
+#define PREADASYNC_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;Ljava/nio/ByteBuffer;JJJ)I"
 #define CLOSE_FUNC "Close"
 #define CLOSE_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;)I"
 #define UNLINK_FUNC "Unlink"
@@ -52,8 +61,8 @@
 #define STATFS_SIG "(Ljava/lang/String;)Lcom/connectedway/io/Resolver$ResolverStatFS;"
 #define OPENDIR_FUNC "OpenDir"
 #define OPENDIR_SIG "(Ljava/lang/String;)Lcom/connectedway/io/Resolver$ResolverDir;"
-#define READDIR_FUNC "ReadDir"
-#define READDIR_SIG "(Lcom/connectedway/io/Resolver$ResolverDir;)Lcom/connectedway/io/Resolver$ResolverDirent;"
+#define READDIRBATCH_FUNC "ReadDirBatch"
+#define READDIRBATCH_SIG "(Lcom/connectedway/io/Resolver$ResolverDir;I)[Lcom/connectedway/io/Resolver$ResolverDirent;"
 #define CLOSEDIR_FUNC "CloseDir"
 #define CLOSEDIR_SIG "(Lcom/connectedway/io/Resolver$ResolverDir;)I"
 #define RENAME_FUNC "Rename"
@@ -72,7 +81,6 @@
 #define TRYLOCK_SIG "(Lcom/connectedway/io/Resolver$ResolverFile;JJZ)I"
 
 static jobject g_resolver = OFC_NULL ;
-static JavaVM* g_jvm;
 static jclass clsResolverStat;
 static jclass clsResolverStatFS;
 static jclass clsResolverDirent;
@@ -81,6 +89,10 @@ static jfieldID fieldResolverStatSize;
 static jfieldID fieldResolverStatMTime;
 static jfieldID fieldResolverStatFlags;
 static jfieldID fieldResolverDirent;
+static jfieldID fieldResolverDirentId;
+static jfieldID fieldResolverDirentSize;
+static jfieldID fieldResolverDirentMTime;
+static jfieldID fieldResolverDirentFlags;
 static jfieldID fieldResolverStatFSAvail;
 static jfieldID fieldResolverStatFSBlocks;
 static jmethodID g_method_stat;
@@ -95,7 +107,7 @@ static jmethodID g_method_close;
 static jmethodID g_method_unlink;
 static jmethodID g_method_rmdir;
 static jmethodID g_method_opendir;
-static jmethodID g_method_readdir;
+static jmethodID g_method_readdirbatch;
 static jmethodID g_method_closedir;
 static jmethodID g_method_rename;
 static jmethodID g_method_flush;
@@ -104,7 +116,205 @@ static jmethodID g_method_truncate;
 static jmethodID g_method_lock;
 static jmethodID g_method_trylock;
 static jmethodID g_method_unlock;
+static jmethodID g_method_preadasync;
+static jmethodID g_method_pwriteasync;
 static jclass clsResolverListener;
+static jclass clsResolverAsyncListener;
+static OFC_BOOL g_async = OFC_FALSE;
+
+/*
+ * A direct buffer holds at most an int's worth of bytes, so larger
+ * transfers are cut short, as read and write are allowed to be
+ */
+#define RESOLVER_MAX_IO 0x7FFFF000
+
+/*
+ * A read or write in flight through a ResolverAsyncListener.  The
+ * request is handed to Java as a long, and Resolver.complete signals
+ * its event once the transfer is done.  done, issuing and result are
+ * only looked at under g_async_lock, which is also held while the event
+ * is set, so a waiter that sees the request done may free it straight
+ * away.  While the upcall that starts the transfer is still running,
+ * the request is issuing and not yet done to a waiter, so that a
+ * listener that completes it and then reports failure, or throws, does
+ * not leave the upcall with a freed request.  Only the first
+ * completion counts.
+ */
+struct _RESOLVER_ASYNC
+{
+  OFC_HANDLE event ;
+  OFC_BOOL own_event ;
+  OFC_BOOL issuing ;
+  OFC_BOOL done ;
+  OFC_SIZET result ;
+  jobject buffer ;
+} ;
+
+static OFC_LOCK g_async_lock = OFC_NULL ;
+
+/*
+ * Direct buffers wrapping the native I/O buffers.  The server reuses a
+ * small set of buffers, so each thread keeps its last few wrappers and
+ * only creates a new one for a buffer it has not seen.  The listener
+ * must reset the position and limit of the buffers it is handed.  The
+ * wrappers of a thread are released when the thread exits.
+ */
+#define RESOLVER_WRAP_SLOTS 4
+
+typedef struct
+{
+  OFC_VOID *addr ;
+  OFC_SIZET len ;
+  jobject buffer ;
+} RESOLVER_WRAP ;
+
+typedef struct
+{
+  OFC_INT next ;
+  RESOLVER_WRAP wraps[RESOLVER_WRAP_SLOTS] ;
+} RESOLVER_WRAPS ;
+
+static OFC_INT g_wrap_key = -1 ;
+static OFC_BOOL g_wrap_init = OFC_FALSE ;
+
+/*
+ * An open directory.  Entries arrive from ReadDirBatch, which is asked
+ * for RESOLVER_DIR_BATCH at a time but may return more, with their stat
+ * data, and resolver_readdir hands them out one by one.  Null entries
+ * and entries without a name are skipped.  A dirent stays valid until
+ * the next readdir of the same directory.  While a batch is buffered, and for no longer than
+ * RESOLVER_STAT_TTL ms after it arrived, resolver_stat of one of its
+ * entries is answered from it rather than by a Stat upcall.  Changes
+ * made through the resolver mark the entries they affect stale.
+ */
+#define RESOLVER_DIR_BATCH 64
+
+typedef struct
+{
+  struct resolver_dirent dirent ;
+  OFC_UINT64 id ;
+  OFC_INT64 size ;
+  OFC_INT64 mtime ;
+  OFC_INT flags ;
+  OFC_BOOL stale ;
+} RESOLVER_DIR_ENTRY ;
+
+typedef struct _RESOLVER_DIR_BUFFER
+{
+  struct _RESOLVER_DIR_BUFFER *next ;
+  jobject dir ;
+  OFC_TCHAR *path ;
+  OFC_SIZET path_len ;
+  OFC_INT count ;
+  OFC_INT cursor ;
+  OFC_BOOL eof ;
+  OFC_MSTIME stamp ;
+  RESOLVER_DIR_ENTRY *entries ;
+} RESOLVER_DIR_BUFFER ;
+
+static OFC_LOCK g_dir_lock = OFC_NULL ;
+static RESOLVER_DIR_BUFFER *g_dirs = OFC_NULL ;
+
+/*
+ * Byte range locks held through each open file, kept in a list sorted
+ * by offset.  A repeat of a shared range only counts another hold, and
+ * shared ranges may overlap each other.  Anything else conflicts, and
+ * waits for a range to be released or, for trylock, fails without an
+ * upcall.
+ *
+ * The locks taken from Java, and so from the OS, are kept apart as
+ * segments, since a FileChannel refuses overlapping locks.  Segments
+ * never overlap.  A new range takes a segment for each part of it that
+ * no segment covers yet, so every held byte is locked in the OS.  A
+ * segment is released once no range overlaps it any more, so a range
+ * that outlives the one that locked its bytes keeps them locked.  A
+ * segment can then cover a few bytes no range holds, until the last
+ * range overlapping it goes.  A segment being locked or unlocked
+ * conflicts with everything until the upcall is done.
+ *
+ * Each file has its own lock, so only locks on the same file contend.
+ * The buckets are only held to find a file's table.  The table also
+ * remembers the path the file was opened with.
+ */
+#define RESOLVER_LOCK_BUCKETS 64
+
+typedef struct _RESOLVER_RANGE
+{
+  struct _RESOLVER_RANGE *next ;
+  OFC_UINT64 offset ;
+  OFC_UINT64 end ;
+  OFC_BOOL shared ;
+  OFC_INT count ;
+  OFC_BOOL pending ;
+} RESOLVER_RANGE ;
+
+typedef enum
+{
+  RESOLVER_SEGMENT_LOCKING,
+  RESOLVER_SEGMENT_HELD,
+  RESOLVER_SEGMENT_UNLOCKING
+} RESOLVER_SEGMENT_STATE ;
+
+typedef struct _RESOLVER_SEGMENT
+{
+  struct _RESOLVER_SEGMENT *next ;
+  OFC_UINT64 offset ;
+  OFC_UINT64 end ;
+  OFC_BOOL shared ;
+  RESOLVER_SEGMENT_STATE state ;
+  RESOLVER_RANGE *owner ;
+} RESOLVER_SEGMENT ;
+
+typedef struct _RESOLVER_WAITER
+{
+  struct _RESOLVER_WAITER *next ;
+  OFC_HANDLE event ;
+} RESOLVER_WAITER ;
+
+typedef struct _RESOLVER_LOCKS
+{
+  struct _RESOLVER_LOCKS *next ;
+  RESOLVER_FILE *rfile ;
+  OFC_TCHAR *path ;
+  OFC_LOCK lock ;
+  RESOLVER_RANGE *ranges ;
+  RESOLVER_SEGMENT *segments ;
+  RESOLVER_WAITER *waiters ;
+} RESOLVER_LOCKS ;
+
+typedef enum
+{
+  RESOLVER_RANGE_CONFLICT,
+  RESOLVER_RANGE_HELD,
+  RESOLVER_RANGE_OS,
+  RESOLVER_RANGE_ERROR
+} RESOLVER_RANGE_GRANT ;
+
+static OFC_LOCK g_lock_buckets[RESOLVER_LOCK_BUCKETS] ;
+static RESOLVER_LOCKS *g_lock_files[RESOLVER_LOCK_BUCKETS] ;
+
+/*
+ * Recent stat results, keyed by path.  The cache is direct mapped, so
+ * it never holds more than RESOLVER_STAT_SLOTS paths, and an entry is
+ * only trusted for RESOLVER_STAT_TTL ms, which bounds how stale a
+ * change made outside the server can look.  Changes made through the
+ * resolver drop the entries they affect.
+ */
+#define RESOLVER_STAT_SLOTS 1024
+#define RESOLVER_STAT_TTL 1000
+
+typedef struct
+{
+  OFC_TCHAR *path ;
+  OFC_UINT32 hash ;
+  OFC_MSTIME stamp ;
+  struct resolver_stat sb ;
+} RESOLVER_STAT_SLOT ;
+
+static OFC_LOCK g_stat_lock = OFC_NULL ;
+static RESOLVER_STAT_SLOT g_stat_cache[RESOLVER_STAT_SLOTS] ;
+static OFC_UINT64 g_stat_hits = 0 ;
+static OFC_UINT64 g_stat_misses = 0 ;
 
 static OFC_VOID exceptCheck(JNIEnv *env)
 {
@@ -114,27 +324,100 @@ static OFC_VOID exceptCheck(JNIEnv *env)
   }
 }
 
+/*
+ * Every upcall runs in its own local frame on a thread attached through
+ * jni_get_env, so it may run on any of the server's threads
+ */
+#define RESOLVER_LOCAL_REFS 16
+
+static JNIEnv *getEnv(OFC_VOID)
+{
+  return (jni_upcall_enter (RESOLVER_LOCAL_REFS)) ;
+}
+
 static OFC_VOID relEnv(JNIEnv *env)
 {
-  exceptCheck(env);
+  jni_upcall_exit (env) ;
 }
 
-static JNIEnv *getEnv(OFC_VOID)
+/*
+ * Called as a thread that wrapped buffers exits
+ */
+static OFC_VOID wrapsRelease(OFC_VOID *value)
 {
-  JNIEnv *env;
-  int status ;
+  RESOLVER_WRAPS *wraps ;
+  JNIEnv *env ;
+  OFC_BOOL attached ;
+  OFC_INT i ;
 
-  if (g_jvm != OFC_NULL)
+  wraps = (RESOLVER_WRAPS *) value ;
+  env = jni_exit_env(&attached);
+  if (env != OFC_NULL)
     {
-      status = (*g_jvm)->GetEnv(g_jvm, (void **) &env, JNI_VERSION_1_6);
-      if (status < 0) 
+      for (i = 0 ; i < RESOLVER_WRAP_SLOTS ; i++)
 	{
-          env = OFC_NULL;
+	  if (wraps->wraps[i].buffer != OFC_NULL)
+	    (*env)->DeleteGlobalRef(env, wraps->wraps[i].buffer) ;
 	}
+      jni_exit_done(attached);
     }
-  else
-    env = OFC_NULL ;
-  return (env) ;
+  ofc_free(wraps);
+}
+
+static jobject wrapBuffer(JNIEnv *env, OFC_VOID *addr, OFC_SIZET len)
+{
+  RESOLVER_WRAPS *wraps ;
+  RESOLVER_WRAP *wrap ;
+  jobject buffer ;
+  OFC_INT i ;
+
+  /*
+   * Without a place to keep them, a wrapper lives as long as the
+   * upcall's local frame
+   */
+  wraps = OFC_NULL ;
+  if (g_wrap_key >= 0)
+    {
+      wraps = (RESOLVER_WRAPS *) jni_thread_get(g_wrap_key) ;
+      if (wraps == OFC_NULL)
+	{
+	  wraps = ofc_malloc (sizeof (RESOLVER_WRAPS)) ;
+	  if (wraps != OFC_NULL)
+	    {
+	      ofc_memset (wraps, 0, sizeof (RESOLVER_WRAPS)) ;
+	      if (!jni_thread_set(g_wrap_key, wraps))
+		{
+		  ofc_free(wraps);
+		  wraps = OFC_NULL ;
+		}
+	    }
+	}
+    }
+  if (wraps == OFC_NULL)
+    return ((*env)->NewDirectByteBuffer(env, addr, (jlong) len)) ;
+
+  for (i = 0 ; i < RESOLVER_WRAP_SLOTS ; i++)
+    {
+      wrap = &wraps->wraps[i] ;
+      if (wrap->buffer != OFC_NULL && wrap->addr == addr &&
+	  wrap->len == len)
+	return (wrap->buffer) ;
+    }
+
+  buffer = (*env)->NewDirectByteBuffer(env, addr, (jlong) len) ;
+  if (buffer == OFC_NULL)
+    return (OFC_NULL) ;
+
+  wrap = &wraps->wraps[wraps->next] ;
+  wraps->next = (wraps->next + 1) % RESOLVER_WRAP_SLOTS ;
+  if (wrap->buffer != OFC_NULL)
+    (*env)->DeleteGlobalRef(env, wrap->buffer) ;
+  wrap->addr = addr ;
+  wrap->len = len ;
+  wrap->buffer = (*env)->NewGlobalRef(env, buffer) ;
+  (*env)->DeleteLocalRef(env, buffer) ;
+
+  return (wrap->buffer) ;
 }
 
 /*
@@ -145,12 +428,26 @@ static JNIEnv *getEnv(OFC_VOID)
 JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_setResolverListener
   (JNIEnv *env, jobject objSmb, jobject resolverListener)
 {
-  (*env)->GetJavaVM(env, &g_jvm) ;
+  OFC_INT i ;
+
+  HEAP_ENTER () ;
+
+  if (!g_wrap_init)
+    {
+      g_wrap_key = jni_thread_key(wrapsRelease);
+      g_dir_lock = ofc_lock_init () ;
+      g_async_lock = ofc_lock_init () ;
+      g_stat_lock = ofc_lock_init () ;
+      for (i = 0 ; i < RESOLVER_LOCK_BUCKETS ; i++)
+	g_lock_buckets[i] = ofc_lock_init () ;
+      g_wrap_init = OFC_TRUE ;
+    }
 
   clsResolverStat = (*env)->FindClass(env, "com/connectedway/io/Resolver$ResolverStat");
   clsResolverStatFS = (*env)->FindClass(env, "com/connectedway/io/Resolver$ResolverStatFS");
   clsResolverDirent = (*env)->FindClass(env, "com/connectedway/io/Resolver$ResolverDirent");
   clsResolverListener = (*env)->FindClass(env, "com/connectedway/io/Resolver$ResolverListener");
+  clsResolverAsyncListener = (*env)->FindClass(env, "com/connectedway/io/Resolver$ResolverAsyncListener");
 
   fieldResolverStatId = (*env)->GetFieldID(env, clsResolverStat,
                                            "FileId", "J");
@@ -163,6 +460,14 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_setResolverListener
   fieldResolverDirent = (*env)->GetFieldID(env, clsResolverDirent,
 					   "Name",
 					   "Ljava/lang/String;");
+  fieldResolverDirentId = (*env)->GetFieldID(env, clsResolverDirent,
+					     "FileId", "J");
+  fieldResolverDirentSize = (*env)->GetFieldID(env, clsResolverDirent,
+					       "Size", "J");
+  fieldResolverDirentMTime = (*env)->GetFieldID(env, clsResolverDirent,
+						"MTime", "J");
+  fieldResolverDirentFlags = (*env)->GetFieldID(env, clsResolverDirent,
+						"Flags", "I");
   fieldResolverStatFSAvail = (*env)->GetFieldID(env, clsResolverStatFS,
 						"Avail", "J");
   fieldResolverStatFSBlocks = (*env)->GetFieldID(env, clsResolverStatFS,
@@ -192,8 +497,9 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_setResolverListener
 				       RMDIR_FUNC, RMDIR_SIG);
   g_method_opendir = (*env)->GetMethodID(env, clsResolverListener, 
 					 OPENDIR_FUNC, OPENDIR_SIG);
-  g_method_readdir = (*env)->GetMethodID(env, clsResolverListener,
-					 READDIR_FUNC, READDIR_SIG);
+  g_method_readdirbatch = (*env)->GetMethodID(env, clsResolverListener,
+					      READDIRBATCH_FUNC,
+					      READDIRBATCH_SIG);
   g_method_closedir = (*env)->GetMethodID(env, clsResolverListener, 
 					  CLOSEDIR_FUNC, CLOSEDIR_SIG);
   g_method_rename = (*env)->GetMethodID(env, clsResolverListener, 
@@ -211,9 +517,555 @@ JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_setResolverListener
   g_method_unlock = (*env)->GetMethodID(env, clsResolverListener, 
 					UNLOCK_FUNC, UNLOCK_SIG);
 
+  g_async = (*env)->IsInstanceOf(env, resolverListener,
+				 clsResolverAsyncListener);
+  if (g_async)
+    {
+      g_method_preadasync =
+	(*env)->GetMethodID(env, clsResolverAsyncListener,
+			    PREADASYNC_FUNC, PREADASYNC_SIG);
+      g_method_pwriteasync =
+	(*env)->GetMethodID(env, clsResolverAsyncListener,
+			    PWRITEASYNC_FUNC, PWRITEASYNC_SIG);
+    }
+
   g_resolver = (*env)->NewGlobalRef(env, resolverListener) ;
 }
 
+static RESOLVER_LOCKS *lockFile(RESOLVER_FILE *rfile, OFC_BOOL create)
+{
+  RESOLVER_LOCKS *locks;
+  OFC_INT bucket;
+
+  bucket = (OFC_INT) (((OFC_DWORD_PTR) rfile >> 4) % RESOLVER_LOCK_BUCKETS);
+
+  ofc_lock(g_lock_buckets[bucket]);
+  for (locks = g_lock_files[bucket] ;
+       locks != OFC_NULL && locks->rfile != rfile ;
+       locks = locks->next) ;
+  if (locks == OFC_NULL && create)
+    {
+      locks = ofc_malloc(sizeof(RESOLVER_LOCKS));
+      if (locks != OFC_NULL)
+	{
+	  locks->rfile = rfile;
+	  locks->path = OFC_NULL;
+	  locks->lock = ofc_lock_init();
+	  locks->ranges = OFC_NULL;
+	  locks->segments = OFC_NULL;
+	  locks->waiters = OFC_NULL;
+	  locks->next = g_lock_files[bucket];
+	  g_lock_files[bucket] = locks;
+	}
+    }
+  ofc_unlock(g_lock_buckets[bucket]);
+  return (locks);
+}
+
+/*
+ * A copy of the path a file was opened by, taken under the bucket lock
+ * so that a close on another thread can not free it underneath.  The
+ * caller frees the copy.
+ */
+static OFC_TCHAR *lockFilePath(RESOLVER_FILE *rfile)
+{
+  RESOLVER_LOCKS *locks;
+  OFC_TCHAR *path;
+  OFC_INT bucket;
+
+  bucket = (OFC_INT) (((OFC_DWORD_PTR) rfile >> 4) % RESOLVER_LOCK_BUCKETS);
+
+  path = OFC_NULL;
+  ofc_lock(g_lock_buckets[bucket]);
+  for (locks = g_lock_files[bucket] ;
+       locks != OFC_NULL && locks->rfile != rfile ;
+       locks = locks->next) ;
+  if (locks != OFC_NULL && locks->path != OFC_NULL)
+    path = ofc_tstrdup(locks->path);
+  ofc_unlock(g_lock_buckets[bucket]);
+  return (path);
+}
+
+/*
+ * Called once the file is closed, which drops any OS locks with it
+ */
+static OFC_VOID lockFileFree(RESOLVER_FILE *rfile)
+{
+  RESOLVER_LOCKS *locks;
+  RESOLVER_LOCKS **link;
+  RESOLVER_RANGE *range;
+  RESOLVER_SEGMENT *segment;
+  OFC_INT bucket;
+
+  bucket = (OFC_INT) (((OFC_DWORD_PTR) rfile >> 4) % RESOLVER_LOCK_BUCKETS);
+
+  ofc_lock(g_lock_buckets[bucket]);
+  for (link = &g_lock_files[bucket] ;
+       *link != OFC_NULL && (*link)->rfile != rfile ;
+       link = &(*link)->next) ;
+  locks = *link;
+  if (locks != OFC_NULL)
+    *link = locks->next;
+  ofc_unlock(g_lock_buckets[bucket]);
+
+  if (locks != OFC_NULL)
+    {
+      while (locks->ranges != OFC_NULL)
+	{
+	  range = locks->ranges;
+	  locks->ranges = range->next;
+	  ofc_free(range);
+	}
+      while (locks->segments != OFC_NULL)
+	{
+	  segment = locks->segments;
+	  locks->segments = segment->next;
+	  ofc_free(segment);
+	}
+      if (locks->path != OFC_NULL)
+	ofc_free(locks->path);
+      ofc_lock_destroy(locks->lock);
+      ofc_free(locks);
+    }
+}
+
+static OFC_UINT64 rangeEnd(OFC_UINT64 offset, OFC_UINT64 size)
+{
+  if (offset + size < offset)
+    return ((OFC_UINT64) -1);
+  return (offset + size);
+}
+
+static OFC_BOOL rangeOverlaps(OFC_UINT64 offset, OFC_UINT64 end,
+			      OFC_UINT64 other, OFC_UINT64 other_end)
+{
+  return (offset < other_end && other < end);
+}
+
+/*
+ * Drop the segments a range was still to lock.  Called with the file's
+ * lock held.
+ */
+static OFC_VOID segmentsAbandon(RESOLVER_LOCKS *locks, RESOLVER_RANGE *range)
+{
+  RESOLVER_SEGMENT *segment;
+  RESOLVER_SEGMENT **link;
+
+  link = &locks->segments;
+  while (*link != OFC_NULL)
+    {
+      segment = *link;
+      if (segment->state == RESOLVER_SEGMENT_LOCKING &&
+	  segment->owner == range)
+	{
+	  *link = segment->next;
+	  ofc_free(segment);
+	}
+      else
+	link = &segment->next;
+    }
+}
+
+/*
+ * Called with the file's lock held.  On RESOLVER_RANGE_OS, the segments
+ * owned by the range are still to be locked in the OS.
+ */
+static RESOLVER_RANGE_GRANT rangeAcquire(RESOLVER_LOCKS *locks,
+					 OFC_UINT64 offset, OFC_UINT64 size,
+					 OFC_BOOL shared,
+					 RESOLVER_RANGE **granted)
+{
+  RESOLVER_RANGE *range;
+  RESOLVER_RANGE *repeat;
+  RESOLVER_RANGE **link;
+  RESOLVER_SEGMENT *segment;
+  RESOLVER_SEGMENT **slink;
+  OFC_UINT64 end;
+  OFC_UINT64 pos;
+  OFC_UINT64 gap;
+  OFC_BOOL os;
+
+  end = rangeEnd(offset, size);
+  repeat = OFC_NULL;
+
+  for (range = locks->ranges ; range != OFC_NULL ; range = range->next)
+    {
+      if (!rangeOverlaps(offset, end, range->offset, range->end))
+	continue;
+      if (!shared || !range->shared)
+	return (RESOLVER_RANGE_CONFLICT);
+      if (range->offset == offset && range->end == end && !range->pending)
+	repeat = range;
+    }
+
+  for (segment = locks->segments ; segment != OFC_NULL ;
+       segment = segment->next)
+    {
+      if (rangeOverlaps(offset, end, segment->offset, segment->end) &&
+	  (!shared || !segment->shared ||
+	   segment->state != RESOLVER_SEGMENT_HELD))
+	return (RESOLVER_RANGE_CONFLICT);
+    }
+
+  if (repeat != OFC_NULL)
+    {
+      repeat->count++;
+      *granted = repeat;
+      return (RESOLVER_RANGE_HELD);
+    }
+
+  range = ofc_malloc(sizeof(RESOLVER_RANGE));
+  if (range == OFC_NULL)
+    return (RESOLVER_RANGE_ERROR);
+  range->offset = offset;
+  range->end = end;
+  range->shared = shared;
+  range->count = 1;
+  range->pending = OFC_FALSE;
+
+  /*
+   * A segment for each gap between the segments already held
+   */
+  os = OFC_FALSE;
+  pos = offset;
+  slink = &locks->segments;
+  while (pos < end)
+    {
+      while (*slink != OFC_NULL && (*slink)->end <= pos)
+	slink = &(*slink)->next;
+      if (*slink != OFC_NULL && (*slink)->offset <= pos)
+	{
+	  pos = (*slink)->end;
+	  continue;
+	}
+      gap = end;
+      if (*slink != OFC_NULL && (*slink)->offset < end)
+	gap = (*slink)->offset;
+
+      segment = ofc_malloc(sizeof(RESOLVER_SEGMENT));
+      if (segment == OFC_NULL)
+	{
+	  segmentsAbandon(locks, range);
+	  ofc_free(range);
+	  return (RESOLVER_RANGE_ERROR);
+	}
+      segment->offset = pos;
+      segment->end = gap;
+      segment->shared = shared;
+      segment->state = RESOLVER_SEGMENT_LOCKING;
+      segment->owner = range;
+      segment->next = *slink;
+      *slink = segment;
+      slink = &segment->next;
+      os = OFC_TRUE;
+      pos = gap;
+    }
+  /*
+   * Until its segments are locked, the range can not be released
+   */
+  range->pending = os;
+
+  for (link = &locks->ranges ;
+       *link != OFC_NULL && (*link)->offset < offset ;
+       link = &(*link)->next) ;
+  range->next = *link;
+  *link = range;
+
+  *granted = range;
+  return (os ? RESOLVER_RANGE_OS : RESOLVER_RANGE_HELD);
+}
+
+/*
+ * Called with the file's lock held.  Wakes every waiter so that each
+ * can look again.
+ */
+static OFC_VOID rangeWake(RESOLVER_LOCKS *locks)
+{
+  RESOLVER_WAITER *waiter;
+
+  while (locks->waiters != OFC_NULL)
+    {
+      waiter = locks->waiters;
+      locks->waiters = waiter->next;
+      ofc_event_set(waiter->event);
+    }
+}
+
+static OFC_VOID rangeRemove(RESOLVER_LOCKS *locks, RESOLVER_RANGE *range)
+{
+  RESOLVER_RANGE **link;
+
+  for (link = &locks->ranges ; *link != OFC_NULL && *link != range ;
+       link = &(*link)->next) ;
+  if (*link != OFC_NULL)
+    *link = range->next;
+  ofc_free(range);
+  rangeWake(locks);
+}
+
+/*
+ * Called with the file's lock held, which is dropped while waiting
+ */
+static OFC_VOID rangeWait(RESOLVER_LOCKS *locks)
+{
+  RESOLVER_WAITER waiter;
+
+  waiter.event = ofc_event_create(OFC_EVENT_AUTO);
+  waiter.next = locks->waiters;
+  locks->waiters = &waiter;
+  ofc_unlock(locks->lock);
+  ofc_event_wait(waiter.event);
+  ofc_lock(locks->lock);
+  ofc_event_destroy(waiter.event);
+}
+
+static OFC_UINT32 statHash(OFC_CTCHAR *path, OFC_SIZET len)
+{
+  OFC_UINT32 hash;
+  OFC_SIZET i;
+
+  hash = 2166136261U;
+  for (i = 0 ; i < len ; i++)
+    hash = (hash ^ (OFC_UINT32) path[i]) * 16777619U;
+  return (hash);
+}
+
+/*
+ * Called with g_stat_lock held
+ */
+static RESOLVER_STAT_SLOT *statSlot(OFC_CTCHAR *path, OFC_SIZET len,
+				    OFC_UINT32 *hash)
+{
+  *hash = statHash(path, len);
+  return (&g_stat_cache[*hash % RESOLVER_STAT_SLOTS]);
+}
+
+static OFC_BOOL statCacheGet(OFC_CTCHAR *tName, struct resolver_stat *sb)
+{
+  RESOLVER_STAT_SLOT *slot;
+  OFC_UINT32 hash;
+  OFC_SIZET len;
+  OFC_BOOL found;
+
+  len = ofc_tstrlen(tName);
+  found = OFC_FALSE;
+
+  ofc_lock(g_stat_lock);
+  slot = statSlot(tName, len, &hash);
+  if (slot->path != OFC_NULL && slot->hash == hash &&
+      ofc_time_get_now() - slot->stamp < RESOLVER_STAT_TTL &&
+      ofc_tstrcmp(slot->path, tName) == 0)
+    {
+      *sb = slot->sb;
+      found = OFC_TRUE;
+      g_stat_hits++;
+    }
+  else
+    g_stat_misses++;
+  ofc_unlock(g_stat_lock);
+
+  return (found);
+}
+
+static OFC_VOID statCachePut(OFC_CTCHAR *tName, struct resolver_stat *sb)
+{
+  RESOLVER_STAT_SLOT *slot;
+  OFC_UINT32 hash;
+  OFC_TCHAR *path;
+  OFC_TCHAR *old;
+
+  path = ofc_tstrdup(tName);
+  if (path == OFC_NULL)
+    return;
+
+  ofc_lock(g_stat_lock);
+  slot = statSlot(tName, ofc_tstrlen(tName), &hash);
+  old = slot->path;
+  slot->path = path;
+  slot->hash = hash;
+  slot->stamp = ofc_time_get_now();
+  slot->sb = *sb;
+  ofc_unlock(g_stat_lock);
+
+  if (old != OFC_NULL)
+    ofc_free(old);
+}
+
+/*
+ * Mark the first len characters of path stale in the batches buffered
+ * for open directories, so that stat no longer answers from them
+ */
+static OFC_VOID dirsDropLen(OFC_CTCHAR *path, OFC_SIZET len)
+{
+  RESOLVER_DIR_BUFFER *buffer;
+  RESOLVER_DIR_ENTRY *entry;
+  OFC_SIZET parent_len;
+  OFC_SIZET leaf_len;
+  OFC_INT i;
+
+  for (parent_len = len ; parent_len > 0 &&
+	 path[parent_len-1] != TCHAR_SLASH &&
+	 path[parent_len-1] != TCHAR_BACKSLASH ; parent_len--) ;
+  if (parent_len == 0)
+    return;
+  leaf_len = len - parent_len;
+  parent_len--;
+
+  ofc_lock(g_dir_lock);
+  for (buffer = g_dirs ; buffer != OFC_NULL ; buffer = buffer->next)
+    {
+      if (buffer->path_len != parent_len ||
+	  ofc_tstrncmp(buffer->path, path, parent_len) != 0)
+	continue;
+
+      for (i = 0 ; i < buffer->count ; i++)
+	{
+	  entry = &buffer->entries[i];
+	  if (ofc_tstrlen(entry->dirent.d_name) == leaf_len &&
+	      ofc_tstrncmp(entry->dirent.d_name, path + parent_len + 1,
+			   leaf_len) == 0)
+	    entry->stale = OFC_TRUE;
+	}
+    }
+  ofc_unlock(g_dir_lock);
+}
+
+/*
+ * Mark every buffered entry stale
+ */
+static OFC_VOID dirsFlush(OFC_VOID)
+{
+  RESOLVER_DIR_BUFFER *buffer;
+  OFC_INT i;
+
+  ofc_lock(g_dir_lock);
+  for (buffer = g_dirs ; buffer != OFC_NULL ; buffer = buffer->next)
+    for (i = 0 ; i < buffer->count ; i++)
+      buffer->entries[i].stale = OFC_TRUE;
+  ofc_unlock(g_dir_lock);
+}
+
+/*
+ * Drop the first len characters of path from the cache, and from the
+ * directory batches
+ */
+static OFC_VOID statCacheDropLen(OFC_CTCHAR *path, OFC_SIZET len)
+{
+  RESOLVER_STAT_SLOT *slot;
+  OFC_UINT32 hash;
+  OFC_TCHAR *old;
+
+  old = OFC_NULL;
+  ofc_lock(g_stat_lock);
+  slot = statSlot(path, len, &hash);
+  if (slot->path != OFC_NULL && slot->hash == hash &&
+      ofc_tstrlen(slot->path) == len &&
+      ofc_tstrncmp(slot->path, path, len) == 0)
+    {
+      old = slot->path;
+      slot->path = OFC_NULL;
+    }
+  ofc_unlock(g_stat_lock);
+
+  if (old != OFC_NULL)
+    ofc_free(old);
+
+  dirsDropLen(path, len);
+}
+
+/*
+ * Drop a path that has changed, and with parent, the directory it is
+ * in, whose times change when entries come and go
+ */
+static OFC_VOID statCacheDrop(OFC_CTCHAR *path, OFC_BOOL parent)
+{
+  OFC_SIZET len;
+  OFC_SIZET i;
+
+  if (path == OFC_NULL)
+    return;
+
+  len = ofc_tstrlen(path);
+  statCacheDropLen(path, len);
+
+  if (parent)
+    {
+      for (i = len ; i > 0 &&
+	     path[i-1] != TCHAR_SLASH && path[i-1] != TCHAR_BACKSLASH ; i--) ;
+      if (i > 1)
+	statCacheDropLen(path, i - 1);
+    }
+}
+
+/*
+ * A rename may move a whole tree, so it drops everything
+ */
+static OFC_VOID statCacheFlush(OFC_VOID)
+{
+  OFC_INT i;
+
+  ofc_lock(g_stat_lock);
+  for (i = 0 ; i < RESOLVER_STAT_SLOTS ; i++)
+    {
+      if (g_stat_cache[i].path != OFC_NULL)
+	{
+	  ofc_free(g_stat_cache[i].path);
+	  g_stat_cache[i].path = OFC_NULL;
+	}
+    }
+  ofc_unlock(g_stat_lock);
+
+  dirsFlush();
+}
+
+static OFC_VOID statCacheDropFile(RESOLVER_FILE *rfile)
+{
+  OFC_TCHAR *path;
+
+  path = lockFilePath(rfile);
+  if (path != OFC_NULL)
+    {
+      statCacheDrop(path, OFC_FALSE);
+      ofc_free(path);
+    }
+}
+
+/*
+ * Class:     com_connectedway_io_Resolver
+ * Method:    getStatCacheHits
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Resolver_getStatCacheHits
+  (JNIEnv *env, jclass cls)
+{
+  jlong hits ;
+
+  HEAP_ENTER () ;
+
+  ofc_lock (g_stat_lock) ;
+  hits = (jlong) g_stat_hits ;
+  ofc_unlock (g_stat_lock) ;
+  return (hits) ;
+}
+
+/*
+ * Class:     com_connectedway_io_Resolver
+ * Method:    getStatCacheMisses
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_com_connectedway_io_Resolver_getStatCacheMisses
+  (JNIEnv *env, jclass cls)
+{
+  jlong misses ;
+
+  HEAP_ENTER () ;
+
+  ofc_lock (g_stat_lock) ;
+  misses = (jlong) g_stat_misses ;
+  ofc_unlock (g_stat_lock) ;
+  return (misses) ;
+}
+
 RESOLVER_FILE *resolver_open(OFC_CTCHAR *lpFileName, OFC_CCHAR *mode)
 {
   JNIEnv *env ;
@@ -221,6 +1073,8 @@ RESOLVER_FILE *resolver_open(OFC_CTCHAR *lpFileName, OFC_CCHAR *mode)
   jstring jstrMode;
   jobject rFile;
   jobject gFile;
+  RESOLVER_LOCKS *locks;
+  OFC_INT i;
 
   gFile = NULL;
   env = getEnv();
@@ -233,9 +1087,29 @@ RESOLVER_FILE *resolver_open(OFC_CTCHAR *lpFileName, OFC_CCHAR *mode)
 				       jstrFileName,
 				       jstrMode);
       exceptCheck(env);
-      gFile = (*env)->NewGlobalRef(env, rFile) ;
+      if (rFile != OFC_NULL)
+	{
+	  gFile = (*env)->NewGlobalRef(env, rFile) ;
+	  (*env)->DeleteLocalRef(env, rFile) ;
+	}
+      (*env)->DeleteLocalRef(env, jstrMode) ;
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
       relEnv(env);
     }
+
+  if (gFile != OFC_NULL)
+    {
+      locks = lockFile(gFile, OFC_TRUE);
+      if (locks != OFC_NULL)
+	locks->path = ofc_tstrdup(lpFileName);
+      /*
+       * Any mode but read may create or truncate the file
+       */
+      for (i = 0 ; mode[i] != '\0' && mode[i] != 'w' && mode[i] != 'a' &&
+	     mode[i] != '+' ; i++) ;
+      if (mode[i] != '\0')
+	statCacheDrop(lpFileName, OFC_TRUE);
+    }
   return (gFile);
 }
 
@@ -253,8 +1127,10 @@ OFC_INT resolver_mkdir(OFC_CTCHAR *lpFileName)
       ret = (*env)->CallIntMethod(env, g_resolver,
 				  g_method_mkdir,
 				  jstrFileName);
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
       relEnv(env);
     }
+  statCacheDrop(lpFileName, OFC_TRUE);
   return(ret);
 }
   
@@ -263,26 +1139,27 @@ OFC_SIZET resolver_write(RESOLVER_FILE *rfile, OFC_LPCVOID lpBuffer,
 {
   jobject jFile;
   JNIEnv *env ;
-  jint written;
-  jbyteArray baBuffer;
+  jlong written;
+  jobject bbBuffer;
 
   written = -1;
+  if (count > RESOLVER_MAX_IO)
+    count = RESOLVER_MAX_IO;
   
   env = getEnv();
   if (env != OFC_NULL)
     {
       jFile = (jobject) rfile;
-      baBuffer = (*env)->NewByteArray(env, count);
-      (*env)->SetByteArrayRegion(env, baBuffer, 0, count,
-				 (jbyte *) lpBuffer);
-
-      written = (*env)->CallIntMethod(env, g_resolver,
-				      g_method_write,
-				      jFile, baBuffer,
-				      (jint) count);
+      bbBuffer = wrapBuffer(env, (OFC_VOID *) lpBuffer, count);
+      if (bbBuffer != OFC_NULL)
+	written = (*env)->CallLongMethod(env, g_resolver,
+					 g_method_write,
+					 jFile, bbBuffer,
+					 (jlong) count);
       
       relEnv(env);
     }
+  statCacheDropFile(rfile);
   return ((OFC_SIZET) written);
 }
 
@@ -291,24 +1168,28 @@ OFC_SIZET resolver_pwrite(RESOLVER_FILE *rfile, OFC_LPCVOID lpBuffer,
 {
   jobject jFile;
   JNIEnv *env ;
-  jint written;
+  jlong written;
   jobject bbBuffer;
 
   written = -1;
+  if (count > RESOLVER_MAX_IO)
+    count = RESOLVER_MAX_IO;
   
   env = getEnv();
   if (env != OFC_NULL)
     {
       jFile = (jobject) rfile;
-      bbBuffer = (*env)->NewDirectByteBuffer(env, (void *) lpBuffer, count);
-      written = (*env)->CallIntMethod(env, g_resolver,
-				      g_method_pwrite,
-				      jFile, bbBuffer,
-				      (jint) count,
-				      (jint) offset);
+      bbBuffer = wrapBuffer(env, (OFC_VOID *) lpBuffer, count);
+      if (bbBuffer != OFC_NULL)
+	written = (*env)->CallLongMethod(env, g_resolver,
+					 g_method_pwrite,
+					 jFile, bbBuffer,
+					 (jlong) count,
+					 (jlong) offset);
       
       relEnv(env);
     }
+  statCacheDropFile(rfile);
   return ((OFC_SIZET) written);
 }
 
@@ -317,23 +1198,23 @@ OFC_SIZET resolver_read(RESOLVER_FILE *rfile, OFC_LPCVOID lpBuffer,
 {
   jobject jFile;
   JNIEnv *env ;
-  jint readd;
-  jbyteArray baBuffer;
+  jlong readd;
+  jobject bbBuffer;
 
   readd = -1;
+  if (count > RESOLVER_MAX_IO)
+    count = RESOLVER_MAX_IO;
   
   env = getEnv();
   if (env != OFC_NULL)
     {
       jFile = (jobject) rfile;
-      baBuffer = (*env)->NewByteArray(env, count);
-      readd = (*env)->CallIntMethod(env, g_resolver,
-				    g_method_read,
-				    jFile, (jbyteArray) baBuffer,
-				    (jint) count);
-      (*env)->GetByteArrayRegion(env, baBuffer, 0, readd,
-				 (jbyte *) lpBuffer);
-
+      bbBuffer = wrapBuffer(env, (OFC_VOID *) lpBuffer, count);
+      if (bbBuffer != OFC_NULL)
+	readd = (*env)->CallLongMethod(env, g_resolver,
+				       g_method_read,
+				       jFile, bbBuffer,
+				       (jlong) count);
       relEnv(env);
     }
   return ((OFC_SIZET) readd);
@@ -344,32 +1225,213 @@ OFC_SIZET resolver_pread(RESOLVER_FILE *rfile, OFC_LPVOID lpBuffer,
 {
   jobject jFile;
   JNIEnv *env ;
-  jint readd;
+  jlong readd;
   jobject bbBuffer;
 
   readd = -1;
+  if (count > RESOLVER_MAX_IO)
+    count = RESOLVER_MAX_IO;
   
   env = getEnv();
   if (env != OFC_NULL)
     {
       jFile = (jobject) rfile;
-      bbBuffer = (*env)->NewDirectByteBuffer(env, lpBuffer, count);
-      readd = (*env)->CallIntMethod(env, g_resolver,
-				    g_method_pread,
-				    jFile, bbBuffer,
-				    (jint) count,
-				    (jint) offset);
+      bbBuffer = wrapBuffer(env, lpBuffer, count);
+      if (bbBuffer != OFC_NULL)
+	readd = (*env)->CallLongMethod(env, g_resolver,
+				       g_method_pread,
+				       jFile, bbBuffer,
+				       (jlong) count,
+				       (jlong) offset);
       relEnv(env);
     }
   return ((OFC_SIZET) readd);
 }
 
+static OFC_VOID asyncDone(JNIEnv *env, RESOLVER_ASYNC *req,
+			  OFC_SIZET result)
+{
+  jobject buffer;
+
+  buffer = OFC_NULL;
+  ofc_lock(g_async_lock);
+  if (!req->done)
+    {
+      buffer = req->buffer;
+      req->buffer = OFC_NULL;
+      req->result = result;
+      req->done = OFC_TRUE;
+      if (!req->issuing)
+	ofc_event_set(req->event);
+    }
+  ofc_unlock(g_async_lock);
+
+  if (buffer != OFC_NULL)
+    (*env)->DeleteGlobalRef(env, buffer) ;
+}
+
+static RESOLVER_ASYNC *asyncIssue(RESOLVER_FILE *rfile, OFC_VOID *lpBuffer,
+				  OFC_SIZET count, OFC_OFFT offset,
+				  OFC_HANDLE hEvent, OFC_BOOL write)
+{
+  RESOLVER_ASYNC *req;
+  JNIEnv *env ;
+  jobject bbBuffer;
+  jint ret;
+  OFC_SIZET result;
+
+  req = ofc_malloc(sizeof(RESOLVER_ASYNC));
+  if (req == OFC_NULL)
+    return (OFC_NULL);
+
+  req->own_event = (hEvent == OFC_HANDLE_NULL);
+  if (req->own_event)
+    req->event = ofc_event_create(OFC_EVENT_MANUAL);
+  else
+    req->event = hEvent;
+  req->issuing = OFC_FALSE;
+  req->done = OFC_FALSE;
+  req->result = (OFC_SIZET) -1;
+  req->buffer = OFC_NULL;
+
+  if (count > RESOLVER_MAX_IO)
+    count = RESOLVER_MAX_IO;
+
+  if (!g_async)
+    {
+      /*
+       * The listener only does blocking I/O, so the request is complete
+       * by the time it is returned
+       */
+      if (write)
+	result = resolver_pwrite(rfile, lpBuffer, count, offset);
+      else
+	result = resolver_pread(rfile, lpBuffer, count, offset);
+      ofc_lock(g_async_lock);
+      req->result = result;
+      req->done = OFC_TRUE;
+      ofc_event_set(req->event);
+      ofc_unlock(g_async_lock);
+      return (req);
+    }
+
+  ret = -1;
+  env = getEnv();
+  if (env != OFC_NULL)
+    {
+      /*
+       * The buffer outlives this upcall, so it can't come from the
+       * per thread wrappers
+       */
+      bbBuffer = (*env)->NewDirectByteBuffer(env, lpBuffer, (jlong) count);
+      if (bbBuffer != OFC_NULL)
+	req->buffer = (*env)->NewGlobalRef(env, bbBuffer) ;
+      if (req->buffer != OFC_NULL)
+	{
+	  req->issuing = OFC_TRUE;
+	  ret = (*env)->CallIntMethod(env, g_resolver,
+				      write ? g_method_pwriteasync :
+				      g_method_preadasync,
+				      (jobject) rfile, req->buffer,
+				      (jlong) count, (jlong) offset,
+				      (jlong) (OFC_DWORD_PTR) req);
+	  if ((*env)->ExceptionCheck(env))
+	    {
+	      exceptCheck(env);
+	      ret = -1;
+	    }
+	}
+      /*
+       * A request the listener would not take, or threw on, is
+       * completed here with an error, unless the listener completed it
+       * already
+       */
+      if (ret != 0)
+	asyncDone(env, req, (OFC_SIZET) -1);
+
+      ofc_lock(g_async_lock);
+      req->issuing = OFC_FALSE;
+      if (req->done)
+	ofc_event_set(req->event);
+      ofc_unlock(g_async_lock);
+      relEnv(env);
+    }
+  else
+    {
+      ofc_lock(g_async_lock);
+      req->done = OFC_TRUE;
+      ofc_event_set(req->event);
+      ofc_unlock(g_async_lock);
+    }
+  return (req);
+}
+
+RESOLVER_ASYNC *resolver_async_pread(RESOLVER_FILE *rfile,
+				     OFC_LPVOID lpBuffer, OFC_SIZET count,
+				     OFC_OFFT offset, OFC_HANDLE hEvent)
+{
+  return (asyncIssue(rfile, lpBuffer, count, offset, hEvent, OFC_FALSE));
+}
+
+RESOLVER_ASYNC *resolver_async_pwrite(RESOLVER_FILE *rfile,
+				      OFC_LPCVOID lpBuffer, OFC_SIZET count,
+				      OFC_OFFT offset, OFC_HANDLE hEvent)
+{
+  return (asyncIssue(rfile, (OFC_VOID *) lpBuffer, count, offset, hEvent,
+		     OFC_TRUE));
+}
+
+OFC_BOOL resolver_async_done(RESOLVER_ASYNC *req)
+{
+  OFC_BOOL done;
+
+  ofc_lock(g_async_lock);
+  done = req->done && !req->issuing;
+  ofc_unlock(g_async_lock);
+  return (done);
+}
+
+OFC_SIZET resolver_async_result(RESOLVER_ASYNC *req)
+{
+  OFC_SIZET result;
+
+  while (!resolver_async_done(req))
+    ofc_event_wait(req->event);
+
+  result = req->result;
+  if (req->own_event)
+    ofc_event_destroy(req->event);
+  ofc_free(req);
+  return (result);
+}
+
+/*
+ * Class:     com_connectedway_io_Resolver
+ * Method:    complete
+ * Signature: (JJ)V
+ */
+JNIEXPORT void JNICALL Java_com_connectedway_io_Resolver_complete
+  (JNIEnv *env, jclass cls, jlong request, jlong result)
+{
+  HEAP_ENTER () ;
+
+  asyncDone(env, (RESOLVER_ASYNC *) (OFC_DWORD_PTR) request,
+	    (OFC_SIZET) result);
+}
+
 OFC_INT resolver_close(RESOLVER_FILE *rfile)
 {
   jobject jFile;
   JNIEnv *env ;
   int ret;
   
+  /*
+   * The lock table is keyed by the global reference, so it goes before
+   * the reference does and a concurrent open can be handed the same
+   * value
+   */
+  lockFileFree(rfile);
+
   env = getEnv();
   ret = -1;
   if (env != OFC_NULL)
@@ -399,8 +1461,10 @@ OFC_INT resolver_unlink(OFC_CTCHAR *lpFileName)
       ret = (*env)->CallIntMethod(env, g_resolver,
 				  g_method_unlink,
 				  jstrFileName);
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
       relEnv(env);
     }
+  statCacheDrop(lpFileName, OFC_TRUE);
   return (ret);
 }
 
@@ -418,19 +1482,101 @@ OFC_INT resolver_rmdir(OFC_CTCHAR *lpPathName)
       ret = (*env)->CallIntMethod(env, g_resolver,
 				  g_method_rmdir,
 				  jstrFileName);
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
       relEnv(env);
     }
+  statCacheDrop(lpPathName, OFC_TRUE);
   return (ret);
 }
 
+static OFC_VOID fillStat(struct resolver_stat *sb, OFC_CTCHAR *tName,
+			 OFC_UINT64 id, OFC_INT64 size, OFC_INT64 mtime,
+			 OFC_INT flags)
+{
+  OFC_PATH *path;
+
+  sb->st_ino = id;
+  sb->st_size = (OFC_OFFT) size;
+  sb->st_blocks = (OFC_OFFT) (sb->st_size + 4095) / 4096;
+  sb->st_mtime = mtime / 1000;
+  sb->st_atime = sb->st_mtime;
+  sb->st_ctime = sb->st_mtime;
+  sb->st_nlink = 1;
+  if (flags & 0x01)
+    sb->st_mode = RESOLVER_S_IFDIR;
+  else
+    {
+      path = ofc_path_createW(tName);
+      if (ofc_path_hidden(path))
+	sb->st_mode = RESOLVER_S_IFHID;
+      else
+	sb->st_mode = RESOLVER_S_IFREG;
+      ofc_path_delete(path);
+    }
+}
+
+/*
+ * Look a path up in the batches buffered for open directories.  Only
+ * batches younger than RESOLVER_STAT_TTL are used, and only entries
+ * that no change has marked stale.
+ */
+static OFC_BOOL statFromDirs(OFC_CTCHAR *tName, struct resolver_stat *sb)
+{
+  RESOLVER_DIR_BUFFER *buffer;
+  RESOLVER_DIR_ENTRY *entry;
+  OFC_CTCHAR *leaf;
+  OFC_SIZET parent_len;
+  OFC_MSTIME now;
+  OFC_BOOL found;
+  OFC_INT i;
+
+  leaf = OFC_NULL;
+  for (i = 0 ; tName[i] != TCHAR_EOS ; i++)
+    if (tName[i] == TCHAR_SLASH || tName[i] == TCHAR_BACKSLASH)
+      leaf = tName + i;
+  if (leaf == OFC_NULL)
+    return (OFC_FALSE);
+  parent_len = leaf - tName;
+  leaf++;
+
+  found = OFC_FALSE;
+  now = ofc_time_get_now();
+  ofc_lock(g_dir_lock);
+  for (buffer = g_dirs ; buffer != OFC_NULL && !found ;
+       buffer = buffer->next)
+    {
+      if (buffer->path_len != parent_len ||
+	  now - buffer->stamp >= RESOLVER_STAT_TTL ||
+	  ofc_tstrncmp(buffer->path, tName, parent_len) != 0)
+	continue;
+
+      for (i = 0 ; i < buffer->count && !found ; i++)
+	{
+	  entry = &buffer->entries[i];
+	  if (!entry->stale && ofc_tstrcmp(entry->dirent.d_name, leaf) == 0)
+	    {
+	      fillStat(sb, tName, entry->id, entry->size, entry->mtime,
+		       entry->flags);
+	      found = OFC_TRUE;
+	    }
+	}
+    }
+  ofc_unlock(g_dir_lock);
+
+  return (found);
+}
+
 OFC_INT resolver_stat(OFC_CTCHAR *tName, struct resolver_stat *sb)
 {
   JNIEnv *env ;
   jstring jstrFileName;
   jobject objResolverStat;
   OFC_INT ret;
-  int mode;
-  OFC_PATH *path;
+
+  if (statCacheGet(tName, sb))
+    return (0);
+  if (statFromDirs(tName, sb))
+    return (0);
 
   ret = -1;
   env = getEnv();
@@ -445,32 +1591,20 @@ OFC_INT resolver_stat(OFC_CTCHAR *tName, struct resolver_stat *sb)
 
       if (objResolverStat != OFC_NULL)
 	{
-          sb->st_ino = (OFC_UINT64) (*env)->GetLongField(env, objResolverStat,
-                                                         fieldResolverStatId);
-	  sb->st_size = (OFC_OFFT) (*env)->GetLongField(env, objResolverStat,
-							fieldResolverStatSize);
-	  sb->st_blocks = (OFC_OFFT) (sb->st_size + 4095) / 4096;
-	  sb->st_mtime = (*env)->GetLongField(env,
-					      objResolverStat,
-					      fieldResolverStatMTime) / 1000;
-	  sb->st_atime = sb->st_mtime;
-	  sb->st_ctime = sb->st_mtime;
-	  sb->st_nlink = 1;
-	  mode = (OFC_INT) (*env)->GetIntField(env, objResolverStat,
-                                               fieldResolverStatFlags);
-          if (mode & 0x01)
-            sb->st_mode = RESOLVER_S_IFDIR;
-          else
-            {
-              path = ofc_path_createW(tName);
-              if (ofc_path_hidden(path))
-                sb->st_mode = RESOLVER_S_IFHID;
-              else
-                sb->st_mode = RESOLVER_S_IFREG;
-            }
-
+	  fillStat(sb, tName,
+		   (OFC_UINT64) (*env)->GetLongField(env, objResolverStat,
+						     fieldResolverStatId),
+		   (*env)->GetLongField(env, objResolverStat,
+					fieldResolverStatSize),
+		   (*env)->GetLongField(env, objResolverStat,
+					fieldResolverStatMTime),
+		   (OFC_INT) (*env)->GetIntField(env, objResolverStat,
+						 fieldResolverStatFlags));
+	  statCachePut(tName, sb);
 	  ret = 0;
+	  (*env)->DeleteLocalRef(env, objResolverStat) ;
 	}
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
       relEnv(env);
     }
   return (ret);
@@ -508,7 +1642,9 @@ OFC_INT resolver_statfs(OFC_CTCHAR *tName, struct resolver_statfs *fsstat)
 					    fieldResolverStatFSBlocks) /
 			4096);
 	  ret = 0;
+	  (*env)->DeleteLocalRef(env, objResolverStatFS) ;
 	}
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
       relEnv(env);
     }
   return (ret);
@@ -519,70 +1655,191 @@ RESOLVER_DIR *resolver_opendir(OFC_CTCHAR *name)
   JNIEnv *env ;
   jstring jstrFileName;
   jobject rDir;
-  jobject gDir;
+  RESOLVER_DIR_BUFFER *buffer;
 
-  gDir = OFC_NULL;
+  buffer = OFC_NULL;
   env = getEnv();
   if (env != OFC_NULL)
     {
       jstrFileName = tchar2jstr(env, name);
-      rDir = (RESOLVER_DIR *) (*env)->CallObjectMethod(env, g_resolver,
-						       g_method_opendir,
-						       jstrFileName);
-      gDir = (*env)->NewGlobalRef(env, rDir) ;
+      rDir = (*env)->CallObjectMethod(env, g_resolver,
+				      g_method_opendir,
+				      jstrFileName);
+      if (rDir != OFC_NULL)
+	{
+	  buffer = ofc_malloc(sizeof(RESOLVER_DIR_BUFFER));
+	  if (buffer != OFC_NULL)
+	    {
+	      buffer->dir = (*env)->NewGlobalRef(env, rDir) ;
+	      buffer->path = ofc_tstrdup(name);
+	      /*
+	       * Match stat paths against the directory without its
+	       * trailing separators
+	       */
+	      for (buffer->path_len = ofc_tstrlen(name) ;
+		   buffer->path_len > 0 &&
+		     (name[buffer->path_len-1] == TCHAR_SLASH ||
+		      name[buffer->path_len-1] == TCHAR_BACKSLASH) ;
+		   buffer->path_len--) ;
+	      buffer->count = 0;
+	      buffer->cursor = 0;
+	      buffer->eof = OFC_FALSE;
+	      buffer->stamp = 0;
+	      buffer->entries = OFC_NULL;
+
+	      ofc_lock(g_dir_lock);
+	      buffer->next = g_dirs;
+	      g_dirs = buffer;
+	      ofc_unlock(g_dir_lock);
+	    }
+	  (*env)->DeleteLocalRef(env, rDir) ;
+	}
+      (*env)->DeleteLocalRef(env, jstrFileName) ;
+      relEnv(env);
     }
-  return (gDir);
+  return ((RESOLVER_DIR *) buffer);
 }
 
-struct resolver_dirent *resolver_readdir(RESOLVER_DIR *dirp)
+/*
+ * Fetch the next batch of entries.  The upcall is made without the
+ * directory lock, and the batch is only swapped in once it has been
+ * converted.  The batch is kept whole however long it is.
+ */
+static OFC_VOID readDirBatch(RESOLVER_DIR_BUFFER *buffer)
 {
   JNIEnv *env ;
+  jobjectArray arrayDirents;
   jobject objResolverDirent;
-  static struct resolver_dirent sdirent;
-  struct resolver_dirent *ret;
-
-  ret = OFC_NULL;
+  jstring name;
+  OFC_TCHAR *tstrName;
+  RESOLVER_DIR_ENTRY *entries;
+  RESOLVER_DIR_ENTRY *entry;
+  RESOLVER_DIR_ENTRY *old;
+  OFC_INT len;
+  OFC_INT count;
+  OFC_INT i;
 
+  len = 0;
+  count = 0;
+  entries = OFC_NULL;
   env = getEnv();
   if (env != OFC_NULL)
     {
-      objResolverDirent = (*env)->CallObjectMethod(env, g_resolver,
-						   g_method_readdir,
-						   (jobject) dirp);
-      if (objResolverDirent != NULL)
+      arrayDirents = (*env)->CallObjectMethod(env, g_resolver,
+					      g_method_readdirbatch,
+					      buffer->dir,
+					      (jint) RESOLVER_DIR_BATCH);
+      if (arrayDirents != OFC_NULL)
+	len = (*env)->GetArrayLength(env, arrayDirents);
+      if (len > 0)
+	entries = ofc_malloc(sizeof(RESOLVER_DIR_ENTRY) * len);
+      if (entries == OFC_NULL)
+	len = 0;
+
+      for (i = 0 ; i < len ; i++)
 	{
-	  jstring name =
-	    (jstring) (*env)->GetObjectField(env, objResolverDirent,
-					     fieldResolverDirent);
-	  OFC_TCHAR *tstrName;
-	  tstrName = jstr2tchar(env, name);
-	  ofc_tstrncpy(sdirent.d_name, tstrName,
-		       sizeof(sdirent.d_name)/sizeof(sdirent.d_name[0]));
-	  ofc_free(tstrName);
-	  ret = &sdirent;
+	  objResolverDirent =
+	    (*env)->GetObjectArrayElement(env, arrayDirents, i);
+	  if (objResolverDirent == OFC_NULL)
+	    continue;
+	  name = (jstring) (*env)->GetObjectField(env, objResolverDirent,
+						  fieldResolverDirent);
+	  tstrName = OFC_NULL;
+	  if (name != OFC_NULL)
+	    tstrName = jstr2tchar(env, name);
+	  if (tstrName != OFC_NULL)
+	    {
+	      entry = &entries[count++];
+	      ofc_tstrncpy(entry->dirent.d_name, tstrName,
+			   sizeof(entry->dirent.d_name) /
+			   sizeof(entry->dirent.d_name[0]));
+	      ofc_free(tstrName);
+	      entry->id = (OFC_UINT64)
+		(*env)->GetLongField(env, objResolverDirent,
+				     fieldResolverDirentId);
+	      entry->size = (*env)->GetLongField(env, objResolverDirent,
+						 fieldResolverDirentSize);
+	      entry->mtime = (*env)->GetLongField(env, objResolverDirent,
+						  fieldResolverDirentMTime);
+	      entry->flags = (*env)->GetIntField(env, objResolverDirent,
+						 fieldResolverDirentFlags);
+	      entry->stale = OFC_FALSE;
+	    }
+	  if (name != OFC_NULL)
+	    (*env)->DeleteLocalRef(env, name) ;
+	  (*env)->DeleteLocalRef(env, objResolverDirent) ;
 	}
+      if (arrayDirents != OFC_NULL)
+	(*env)->DeleteLocalRef(env, arrayDirents) ;
       relEnv(env);
     }
+
+  ofc_lock(g_dir_lock);
+  /*
+   * The old batch goes, and with it the last dirent handed out
+   */
+  old = buffer->entries;
+  buffer->entries = entries;
+  buffer->count = count;
+  buffer->cursor = 0;
+  buffer->eof = (len == 0);
+  buffer->stamp = ofc_time_get_now();
+  ofc_unlock(g_dir_lock);
+
+  if (old != OFC_NULL)
+    ofc_free(old);
+}
+
+struct resolver_dirent *resolver_readdir(RESOLVER_DIR *dirp)
+{
+  RESOLVER_DIR_BUFFER *buffer;
+  struct resolver_dirent *ret;
+
+  buffer = (RESOLVER_DIR_BUFFER *) dirp;
+  ret = OFC_NULL;
+
+  /*
+   * A batch of nothing but skipped entries is not the end
+   */
+  while (buffer->cursor == buffer->count && !buffer->eof)
+    readDirBatch(buffer);
+
+  if (buffer->cursor < buffer->count)
+    ret = &buffer->entries[buffer->cursor++].dirent;
+
   return(ret);
 }
 
 OFC_INT resolver_closedir(RESOLVER_DIR *dirp)
 {
-  jobject jDir;
+  RESOLVER_DIR_BUFFER *buffer;
+  RESOLVER_DIR_BUFFER **link;
   JNIEnv *env ;
   int ret;
   
+  buffer = (RESOLVER_DIR_BUFFER *) dirp;
+
+  ofc_lock(g_dir_lock);
+  for (link = &g_dirs ; *link != OFC_NULL && *link != buffer ;
+       link = &(*link)->next) ;
+  if (*link != OFC_NULL)
+    *link = buffer->next;
+  ofc_unlock(g_dir_lock);
+
   ret = -1;
   env = getEnv();
   if (env != OFC_NULL)
     {
-      jDir = (jobject) dirp;
       ret = (*env)->CallIntMethod(env, g_resolver,
 				     g_method_closedir,
-				     jDir);
-      (*env)->DeleteGlobalRef(env, jDir) ;
+				     buffer->dir);
+      (*env)->DeleteGlobalRef(env, buffer->dir) ;
       relEnv(env);
     }
+  if (buffer->entries != OFC_NULL)
+    ofc_free(buffer->entries);
+  ofc_free(buffer->path);
+  ofc_free(buffer);
   return(ret);
 }
 
@@ -604,8 +1861,11 @@ OFC_INT resolver_rename(OFC_CTCHAR *old, OFC_CTCHAR *new)
 				  g_method_rename,
 				  jstrOldName,
 				  jstrNewName);
+      (*env)->DeleteLocalRef(env, jstrNewName) ;
+      (*env)->DeleteLocalRef(env, jstrOldName) ;
       relEnv(env);
     }
+  statCacheFlush();
   return (ret);
 }
 
@@ -672,76 +1932,245 @@ OFC_INT resolver_truncate(RESOLVER_FILE *rfile, OFC_UINT64 offset)
 
       relEnv(env);
     }
+  statCacheDropFile(rfile);
   return (ret);
 }
 
-OFC_VOID resolver_unlock(RESOLVER_FILE *rfile, OFC_UINT64 offset,
-			 OFC_UINT64 size)
+/*
+ * The upcalls for locks that reach the OS.  Lock and TryLock return 0
+ * once the lock is held.
+ */
+static OFC_INT lockOS(RESOLVER_FILE *rfile, OFC_UINT64 offset,
+		      OFC_UINT64 size, OFC_BOOL shared, OFC_BOOL wait)
 {
-  jobject jFile;
   JNIEnv *env ;
-  jlong joffset;
-  jlong jsize;
-  
+  OFC_INT ret;
+
+  ret = -1;
   env = getEnv();
   if (env != OFC_NULL)
     {
-      jFile = (jobject) rfile;
-      joffset = (jlong) offset;
-      jsize = (jlong) size;
-      (*env)->CallIntMethod(env, g_resolver,
-			    g_method_unlock,
-			    jFile, joffset, jsize);
+      ret = (*env)->CallIntMethod(env, g_resolver,
+				  wait ? g_method_lock : g_method_trylock,
+				  (jobject) rfile, (jlong) offset,
+				  (jlong) size, (jboolean) shared);
+      /*
+       * A listener that threw does not hold the lock, whatever the
+       * return value reads as
+       */
+      if ((*env)->ExceptionCheck(env))
+	{
+	  exceptCheck(env);
+	  ret = -1;
+	}
       relEnv(env);
     }
+  return (ret);
 }
 
-OFC_VOID resolver_lock(RESOLVER_FILE *rfile, OFC_UINT64 offset,
-		       OFC_UINT64 size, OFC_BOOL shared)
+static OFC_VOID unlockOS(RESOLVER_FILE *rfile, OFC_UINT64 offset,
+			 OFC_UINT64 size)
 {
-  jobject jFile;
   JNIEnv *env ;
-  jboolean jshared;
-  jlong joffset;
-  jlong jsize;
-  
+
   env = getEnv();
   if (env != OFC_NULL)
     {
-      jFile = (jobject) rfile;
-      joffset = (jlong) offset;
-      jsize = (jlong) size;
-      jshared = (jboolean) shared;
       (*env)->CallIntMethod(env, g_resolver,
-			    g_method_lock,
-			    jFile, joffset, jsize, jshared);
+			    g_method_unlock,
+			    (jobject) rfile, (jlong) offset, (jlong) size);
       relEnv(env);
     }
 }
 
-OFC_INT resolver_trylock(RESOLVER_FILE *rfile, OFC_UINT64 offset,
-			 OFC_UINT64 size, OFC_BOOL shared)
+/*
+ * Find a held segment that no range overlaps any more.  Called with the
+ * file's lock held.
+ */
+static RESOLVER_SEGMENT *segmentUnused(RESOLVER_LOCKS *locks)
 {
-  jobject jFile;
-  JNIEnv *env ;
-  jboolean jshared;
-  jlong joffset;
-  jlong jsize;
-  OFC_INT ret = -1;
-  
-  env = getEnv();
-  if (env != OFC_NULL)
+  RESOLVER_SEGMENT *segment;
+  RESOLVER_RANGE *range;
+
+  for (segment = locks->segments ; segment != OFC_NULL ;
+       segment = segment->next)
     {
-      jFile = (jobject) rfile;
-      joffset = (jlong) offset;
-      jsize = (jlong) size;
-      jshared = (jboolean) shared;
-      (*env)->CallIntMethod(env, g_resolver,
-			    g_method_trylock,
-			    jFile, joffset, jsize, jshared);
-      ret = 0;
-      relEnv(env);
+      if (segment->state != RESOLVER_SEGMENT_HELD)
+	continue;
+      for (range = locks->ranges ;
+	   range != OFC_NULL &&
+	     !rangeOverlaps(segment->offset, segment->end,
+			    range->offset, range->end) ;
+	   range = range->next) ;
+      if (range == OFC_NULL)
+	break;
     }
+  return (segment);
+}
+
+/*
+ * Unlock the segments no range overlaps any more.  Called with the
+ * file's lock held, which is dropped for each upcall.
+ */
+static OFC_VOID segmentsRelease(RESOLVER_LOCKS *locks)
+{
+  RESOLVER_SEGMENT *segment;
+  RESOLVER_SEGMENT **link;
+
+  while ((segment = segmentUnused(locks)) != OFC_NULL)
+    {
+      segment->state = RESOLVER_SEGMENT_UNLOCKING;
+      ofc_unlock(locks->lock);
+      unlockOS(locks->rfile, segment->offset,
+	       segment->end - segment->offset);
+      ofc_lock(locks->lock);
+
+      for (link = &locks->segments ;
+	   *link != OFC_NULL && *link != segment ;
+	   link = &(*link)->next) ;
+      if (*link != OFC_NULL)
+	*link = segment->next;
+      ofc_free(segment);
+      rangeWake(locks);
+    }
+}
+
+/*
+ * Lock the segments a range was granted.  If any of them fails, the
+ * range is given up, along with whatever it had locked, and the error
+ * of the upcall is returned.
+ */
+static OFC_INT rangeLockOS(RESOLVER_LOCKS *locks, RESOLVER_RANGE *range,
+			   OFC_BOOL wait)
+{
+  RESOLVER_SEGMENT *segment;
+  OFC_INT ret;
+
+  ret = 0;
+  ofc_lock(locks->lock);
+  while (ret == 0)
+    {
+      for (segment = locks->segments ;
+	   segment != OFC_NULL &&
+	     (segment->state != RESOLVER_SEGMENT_LOCKING ||
+	      segment->owner != range) ;
+	   segment = segment->next) ;
+      if (segment == OFC_NULL)
+	break;
+
+      /*
+       * Nobody else touches a segment while it is being locked
+       */
+      ofc_unlock(locks->lock);
+      ret = lockOS(locks->rfile, segment->offset,
+		   segment->end - segment->offset, segment->shared, wait);
+      ofc_lock(locks->lock);
+      if (ret == 0)
+	{
+	  segment->state = RESOLVER_SEGMENT_HELD;
+	  segment->owner = OFC_NULL;
+	}
+    }
+
+  if (ret == 0)
+    {
+      range->pending = OFC_FALSE;
+      rangeWake(locks);
+    }
+  else
+    {
+      segmentsAbandon(locks, range);
+      rangeRemove(locks, range);
+      segmentsRelease(locks);
+    }
+  ofc_unlock(locks->lock);
   return (ret);
 }
 
+OFC_VOID resolver_unlock(RESOLVER_FILE *rfile, OFC_UINT64 offset,
+			 OFC_UINT64 size)
+{
+  RESOLVER_LOCKS *locks;
+  RESOLVER_RANGE *range;
+  OFC_UINT64 end;
+
+  locks = lockFile(rfile, OFC_FALSE);
+  if (locks == OFC_NULL)
+    return;
+
+  end = rangeEnd(offset, size);
+  ofc_lock(locks->lock);
+  for (range = locks->ranges ;
+       range != OFC_NULL &&
+	 (range->offset != offset || range->end != end || range->pending) ;
+       range = range->next) ;
+
+  if (range != OFC_NULL)
+    {
+      range->count--;
+      if (range->count == 0)
+	{
+	  /*
+	   * Whatever the range shares with the ranges still held stays
+	   * locked for them
+	   */
+	  rangeRemove(locks, range);
+	  segmentsRelease(locks);
+	}
+    }
+  ofc_unlock(locks->lock);
+}
+
+/*
+ * Returns zero once the range is held, or what the failing upcall
+ * returned
+ */
+OFC_INT resolver_lock(RESOLVER_FILE *rfile, OFC_UINT64 offset,
+		      OFC_UINT64 size, OFC_BOOL shared)
+{
+  RESOLVER_LOCKS *locks;
+  RESOLVER_RANGE *range;
+  RESOLVER_RANGE_GRANT grant;
+  OFC_INT ret;
+
+  locks = lockFile(rfile, OFC_TRUE);
+  if (locks == OFC_NULL)
+    return (lockOS(rfile, offset, size, shared, OFC_TRUE));
+
+  ofc_lock(locks->lock);
+  while ((grant = rangeAcquire(locks, offset, size, shared, &range)) ==
+	 RESOLVER_RANGE_CONFLICT)
+    rangeWait(locks);
+  ofc_unlock(locks->lock);
+
+  ret = -1;
+  if (grant == RESOLVER_RANGE_HELD)
+    ret = 0;
+  else if (grant == RESOLVER_RANGE_OS)
+    ret = rangeLockOS(locks, range, OFC_TRUE);
+  return (ret);
+}
+
+OFC_INT resolver_trylock(RESOLVER_FILE *rfile, OFC_UINT64 offset,
+			 OFC_UINT64 size, OFC_BOOL shared)
+{
+  RESOLVER_LOCKS *locks;
+  RESOLVER_RANGE *range;
+  RESOLVER_RANGE_GRANT grant;
+  OFC_INT ret;
+
+  locks = lockFile(rfile, OFC_TRUE);
+  if (locks == OFC_NULL)
+    return (lockOS(rfile, offset, size, shared, OFC_FALSE));
+
+  ofc_lock(locks->lock);
+  grant = rangeAcquire(locks, offset, size, shared, &range);
+  ofc_unlock(locks->lock);
+
+  ret = -1;
+  if (grant == RESOLVER_RANGE_HELD)
+    ret = 0;
+  else if (grant == RESOLVER_RANGE_OS)
+    ret = rangeLockOS(locks, range, OFC_FALSE);
+  return (ret);
+}
@@ -0,0 +1,119 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/libc.h"
+
+#include "ofc_jni/com_connectedway_io_Search.h"
+
+#if defined(__SSE2__)
+#define SEARCH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SEARCH_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Compare the middle of a candidate.  The first and last bytes are
+ * already known to match.
+ */
+static OFC_BOOL search_match (const OFC_UINT8 *p, const OFC_UINT8 *pattern,
+			      OFC_SIZET pattern_len)
+{
+  OFC_SIZET i ;
+
+  for (i = 1 ; i + 1 < pattern_len ; i++)
+    if (p[i] != pattern[i])
+      return (OFC_FALSE) ;
+  return (OFC_TRUE) ;
+}
+
+OFC_LONG search_find (const OFC_UINT8 *buf, OFC_SIZET len,
+		      const OFC_UINT8 *pattern, OFC_SIZET pattern_len)
+{
+  OFC_SIZET i ;
+  OFC_SIZET last ;
+  OFC_UINT8 first_byte ;
+  OFC_UINT8 last_byte ;
+
+  if (pattern_len == 0 || pattern_len > len)
+    return (-1) ;
+
+  i = 0 ;
+  last = pattern_len - 1 ;
+  first_byte = pattern[0] ;
+  last_byte = pattern[last] ;
+
+#if defined(SEARCH_SSE2)
+  {
+    __m128i first ;
+    __m128i final ;
+    __m128i block_first ;
+    __m128i block_last ;
+    OFC_UINT32 mask ;
+    OFC_UINT32 bit ;
+
+    first = _mm_set1_epi8 ((char) first_byte) ;
+    final = _mm_set1_epi8 ((char) last_byte) ;
+    for (; i + last + 16 <= len ; i += 16)
+      {
+	block_first = _mm_loadu_si128 ((const __m128i *) (buf + i)) ;
+	block_last = _mm_loadu_si128 ((const __m128i *) (buf + i + last)) ;
+	mask = (OFC_UINT32) _mm_movemask_epi8
+	  (_mm_and_si128 (_mm_cmpeq_epi8 (first, block_first),
+			  _mm_cmpeq_epi8 (final, block_last))) ;
+	while (mask != 0)
+	  {
+	    bit = (OFC_UINT32) __builtin_ctz (mask) ;
+	    if (search_match (buf + i + bit, pattern, pattern_len))
+	      return ((OFC_LONG) (i + bit)) ;
+	    mask &= mask - 1 ;
+	  }
+      }
+  }
+#elif defined(SEARCH_NEON)
+  {
+    uint8x16_t first ;
+    uint8x16_t final ;
+    uint8x16_t eq ;
+    OFC_UINT64 mask ;
+    OFC_UINT32 bit ;
+
+    first = vdupq_n_u8 (first_byte) ;
+    final = vdupq_n_u8 (last_byte) ;
+    for (; i + last + 16 <= len ; i += 16)
+      {
+	eq = vandq_u8 (vceqq_u8 (first, vld1q_u8 (buf + i)),
+		       vceqq_u8 (final, vld1q_u8 (buf + i + last))) ;
+	/*
+	 * Narrow to four bits per byte to get a mask NEON has no
+	 * movemask for
+	 */
+	mask = vget_lane_u64
+	  (vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (eq), 4)),
+	   0) ;
+	while (mask != 0)
+	  {
+	    bit = (OFC_UINT32) __builtin_ctzll (mask) / 4 ;
+	    if (search_match (buf + i + bit, pattern, pattern_len))
+	      return ((OFC_LONG) (i + bit)) ;
+	    mask &= ~((OFC_UINT64) 0xF << (bit * 4)) ;
+	  }
+      }
+  }
+#endif
+
+  for (; i + last < len ; i++)
+    {
+      if (buf[i] == first_byte && buf[i + last] == last_byte &&
+	  search_match (buf + i, pattern, pattern_len))
+	return ((OFC_LONG) i) ;
+    }
+  return (-1) ;
+}
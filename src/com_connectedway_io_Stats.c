@@ -0,0 +1,604 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+#include <jni.h>
+#if !defined(_WIN32)
+#include <time.h>
+#endif
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/heap.h"
+#include "ofc/libc.h"
+#include "ofc/lock.h"
+#include "ofc/thread.h"
+#include "ofc/time.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_Stats.h"
+
+#if defined(OFC_JNI_STATS)
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/*
+ * Relaxed atomic loads and stores, and the fences that order them.  A
+ * counter has a single writer, so a load and a store make an increment
+ * and no read-modify-write is needed.  Compilers without the atomic
+ * builtins are assumed to target 64 bit machines, where aligned 64 bit
+ * accesses do not tear.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define STATS_LOAD(p) __atomic_load_n ((p), __ATOMIC_RELAXED)
+#define STATS_STORE(p, v) __atomic_store_n ((p), (v), __ATOMIC_RELAXED)
+#define STATS_ACQUIRE() __atomic_thread_fence (__ATOMIC_ACQUIRE)
+#define STATS_RELEASE() __atomic_thread_fence (__ATOMIC_RELEASE)
+#else
+#define STATS_LOAD(p) (*(p))
+#define STATS_STORE(p, v) (*(p) = (v))
+#define STATS_ACQUIRE() _ReadWriteBarrier ()
+#define STATS_RELEASE() _ReadWriteBarrier ()
+#endif
+
+#define STATS_BUMP(p, v) STATS_STORE ((p), STATS_LOAD (p) + (v))
+
+/*
+ * Counters of one thread.  Only the owning thread writes a block, with
+ * relaxed atomic stores, and a snapshot reads it with relaxed atomic
+ * loads, so counting takes no lock and a snapshot never sees a torn 64
+ * bit counter.  When the thread exits, its counts are folded into
+ * stats_exited and the block is freed.
+ */
+typedef struct _STATS_BLOCK
+{
+  struct _STATS_BLOCK *next ;
+  volatile OFC_UINT64 count[STATS_MAX_SHARES][STATS_OP_MAX] ;
+  volatile OFC_UINT64 bytes[STATS_MAX_SHARES][STATS_OP_MAX] ;
+  volatile OFC_UINT64 nanos[STATS_MAX_SHARES][STATS_OP_MAX] ;
+  volatile OFC_UINT64 hist[STATS_MAX_SHARES][STATS_OP_MAX][STATS_BUCKETS] ;
+} STATS_BLOCK ;
+
+/*
+ * Shares are interned on first sight.  Slot 0 collects local paths and
+ * anything beyond STATS_MAX_SHARES.  A share is never removed, so
+ * lookups read the table without the stats lock, and only a new share
+ * is added under it, published by a release of the count.
+ *
+ * Open handles are kept in a linear probed table, and a handle is
+ * taken out by moving up the entries behind it, so the table never
+ * fills with deleted entries.  The table is changed under the stats
+ * lock, on open and close only, and read without it: a change makes
+ * stats_handle_seq odd while it is in progress, and a lookup that
+ * overlapped one is tried again.
+ */
+#define STATS_SHARE_LEN 64
+#define STATS_HANDLE_SLOTS 1024
+#define STATS_HANDLE_FREE ((OFC_HANDLE) 0)
+
+typedef struct
+{
+  volatile OFC_HANDLE hFile ;
+  volatile OFC_INT share ;
+} STATS_HANDLE_SLOT ;
+
+static OFC_CCHAR *stats_op_names[STATS_OP_MAX] =
+  {
+    "open", "read", "write", "seek", "flush", "close",
+    "stat", "list", "find", "rename", "delete"
+  } ;
+
+static OFC_LOCK stats_lock = OFC_NULL ;
+static OFC_INT stats_key = -1 ;
+static STATS_BLOCK *stats_blocks = OFC_NULL ;
+static STATS_BLOCK *stats_exited = OFC_NULL ;
+static STATS_BLOCK *stats_baseline = OFC_NULL ;
+static OFC_CHAR stats_shares[STATS_MAX_SHARES][STATS_SHARE_LEN] =
+  { "local" } ;
+static volatile OFC_INT stats_share_count = 1 ;
+static STATS_HANDLE_SLOT stats_handles[STATS_HANDLE_SLOTS] ;
+static volatile OFC_UINT32 stats_handle_seq = 0 ;
+
+/*
+ * Add one block's counts to another.  block may be counting, sum is
+ * not.
+ */
+static OFC_VOID stats_add (STATS_BLOCK *sum, STATS_BLOCK *block)
+{
+  OFC_INT share ;
+  OFC_INT op ;
+  OFC_INT bucket ;
+
+  for (share = 0 ; share < STATS_MAX_SHARES ; share++)
+    for (op = 0 ; op < STATS_OP_MAX ; op++)
+      {
+	sum->count[share][op] += STATS_LOAD (&block->count[share][op]) ;
+	sum->bytes[share][op] += STATS_LOAD (&block->bytes[share][op]) ;
+	sum->nanos[share][op] += STATS_LOAD (&block->nanos[share][op]) ;
+	for (bucket = 0 ; bucket < STATS_BUCKETS ; bucket++)
+	  sum->hist[share][op][bucket] +=
+	    STATS_LOAD (&block->hist[share][op][bucket]) ;
+      }
+}
+
+/*
+ * Called as a thread that counted exits
+ */
+static OFC_VOID stats_block_release (OFC_VOID *value)
+{
+  STATS_BLOCK *block ;
+  STATS_BLOCK **link ;
+
+  block = (STATS_BLOCK *) value ;
+  ofc_lock (stats_lock) ;
+  for (link = &stats_blocks ; *link != OFC_NULL && *link != block ;
+       link = &(*link)->next) ;
+  if (*link != OFC_NULL)
+    *link = block->next ;
+  stats_add (stats_exited, block) ;
+  ofc_unlock (stats_lock) ;
+
+  ofc_free (block) ;
+}
+
+OFC_VOID stats_init (OFC_VOID)
+{
+  if (stats_lock == OFC_NULL)
+    {
+      stats_exited = ofc_malloc (sizeof (STATS_BLOCK)) ;
+      if (stats_exited == OFC_NULL)
+	return ;
+      ofc_memset (stats_exited, 0, sizeof (STATS_BLOCK)) ;
+      stats_key = jni_thread_key (stats_block_release) ;
+      stats_lock = ofc_lock_init () ;
+    }
+}
+
+OFC_UINT64 stats_now (OFC_VOID)
+{
+#if defined(_WIN32)
+  return ((OFC_UINT64) ofc_time_get_now () * 1000000) ;
+#else
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return ((OFC_UINT64) ts.tv_sec * 1000000000 + ts.tv_nsec) ;
+#endif
+}
+
+static STATS_BLOCK *stats_block (OFC_VOID)
+{
+  STATS_BLOCK *block ;
+
+  if (stats_key < 0)
+    return (OFC_NULL) ;
+
+  block = (STATS_BLOCK *) jni_thread_get (stats_key) ;
+  if (block == OFC_NULL)
+    {
+      block = ofc_malloc (sizeof (STATS_BLOCK)) ;
+      if (block == OFC_NULL)
+	return (OFC_NULL) ;
+      ofc_memset ((OFC_VOID *) block, 0, sizeof (STATS_BLOCK)) ;
+      if (!jni_thread_set (stats_key, block))
+	{
+	  ofc_free (block) ;
+	  return (OFC_NULL) ;
+	}
+      ofc_lock (stats_lock) ;
+      block->next = stats_blocks ;
+      stats_blocks = block ;
+      ofc_unlock (stats_lock) ;
+    }
+  return (block) ;
+}
+
+/*
+ * Reduce a path to its server and share.  "//server/share/..." and
+ * "scheme://server/share/..." become "server/share", a map prefix
+ * "name:/..." becomes "name:" and anything else is local.
+ */
+static OFC_VOID stats_share_key (OFC_LPCTSTR path, OFC_CHAR *key)
+{
+  OFC_LPCTSTR p ;
+  OFC_INT i ;
+  OFC_INT seps ;
+
+  key[0] = '\0' ;
+  if (path == OFC_NULL)
+    return ;
+
+  for (p = path ; *p != TCHAR_EOS && *p != TCHAR_COLON &&
+	 *p != TCHAR_SLASH && *p != TCHAR_BACKSLASH ; p++) ;
+  if (*p == TCHAR_COLON)
+    {
+      if ((p[1] == TCHAR_SLASH || p[1] == TCHAR_BACKSLASH) &&
+	  (p[2] == TCHAR_SLASH || p[2] == TCHAR_BACKSLASH))
+	p += 3 ;
+      else
+	{
+	  /* Map prefix */
+	  for (i = 0 ; path + i <= p && i < STATS_SHARE_LEN - 1 ; i++)
+	    key[i] = (OFC_CHAR) path[i] ;
+	  key[i] = '\0' ;
+	  return ;
+	}
+    }
+  else if ((path[0] == TCHAR_SLASH || path[0] == TCHAR_BACKSLASH) &&
+	   (path[1] == TCHAR_SLASH || path[1] == TCHAR_BACKSLASH))
+    p = path + 2 ;
+  else
+    return ;
+
+  for (i = 0, seps = 0 ; p[i] != TCHAR_EOS && i < STATS_SHARE_LEN - 1 ; i++)
+    {
+      if (p[i] == TCHAR_SLASH || p[i] == TCHAR_BACKSLASH)
+	{
+	  if (++seps == 2)
+	    break ;
+	  key[i] = '/' ;
+	}
+      else
+	key[i] = (OFC_CHAR) p[i] ;
+    }
+  key[i] = '\0' ;
+}
+
+/*
+ * Find an interned share among the first count
+ */
+static OFC_INT stats_share_find (OFC_CCHAR *key, OFC_INT count)
+{
+  OFC_INT i ;
+
+  for (i = 1 ; i < count ; i++)
+    if (ofc_strcmp (stats_shares[i], key) == 0)
+      return (i) ;
+  return (0) ;
+}
+
+static OFC_INT stats_share (OFC_LPCTSTR path)
+{
+  OFC_CHAR key[STATS_SHARE_LEN] ;
+  OFC_INT count ;
+  OFC_INT i ;
+
+  stats_share_key (path, key) ;
+  if (key[0] == '\0' || stats_lock == OFC_NULL)
+    return (0) ;
+
+  count = STATS_LOAD (&stats_share_count) ;
+  STATS_ACQUIRE () ;
+  i = stats_share_find (key, count) ;
+  if (i == 0)
+    {
+      ofc_lock (stats_lock) ;
+      count = stats_share_count ;
+      i = stats_share_find (key, count) ;
+      if (i == 0 && count < STATS_MAX_SHARES)
+	{
+	  ofc_strncpy (stats_shares[count], key, STATS_SHARE_LEN) ;
+	  STATS_RELEASE () ;
+	  STATS_STORE (&stats_share_count, count + 1) ;
+	  i = count ;
+	}
+      ofc_unlock (stats_lock) ;
+    }
+  return (i) ;
+}
+
+static OFC_VOID stats_record (STATS_OP op, OFC_UINT64 start, OFC_INT share,
+			      OFC_UINT64 bytes)
+{
+  STATS_BLOCK *block ;
+  OFC_UINT64 nanos ;
+  OFC_INT bucket ;
+
+  nanos = stats_now () - start ;
+  for (bucket = 0 ; bucket < STATS_BUCKETS - 1 && (nanos >> (bucket + 1)) ;
+       bucket++) ;
+
+  block = stats_block () ;
+  if (block != OFC_NULL)
+    {
+      STATS_BUMP (&block->count[share][op], 1) ;
+      STATS_BUMP (&block->bytes[share][op], bytes) ;
+      STATS_BUMP (&block->nanos[share][op], nanos) ;
+      STATS_BUMP (&block->hist[share][op][bucket], 1) ;
+    }
+}
+
+OFC_VOID stats_record_path (STATS_OP op, OFC_UINT64 start,
+			    OFC_LPCTSTR path, OFC_UINT64 bytes)
+{
+  stats_record (op, start, stats_share (path), bytes) ;
+}
+
+static OFC_UINT stats_handle_hash (OFC_HANDLE hFile)
+{
+  return ((OFC_UINT) (((OFC_DWORD_PTR) hFile * 2654435761u) %
+		      STATS_HANDLE_SLOTS)) ;
+}
+
+/*
+ * Start and end a change to the handle table.  Called with the stats
+ * lock held.
+ */
+static OFC_VOID stats_handles_change (OFC_VOID)
+{
+  STATS_STORE (&stats_handle_seq, stats_handle_seq + 1) ;
+  STATS_RELEASE () ;
+}
+
+static OFC_VOID stats_handles_changed (OFC_VOID)
+{
+  STATS_RELEASE () ;
+  STATS_STORE (&stats_handle_seq, stats_handle_seq + 1) ;
+}
+
+OFC_VOID stats_record_handle (STATS_OP op, OFC_UINT64 start,
+			      OFC_HANDLE hFile, OFC_UINT64 bytes)
+{
+  OFC_UINT slot ;
+  OFC_UINT i ;
+  OFC_UINT32 seq ;
+  OFC_HANDLE found ;
+  OFC_INT share ;
+
+  do
+    {
+      seq = STATS_LOAD (&stats_handle_seq) ;
+      STATS_ACQUIRE () ;
+      share = 0 ;
+      slot = stats_handle_hash (hFile) ;
+      for (i = 0 ; i < STATS_HANDLE_SLOTS &&
+	     (found = STATS_LOAD (&stats_handles[slot].hFile)) !=
+	     STATS_HANDLE_FREE ; i++)
+	{
+	  if (found == hFile)
+	    {
+	      share = STATS_LOAD (&stats_handles[slot].share) ;
+	      break ;
+	    }
+	  slot = (slot + 1) % STATS_HANDLE_SLOTS ;
+	}
+      STATS_ACQUIRE () ;
+    }
+  while ((seq & 1) || seq != STATS_LOAD (&stats_handle_seq)) ;
+
+  if (share < 0 || share >= STATS_MAX_SHARES)
+    share = 0 ;
+  stats_record (op, start, share, bytes) ;
+}
+
+/*
+ * Remember the share of an open file so the handle based operations
+ * can be attributed to it
+ */
+OFC_VOID stats_bind_handle (OFC_HANDLE hFile, OFC_LPCTSTR path)
+{
+  OFC_UINT slot ;
+  OFC_UINT i ;
+  OFC_INT share ;
+
+  share = stats_share (path) ;
+  if (share == 0)
+    return ;
+
+  ofc_lock (stats_lock) ;
+  stats_handles_change () ;
+  slot = stats_handle_hash (hFile) ;
+  for (i = 0 ; i < STATS_HANDLE_SLOTS ; i++)
+    {
+      if (stats_handles[slot].hFile == STATS_HANDLE_FREE)
+	{
+	  STATS_STORE (&stats_handles[slot].share, share) ;
+	  STATS_STORE (&stats_handles[slot].hFile, hFile) ;
+	  break ;
+	}
+      slot = (slot + 1) % STATS_HANDLE_SLOTS ;
+    }
+  stats_handles_changed () ;
+  ofc_unlock (stats_lock) ;
+}
+
+OFC_VOID stats_unbind_handle (OFC_HANDLE hFile)
+{
+  OFC_UINT slot ;
+  OFC_UINT next ;
+  OFC_UINT home ;
+  OFC_UINT i ;
+
+  if (stats_lock == OFC_NULL)
+    return ;
+
+  ofc_lock (stats_lock) ;
+  slot = stats_handle_hash (hFile) ;
+  for (i = 0 ; i < STATS_HANDLE_SLOTS &&
+	 stats_handles[slot].hFile != STATS_HANDLE_FREE &&
+	 stats_handles[slot].hFile != hFile ; i++)
+    slot = (slot + 1) % STATS_HANDLE_SLOTS ;
+
+  if (i < STATS_HANDLE_SLOTS && stats_handles[slot].hFile == hFile)
+    {
+      /*
+       * Move up each entry behind the hole that may not live beyond
+       * it, so that every entry stays reachable from its home slot
+       */
+      stats_handles_change () ;
+      STATS_STORE (&stats_handles[slot].hFile, STATS_HANDLE_FREE) ;
+      next = slot ;
+      for (;;)
+	{
+	  next = (next + 1) % STATS_HANDLE_SLOTS ;
+	  if (stats_handles[next].hFile == STATS_HANDLE_FREE)
+	    break ;
+	  home = stats_handle_hash (stats_handles[next].hFile) ;
+	  if ((next > slot && (home <= slot || home > next)) ||
+	      (next < slot && home <= slot && home > next))
+	    {
+	      STATS_STORE (&stats_handles[slot].share,
+			   stats_handles[next].share) ;
+	      STATS_STORE (&stats_handles[slot].hFile,
+			   stats_handles[next].hFile) ;
+	      STATS_STORE (&stats_handles[next].hFile, STATS_HANDLE_FREE) ;
+	      slot = next ;
+	    }
+	}
+      stats_handles_changed () ;
+    }
+  ofc_unlock (stats_lock) ;
+}
+
+/*
+ * Sum every thread's block, less the baseline of the last reset.
+ * Called with the stats lock held.
+ */
+static OFC_VOID stats_sum (STATS_BLOCK *sum)
+{
+  STATS_BLOCK *block ;
+  OFC_INT share ;
+  OFC_INT op ;
+  OFC_INT bucket ;
+
+  ofc_memset ((OFC_VOID *) sum, 0, sizeof (STATS_BLOCK)) ;
+  stats_add (sum, stats_exited) ;
+  for (block = stats_blocks ; block != OFC_NULL ; block = block->next)
+    stats_add (sum, block) ;
+
+  if (stats_baseline != OFC_NULL)
+    {
+      for (share = 0 ; share < STATS_MAX_SHARES ; share++)
+	for (op = 0 ; op < STATS_OP_MAX ; op++)
+	  {
+	    sum->count[share][op] -= stats_baseline->count[share][op] ;
+	    sum->bytes[share][op] -= stats_baseline->bytes[share][op] ;
+	    sum->nanos[share][op] -= stats_baseline->nanos[share][op] ;
+	    for (bucket = 0 ; bucket < STATS_BUCKETS ; bucket++)
+	      sum->hist[share][op][bucket] -=
+		stats_baseline->hist[share][op][bucket] ;
+	  }
+    }
+}
+
+OFC_VOID stats_reset (OFC_VOID)
+{
+  STATS_BLOCK *sum ;
+
+  if (stats_lock == OFC_NULL)
+    return ;
+  sum = ofc_malloc (sizeof (STATS_BLOCK)) ;
+  if (sum == OFC_NULL)
+    return ;
+  ofc_lock (stats_lock) ;
+  stats_sum (sum) ;
+  if (stats_baseline == OFC_NULL)
+    stats_baseline = sum ;
+  else
+    {
+      /*
+       * The sum is relative to the old baseline.  Fold it in.
+       */
+      stats_add (stats_baseline, sum) ;
+      ofc_free (sum) ;
+    }
+  ofc_unlock (stats_lock) ;
+}
+
+jobject stats_snapshot (JNIEnv *env)
+{
+  STATS_BLOCK *sum ;
+  OFC_INT share ;
+  OFC_INT op ;
+  OFC_INT i ;
+  OFC_INT entries ;
+  OFC_INT share_count ;
+  jclass clsStats ;
+  jclass clsEntry ;
+  jmethodID midNewStats ;
+  jmethodID midNewEntry ;
+  jobjectArray arrayEntries ;
+  jobject objEntry ;
+  jobject objStats ;
+  jstring jstrShare ;
+  jstring jstrOp ;
+  jlongArray arrayHist ;
+
+  if (stats_lock == OFC_NULL)
+    return (OFC_NULL) ;
+  sum = ofc_malloc (sizeof (STATS_BLOCK)) ;
+  if (sum == OFC_NULL)
+    return (OFC_NULL) ;
+  ofc_lock (stats_lock) ;
+  stats_sum (sum) ;
+  share_count = stats_share_count ;
+  ofc_unlock (stats_lock) ;
+
+  entries = 0 ;
+  for (share = 0 ; share < share_count ; share++)
+    for (op = 0 ; op < STATS_OP_MAX ; op++)
+      if (sum->count[share][op] > 0)
+	entries++ ;
+
+  clsStats = (*env)->FindClass (env, "com/connectedway/io/Stats") ;
+  clsEntry = (*env)->FindClass (env, "com/connectedway/io/Stats$Entry") ;
+  midNewStats = (*env)->GetMethodID
+    (env, clsStats, "<init>", "([Lcom/connectedway/io/Stats$Entry;)V") ;
+  midNewEntry = (*env)->GetMethodID
+    (env, clsEntry, "<init>", "(Ljava/lang/String;Ljava/lang/String;JJJ[J)V") ;
+
+  arrayEntries = (*env)->NewObjectArray (env, entries, clsEntry, NULL) ;
+  i = 0 ;
+  for (share = 0 ; share < share_count ; share++)
+    for (op = 0 ; op < STATS_OP_MAX ; op++)
+      {
+	if (sum->count[share][op] == 0)
+	  continue ;
+
+	jstrShare = (*env)->NewStringUTF (env, stats_shares[share]) ;
+	jstrOp = (*env)->NewStringUTF (env, stats_op_names[op]) ;
+	arrayHist = (*env)->NewLongArray (env, STATS_BUCKETS) ;
+	(*env)->SetLongArrayRegion (env, arrayHist, 0, STATS_BUCKETS,
+				    (jlong *) sum->hist[share][op]) ;
+	objEntry = (*env)->NewObject (env, clsEntry, midNewEntry,
+				      jstrShare, jstrOp,
+				      (jlong) sum->count[share][op],
+				      (jlong) sum->bytes[share][op],
+				      (jlong) sum->nanos[share][op],
+				      arrayHist) ;
+	(*env)->SetObjectArrayElement (env, arrayEntries, i++, objEntry) ;
+	(*env)->DeleteLocalRef (env, objEntry) ;
+	(*env)->DeleteLocalRef (env, arrayHist) ;
+	(*env)->DeleteLocalRef (env, jstrOp) ;
+	(*env)->DeleteLocalRef (env, jstrShare) ;
+      }
+
+  objStats = (*env)->NewObject (env, clsStats, midNewStats, arrayEntries) ;
+
+  (*env)->DeleteLocalRef (env, arrayEntries) ;
+  (*env)->DeleteLocalRef (env, clsEntry) ;
+  (*env)->DeleteLocalRef (env, clsStats) ;
+  ofc_free (sum) ;
+
+  return (objStats) ;
+}
+
+#else
+
+OFC_VOID stats_init (OFC_VOID)
+{
+}
+
+OFC_VOID stats_reset (OFC_VOID)
+{
+}
+
+jobject stats_snapshot (JNIEnv *env)
+{
+  return (OFC_NULL) ;
+}
+
+#endif
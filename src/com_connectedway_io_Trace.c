@@ -0,0 +1,343 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#define __OFC_CORE_DLL__
+#include <jni.h>
+#if !defined(_WIN32)
+#include <time.h>
+#endif
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/heap.h"
+#include "ofc/libc.h"
+#include "ofc/lock.h"
+#include "ofc/thread.h"
+#include "ofc/time.h"
+#include "ofc/file.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_Trace.h"
+
+/*
+ * One event.  name points at a string constant, either the function
+ * name of a JNI entry point or the direction of an I/O.  id is the
+ * buffer descriptor of an I/O and ties a completion to its submit.
+ */
+typedef struct
+{
+  OFC_UINT64 ts ;
+  OFC_UINT64 offset ;
+  OFC_CCHAR *name ;
+  OFC_VOID *id ;
+  OFC_HANDLE handle ;
+  OFC_UINT32 len ;
+  OFC_UINT16 type ;
+} TRACE_RECORD ;
+
+/*
+ * The ring of one thread.  head counts every event recorded, so the
+ * valid events are the last OFC_MIN(head, TRACE_RING_EVENTS).  Only the
+ * owning thread writes a ring.
+ *
+ * When its thread exits, a ring is marked free but kept, events and
+ * all, so that a dump still shows what the thread did until another
+ * thread takes the ring over.  New threads take over free rings before
+ * any ring is allocated, so short lived workers cost no more rings
+ * than run at once.
+ */
+typedef struct _TRACE_RING
+{
+  struct _TRACE_RING *next ;
+  OFC_INT tid ;
+  OFC_BOOL free ;
+  volatile OFC_UINT64 head ;
+  TRACE_RECORD events[TRACE_RING_EVENTS] ;
+} TRACE_RING ;
+
+#define TRACE_WRITE_SIZE (64 * 1024)
+#define TRACE_LINE_SIZE 512
+#define TRACE_NAME_SIZE 64
+
+typedef struct
+{
+  OFC_HANDLE hFile ;
+  OFC_BOOL status ;
+  OFC_SIZET len ;
+  OFC_CHAR data[TRACE_WRITE_SIZE] ;
+} TRACE_WRITER ;
+
+volatile OFC_BOOL trace_enabled = OFC_FALSE ;
+
+static OFC_LOCK trace_lock = OFC_NULL ;
+static OFC_INT trace_key = -1 ;
+static TRACE_RING *trace_rings = OFC_NULL ;
+static OFC_INT trace_tids = 0 ;
+static OFC_UINT64 trace_epoch = 0 ;
+
+static OFC_UINT64 trace_now (OFC_VOID)
+{
+#if defined(_WIN32)
+  return ((OFC_UINT64) ofc_time_get_now () * 1000000) ;
+#else
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return ((OFC_UINT64) ts.tv_sec * 1000000000 + ts.tv_nsec) ;
+#endif
+}
+
+/*
+ * Called as a thread that traced exits
+ */
+static OFC_VOID trace_ring_release (OFC_VOID *value)
+{
+  TRACE_RING *ring ;
+
+  ring = (TRACE_RING *) value ;
+  ofc_lock (trace_lock) ;
+  ring->free = OFC_TRUE ;
+  ofc_unlock (trace_lock) ;
+}
+
+OFC_VOID trace_init (OFC_VOID)
+{
+  if (trace_lock == OFC_NULL)
+    {
+      trace_lock = ofc_lock_init () ;
+      trace_key = jni_thread_key (trace_ring_release) ;
+    }
+}
+
+OFC_VOID trace_enable (OFC_BOOL enable)
+{
+  if (enable && trace_epoch == 0)
+    trace_epoch = trace_now () ;
+  trace_enabled = enable ;
+}
+
+static TRACE_RING *trace_ring (OFC_VOID)
+{
+  TRACE_RING *ring ;
+
+  if (trace_key < 0)
+    return (OFC_NULL) ;
+
+  ring = (TRACE_RING *) jni_thread_get (trace_key) ;
+  if (ring == OFC_NULL)
+    {
+      ofc_lock (trace_lock) ;
+      for (ring = trace_rings ; ring != OFC_NULL && !ring->free ;
+	   ring = ring->next) ;
+      if (ring == OFC_NULL)
+	{
+	  ring = ofc_malloc (sizeof (TRACE_RING)) ;
+	  if (ring != OFC_NULL)
+	    {
+	      ring->next = trace_rings ;
+	      trace_rings = ring ;
+	    }
+	}
+      if (ring != OFC_NULL)
+	{
+	  ring->free = OFC_FALSE ;
+	  ring->head = 0 ;
+	  ring->tid = ++trace_tids ;
+	}
+      ofc_unlock (trace_lock) ;
+
+      if (ring != OFC_NULL && !jni_thread_set (trace_key, ring))
+	{
+	  trace_ring_release (ring) ;
+	  ring = OFC_NULL ;
+	}
+    }
+  return (ring) ;
+}
+
+OFC_VOID trace_record (TRACE_TYPE type, OFC_CCHAR *name, OFC_HANDLE handle,
+		       OFC_VOID *id, OFC_UINT64 offset, OFC_UINT32 len)
+{
+  TRACE_RING *ring ;
+  TRACE_RECORD *record ;
+
+  ring = trace_ring () ;
+  if (ring != OFC_NULL)
+    {
+      record = &ring->events[ring->head % TRACE_RING_EVENTS] ;
+      record->ts = trace_now () ;
+      record->offset = offset ;
+      record->name = name ;
+      record->id = id ;
+      record->handle = handle ;
+      record->len = len ;
+      record->type = (OFC_UINT16) type ;
+      ring->head++ ;
+    }
+}
+
+static OFC_VOID trace_flush (TRACE_WRITER *writer)
+{
+  OFC_DWORD dwWritten ;
+
+  if (writer->status == OFC_TRUE && writer->len > 0)
+    {
+      writer->status = OfcWriteFile (writer->hFile, writer->data,
+				     (OFC_DWORD) writer->len, &dwWritten,
+				     OFC_HANDLE_NULL) ;
+    }
+  writer->len = 0 ;
+}
+
+static OFC_VOID trace_write (TRACE_WRITER *writer, OFC_CCHAR *str)
+{
+  OFC_SIZET len ;
+
+  len = ofc_strlen (str) ;
+  if (writer->len + len > TRACE_WRITE_SIZE)
+    trace_flush (writer) ;
+  ofc_memcpy (writer->data + writer->len, str, len) ;
+  writer->len += len ;
+}
+
+/*
+ * Shorten a JNI entry point name, so that
+ * "Java_com_connectedway_io_FileSystem_read__Lcom_..." reads as
+ * "FileSystem_read"
+ */
+static OFC_VOID trace_name (OFC_CCHAR *name, OFC_CHAR *out)
+{
+  static OFC_CCHAR prefix[] = "Java_com_connectedway_io_" ;
+  OFC_SIZET len ;
+  OFC_INT i ;
+
+  len = ofc_strlen (prefix) ;
+  if (ofc_strncmp (name, prefix, len) == 0)
+    name += len ;
+
+  for (i = 0 ; name[i] != '\0' && i < TRACE_NAME_SIZE - 1 &&
+	 !(name[i] == '_' && name[i+1] == '_') ; i++)
+    out[i] = name[i] ;
+  out[i] = '\0' ;
+}
+
+/*
+ * Render one event as a Chrome trace event.  JNI calls become duration
+ * events on their thread, each I/O becomes an async event spanning
+ * submit to completion, and waitset wake-ups become instant events.
+ */
+static OFC_VOID trace_event (TRACE_WRITER *writer, OFC_INT tid,
+			     TRACE_RECORD *record)
+{
+  OFC_CHAR line[TRACE_LINE_SIZE] ;
+  OFC_CHAR name[TRACE_NAME_SIZE] ;
+  OFC_UINT64 ts ;
+
+  ts = record->ts > trace_epoch ? record->ts - trace_epoch : 0 ;
+
+  switch (record->type)
+    {
+    case TRACE_JNI_ENTER:
+    case TRACE_JNI_EXIT:
+      trace_name (record->name, name) ;
+      ofc_snprintf (line, TRACE_LINE_SIZE,
+		    ",\n{\"name\":\"%s\",\"cat\":\"jni\",\"ph\":\"%s\","
+		    "\"pid\":1,\"tid\":%d,\"ts\":%llu.%03u}",
+		    name,
+		    record->type == TRACE_JNI_ENTER ? "B" : "E",
+		    tid, (unsigned long long) (ts / 1000),
+		    (OFC_UINT) (ts % 1000)) ;
+      break ;
+
+    case TRACE_IO_SUBMIT:
+    case TRACE_IO_COMPLETE:
+      ofc_snprintf (line, TRACE_LINE_SIZE,
+		    ",\n{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"%s\","
+		    "\"id\":\"0x%llx\",\"pid\":1,\"tid\":%d,"
+		    "\"ts\":%llu.%03u,\"args\":{\"handle\":\"0x%llx\","
+		    "\"offset\":%llu,\"length\":%u}}",
+		    record->name,
+		    record->type == TRACE_IO_SUBMIT ? "b" : "e",
+		    (unsigned long long) (OFC_DWORD_PTR) record->id, tid,
+		    (unsigned long long) (ts / 1000), (OFC_UINT) (ts % 1000),
+		    (unsigned long long) (OFC_DWORD_PTR) record->handle,
+		    (unsigned long long) record->offset, record->len) ;
+      break ;
+
+    default:
+      ofc_snprintf (line, TRACE_LINE_SIZE,
+		    ",\n{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"i\","
+		    "\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%llu.%03u,"
+		    "\"args\":{\"handle\":\"0x%llx\"}}",
+		    record->name, tid,
+		    (unsigned long long) (ts / 1000), (OFC_UINT) (ts % 1000),
+		    (unsigned long long) (OFC_DWORD_PTR) record->handle) ;
+      break ;
+    }
+  trace_write (writer, line) ;
+}
+
+/*
+ * Write every ring out as a Chrome trace event file, loadable in
+ * chrome://tracing or Perfetto.  Threads keep recording while we dump,
+ * so the newest events of a busy thread may be torn.
+ */
+OFC_BOOL trace_dump (OFC_LPCTSTR path)
+{
+  TRACE_WRITER *writer ;
+  TRACE_RING *ring ;
+  OFC_UINT64 head ;
+  OFC_UINT64 i ;
+  OFC_BOOL ret ;
+  OFC_CHAR line[TRACE_LINE_SIZE] ;
+
+  writer = ofc_malloc (sizeof (TRACE_WRITER)) ;
+  if (writer == OFC_NULL)
+    return (OFC_FALSE) ;
+
+  writer->len = 0 ;
+  writer->status = OFC_TRUE ;
+  writer->hFile = OfcCreateFileW (path, OFC_GENERIC_WRITE,
+				  OFC_FILE_SHARE_READ, OFC_NULL,
+				  OFC_CREATE_ALWAYS,
+				  OFC_FILE_ATTRIBUTE_NORMAL,
+				  OFC_HANDLE_NULL) ;
+  if (writer->hFile == OFC_INVALID_HANDLE_VALUE)
+    {
+      ofc_free (writer) ;
+      return (OFC_FALSE) ;
+    }
+
+  trace_write (writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+	       "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+	       "\"args\":{\"name\":\"of_core_jni\"}}") ;
+
+  ofc_lock (trace_lock) ;
+  for (ring = trace_rings ; ring != OFC_NULL ; ring = ring->next)
+    {
+      ofc_snprintf (line, TRACE_LINE_SIZE,
+		    ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		    "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+		    ring->tid, ring->tid) ;
+      trace_write (writer, line) ;
+
+      head = ring->head ;
+      i = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0 ;
+      for ( ; i < head ; i++)
+	trace_event (writer, ring->tid,
+		     &ring->events[i % TRACE_RING_EVENTS]) ;
+    }
+  ofc_unlock (trace_lock) ;
+
+  trace_write (writer, "\n]}\n") ;
+  trace_flush (writer) ;
+
+  ret = writer->status ;
+  if (OfcCloseHandle (writer->hFile) != OFC_TRUE)
+    ret = OFC_FALSE ;
+  ofc_free (writer) ;
+
+  return (ret) ;
+}
@@ -5,6 +5,11 @@
  */
 #define __OFC_CORE_DLL__
 #include <jni.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 #include "ofc/config.h"
 #include "ofc/types.h"
@@ -15,6 +20,7 @@
 #include "ofc/process.h"
 
 #include "ofc_jni/com_connectedway_io_Utils.h"
+#include "ofc_jni/com_connectedway_io_Heap.h"
 
 OFC_SIZET 
 jstrlen (const jchar *jstr)
@@ -295,12 +301,149 @@ OFC_HANDLE file_descriptor_get_handle (JNIEnv *env, jobject objFd)
   return (hFile) ;
 }
 
-#if defined(__ANDROID__)
+/*
+ * Thread local state freed when its thread exits
+ *
+ * ofc's thread variables have no destructor, so state that a module
+ * keeps per thread would outlive every short lived thread.  Such state
+ * is kept in one of these slots instead, and the slot's destructor is
+ * called with the thread's value when the thread exits.  The slots are
+ * pthread keys, or fiber local slots on Windows, and are only created
+ * from the init calls.
+ */
+#define JNI_THREAD_KEYS 8
+
+#if defined(_WIN32)
+typedef struct
+{
+  OFC_VOID (*destroy) (OFC_VOID *value) ;
+  OFC_VOID *value ;
+} JNI_THREAD_VALUE ;
+
+static DWORD g_thread_keys[JNI_THREAD_KEYS] ;
+
+static VOID WINAPI jni_thread_destroy (PVOID value)
+{
+  JNI_THREAD_VALUE *tvalue ;
+
+  tvalue = (JNI_THREAD_VALUE *) value ;
+  if (tvalue != OFC_NULL)
+    {
+      if (tvalue->value != OFC_NULL)
+	(*tvalue->destroy) (tvalue->value) ;
+      ofc_free (tvalue) ;
+    }
+}
+#else
+static pthread_key_t g_thread_keys[JNI_THREAD_KEYS] ;
+#endif
+static OFC_VOID (*g_thread_destroy[JNI_THREAD_KEYS]) (OFC_VOID *value) ;
+static OFC_INT g_thread_key_count = 0 ;
+
+/*
+ * Returns the slot, or -1 if there are none left.  A caller without a
+ * slot keeps its state for good, as before.
+ */
+OFC_INT jni_thread_key (OFC_VOID (*destroy) (OFC_VOID *value))
+{
+  OFC_INT key ;
+
+  key = -1 ;
+  if (g_thread_key_count < JNI_THREAD_KEYS)
+    {
+#if defined(_WIN32)
+      g_thread_keys[g_thread_key_count] = FlsAlloc (jni_thread_destroy) ;
+      if (g_thread_keys[g_thread_key_count] != FLS_OUT_OF_INDEXES)
+	key = g_thread_key_count ;
+#else
+      if (pthread_key_create (&g_thread_keys[g_thread_key_count],
+			      destroy) == 0)
+	key = g_thread_key_count ;
+#endif
+      if (key >= 0)
+	{
+	  g_thread_destroy[key] = destroy ;
+	  g_thread_key_count++ ;
+	}
+    }
+  return (key) ;
+}
+
+OFC_VOID *jni_thread_get (OFC_INT key)
+{
+#if defined(_WIN32)
+  JNI_THREAD_VALUE *tvalue ;
+
+  tvalue = (JNI_THREAD_VALUE *) FlsGetValue (g_thread_keys[key]) ;
+  return (tvalue == OFC_NULL ? OFC_NULL : tvalue->value) ;
+#else
+  return (pthread_getspecific (g_thread_keys[key])) ;
+#endif
+}
+
+/*
+ * Returns false if the value could not be kept, in which case the
+ * caller still owns it
+ */
+OFC_BOOL jni_thread_set (OFC_INT key, OFC_VOID *value)
+{
+#if defined(_WIN32)
+  JNI_THREAD_VALUE *tvalue ;
+
+  tvalue = (JNI_THREAD_VALUE *) FlsGetValue (g_thread_keys[key]) ;
+  if (tvalue == OFC_NULL)
+    {
+      tvalue = ofc_malloc (sizeof (JNI_THREAD_VALUE)) ;
+      if (tvalue == OFC_NULL)
+	return (OFC_FALSE) ;
+      tvalue->destroy = g_thread_destroy[key] ;
+      if (!FlsSetValue (g_thread_keys[key], tvalue))
+	{
+	  ofc_free (tvalue) ;
+	  return (OFC_FALSE) ;
+	}
+    }
+  tvalue->value = value ;
+  return (OFC_TRUE) ;
+#else
+  return (pthread_setspecific (g_thread_keys[key], value) == 0 ?
+	  OFC_TRUE : OFC_FALSE) ;
+#endif
+}
+
+/*
+ * Attaching native threads to the VM
+ *
+ * Upcalls from threads that ofc or a server pool created need a JNIEnv.
+ * jni_get_env attaches such a thread the first time it asks, as a
+ * daemon so that it never holds up VM shutdown, and caches the JNIEnv
+ * in thread local storage.  A thread we attached is detached by the
+ * key destructor when it exits.  Threads that were already attached,
+ * Java threads among them, are left as they are.
+ */
 static JavaVM *g_jvm = OFC_NULL ;
+#if !defined(_WIN32)
+static pthread_key_t g_env_key ;
+static pthread_once_t g_env_once = PTHREAD_ONCE_INIT ;
+
+static OFC_VOID jni_env_destroy (OFC_VOID *value)
+{
+  if (g_jvm != OFC_NULL)
+    (*g_jvm)->DetachCurrentThread (g_jvm) ;
+}
+
+static OFC_VOID jni_env_key_init (OFC_VOID)
+{
+  pthread_key_create (&g_env_key, jni_env_destroy) ;
+}
+#endif
 
 jint JNI_OnLoad(JavaVM *jvm, void *reerved)
 {
   g_jvm = jvm;
+#if !defined(_WIN32)
+  pthread_once (&g_env_once, jni_env_key_init) ;
+#endif
   return (JNI_VERSION_1_6);
 }
 
@@ -308,6 +451,119 @@ void JNI_OnUnload(JavaVM *vm, void *reserved)
 {
 }
 
+JNIEnv *jni_get_env (OFC_VOID)
+{
+  JNIEnv *env ;
+  jint status ;
+  /* The Darwin and Linux VMs declare the env argument as void ** */
+#if defined(__ANDROID__) || defined(ANDROID)
+  JNIEnv *envx;
+#elif defined(__APPLE__) || defined(__linux__)
+  void *envx ;
+#else
+  JNIEnv *envx;
+#endif
+
+  if (g_jvm == OFC_NULL)
+    return (OFC_NULL) ;
+
+#if !defined(_WIN32)
+  env = (JNIEnv *) pthread_getspecific (g_env_key) ;
+  if (env != OFC_NULL)
+    return (env) ;
+#endif
+
+  status = (*g_jvm)->GetEnv (g_jvm, (void **) &env, JNI_VERSION_1_6) ;
+  if (status == JNI_EDETACHED)
+    {
+      status = (*g_jvm)->AttachCurrentThreadAsDaemon (g_jvm, &envx, NULL) ;
+      if (status == JNI_OK)
+	{
+	  env = (JNIEnv *) envx ;
+#if !defined(_WIN32)
+	  pthread_setspecific (g_env_key, env) ;
+#endif
+	}
+    }
+  if (status != JNI_OK)
+    env = OFC_NULL ;
+  return (env) ;
+}
+
+/*
+ * A JNIEnv for a jni_thread_key destructor that has global references
+ * to release.  By the time the destructor runs, the thread may already
+ * have been detached, by the VM or by jni_env_destroy.  Such a thread
+ * is attached again, as a daemon, for as long as the destructor needs
+ * it, and jni_exit_done detaches it.  Returns null if the VM cannot
+ * take the thread, in which case the references stay behind.
+ */
+JNIEnv *jni_exit_env (OFC_BOOL *attached)
+{
+  JNIEnv *env ;
+  jint status ;
+#if defined(__ANDROID__) || defined(ANDROID)
+  JNIEnv *envx;
+#elif defined(__APPLE__) || defined(__linux__)
+  void *envx ;
+#else
+  JNIEnv *envx;
+#endif
+
+  *attached = OFC_FALSE ;
+  if (g_jvm == OFC_NULL)
+    return (OFC_NULL) ;
+
+  status = (*g_jvm)->GetEnv (g_jvm, (void **) &env, JNI_VERSION_1_6) ;
+  if (status == JNI_EDETACHED)
+    {
+      status = (*g_jvm)->AttachCurrentThreadAsDaemon (g_jvm, &envx, NULL) ;
+      if (status == JNI_OK)
+	{
+	  env = (JNIEnv *) envx ;
+	  *attached = OFC_TRUE ;
+	}
+    }
+  if (status != JNI_OK)
+    env = OFC_NULL ;
+  return (env) ;
+}
+
+OFC_VOID jni_exit_done (OFC_BOOL attached)
+{
+  if (attached)
+    (*g_jvm)->DetachCurrentThread (g_jvm) ;
+}
+
+/*
+ * Bracket an upcall.  The frame releases every local reference the
+ * upcall made, which would otherwise pile up on a native thread that
+ * never returns to Java.
+ */
+JNIEnv *jni_upcall_enter (jint capacity)
+{
+  JNIEnv *env ;
+
+  env = jni_get_env () ;
+  if (env != OFC_NULL && (*env)->PushLocalFrame (env, capacity) != JNI_OK)
+    {
+      (*env)->ExceptionClear (env) ;
+      env = OFC_NULL ;
+    }
+  return (env) ;
+}
+
+OFC_VOID jni_upcall_exit (JNIEnv *env)
+{
+  if ((*env)->ExceptionCheck (env))
+    {
+      (*env)->ExceptionDescribe (env) ;
+      (*env)->ExceptionClear (env) ;
+    }
+  (*env)->PopLocalFrame (env, NULL) ;
+}
+
+#if defined(__ANDROID__)
 OFC_VOID ofc_attach_java_thread(OFC_VOID)
 {
   int status;
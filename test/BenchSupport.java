@@ -0,0 +1,133 @@
+import java.io.IOException;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.Random;
+
+import com.connectedway.io.*;
+
+/**
+ * Shared setup for the benchmarks.
+ *
+ * The benchmarks run against the local file system backend so that
+ * they need neither a server nor a configuration.  Their files are kept
+ * under the directory named by the bench.dir system property, by
+ * default of_core_jni_bench in java.io.tmpdir, and are only generated
+ * when missing so that repeated runs do not pay for it.
+ */
+final class BenchSupport
+{
+    static final int CHUNK = 1024 * 1024 ;
+
+    private static boolean started = false ;
+    private static final Map<Long, byte[]> chunks =
+	new HashMap<Long, byte[]>() ;
+
+    private BenchSupport() {
+    }
+
+    static synchronized void startup() {
+	if (!started) {
+	    Framework.getFramework().startup() ;
+	    started = true ;
+	}
+    }
+
+    static File dir (String name) throws IOException {
+	String base = System.getProperty ("bench.dir",
+					  System.getProperty ("java.io.tmpdir") +
+					  "/of_core_jni_bench") ;
+	File dir = new File (base, name) ;
+	if (!dir.isDirectory() && !dir.mkdirs())
+	    throw new IOException ("Cannot create " + dir.getPath()) ;
+	return dir ;
+    }
+
+    /**
+     * The pseudo random bytes that a data file of the given size
+     * repeats every CHUNK bytes
+     */
+    static synchronized byte[] chunk (long size) {
+	byte[] chunk = chunks.get (size) ;
+	if (chunk == null) {
+	    chunk = new byte[CHUNK] ;
+	    new Random (size).nextBytes (chunk) ;
+	    chunks.put (size, chunk) ;
+	}
+	return chunk ;
+    }
+
+    /**
+     * Return a file of the given size filled with pseudo random bytes,
+     * creating it if needed
+     */
+    static File dataFile (String name, long size) throws IOException {
+	File file = new File (dir ("data"), name) ;
+
+	if (!file.exists() || file.length() != size) {
+	    byte[] chunk = chunk (size) ;
+
+	    FileOutputStream out = new FileOutputStream (file) ;
+	    try {
+		for (long written = 0 ; written < size ; ) {
+		    int len = (int) Math.min (chunk.length, size - written) ;
+		    out.write (chunk, 0, len) ;
+		    written += len ;
+		}
+	    } finally {
+		out.close() ;
+	    }
+	    if (file.length() != size)
+		throw new IOException ("Wrote " + file.length() + " bytes of " +
+				       file.getPath() + ", expected " + size) ;
+	}
+	return file ;
+    }
+
+    /**
+     * Check a sample of the bytes read into buf from offset of a data
+     * file of the given size.  A benchmark checks what it moved at the
+     * end of every iteration, so that a broken I/O path fails rather
+     * than producing numbers.
+     */
+    static void checkData (String what, byte[] buf, int off, int len,
+			   long size, long offset) throws IOException {
+	byte[] chunk = chunk (size) ;
+	int step = Math.max (1, len / 16) ;
+
+	for (int i = 0 ; i < len ; i += step)
+	    checkByte (what, buf[off + i], chunk, offset + i) ;
+	if (len > 0)
+	    checkByte (what, buf[off + len - 1], chunk, offset + len - 1) ;
+    }
+
+    private static void checkByte (String what, byte b, byte[] chunk,
+				   long offset) throws IOException {
+	if (b != chunk[(int) (offset % CHUNK)])
+	    throw new IOException (what + ": wrong data at offset " + offset) ;
+    }
+
+    /**
+     * Check that a file pointer is where the transfers should have left
+     * it
+     */
+    static void checkPosition (String what, long expected, long actual)
+	throws IOException {
+	if (expected != actual)
+	    throw new IOException (what + ": file pointer at " + actual +
+				   ", expected " + expected) ;
+    }
+
+    /**
+     * Random block aligned offsets at which a buffer of len bytes fits
+     * in a file of the given size
+     */
+    static long[] offsets (long size, int len, int count) {
+	long[] offsets = new long[count] ;
+	long blocks = Math.max (1, size / len) ;
+	Random random = new Random (42) ;
+
+	for (int i = 0 ; i < count ; i++)
+	    offsets[i] = (long) (random.nextDouble() * blocks) * len ;
+	return offsets ;
+    }
+}
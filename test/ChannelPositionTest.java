@@ -0,0 +1,177 @@
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+
+import com.connectedway.io.*;
+
+/**
+ * Positional channel I/O must not move the channel position, and
+ * stream I/O must move it by what was transferred.
+ *
+ * Reads and writes at an explicit position, transfers between two
+ * channels, and stream reads and writes into the middle of an array,
+ * are checked for the bytes they move and for the position of the
+ * file afterwards.  Run against both engines, by building with and
+ * without OF_CORE_JNI_SYNC_IO.
+ *
+ * usage: ChannelPositionTest
+ *
+ * Exits non zero on the first failure.
+ */
+public class ChannelPositionTest
+{
+    static final int SIZE = 256 * 1024 ;
+    static final long START = 1234 ;
+
+    static void check (boolean ok, String what) {
+	if (!ok) {
+	    System.err.println ("FAIL: " + what) ;
+	    System.exit (1) ;
+	}
+    }
+
+    static byte expected (long offset) {
+	return (byte) (offset * 31 + 7) ;
+    }
+
+    static void checkData (ByteBuffer buf, int len, long offset,
+			   String what) {
+	for (int i = 0 ; i < len ; i++)
+	    check (buf.get (i) == expected (offset + i), what) ;
+    }
+
+    static File create (String name) throws IOException {
+	File file = new File (BenchSupport.dir ("test"), name) ;
+	byte[] data = new byte[SIZE] ;
+	for (int i = 0 ; i < SIZE ; i++)
+	    data[i] = expected (i) ;
+
+	RandomAccessFile raf = new RandomAccessFile (file, "rw") ;
+	try {
+	    raf.setLength (0) ;
+	    FileChannel ch = raf.getChannel() ;
+	    ByteBuffer buf = ByteBuffer.wrap (data) ;
+	    while (buf.hasRemaining())
+		ch.write (buf) ;
+	} finally {
+	    raf.close() ;
+	}
+	check (file.length() == SIZE, "length of " + name) ;
+	return file ;
+    }
+
+    static void positional (FileChannel ch) throws IOException {
+	ch.position (START) ;
+
+	ByteBuffer direct = ByteBuffer.allocateDirect (4096) ;
+	int n = ch.read (direct, 100000) ;
+	check (n == 4096, "positional read count") ;
+	check (ch.position() == START, "position after positional read") ;
+	checkData (direct, n, 100000, "positional read data") ;
+
+	ByteBuffer heap = ByteBuffer.allocate (4096) ;
+	n = ch.read (heap, 200000) ;
+	check (n == 4096, "positional heap read count") ;
+	check (ch.position() == START,
+	       "position after positional heap read") ;
+	checkData (heap, n, 200000, "positional heap read data") ;
+
+	direct.clear() ;
+	n = ch.write (direct, 100000) ;
+	check (n == 4096, "positional write count") ;
+	check (ch.position() == START, "position after positional write") ;
+
+	/*
+	 * The relative read picks up where the position says
+	 */
+	direct.clear() ;
+	n = ch.read (direct) ;
+	check (n == 4096, "relative read count") ;
+	check (ch.position() == START + n, "position after relative read") ;
+	checkData (direct, n, START, "relative read data") ;
+    }
+
+    static void transfers (FileChannel src, FileChannel dst)
+	throws IOException {
+	src.position (START) ;
+	dst.position (0) ;
+
+	long n = src.transferTo (8192, 65536, dst) ;
+	check (n == 65536, "transferTo count") ;
+	check (src.position() == START, "source position after transferTo") ;
+	check (dst.position() == n, "target position after transferTo") ;
+
+	ByteBuffer buf = ByteBuffer.allocate ((int) n) ;
+	dst.read (buf, 0) ;
+	checkData (buf, (int) n, 8192, "transferTo data") ;
+
+	src.position (0) ;
+	dst.position (START) ;
+	n = dst.transferFrom (src, 131072, 4096) ;
+	check (n == 4096, "transferFrom count") ;
+	check (dst.position() == START, "target position after transferFrom") ;
+	check (src.position() == n, "source position after transferFrom") ;
+
+	buf = ByteBuffer.allocate ((int) n) ;
+	dst.read (buf, 131072) ;
+	checkData (buf, (int) n, 0, "transferFrom data") ;
+    }
+
+    static void streams() throws IOException {
+	File file = new File (BenchSupport.dir ("test"), "position-s.dat") ;
+	byte[] data = new byte[SIZE + 100] ;
+	for (int i = 0 ; i < SIZE ; i++)
+	    data[i + 100] = expected (i) ;
+
+	FileOutputStream out = new FileOutputStream (file) ;
+	try {
+	    out.write (data, 100, SIZE / 2) ;
+	    check (out.getChannel().position() == SIZE / 2,
+		   "position after stream write") ;
+	    out.write (data, 100 + SIZE / 2, SIZE / 2) ;
+	} finally {
+	    out.close() ;
+	}
+	check (file.length() == SIZE, "length after stream writes") ;
+
+	byte[] b = new byte[4096 + 10] ;
+	FileInputStream in = new FileInputStream (file) ;
+	try {
+	    for (long offset = 0 ; offset < SIZE ; ) {
+		int n = in.read (b, 10, 4096) ;
+		check (n > 0, "stream read count") ;
+		for (int i = 0 ; i < 10 ; i++)
+		    check (b[i] == 0, "stream read before offset") ;
+		for (int i = 0 ; i < n ; i++)
+		    check (b[10 + i] == expected (offset + i),
+			   "stream read data") ;
+		offset += n ;
+		check (in.getChannel().position() == offset,
+		       "position after stream read") ;
+	    }
+	    check (in.read (b, 10, 4096) == -1, "stream read at end") ;
+	} finally {
+	    in.close() ;
+	}
+    }
+
+    public static void main (String[] args) throws IOException {
+	BenchSupport.startup() ;
+
+	RandomAccessFile a = new RandomAccessFile (create ("position-a.dat"),
+						   "rw") ;
+	RandomAccessFile b = new RandomAccessFile (create ("position-b.dat"),
+						   "rw") ;
+	try {
+	    streams() ;
+	    positional (a.getChannel()) ;
+	    transfers (a.getChannel(), b.getChannel()) ;
+	} finally {
+	    a.close() ;
+	    b.close() ;
+	}
+
+	System.out.println ("ChannelPositionTest passed") ;
+	System.exit (0) ;
+    }
+}
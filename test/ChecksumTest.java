@@ -0,0 +1,121 @@
+import java.io.IOException;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+
+import com.connectedway.io.*;
+
+/**
+ * Known answers for FileSystem.checksum.
+ *
+ * CRC32C, XXH64 and SHA-256 are checked against their published test
+ * vectors.  A file of a few chunks is then hashed in several parts, to
+ * check that the combined CRC32C is the CRC32C of the whole range, and
+ * that XXH64 and SHA-256 do not depend on the number of parts asked
+ * for.
+ *
+ * usage: ChecksumTest
+ *
+ * Exits non zero on the first failure.
+ */
+public class ChecksumTest
+{
+    static final int SIZE = 5 * BenchSupport.CHUNK + 123 ;
+    static final long START = 4097 ;
+
+    static void check (boolean ok, String what) {
+	if (!ok) {
+	    System.err.println ("FAIL: " + what) ;
+	    System.exit (1) ;
+	}
+    }
+
+    static String hex (byte[] digest) {
+	StringBuilder sb = new StringBuilder() ;
+	for (byte b : digest)
+	    sb.append (String.format ("%02x", b & 0xff)) ;
+	return sb.toString() ;
+    }
+
+    static File create (String name, byte[] data) throws IOException {
+	File file = new File (BenchSupport.dir ("test"), name) ;
+	FileOutputStream out = new FileOutputStream (file) ;
+	try {
+	    out.write (data, 0, data.length) ;
+	} finally {
+	    out.close() ;
+	}
+	check (file.length() == data.length, "length of " + name) ;
+	return file ;
+    }
+
+    static void known (FileSystem fs, String text, FileSystem.Algorithm alg,
+		       String expected) throws IOException {
+	File file = create ("checksum-known.dat", text.getBytes ("US-ASCII")) ;
+	String got = hex (fs.checksum (file, alg, 0, -1)) ;
+	check (got.equals (expected),
+	       alg + " of \"" + text + "\": " + got) ;
+    }
+
+    /**
+     * Bitwise CRC32C, the reference for the combined parts
+     */
+    static int crc32c (byte[] data, int off, int len) {
+	int crc = 0xffffffff ;
+	for (int i = off ; i < off + len ; i++) {
+	    crc ^= data[i] & 0xff ;
+	    for (int j = 0 ; j < 8 ; j++)
+		crc = (crc >>> 1) ^ ((crc & 1) != 0 ? 0x82f63b78 : 0) ;
+	}
+	return ~crc ;
+    }
+
+    static void parts (FileSystem fs) throws IOException,
+					     NoSuchAlgorithmException {
+	byte[] data = new byte[SIZE] ;
+	byte[] chunk = BenchSupport.chunk (SIZE) ;
+	for (int i = 0 ; i < SIZE ; i++)
+	    data[i] = chunk[i % chunk.length] ;
+	File file = create ("checksum-parts.dat", data) ;
+	int len = SIZE - (int) START ;
+
+	String crc = String.format ("%08x", crc32c (data, (int) START, len)) ;
+	for (int parts = 1 ; parts <= 4 ; parts++)
+	    check (hex (fs.checksum (file, FileSystem.Algorithm.CRC32C,
+				     START, len, parts)).equals (crc),
+		   "CRC32C in " + parts + " parts") ;
+
+	String xxh = hex (fs.checksum (file, FileSystem.Algorithm.XXH64,
+				       START, len, 1)) ;
+	check (hex (fs.checksum (file, FileSystem.Algorithm.XXH64,
+				 START, len, 4)).equals (xxh),
+	       "XXH64 in 4 parts") ;
+
+	MessageDigest md = MessageDigest.getInstance ("SHA-256") ;
+	md.update (data, (int) START, len) ;
+	String sha = hex (md.digest()) ;
+	for (int parts = 1 ; parts <= 4 ; parts += 3)
+	    check (hex (fs.checksum (file, FileSystem.Algorithm.SHA256,
+				     START, len, parts)).equals (sha),
+		   "SHA-256 in " + parts + " parts") ;
+    }
+
+    public static void main (String[] args) throws Exception {
+	BenchSupport.startup() ;
+	FileSystem fs = FileSystem.getFileSystem() ;
+
+	known (fs, "123456789", FileSystem.Algorithm.CRC32C, "e3069283") ;
+	known (fs, "abc", FileSystem.Algorithm.XXH64, "44bc2cf5ad770999") ;
+	known (fs, "abc", FileSystem.Algorithm.SHA256,
+	       "ba7816bf8f01cfea414140de5dae2223" +
+	       "b00361a396177a9cb410ff61f20015ad") ;
+	known (fs, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+	       FileSystem.Algorithm.SHA256,
+	       "248d6a61d20638b8e5c026930c3e6039" +
+	       "a33ce45964ff2167f6ecedd419db06c1") ;
+
+	parts (fs) ;
+
+	System.out.println ("ChecksumTest passed") ;
+	System.exit (0) ;
+    }
+}
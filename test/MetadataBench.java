@@ -0,0 +1,258 @@
+import java.io.IOException;
+import java.io.PrintStream;
+import java.lang.management.ManagementFactory;
+import java.lang.management.MemoryPoolMXBean;
+import java.lang.management.MemoryType;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.ArrayList;
+import java.util.List;
+
+import com.connectedway.io.*;
+import com.connectedway.nio.directory.Directory;
+import com.connectedway.nio.directory.FileDirectoryStream;
+
+/**
+ * Metadata at scale.
+ *
+ * Generates local trees of 10k, 100k and 1M entries, spread over
+ * directories of ENTRIES_PER_DIR files, and times listing and per file
+ * metadata over each of them.  Every measurement reports entries per
+ * second, the peak Java heap seen while it ran, and the peak native
+ * heap and allocation count of the JNI layer from getHeapStats.
+ *
+ * usage: MetadataBench [results.json [entries ...]]
+ *
+ * The trees are generated under bench.dir with java.nio, so they do not
+ * skew the numbers, and are reused by later runs.
+ */
+public class MetadataBench
+{
+    static final int ENTRIES_PER_DIR = 1000 ;
+    static final int PASSES = 3 ;
+
+    interface Measurement {
+	long run (File[] dirs) throws IOException ;
+    }
+
+    private final Framework framework ;
+    private final List<String> results = new ArrayList<String>() ;
+
+    MetadataBench() {
+	BenchSupport.startup() ;
+	framework = Framework.getFramework() ;
+    }
+
+    static File tree (int entries) throws IOException {
+	File root = BenchSupport.dir ("tree-" + entries) ;
+	Path base = Paths.get (root.getPath()) ;
+	Path done = base.resolve (".complete") ;
+
+	if (!Files.exists (done)) {
+	    for (int i = 0 ; i < entries ; i++) {
+		Path dir = base.resolve ("d" + (i / ENTRIES_PER_DIR)) ;
+		if (i % ENTRIES_PER_DIR == 0)
+		    Files.createDirectories (dir) ;
+		Path file = dir.resolve ("f" + i) ;
+		if (!Files.exists (file))
+		    Files.write (file, new byte[i % 64]) ;
+	    }
+	    Files.createFile (done) ;
+	}
+	return root ;
+    }
+
+    static File[] dirs (File root, int entries) {
+	int count = (entries + ENTRIES_PER_DIR - 1) / ENTRIES_PER_DIR ;
+	File[] dirs = new File[count] ;
+	for (int i = 0 ; i < count ; i++)
+	    dirs[i] = new File (root, "d" + i) ;
+	return dirs ;
+    }
+
+    static long peakHeap() {
+	long peak = 0 ;
+	for (MemoryPoolMXBean pool : ManagementFactory.getMemoryPoolMXBeans())
+	    if (pool.getType() == MemoryType.HEAP)
+		peak += pool.getPeakUsage().getUsed() ;
+	return peak ;
+    }
+
+    static void resetPeakHeap() {
+	System.gc() ;
+	for (MemoryPoolMXBean pool : ManagementFactory.getMemoryPoolMXBeans())
+	    if (pool.getType() == MemoryType.HEAP)
+		pool.resetPeakUsage() ;
+    }
+
+    void measure (String name, int entries, File[] dirs, Measurement m)
+	throws IOException {
+	/*
+	 * One untimed pass to warm the JIT and the caches
+	 */
+	m.run (dirs) ;
+
+	resetPeakHeap() ;
+	framework.resetHeapStats() ;
+	long ops = 0 ;
+	long start = System.nanoTime() ;
+	for (int pass = 0 ; pass < PASSES ; pass++)
+	    ops += m.run (dirs) ;
+	long nanos = System.nanoTime() - start ;
+	long peak = peakHeap() ;
+	HeapStats heap = framework.getHeapStats() ;
+	long nativePeak = heap == null ? 0 : heap.getPeakBytes() ;
+	long nativeAllocs = heap == null ? 0 : heap.getAllocCount() ;
+
+	double opsPerSecond = ops * 1e9 / nanos ;
+	System.out.printf ("%-20s %8d entries %14.0f ops/s %8d KB peak heap " +
+			   "%8d KB peak native %6.1f allocs/op%n",
+			   name, entries, opsPerSecond, peak / 1024,
+			   nativePeak / 1024, (double) nativeAllocs / ops) ;
+
+	results.add (String.format
+		     ("{\"benchmark\":\"%s\",\"entries\":%d,\"ops\":%d," +
+		      "\"nanos\":%d,\"opsPerSecond\":%.1f," +
+		      "\"peakJavaHeap\":%d,\"peakNativeHeap\":%d," +
+		      "\"nativeAllocs\":%d}",
+		      name, entries, ops, nanos, opsPerSecond, peak,
+		      nativePeak, nativeAllocs)) ;
+    }
+
+    void run (int entries) throws IOException {
+	final File[] dirs = dirs (tree (entries), entries) ;
+
+	/*
+	 * Names of every entry, for the construction and stat passes
+	 */
+	final String[][] names = new String[dirs.length][] ;
+	for (int i = 0 ; i < dirs.length ; i++)
+	    names[i] = dirs[i].list() ;
+
+	measure ("listFiles", entries, dirs, new Measurement() {
+		public long run (File[] dirs) {
+		    long ops = 0 ;
+		    for (File dir : dirs)
+			ops += dir.listFiles().length ;
+		    return ops ;
+		}
+	    }) ;
+
+	measure ("list", entries, dirs, new Measurement() {
+		public long run (File[] dirs) {
+		    long ops = 0 ;
+		    for (File dir : dirs)
+			ops += dir.list().length ;
+		    return ops ;
+		}
+	    }) ;
+
+	measure ("findFile", entries, dirs, new Measurement() {
+		public long run (File[] dirs) throws IOException {
+		    long ops = 0 ;
+		    for (File dir : dirs) {
+			Directory d = new Directory (dir) ;
+			try {
+			    while (d.find() != null)
+				ops++ ;
+			} finally {
+			    d.close() ;
+			}
+		    }
+		    return ops ;
+		}
+	    }) ;
+
+	measure ("FileDirectoryStream", entries, dirs, new Measurement() {
+		public long run (File[] dirs) throws IOException {
+		    long ops = 0 ;
+		    for (File dir : dirs)
+			ops += stream (dir) ;
+		    return ops ;
+		}
+	    }) ;
+
+	measure ("File", entries, dirs, new Measurement() {
+		public long run (File[] dirs) {
+		    long ops = 0 ;
+		    for (int i = 0 ; i < dirs.length ; i++)
+			for (String name : names[i]) {
+			    if (new File (dirs[i], name).getPath().length() > 0)
+				ops++ ;
+			}
+		    return ops ;
+		}
+	    }) ;
+
+	measure ("exists+length+lastModified", entries, dirs,
+		 new Measurement() {
+		     public long run (File[] dirs) {
+			 long ops = 0 ;
+			 for (int i = 0 ; i < dirs.length ; i++)
+			     for (String name : names[i]) {
+				 File file = new File (dirs[i], name) ;
+				 if (file.exists() && file.length() >= 0 &&
+				     file.lastModified() > 0)
+				     ops++ ;
+			     }
+			 return ops ;
+		     }
+		 }) ;
+    }
+
+    /**
+     * Drain a FileDirectoryStream over a directory, returning the number
+     * of entries it produced
+     */
+    static long stream (File dir) throws IOException {
+	final Object done = new Object() ;
+	final FileDirectoryStream[] holder = new FileDirectoryStream[1] ;
+
+	synchronized (done) {
+	    holder[0] = new FileDirectoryStream
+		(dir, new FileDirectoryStream.DirectoryListener() {
+			public void onNotifyEvent() {
+			    synchronized (done) {
+				done.notifyAll() ;
+			    }
+			}
+		    }) ;
+	    try {
+		while (holder[0].getState() != FileDirectoryStream.State.FRESH)
+		    done.wait (100) ;
+	    } catch (InterruptedException e) {
+		throw new IOException (e) ;
+	    }
+	}
+
+	long count = holder[0].getListing().length ;
+	holder[0].close() ;
+	return count ;
+    }
+
+    public static void main (String[] args) throws IOException {
+	String output = args.length > 0 ? args[0] : "metadata_bench.json" ;
+	int[] sizes = { 10000, 100000, 1000000 } ;
+
+	if (args.length > 1) {
+	    sizes = new int[args.length - 1] ;
+	    for (int i = 1 ; i < args.length ; i++)
+		sizes[i-1] = Integer.parseInt (args[i]) ;
+	}
+
+	MetadataBench bench = new MetadataBench() ;
+	for (int entries : sizes)
+	    bench.run (entries) ;
+
+	PrintStream out = new PrintStream (output) ;
+	out.println ("[") ;
+	for (int i = 0 ; i < bench.results.size() ; i++)
+	    out.println ("  " + bench.results.get (i) +
+			 (i + 1 < bench.results.size() ? "," : "")) ;
+	out.println ("]") ;
+	out.close() ;
+
+	System.exit (0) ;
+    }
+}
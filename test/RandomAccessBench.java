@@ -0,0 +1,121 @@
+import java.io.IOException;
+import java.util.concurrent.TimeUnit;
+
+import org.openjdk.jmh.annotations.*;
+
+import com.connectedway.io.*;
+
+/**
+ * RandomAccessFile reads and writes, either walking the file in order
+ * or seeking to a block aligned random offset before each transfer.
+ *
+ * Writes go to a file of their own, so the file that is read keeps
+ * its contents.  After every iteration the file pointers, and a sample
+ * of the last buffer read, are checked.
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.SECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+public class RandomAccessBench
+{
+    static final long FILE_SIZE = 64L * 1024 * 1024 ;
+    static final int OFFSETS = 4096 ;
+
+    @Param({"1", "64", "4096", "65536", "1048576", "16777216"})
+    public int bufferSize ;
+
+    @Param({"sequential", "random"})
+    public String access ;
+
+    private RandomAccessFile file ;
+    private RandomAccessFile output ;
+    private byte[] buffer ;
+    private long[] offsets ;
+    private boolean random ;
+    private int next ;
+    private long position ;
+    private long lastOffset ;
+    private int lastLen ;
+    private long readPointer ;
+    private long writePointer ;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException {
+	BenchSupport.startup() ;
+	/*
+	 * Writes stay within the file, so its size never changes
+	 */
+	file = new RandomAccessFile
+	    (BenchSupport.dataFile ("random.dat", FILE_SIZE), "r") ;
+	output = new RandomAccessFile
+	    (BenchSupport.dataFile ("random-write.dat", FILE_SIZE), "rw") ;
+	buffer = new byte[bufferSize] ;
+	offsets = BenchSupport.offsets (FILE_SIZE, bufferSize, OFFSETS) ;
+	random = access.equals ("random") ;
+	next = 0 ;
+	position = 0 ;
+	lastLen = 0 ;
+	readPointer = 0 ;
+	writePointer = 0 ;
+    }
+
+    @TearDown(Level.Trial)
+    public void teardown() throws IOException {
+	file.close() ;
+	output.close() ;
+    }
+
+    @TearDown(Level.Iteration)
+    public void check() throws IOException {
+	if (lastLen > 0)
+	    BenchSupport.checkData ("read", buffer, 0, lastLen, FILE_SIZE,
+				    lastOffset) ;
+	BenchSupport.checkPosition ("read", readPointer,
+				    file.getFilePointer()) ;
+	BenchSupport.checkPosition ("write", writePointer,
+				    output.getFilePointer()) ;
+    }
+
+    /**
+     * Position f for the next transfer, returning the offset it starts
+     * at
+     */
+    private long position (RandomAccessFile f) throws IOException {
+	long offset ;
+
+	if (random) {
+	    offset = offsets[next] ;
+	    f.seek (offset) ;
+	    next = (next + 1) % OFFSETS ;
+	} else {
+	    if (position + bufferSize > FILE_SIZE) {
+		f.seek (0) ;
+		position = 0 ;
+	    }
+	    offset = position ;
+	    position += bufferSize ;
+	}
+	return offset ;
+    }
+
+    @Benchmark
+    public int read() throws IOException {
+	long start = position (file) ;
+	int len = file.read (buffer, 0, bufferSize) ;
+	if (len > 0) {
+	    lastOffset = start ;
+	    lastLen = len ;
+	    readPointer = start + len ;
+	}
+	return len ;
+    }
+
+    @Benchmark
+    public void write() throws IOException {
+	writePointer = position (output) + bufferSize ;
+	output.write (buffer, 0, bufferSize) ;
+    }
+}
@@ -0,0 +1,105 @@
+import java.io.IOException;
+
+import com.connectedway.io.*;
+
+/**
+ * Framework.reconfigure must only touch the maps that differ.
+ *
+ * Two maps onto local directories are configured, then configured
+ * again as they are, which must change nothing even if the stack
+ * reports their paths differently than they were given.  One is then
+ * changed, both are removed, and a set with two maps of the same name
+ * is refused without changing anything.
+ *
+ * usage: ReconfigureTest
+ *
+ * Exits non zero on the first failure.
+ */
+public class ReconfigureTest
+{
+    static void check (boolean ok, String what) {
+	if (!ok) {
+	    System.err.println ("FAIL: " + what) ;
+	    System.exit (1) ;
+	}
+    }
+
+    static Framework.mapType localType() {
+	String os = System.getProperty ("os.name").toLowerCase() ;
+	if (os.startsWith ("windows"))
+	    return Framework.mapType.WIN32 ;
+	if (os.startsWith ("mac"))
+	    return Framework.mapType.DARWIN ;
+	return Framework.mapType.LINUX ;
+    }
+
+    static Framework.Map map (String name, String dir, String desc)
+	throws IOException {
+	return new Framework.Map (name, desc,
+				  BenchSupport.dir ("reconfigure/" + dir),
+				  localType(), false) ;
+    }
+
+    static boolean configured (Framework framework, String name) {
+	Framework.Map[] maps = framework.getMaps() ;
+	if (maps != null)
+	    for (Framework.Map map : maps)
+		if (name.equalsIgnoreCase (map.getName()))
+		    return true ;
+	return false ;
+    }
+
+    public static void main (String[] args) throws IOException {
+	BenchSupport.startup() ;
+	Framework framework = Framework.getFramework() ;
+
+	Framework.Map[] maps = new Framework.Map[] {
+	    map ("RECONFA", "a", "first"),
+	    map ("RECONFB", "b", "second")
+	} ;
+	check (framework.reconfigure (null, maps) == 2, "maps added") ;
+	check (configured (framework, "RECONFA") &&
+	       configured (framework, "RECONFB"), "maps configured") ;
+
+	check (framework.reconfigure (null, maps) == 0, "same maps again") ;
+
+	maps[1] = map ("RECONFB", "c", "second") ;
+	check (framework.reconfigure (null, maps) == 1, "one map changed") ;
+	check (framework.reconfigure (null, maps) == 0,
+	       "changed map again") ;
+
+	Framework.Map[] duplicates = new Framework.Map[] {
+	    map ("RECONFC", "a", "first"),
+	    map ("reconfc", "b", "second")
+	} ;
+	boolean refused = false ;
+	try {
+	    framework.reconfigure (null, duplicates) ;
+	} catch (IllegalArgumentException e) {
+	    refused = true ;
+	}
+	check (refused, "duplicate names refused") ;
+	check (!configured (framework, "RECONFC") &&
+	       configured (framework, "RECONFA"),
+	       "nothing changed by duplicate names") ;
+
+	Framework.Map[] others = framework.getMaps() ;
+	int remaining = 0 ;
+	if (others != null)
+	    for (Framework.Map map : others)
+		if (!map.getName().toUpperCase().startsWith ("RECONF"))
+		    remaining++ ;
+	Framework.Map[] keep = new Framework.Map[remaining] ;
+	remaining = 0 ;
+	if (others != null)
+	    for (Framework.Map map : others)
+		if (!map.getName().toUpperCase().startsWith ("RECONF"))
+		    keep[remaining++] = map ;
+	check (framework.reconfigure (null, keep) == 2, "maps removed") ;
+	check (!configured (framework, "RECONFA") &&
+	       !configured (framework, "RECONFB"), "maps gone") ;
+
+	System.out.println ("ReconfigureTest passed") ;
+	System.exit (0) ;
+    }
+}
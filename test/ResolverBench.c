@@ -0,0 +1,212 @@
+/* Copyright (c) 2021 Connected Way, LLC. All rights reserved.
+ * Use of this source code is governed by a Creative Commons
+ * Attribution-NoDerivatives 4.0 International license that can be
+ * found in the LICENSE file.
+ */
+#include <jni.h>
+#include <time.h>
+
+#include "ofc/config.h"
+#include "ofc/types.h"
+#include "ofc/handle.h"
+#include "ofc/libc.h"
+#include "ofc/heap.h"
+#include "ofc/lock.h"
+#include "ofc/thread.h"
+
+#include "of_resolver_fs/resolver_api.h"
+
+#include "ofc_jni/com_connectedway_io_Utils.h"
+
+/*
+ * Native side of ResolverBench.  Drives the resolver entry points from
+ * ofc threads, as the server does, so every call is an upcall from a
+ * thread that the JVM did not start.
+ */
+#define BENCH_OP_OPEN 0
+#define BENCH_OP_PREAD 1
+#define BENCH_OP_PWRITE 2
+#define BENCH_OP_STAT 3
+#define BENCH_OP_READDIR 4
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_IO_SIZE 4096
+#define BENCH_STAT_NAMES 1024
+
+typedef struct
+{
+  OFC_INT op ;
+  OFC_INT iterations ;
+  OFC_TCHAR *file ;
+  OFC_TCHAR *dir ;
+  OFC_UINT64 file_size ;
+  OFC_TCHAR **names ;
+  OFC_INT num_names ;
+  OFC_LOCK lock ;
+  OFC_INT next ;
+  OFC_UINT64 elapsed ;
+} BENCH_CONTEXT ;
+
+static OFC_UINT64 bench_now (OFC_VOID)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return ((OFC_UINT64) ts.tv_sec * 1000000000 + ts.tv_nsec) ;
+}
+
+static OFC_VOID bench_loop (BENCH_CONTEXT *ctx, OFC_INT id)
+{
+  RESOLVER_FILE *rfile ;
+  RESOLVER_DIR *rdir ;
+  struct resolver_stat sb ;
+  OFC_CHAR buffer[BENCH_IO_SIZE] ;
+  OFC_UINT64 blocks ;
+  OFC_UINT64 offset ;
+  OFC_INT i ;
+
+  rfile = OFC_NULL ;
+  if (ctx->op == BENCH_OP_PREAD || ctx->op == BENCH_OP_PWRITE)
+    {
+      rfile = resolver_open (ctx->file, "r+") ;
+      if (rfile == OFC_NULL)
+	return ;
+    }
+
+  ofc_memset (buffer, id, BENCH_IO_SIZE) ;
+  blocks = ctx->file_size / BENCH_IO_SIZE ;
+  if (blocks == 0)
+    blocks = 1 ;
+  offset = id ;
+
+  for (i = 0 ; i < ctx->iterations ; i++)
+    {
+      /*
+       * A stride that walks every block of the file in turn
+       */
+      offset = (offset + 7919) % blocks ;
+      switch (ctx->op)
+	{
+	case BENCH_OP_OPEN:
+	  rfile = resolver_open (ctx->file, "r") ;
+	  if (rfile != OFC_NULL)
+	    resolver_close (rfile) ;
+	  rfile = OFC_NULL ;
+	  break ;
+	case BENCH_OP_PREAD:
+	  resolver_pread (rfile, buffer, BENCH_IO_SIZE,
+			  offset * BENCH_IO_SIZE) ;
+	  break ;
+	case BENCH_OP_PWRITE:
+	  resolver_pwrite (rfile, buffer, BENCH_IO_SIZE,
+			   offset * BENCH_IO_SIZE) ;
+	  break ;
+	case BENCH_OP_STAT:
+	  resolver_stat (ctx->names[(id + i) % ctx->num_names], &sb) ;
+	  break ;
+	case BENCH_OP_READDIR:
+	  rdir = resolver_opendir (ctx->dir) ;
+	  if (rdir != OFC_NULL)
+	    {
+	      while (resolver_readdir (rdir) != OFC_NULL) ;
+	      resolver_closedir (rdir) ;
+	    }
+	  break ;
+	}
+    }
+
+  if (rfile != OFC_NULL)
+    resolver_close (rfile) ;
+}
+
+static OFC_DWORD bench_worker (OFC_HANDLE hThread, OFC_VOID *context)
+{
+  BENCH_CONTEXT *ctx ;
+  OFC_UINT64 start ;
+  OFC_UINT64 elapsed ;
+  OFC_INT id ;
+
+  ctx = context ;
+  ofc_lock (ctx->lock) ;
+  id = ctx->next++ ;
+  ofc_unlock (ctx->lock) ;
+
+  start = bench_now () ;
+  bench_loop (ctx, id) ;
+  elapsed = bench_now () - start ;
+
+  ofc_lock (ctx->lock) ;
+  if (elapsed > ctx->elapsed)
+    ctx->elapsed = elapsed ;
+  ofc_unlock (ctx->lock) ;
+  return (0) ;
+}
+
+/*
+ * Class:     ResolverBench
+ * Method:    run
+ * Signature: (IIILjava/lang/String;JLjava/lang/String;[Ljava/lang/String;)J
+ *
+ * Returns the time taken by the slowest thread, in ns
+ */
+JNIEXPORT jlong JNICALL Java_ResolverBench_run
+  (JNIEnv *env, jclass cls, jint jiOp, jint jiThreads, jint jiIterations,
+   jstring jstrFile, jlong jlFileSize, jstring jstrDir,
+   jobjectArray arrayNames)
+{
+  BENCH_CONTEXT ctx ;
+  OFC_HANDLE threads[BENCH_MAX_THREADS] ;
+  OFC_INT num_threads ;
+  OFC_INT i ;
+  jstring jstrName ;
+
+  ctx.op = jiOp ;
+  ctx.iterations = jiIterations ;
+  ctx.file = jstr2tchar (env, jstrFile) ;
+  ctx.file_size = jlFileSize ;
+  ctx.dir = jstr2tchar (env, jstrDir) ;
+  ctx.num_names = (*env)->GetArrayLength (env, arrayNames) ;
+  if (ctx.num_names > BENCH_STAT_NAMES)
+    ctx.num_names = BENCH_STAT_NAMES ;
+  ctx.names = ofc_malloc (sizeof (OFC_TCHAR *) *
+			  (ctx.num_names > 0 ? ctx.num_names : 1)) ;
+  for (i = 0 ; i < ctx.num_names ; i++)
+    {
+      jstrName = (*env)->GetObjectArrayElement (env, arrayNames, i) ;
+      ctx.names[i] = jstr2tchar (env, jstrName) ;
+      (*env)->DeleteLocalRef (env, jstrName) ;
+    }
+  if (ctx.num_names == 0)
+    {
+      ctx.names[0] = ctx.file ;
+      ctx.num_names = 1 ;
+    }
+  ctx.lock = ofc_lock_init () ;
+  ctx.next = 0 ;
+  ctx.elapsed = 0 ;
+
+  num_threads = OFC_MIN (jiThreads, BENCH_MAX_THREADS) ;
+  if (num_threads < 1)
+    num_threads = 1 ;
+
+  for (i = 0 ; i < num_threads ; i++)
+    threads[i] = ofc_thread_create (&bench_worker, "ResolverBench", i,
+				    &ctx, OFC_THREAD_JOIN, OFC_HANDLE_NULL) ;
+  for (i = 0 ; i < num_threads ; i++)
+    {
+      if (threads[i] != OFC_HANDLE_NULL)
+	ofc_thread_wait (threads[i]) ;
+    }
+
+  ofc_lock_destroy (ctx.lock) ;
+  for (i = 0 ; i < ctx.num_names ; i++)
+    {
+      if (ctx.names[i] != ctx.file)
+	ofc_free (ctx.names[i]) ;
+    }
+  ofc_free (ctx.names) ;
+  ofc_free (ctx.dir) ;
+  ofc_free (ctx.file) ;
+
+  return ((jlong) ctx.elapsed) ;
+}
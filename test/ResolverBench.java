@@ -0,0 +1,107 @@
+import java.io.IOException;
+import java.io.PrintStream;
+import java.util.ArrayList;
+import java.util.List;
+
+import com.connectedway.io.*;
+
+/**
+ * Cost of a Resolver upcall.
+ *
+ * Installs a LocalResolver over a generated directory, then drives
+ * resolver_open, pread, pwrite, stat and readdir from 1 to 64 native
+ * threads through the of_core_jni_resolver_bench library.  Each
+ * measurement reports operations per second and the wall time of one
+ * operation as seen by a thread, and, for stat, how many were answered
+ * by the native stat cache.
+ *
+ * usage: ResolverBench [results.json [threads ...]]
+ */
+public class ResolverBench
+{
+    static final String[] OPS = { "open", "pread", "pwrite", "stat", "readdir" } ;
+    static final int OPS_PER_THREAD = 20000 ;
+    static final int READDIR_PER_THREAD = 200 ;
+    static final int ENTRIES = 1000 ;
+    static final long FILE_SIZE = 16L * 1024 * 1024 ;
+
+    private static native long run (int op, int threads, int iterations,
+				    String file, long fileSize, String dir,
+				    String[] names) ;
+
+    public static void main (String[] args) throws IOException {
+	String output = args.length > 0 ? args[0] : "resolver_bench.json" ;
+	int[] threads = { 1, 2, 4, 8, 16, 32, 64 } ;
+
+	if (args.length > 1) {
+	    threads = new int[args.length - 1] ;
+	    for (int i = 1 ; i < args.length ; i++)
+		threads[i-1] = Integer.parseInt (args[i]) ;
+	}
+
+	BenchSupport.startup() ;
+	System.loadLibrary ("of_core_jni_resolver_bench") ;
+
+	/*
+	 * The data file and listing live in the resolver's root
+	 */
+	File data = BenchSupport.dataFile ("resolver.dat", FILE_SIZE) ;
+	File root = data.getParentFile() ;
+	File dir = BenchSupport.dir ("data/resolver-dir") ;
+	String[] names = new String[ENTRIES] ;
+	for (int i = 0 ; i < ENTRIES ; i++) {
+	    File entry = new File (dir, "f" + i) ;
+	    if (!entry.exists())
+		entry.createNewFile() ;
+	    names[i] = "resolver-dir/f" + i ;
+	}
+
+	Resolver.setResolverListener (new LocalResolver (root)) ;
+
+	List<String> results = new ArrayList<String>() ;
+	for (int op = 0 ; op < OPS.length ; op++) {
+	    int iterations = OPS[op].equals ("readdir") ?
+		READDIR_PER_THREAD : OPS_PER_THREAD ;
+
+	    /*
+	     * One untimed pass to warm the JIT
+	     */
+	    run (op, 1, iterations, "resolver.dat", FILE_SIZE,
+		 "resolver-dir", names) ;
+
+	    for (int count : threads) {
+		long hits = Resolver.getStatCacheHits() ;
+		long misses = Resolver.getStatCacheMisses() ;
+		long nanos = run (op, count, iterations, "resolver.dat",
+				  FILE_SIZE, "resolver-dir", names) ;
+		hits = Resolver.getStatCacheHits() - hits ;
+		misses = Resolver.getStatCacheMisses() - misses ;
+
+		long ops = (long) count * iterations ;
+		double opsPerSecond = ops * 1e9 / nanos ;
+		double nanosPerOp = (double) nanos / iterations ;
+		System.out.printf ("%-8s %3d threads %12.0f ops/s %10.0f ns/op " +
+				   "%8d cache hits %8d misses%n",
+				   OPS[op], count, opsPerSecond, nanosPerOp,
+				   hits, misses) ;
+		results.add (String.format
+			     ("{\"op\":\"%s\",\"threads\":%d,\"ops\":%d," +
+			      "\"nanos\":%d,\"opsPerSecond\":%.1f," +
+			      "\"nanosPerOp\":%.1f,\"statCacheHits\":%d," +
+			      "\"statCacheMisses\":%d}",
+			      OPS[op], count, ops, nanos, opsPerSecond,
+			      nanosPerOp, hits, misses)) ;
+	    }
+	}
+
+	PrintStream out = new PrintStream (output) ;
+	out.println ("[") ;
+	for (int i = 0 ; i < results.size() ; i++)
+	    out.println ("  " + results.get (i) +
+			 (i + 1 < results.size() ? "," : "")) ;
+	out.println ("]") ;
+	out.close() ;
+
+	System.exit (0) ;
+    }
+}
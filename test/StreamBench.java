@@ -0,0 +1,96 @@
+import java.io.IOException;
+import java.util.concurrent.TimeUnit;
+
+import org.openjdk.jmh.annotations.*;
+
+import com.connectedway.io.*;
+
+/**
+ * Sequential throughput of FileInputStream and FileOutputStream.
+ *
+ * Each operation moves one buffer, so bytes per second is the score
+ * times bufferSize.  A stream that reaches the end of the file is
+ * reopened at its start.  After every iteration the stream positions,
+ * and a sample of the last buffer read, are checked.
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.Throughput)
+@OutputTimeUnit(TimeUnit.SECONDS)
+@Warmup(iterations = 3, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(1)
+public class StreamBench
+{
+    static final long FILE_SIZE = 64L * 1024 * 1024 ;
+
+    @Param({"1", "64", "4096", "65536", "1048576", "16777216"})
+    public int bufferSize ;
+
+    private File source ;
+    private File sink ;
+    private byte[] buffer ;
+    private FileInputStream in ;
+    private FileOutputStream out ;
+    private long written ;
+    private long readOffset ;
+    private long lastOffset ;
+    private int lastLen ;
+
+    @Setup(Level.Trial)
+    public void setup() throws IOException {
+	BenchSupport.startup() ;
+	source = BenchSupport.dataFile ("stream.dat", FILE_SIZE) ;
+	sink = new File (BenchSupport.dir ("out"), "stream.out") ;
+	buffer = new byte[bufferSize] ;
+	in = new FileInputStream (source) ;
+	out = new FileOutputStream (sink) ;
+	written = 0 ;
+	readOffset = 0 ;
+	lastLen = 0 ;
+    }
+
+    @TearDown(Level.Iteration)
+    public void check() throws IOException {
+	if (lastLen > 0)
+	    BenchSupport.checkData ("inputStreamRead", buffer, 0, lastLen,
+				    FILE_SIZE, lastOffset) ;
+	BenchSupport.checkPosition ("inputStreamRead", readOffset,
+				    in.getChannel().position()) ;
+	BenchSupport.checkPosition ("outputStreamWrite", written,
+				    out.getChannel().position()) ;
+    }
+
+    @TearDown(Level.Trial)
+    public void teardown() throws IOException {
+	in.close() ;
+	out.close() ;
+	sink.delete() ;
+    }
+
+    @Benchmark
+    public int inputStreamRead() throws IOException {
+	int len = in.read (buffer, 0, bufferSize) ;
+	if (len > 0) {
+	    lastOffset = readOffset ;
+	    lastLen = len ;
+	    readOffset += len ;
+	}
+	if (len < bufferSize) {
+	    in.close() ;
+	    in = new FileInputStream (source) ;
+	    readOffset = 0 ;
+	}
+	return len ;
+    }
+
+    @Benchmark
+    public void outputStreamWrite() throws IOException {
+	if (written >= FILE_SIZE) {
+	    out.close() ;
+	    out = new FileOutputStream (sink) ;
+	    written = 0 ;
+	}
+	out.write (buffer, 0, bufferSize) ;
+	written += bufferSize ;
+    }
+}